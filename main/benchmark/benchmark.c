@@ -0,0 +1,712 @@
+/*
+*   Mesh throughput benchmark
+*   Runs timed bulk transfers between two nodes over the raw mesh channel
+*   (MESH_PROTO_BIN through esp_mesh_send) or over the IP path (UDP/TCP through
+*   the mesh netifs and the root NAT) and publishes throughput, jitter and the
+*   CPU time spent per layer on /mesh/[mesh_id]/devices/[device_id]/benchmark
+*/
+#include "benchmark.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+#include "esp_timer.h"
+#include "esp_mac.h"
+#include "lwip/sockets.h"
+#include "mesh_netif.h"
+#include "mqtt/utils/mqtt_utils.h"
+#include "performance/performance.h"
+#include "rtos_alloc/rtos_alloc.h"
+
+#define BENCHMARK_TAG "benchmark"
+
+#ifndef CONFIG_MESH_BENCHMARK_ENABLE
+#define CONFIG_MESH_BENCHMARK_ENABLE 0
+#endif
+
+#define BENCHMARK_FRAME_DATA   0x01
+#define BENCHMARK_FRAME_END    0x02
+#define BENCHMARK_FRAME_REPORT 0x03
+
+#define BENCHMARK_MIN_PAYLOAD   (sizeof(benchmark_frame_t))
+#define BENCHMARK_MAX_PAYLOAD   (MESH_MPS - 16)
+#define BENCHMARK_END_RETRIES   3
+#define BENCHMARK_REPORT_WAIT_MS 500
+#define BENCHMARK_REPORT_BIT    BIT0
+#define BENCHMARK_MAX_DURATION_MS 120000
+// a TCP sender silent this long is gone (rebooted, left the mesh)
+#define BENCHMARK_SINK_IDLE_MS  2000
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef struct __attribute__((packed)) {
+    uint8_t cmd;          // CMD_BENCHMARK
+    uint8_t type;         // BENCHMARK_FRAME_*
+    uint16_t run_id;
+    uint32_t seq;
+    int64_t tx_time_us;   // sender esp_timer time, only differences are used
+} benchmark_frame_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t lost;
+    uint32_t jitter_us;
+    int64_t elapsed_us;
+} benchmark_rx_report_t;
+
+typedef struct __attribute__((packed)) {
+    benchmark_frame_t header;
+    benchmark_rx_report_t report;
+} benchmark_report_frame_t;
+
+typedef struct {
+    bool active;
+    uint16_t run_id;
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t lost;
+    uint32_t next_seq;
+    int64_t first_rx_us;
+    int64_t last_rx_us;
+    int64_t last_transit_us;
+    double jitter_us;
+} benchmark_rx_stats_t;
+
+typedef struct {
+    uint32_t tx_packets;
+    uint64_t tx_bytes;
+    uint32_t tx_errors;
+    int64_t elapsed_us;
+    bool has_report;
+    benchmark_rx_report_t report;
+} benchmark_result_t;
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#define BENCHMARK_CPU_STATS 1
+#else
+#define BENCHMARK_CPU_STATS 0
+#endif
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static bool s_running = false;
+// a TCP stream is served by the sink, a single one at a time
+static bool s_tcp_sink_busy = false;
+static uint16_t s_run_id = 0;
+static EventGroupHandle_t s_report_events = NULL;
+static benchmark_rx_report_t s_raw_report;
+static benchmark_rx_stats_t s_raw_rx = { 0 };
+
+/*******************************************************
+ *                Receiver statistics
+ *******************************************************/
+
+/*
+  * Function: rx_stats_update
+  * ----------------------------
+  *   Accounts a received data frame. Jitter is the RFC 3550 interarrival jitter,
+  *   so the clock offset between sender and receiver cancels out
+  *
+*/
+static void rx_stats_update(benchmark_rx_stats_t *stats, const benchmark_frame_t *frame, size_t len) {
+    int64_t now = esp_timer_get_time();
+    if (!stats->active || stats->run_id != frame->run_id) {
+        memset(stats, 0, sizeof(benchmark_rx_stats_t));
+        stats->active = true;
+        stats->run_id = frame->run_id;
+        stats->first_rx_us = now;
+        stats->last_transit_us = now - frame->tx_time_us;
+    }
+    if (frame->seq > stats->next_seq) {
+        stats->lost += frame->seq - stats->next_seq;
+    }
+    stats->next_seq = frame->seq + 1;
+    stats->packets++;
+    stats->bytes += len;
+    stats->last_rx_us = now;
+
+    int64_t transit = now - frame->tx_time_us;
+    int64_t d = transit - stats->last_transit_us;
+    if (d < 0) d = -d;
+    stats->last_transit_us = transit;
+    stats->jitter_us += ((double) d - stats->jitter_us) / 16.0;
+}
+
+static void rx_stats_to_report(const benchmark_rx_stats_t *stats, benchmark_rx_report_t *report) {
+    report->packets = stats->packets;
+    report->bytes = stats->bytes;
+    report->lost = stats->lost;
+    report->jitter_us = (uint32_t) stats->jitter_us;
+    report->elapsed_us = stats->last_rx_us - stats->first_rx_us;
+}
+
+/*******************************************************
+ *                Raw mesh path
+ *******************************************************/
+
+void benchmark_raw_recv(mesh_addr_t *from, mesh_data_t *data) {
+    if (data->size < sizeof(benchmark_frame_t)) {
+        ESP_LOGE(BENCHMARK_TAG, "Benchmark frame too short: %d", data->size);
+        return;
+    }
+    benchmark_frame_t frame;
+    memcpy(&frame, data->data, sizeof(benchmark_frame_t));
+
+    switch (frame.type) {
+    case BENCHMARK_FRAME_DATA:
+        rx_stats_update(&s_raw_rx, &frame, data->size);
+        break;
+    case BENCHMARK_FRAME_END:
+    {
+        // Answering the sender with what we have seen for this run (END is retried, answer every time)
+        benchmark_report_frame_t reply = { 0 };
+        reply.header.cmd = CMD_BENCHMARK;
+        reply.header.type = BENCHMARK_FRAME_REPORT;
+        reply.header.run_id = frame.run_id;
+        if (s_raw_rx.active && s_raw_rx.run_id == frame.run_id) {
+            rx_stats_to_report(&s_raw_rx, &reply.report);
+        }
+        mesh_data_t out = {
+            .data = (uint8_t *) &reply,
+            .size = sizeof(reply),
+            .proto = MESH_PROTO_BIN,
+            .tos = MESH_TOS_P2P
+        };
+        // non blocking: we are running inside the netif rx task
+        esp_err_t err = esp_mesh_send(from, &out, MESH_DATA_P2P | MESH_DATA_NONBLOCK, NULL, 0);
+        if (err != ESP_OK) {
+            ESP_LOGW(BENCHMARK_TAG, "Failed to send benchmark report to " MACSTR ": %s", MAC2STR(from->addr), esp_err_to_name(err));
+        }
+    }
+    break;
+    case BENCHMARK_FRAME_REPORT:
+        if (data->size >= sizeof(benchmark_report_frame_t) && __atomic_load_n(&s_running, __ATOMIC_ACQUIRE) && frame.run_id == s_run_id) {
+            memcpy(&s_raw_report, data->data + sizeof(benchmark_frame_t), sizeof(benchmark_rx_report_t));
+            xEventGroupSetBits(s_report_events, BENCHMARK_REPORT_BIT);
+        }
+        break;
+    default:
+        ESP_LOGE(BENCHMARK_TAG, "Unknown benchmark frame type: %d", frame.type);
+        break;
+    }
+}
+
+static void benchmark_run_raw(const benchmark_params_t *params, benchmark_result_t *result) {
+    uint8_t *buffer = calloc(1, params->payload_size);
+    if (buffer == NULL) {
+        ESP_LOGE(BENCHMARK_TAG, "No memory for the benchmark buffer");
+        return;
+    }
+    benchmark_frame_t *frame = (benchmark_frame_t *) buffer;
+    frame->cmd = CMD_BENCHMARK;
+    frame->run_id = s_run_id;
+
+    mesh_data_t data = {
+        .data = buffer,
+        .size = params->payload_size,
+        .proto = MESH_PROTO_BIN,
+        .tos = MESH_TOS_P2P
+    };
+    // NULL destination with no flag is the root
+    mesh_addr_t *to = params->target_is_root ? NULL : (mesh_addr_t *) &params->target;
+    int flag = params->target_is_root ? 0 : MESH_DATA_P2P;
+
+    int64_t start = esp_timer_get_time();
+    int64_t end = start + (int64_t) params->duration_ms * 1000;
+    frame->type = BENCHMARK_FRAME_DATA;
+    while (esp_timer_get_time() < end) {
+        frame->seq = result->tx_packets + result->tx_errors;
+        frame->tx_time_us = esp_timer_get_time();
+        if (esp_mesh_send(to, &data, flag, NULL, 0) == ESP_OK) {
+            result->tx_packets++;
+            result->tx_bytes += data.size;
+        } else {
+            result->tx_errors++;
+        }
+    }
+    result->elapsed_us = esp_timer_get_time() - start;
+
+    // Asking the target for its receiver side numbers
+    frame->type = BENCHMARK_FRAME_END;
+    data.size = sizeof(benchmark_frame_t);
+    xEventGroupClearBits(s_report_events, BENCHMARK_REPORT_BIT);
+    for (int i = 0; i < BENCHMARK_END_RETRIES && !result->has_report; i++) {
+        esp_mesh_send(to, &data, flag, NULL, 0);
+        EventBits_t bits = xEventGroupWaitBits(s_report_events, BENCHMARK_REPORT_BIT, pdTRUE, pdTRUE, pdMS_TO_TICKS(BENCHMARK_REPORT_WAIT_MS));
+        if (bits & BENCHMARK_REPORT_BIT) {
+            result->report = s_raw_report;
+            result->has_report = true;
+        }
+    }
+    free(buffer);
+}
+
+/*******************************************************
+ *                IP path (UDP / TCP)
+ *******************************************************/
+
+static void benchmark_target_addr(const benchmark_params_t *params, struct sockaddr_in *addr) {
+    memset(addr, 0, sizeof(struct sockaddr_in));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(CONFIG_MESH_BENCHMARK_PORT);
+    addr->sin_addr.s_addr = params->target_is_root ? g_mesh_netif_subnet_ip.ip.addr : params->target_ip.addr;
+}
+
+static void benchmark_run_udp(const benchmark_params_t *params, benchmark_result_t *result) {
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(BENCHMARK_TAG, "Unable to create UDP socket: errno %d", errno);
+        return;
+    }
+    uint8_t *buffer = calloc(1, params->payload_size);
+    if (buffer == NULL) {
+        ESP_LOGE(BENCHMARK_TAG, "No memory for the benchmark buffer");
+        close(sock);
+        return;
+    }
+    struct sockaddr_in dest;
+    benchmark_target_addr(params, &dest);
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = BENCHMARK_REPORT_WAIT_MS * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    benchmark_frame_t *frame = (benchmark_frame_t *) buffer;
+    frame->cmd = CMD_BENCHMARK;
+    frame->run_id = s_run_id;
+    frame->type = BENCHMARK_FRAME_DATA;
+
+    int64_t start = esp_timer_get_time();
+    int64_t end = start + (int64_t) params->duration_ms * 1000;
+    while (esp_timer_get_time() < end) {
+        frame->seq = result->tx_packets + result->tx_errors;
+        frame->tx_time_us = esp_timer_get_time();
+        int sent = sendto(sock, buffer, params->payload_size, 0, (struct sockaddr *) &dest, sizeof(dest));
+        if (sent == params->payload_size) {
+            result->tx_packets++;
+            result->tx_bytes += sent;
+        } else {
+            // ENOMEM means the lwip/mesh tx queue is full, give the stack a tick to drain
+            result->tx_errors++;
+            vTaskDelay(1);
+        }
+    }
+    result->elapsed_us = esp_timer_get_time() - start;
+
+    frame->type = BENCHMARK_FRAME_END;
+    benchmark_report_frame_t reply;
+    for (int i = 0; i < BENCHMARK_END_RETRIES && !result->has_report; i++) {
+        sendto(sock, buffer, sizeof(benchmark_frame_t), 0, (struct sockaddr *) &dest, sizeof(dest));
+        int len = recv(sock, &reply, sizeof(reply), 0);
+        if (len == sizeof(reply) && reply.header.type == BENCHMARK_FRAME_REPORT && reply.header.run_id == s_run_id) {
+            result->report = reply.report;
+            result->has_report = true;
+        }
+    }
+    free(buffer);
+    close(sock);
+}
+
+static void benchmark_run_tcp(const benchmark_params_t *params, benchmark_result_t *result) {
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(BENCHMARK_TAG, "Unable to create TCP socket: errno %d", errno);
+        return;
+    }
+    struct sockaddr_in dest;
+    benchmark_target_addr(params, &dest);
+    if (connect(sock, (struct sockaddr *) &dest, sizeof(dest)) != 0) {
+        ESP_LOGE(BENCHMARK_TAG, "Unable to connect to " IPSTR ": errno %d", IP2STR((esp_ip4_addr_t *) &dest.sin_addr.s_addr), errno);
+        result->tx_errors++;
+        close(sock);
+        return;
+    }
+    uint8_t *buffer = calloc(1, params->payload_size);
+    if (buffer == NULL) {
+        ESP_LOGE(BENCHMARK_TAG, "No memory for the benchmark buffer");
+        close(sock);
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+    int64_t end = start + (int64_t) params->duration_ms * 1000;
+    while (esp_timer_get_time() < end) {
+        int sent = send(sock, buffer, params->payload_size, 0);
+        if (sent < 0) {
+            result->tx_errors++;
+            break;
+        }
+        result->tx_packets++;
+        result->tx_bytes += sent;
+    }
+    result->elapsed_us = esp_timer_get_time() - start;
+
+    // Closing our side makes the sink answer with the bytes it received
+    shutdown(sock, SHUT_WR);
+    struct timeval timeout = { .tv_sec = 2, .tv_usec = 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    benchmark_rx_report_t report;
+    if (recv(sock, &report, sizeof(report), MSG_WAITALL) == sizeof(report)) {
+        result->report = report;
+        result->has_report = true;
+    }
+    free(buffer);
+    close(sock);
+}
+
+/*
+  * Function: task_benchmark_sink_tcp
+  * ----------------------------
+  *   Counts the bytes of a TCP stream until the sender closes it. Runs in
+  *   its own task so the sink keeps answering the UDP runs meanwhile; a
+  *   sender that disappears without closing the stream is dropped after
+  *   BENCHMARK_SINK_IDLE_MS of silence, and no stream lasts longer than the
+  *   longest benchmark.
+  *
+*/
+static void task_benchmark_sink_tcp(void *args) {
+    // shared by the streams, s_tcp_sink_busy serves one at a time
+    static uint8_t rx_buf[1460];
+    int client = (int) (intptr_t) args;
+    benchmark_rx_stats_t stats = { 0 };
+    stats.first_rx_us = esp_timer_get_time();
+    int64_t end = stats.first_rx_us + (int64_t) (BENCHMARK_MAX_DURATION_MS + BENCHMARK_SINK_IDLE_MS) * 1000;
+    struct timeval timeout = { .tv_sec = BENCHMARK_SINK_IDLE_MS / 1000, .tv_usec = (BENCHMARK_SINK_IDLE_MS % 1000) * 1000 };
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int len;
+    while ((len = recv(client, rx_buf, sizeof(rx_buf), 0)) > 0) {
+        stats.packets++;
+        stats.bytes += len;
+        stats.last_rx_us = esp_timer_get_time();
+        if (stats.last_rx_us > end) {
+            ESP_LOGW(BENCHMARK_TAG, "TCP sink stream longer than %d ms, closed", BENCHMARK_MAX_DURATION_MS);
+            break;
+        }
+    }
+    if (len < 0) {
+        ESP_LOGW(BENCHMARK_TAG, "TCP sink stream dropped: errno %d", errno);
+    }
+    benchmark_rx_report_t report = { 0 };
+    rx_stats_to_report(&stats, &report);
+    send(client, &report, sizeof(report), 0);
+    close(client);
+    ESP_LOGI(BENCHMARK_TAG, "TCP sink received %" PRIu32 " bytes", stats.bytes);
+    __atomic_store_n(&s_tcp_sink_busy, false, __ATOMIC_RELEASE);
+    vTaskDelete(NULL);
+}
+
+/*
+  * Function: task_benchmark_sink
+  * ----------------------------
+  *   Receives UDP datagrams and TCP streams of other nodes benchmarks
+  *
+*/
+static void task_benchmark_sink(void *args) {
+    static uint8_t rx_buf[BENCHMARK_MAX_PAYLOAD];
+    benchmark_rx_stats_t udp_rx = { 0 };
+    struct sockaddr_in bind_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_MESH_BENCHMARK_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+
+    int udp = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    int tcp = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (udp < 0 || tcp < 0 ||
+        bind(udp, (struct sockaddr *) &bind_addr, sizeof(bind_addr)) != 0 ||
+        bind(tcp, (struct sockaddr *) &bind_addr, sizeof(bind_addr)) != 0 ||
+        listen(tcp, 1) != 0) {
+        ESP_LOGE(BENCHMARK_TAG, "Unable to start the benchmark sink: errno %d", errno);
+        if (udp >= 0) close(udp);
+        if (tcp >= 0) close(tcp);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(BENCHMARK_TAG, "STARTED: benchmark sink on port %d", CONFIG_MESH_BENCHMARK_PORT);
+
+    while (1) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(udp, &fds);
+        FD_SET(tcp, &fds);
+        if (select((udp > tcp ? udp : tcp) + 1, &fds, NULL, NULL, NULL) <= 0) {
+            continue;
+        }
+        if (FD_ISSET(tcp, &fds)) {
+            int client = accept(tcp, NULL, NULL);
+            bool idle = false;
+            if (client >= 0 && !__atomic_compare_exchange_n(&s_tcp_sink_busy, &idle, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                // the sender gets no report, its run shows the stream was refused
+                ESP_LOGW(BENCHMARK_TAG, "TCP sink already serves a stream, refused");
+                close(client);
+            } else if (client >= 0 && rtos_alloc_transient_task(RTOS_TRANSIENT_BENCH_TCP_SINK, task_benchmark_sink_tcp, (void *) (intptr_t) client) != ESP_OK) {
+                ESP_LOGW(BENCHMARK_TAG, "No memory for the TCP sink task, stream refused");
+                close(client);
+                __atomic_store_n(&s_tcp_sink_busy, false, __ATOMIC_RELEASE);
+            }
+        }
+        if (FD_ISSET(udp, &fds)) {
+            struct sockaddr_in source;
+            socklen_t socklen = sizeof(source);
+            int len = recvfrom(udp, rx_buf, sizeof(rx_buf), 0, (struct sockaddr *) &source, &socklen);
+            if (len < (int) sizeof(benchmark_frame_t)) {
+                continue;
+            }
+            benchmark_frame_t frame;
+            memcpy(&frame, rx_buf, sizeof(frame));
+            if (frame.type == BENCHMARK_FRAME_DATA) {
+                rx_stats_update(&udp_rx, &frame, len);
+            } else if (frame.type == BENCHMARK_FRAME_END) {
+                benchmark_report_frame_t reply = { 0 };
+                reply.header.cmd = CMD_BENCHMARK;
+                reply.header.type = BENCHMARK_FRAME_REPORT;
+                reply.header.run_id = frame.run_id;
+                if (udp_rx.active && udp_rx.run_id == frame.run_id) {
+                    rx_stats_to_report(&udp_rx, &reply.report);
+                }
+                sendto(udp, &reply, sizeof(reply), 0, (struct sockaddr *) &source, socklen);
+            }
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+/*******************************************************
+ *                CPU usage per layer
+ *******************************************************/
+#if BENCHMARK_CPU_STATS
+static const char * cpu_layer_of_task(const char *name) {
+    if (strcmp(name, "netif rx task") == 0 || strncmp(name, "mesh", 4) == 0) return "mesh";
+    if (strcmp(name, "tiT") == 0) return "lwip";
+    if (strncmp(name, "wifi", 4) == 0) return "wifi";
+    if (strncmp(name, "bench", 5) == 0) return "app";
+    if (strncmp(name, "IDLE", 4) == 0) return "idle";
+    return "other";
+}
+
+static cJSON * cpu_usage_json(const performance_task_snapshot_t *before, const performance_task_snapshot_t *after) {
+    cJSON *cpu = cJSON_CreateObject();
+    for (UBaseType_t i = 0; i < after->count; i++) {
+        double percent = performance_task_cpu(before, after, i);
+        if (percent < 0) {
+            break;
+        }
+        const char *layer = cpu_layer_of_task(after->tasks[i].pcTaskName);
+        cJSON *item = cJSON_GetObjectItem(cpu, layer);
+        if (item == NULL) {
+            cJSON_AddNumberToObject(cpu, layer, percent);
+        } else {
+            cJSON_SetNumberValue(item, item->valuedouble + percent);
+        }
+    }
+    return cpu;
+}
+#endif
+
+/*******************************************************
+ *                Benchmark runner
+ *******************************************************/
+
+const char * benchmark_path_to_str(benchmark_path_t path) {
+    switch (path) {
+    case BENCHMARK_PATH_RAW: return "raw";
+    case BENCHMARK_PATH_UDP: return "udp";
+    case BENCHMARK_PATH_TCP: return "tcp";
+    }
+    return "unknown";
+}
+
+static double throughput_kbps(uint64_t bytes, int64_t elapsed_us) {
+    return elapsed_us > 0 ? (bytes * 8.0 * 1000.0) / elapsed_us : 0;
+}
+
+static char * benchmark_result_message(const benchmark_params_t *params, const benchmark_result_t *result, cJSON *cpu) {
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "path", benchmark_path_to_str(params->path));
+    if (params->target_is_root) {
+        cJSON_AddStringToObject(root, "target", "root");
+    } else {
+        char target[18];
+        if (params->path == BENCHMARK_PATH_RAW)
+            sprintf(target, MACSTR, MAC2STR(params->target.addr));
+        else
+            sprintf(target, IPSTR, IP2STR(&params->target_ip));
+        cJSON_AddStringToObject(root, "target", target);
+    }
+    cJSON_AddNumberToObject(root, "layer", esp_mesh_get_layer());
+    cJSON_AddNumberToObject(root, "duration_ms", params->duration_ms);
+    cJSON_AddNumberToObject(root, "payload_size", params->payload_size);
+
+    cJSON *tx = cJSON_CreateObject();
+    cJSON_AddNumberToObject(tx, "packets", result->tx_packets);
+    cJSON_AddNumberToObject(tx, "bytes", result->tx_bytes);
+    cJSON_AddNumberToObject(tx, "errors", result->tx_errors);
+    cJSON_AddNumberToObject(tx, "throughput_kbps", throughput_kbps(result->tx_bytes, result->elapsed_us));
+    cJSON_AddItemToObject(root, "tx", tx);
+
+    if (result->has_report) {
+        cJSON *rx = cJSON_CreateObject();
+        cJSON_AddNumberToObject(rx, "packets", result->report.packets);
+        cJSON_AddNumberToObject(rx, "bytes", result->report.bytes);
+        cJSON_AddNumberToObject(rx, "throughput_kbps", throughput_kbps(result->report.bytes, result->report.elapsed_us));
+        if (params->path != BENCHMARK_PATH_TCP) {
+            cJSON_AddNumberToObject(rx, "lost", result->report.lost);
+            cJSON_AddNumberToObject(rx, "jitter_us", result->report.jitter_us);
+        }
+        cJSON_AddItemToObject(root, "rx", rx);
+    } else {
+        cJSON_AddNullToObject(root, "rx");
+    }
+
+    if (cpu != NULL) {
+        cJSON_AddItemToObject(root, "cpu", cpu);
+    } else {
+        cJSON_AddNullToObject(root, "cpu");
+    }
+
+    char *message = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return message;
+}
+
+static void task_benchmark_run(void *args) {
+    benchmark_params_t *params = (benchmark_params_t *) args;
+    benchmark_result_t result = { 0 };
+    cJSON *cpu = NULL;
+
+    ESP_LOGI(BENCHMARK_TAG, "STARTED: %s benchmark, %" PRIu32 " ms, %d bytes per frame",
+             benchmark_path_to_str(params->path), params->duration_ms, params->payload_size);
+
+#if BENCHMARK_CPU_STATS
+    performance_task_snapshot_t before, after;
+    performance_task_snapshot(&before);
+#endif
+    switch (params->path) {
+    case BENCHMARK_PATH_RAW:
+        benchmark_run_raw(params, &result);
+        break;
+    case BENCHMARK_PATH_UDP:
+        benchmark_run_udp(params, &result);
+        break;
+    case BENCHMARK_PATH_TCP:
+        benchmark_run_tcp(params, &result);
+        break;
+    }
+#if BENCHMARK_CPU_STATS
+    performance_task_snapshot(&after);
+    cpu = cpu_usage_json(&before, &after);
+    performance_task_snapshot_free(&before);
+    performance_task_snapshot_free(&after);
+#endif
+
+    char *result_message = benchmark_result_message(params, &result, cpu);
+    char *message = create_mqtt_message(result_message);
+    if (message != NULL) {
+        ESP_LOGI(BENCHMARK_TAG, "Benchmark result: %s", message);
+        char *topic = create_topic("benchmark", "", true);
+        publish(topic, message);
+        free(topic);
+    }
+    free(message);
+    free(result_message);
+    free(params);
+    __atomic_store_n(&s_running, false, __ATOMIC_RELEASE);
+    vTaskDelete(NULL);
+}
+
+bool benchmark_parse_params(cJSON *payload, benchmark_params_t *params) {
+    if (payload == NULL) {
+        return false;
+    }
+    memset(params, 0, sizeof(benchmark_params_t));
+    cJSON *path = cJSON_GetObjectItem(payload, "path");
+    cJSON *target = cJSON_GetObjectItem(payload, "target");
+    cJSON *duration = cJSON_GetObjectItem(payload, "duration");
+    cJSON *size = cJSON_GetObjectItem(payload, "size");
+    if (!cJSON_IsString(path) || !cJSON_IsString(target)) {
+        return false;
+    }
+
+    if (!strcmp(path->valuestring, "raw")) {
+        params->path = BENCHMARK_PATH_RAW;
+    } else if (!strcmp(path->valuestring, "udp")) {
+        params->path = BENCHMARK_PATH_UDP;
+    } else if (!strcmp(path->valuestring, "tcp")) {
+        params->path = BENCHMARK_PATH_TCP;
+    } else {
+        return false;
+    }
+
+    if (!strcmp(target->valuestring, "root")) {
+        params->target_is_root = true;
+    } else if (params->path == BENCHMARK_PATH_RAW) {
+        unsigned int mac[6];
+        if (sscanf(target->valuestring, "%x:%x:%x:%x:%x:%x", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) != 6) {
+            return false;
+        }
+        for (int i = 0; i < 6; i++) {
+            params->target.addr[i] = (uint8_t) mac[i];
+        }
+    } else if (esp_netif_str_to_ip4(target->valuestring, &params->target_ip) != ESP_OK) {
+        return false;
+    }
+
+    int duration_ms = cJSON_IsNumber(duration) ? duration->valueint : 10000;
+    if (duration_ms <= 0) {
+        return false;
+    }
+    if (duration_ms > BENCHMARK_MAX_DURATION_MS) duration_ms = BENCHMARK_MAX_DURATION_MS;
+    params->duration_ms = duration_ms;
+    int payload_size = cJSON_IsNumber(size) ? size->valueint : 1000;
+    if (payload_size < (int) BENCHMARK_MIN_PAYLOAD) payload_size = BENCHMARK_MIN_PAYLOAD;
+    if (payload_size > (int) BENCHMARK_MAX_PAYLOAD) payload_size = BENCHMARK_MAX_PAYLOAD;
+    params->payload_size = payload_size;
+    return params->duration_ms > 0;
+}
+
+esp_err_t benchmark_start(const benchmark_params_t *params) {
+    if (!CONFIG_MESH_BENCHMARK_ENABLE) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (params->target_is_root && esp_mesh_is_root()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // benchmark_start is called from the config handlers of any task
+    bool idle = false;
+    if (!__atomic_compare_exchange_n(&s_running, &idle, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    benchmark_params_t *params_copy = malloc(sizeof(benchmark_params_t));
+    if (params_copy == NULL) {
+        __atomic_store_n(&s_running, false, __ATOMIC_RELEASE);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(params_copy, params, sizeof(benchmark_params_t));
+    s_run_id++;
+    if (rtos_alloc_transient_task(RTOS_TRANSIENT_BENCH_RUN, task_benchmark_run, (void *) params_copy) != ESP_OK) {
+        free(params_copy);
+        __atomic_store_n(&s_running, false, __ATOMIC_RELEASE);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t benchmark_init(void) {
+    static bool is_started = false;
+    if (!CONFIG_MESH_BENCHMARK_ENABLE || is_started) {
+        return ESP_OK;
+    }
+    s_report_events = xEventGroupCreate();
+    if (s_report_events == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (rtos_alloc_task(RTOS_TASK_BENCH_SINK, task_benchmark_sink, NULL, NULL) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+    is_started = true;
+    return ESP_OK;
+}
@@ -0,0 +1,69 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_mesh.h"
+#include "esp_netif.h"
+#include "cJSON.h"
+
+/* Raw mesh command used by the benchmark frames (see recv_cb in mesh_main.c) */
+#define CMD_BENCHMARK 0x57
+
+typedef enum {
+    BENCHMARK_PATH_RAW = 0, // esp_mesh_send with MESH_PROTO_BIN
+    BENCHMARK_PATH_UDP,     // UDP socket through the mesh netifs
+    BENCHMARK_PATH_TCP      // TCP socket through the mesh netifs
+} benchmark_path_t;
+
+typedef struct {
+    benchmark_path_t path;
+    bool target_is_root;     // send to the root instead of target/target_ip
+    mesh_addr_t target;      // raw path: STA MAC of the destination node
+    esp_ip4_addr_t target_ip; // ip path: mesh subnet IP of the destination node
+    uint32_t duration_ms;    // how long the bulk transfer runs
+    uint16_t payload_size;   // bytes per frame/datagram/write
+} benchmark_params_t;
+
+/*
+  * Function: benchmark_init
+  * ----------------------------
+  *   Starts the UDP/TCP sink task so this node can be a benchmark target
+  *
+*/
+esp_err_t benchmark_init(void);
+
+/*
+  * Function: benchmark_parse_params
+  * ----------------------------
+  *   Fills params from a config payload
+  *   {"path": "raw|udp|tcp", "target": "<mac>|<ip>|root", "duration": ms, "size": bytes}
+  *   The duration is capped at 120 s
+  *
+  *   returns: true if the payload is valid
+*/
+bool benchmark_parse_params(cJSON *payload, benchmark_params_t *params);
+
+/*
+  * Function: benchmark_start
+  * ----------------------------
+  *   Runs a timed bulk transfer in a background task and publishes the result
+  *   on /mesh/[mesh_id]/devices/[device_id]/benchmark
+  *
+  *   returns: ESP_ERR_INVALID_STATE if a benchmark is already running,
+  *            ESP_ERR_NOT_SUPPORTED if CONFIG_MESH_BENCHMARK_ENABLE is off
+*/
+esp_err_t benchmark_start(const benchmark_params_t *params);
+
+/*
+  * Function: benchmark_raw_recv
+  * ----------------------------
+  *   Handles CMD_BENCHMARK frames received on the raw mesh channel
+  *
+*/
+void benchmark_raw_recv(mesh_addr_t *from, mesh_data_t *data);
+
+const char * benchmark_path_to_str(benchmark_path_t path);
+
+#endif // BENCHMARK_H
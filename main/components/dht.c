@@ -45,6 +45,18 @@
 #include <esp_log.h>
 #include <ets_sys.h>
 #include <esp_idf_lib_helpers.h>
+#include "dht_decode.h"
+
+#ifndef CONFIG_DHT_USE_RMT
+#define CONFIG_DHT_USE_RMT 0
+#endif
+
+#if CONFIG_DHT_USE_RMT
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_attr.h>
+#include <driver/rmt_rx.h>
+#endif
 
 // DHT timer precision in microseconds
 #define DHT_TIMER_INTERVAL 2
@@ -103,6 +115,7 @@ static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
     } while (0)
 
 
+#if !CONFIG_DHT_USE_RMT
 /**
  * Wait specified time for pin to go to a specified state.
  * If timeout is reached and pin doesn't go to a requested state
@@ -176,6 +189,143 @@ static inline esp_err_t dht_fetch_data(dht_sensor_type_t sensor_type, gpio_num_t
 
     return ESP_OK;
 }
+#else
+/*
+ *  RMT reader: the start pulse is a task delay instead of a busy-wait and the
+ *  frame is captured by the RMT peripheral, then decoded by dht_decode_pulses.
+ *  No critical section, interrupts stay enabled during the whole read.
+ */
+
+// 1 tick = 1 us
+#define DHT_RMT_RESOLUTION_HZ 1000000
+// the frame is ~45 symbols, 64 is the smallest RMT memory block
+#define DHT_RMT_SYMBOLS 64
+// the line is idle high after the last bit
+#define DHT_RMT_IDLE_NS (200 * 1000)
+// shorter pulses are glitches
+#define DHT_RMT_GLITCH_NS 1000
+// the whole frame takes less than 5 ms
+#define DHT_RMT_TIMEOUT_MS 20
+
+typedef struct
+{
+    gpio_num_t pin;
+    rmt_channel_handle_t channel;
+    QueueHandle_t done_queue;
+    SemaphoreHandle_t lock;
+    StaticSemaphore_t lock_buffer;
+    rmt_symbol_word_t symbols[DHT_RMT_SYMBOLS];
+    dht_pulse_t pulses[DHT_RMT_SYMBOLS * 2];
+} dht_rmt_t;
+
+static dht_rmt_t rmt = { .pin = GPIO_NUM_NC };
+
+static bool IRAM_ATTR dht_rmt_rx_done(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t *edata, void *user_data)
+{
+    BaseType_t task_woken = pdFALSE;
+    xQueueSendFromISR((QueueHandle_t) user_data, edata, &task_woken);
+    return task_woken == pdTRUE;
+}
+
+/**
+ * Create the RX channel for the pin, the channel is kept between reads.
+ */
+static esp_err_t dht_rmt_setup(gpio_num_t pin)
+{
+    if (rmt.channel != NULL && rmt.pin == pin)
+        return ESP_OK;
+
+    if (rmt.channel != NULL)
+    {
+        rmt_disable(rmt.channel);
+        rmt_del_channel(rmt.channel);
+        rmt.channel = NULL;
+    }
+    if (rmt.done_queue == NULL)
+        rmt.done_queue = xQueueCreate(1, sizeof(rmt_rx_done_event_data_t));
+    if (rmt.done_queue == NULL)
+        return ESP_ERR_NO_MEM;
+
+    rmt_rx_channel_config_t config = {
+        .gpio_num = pin,
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = DHT_RMT_RESOLUTION_HZ,
+        .mem_block_symbols = DHT_RMT_SYMBOLS,
+    };
+    esp_err_t err = rmt_new_rx_channel(&config, &rmt.channel);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Unable to create the RMT channel: %s", esp_err_to_name(err));
+        return err;
+    }
+    rmt_rx_event_callbacks_t callbacks = {
+        .on_recv_done = dht_rmt_rx_done,
+    };
+    rmt_rx_register_event_callbacks(rmt.channel, &callbacks, rmt.done_queue);
+    rmt_enable(rmt.channel);
+    rmt.pin = pin;
+    return ESP_OK;
+}
+
+static esp_err_t dht_fetch_data(dht_sensor_type_t sensor_type, gpio_num_t pin, uint8_t data[DHT_DATA_BYTES])
+{
+    esp_err_t err = dht_rmt_setup(pin);
+    if (err != ESP_OK)
+        return err;
+
+    // the pin drives the start pulse and is captured by the RMT at the same time
+    gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT_OD);
+
+    // Phase 'A' pulling signal low to initiate read sequence
+    gpio_set_level(pin, 0);
+    if (sensor_type == DHT_TYPE_SI7021)
+        ets_delay_us(500);
+    else
+        vTaskDelay(pdMS_TO_TICKS(20) + 1); // at least 20 ms whatever the tick rate
+
+    rmt_receive_config_t receive_config = {
+        .signal_range_min_ns = DHT_RMT_GLITCH_NS,
+        .signal_range_max_ns = DHT_RMT_IDLE_NS,
+    };
+    xQueueReset(rmt.done_queue);
+    err = rmt_receive(rmt.channel, rmt.symbols, sizeof(rmt.symbols), &receive_config);
+    gpio_set_level(pin, 1);
+    if (err != ESP_OK)
+        return err;
+
+    rmt_rx_done_event_data_t done;
+    if (xQueueReceive(rmt.done_queue, &done, pdMS_TO_TICKS(DHT_RMT_TIMEOUT_MS) + 1) != pdTRUE)
+    {
+        // restart the channel, it is still waiting for a frame
+        rmt_disable(rmt.channel);
+        rmt_enable(rmt.channel);
+        ESP_LOGE(TAG, "No frame from the sensor");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < done.num_symbols; i++)
+    {
+        rmt.pulses[count++] = (dht_pulse_t) { done.received_symbols[i].level0, done.received_symbols[i].duration0 };
+        // a zero duration marks the end of the frame
+        if (done.received_symbols[i].duration1 == 0)
+            break;
+        rmt.pulses[count++] = (dht_pulse_t) { done.received_symbols[i].level1, done.received_symbols[i].duration1 };
+    }
+
+    switch (dht_decode_pulses(rmt.pulses, count, data))
+    {
+        case DHT_DECODE_OK:
+            return ESP_OK;
+        case DHT_DECODE_NO_RESPONSE:
+            ESP_LOGE(TAG, "Initialization error, no response in the frame");
+            return ESP_ERR_TIMEOUT;
+        default:
+            ESP_LOGE(TAG, "Invalid bit timing in the frame (%d pulses)", (int) count);
+            return ESP_ERR_INVALID_RESPONSE;
+    }
+}
+#endif
 
 /**
  * Pack two data bytes into single value and take into account sign bit.
@@ -210,10 +360,21 @@ esp_err_t dht_read_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
     gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
     gpio_set_level(pin, 1);
 
+#if CONFIG_DHT_USE_RMT
+    // static mutex, created without allocating so it can be done in the critical section
+    PORT_ENTER_CRITICAL();
+    if (rmt.lock == NULL)
+        rmt.lock = xSemaphoreCreateMutexStatic(&rmt.lock_buffer);
+    PORT_EXIT_CRITICAL();
+    xSemaphoreTake(rmt.lock, portMAX_DELAY);
+    esp_err_t result = dht_fetch_data(sensor_type, pin, data);
+    xSemaphoreGive(rmt.lock);
+#else
     PORT_ENTER_CRITICAL();
     esp_err_t result = dht_fetch_data(sensor_type, pin, data);
     if (result == ESP_OK)
         PORT_EXIT_CRITICAL();
+#endif
 
     /* restore GPIO direction because, after calling dht_fetch_data(), the
      * GPIO direction mode changes */
@@ -0,0 +1,58 @@
+/**
+ * @file dht_decode.c
+ *
+ * Pulse-width decoder of the DHT single-wire frame, see dht.c for the
+ * protocol phases.
+ */
+#include "dht_decode.h"
+
+#include <string.h>
+
+// Phases 'C' and 'D' are ~80 us each
+#define DHT_RESPONSE_MIN_US 60
+#define DHT_RESPONSE_MAX_US 110
+// A bit starts with a ~50 us low, its high lasts ~26 us for '0' and ~70 us for '1'
+#define DHT_BIT_LOW_MIN_US 30
+#define DHT_BIT_LOW_MAX_US 90
+#define DHT_BIT_HIGH_MAX_US 100
+
+static int in_range(uint16_t value, uint16_t min, uint16_t max)
+{
+    return value >= min && value <= max;
+}
+
+dht_decode_result_t dht_decode_pulses(const dht_pulse_t *pulses, size_t count,
+        uint8_t data[DHT_DECODE_DATA_BYTES])
+{
+    size_t i = 0;
+
+    // Skip the start signal up to the response: low ~80 us then high ~80 us
+    for (; i + 1 < count; i++)
+    {
+        if (pulses[i].level == 0 && in_range(pulses[i].duration_us, DHT_RESPONSE_MIN_US, DHT_RESPONSE_MAX_US)
+                && pulses[i + 1].level == 1 && in_range(pulses[i + 1].duration_us, DHT_RESPONSE_MIN_US, DHT_RESPONSE_MAX_US))
+            break;
+    }
+    if (i + 1 >= count)
+        return DHT_DECODE_NO_RESPONSE;
+    i += 2;
+
+    memset(data, 0, DHT_DECODE_DATA_BYTES);
+    for (int bit = 0; bit < DHT_DECODE_DATA_BITS; bit++, i += 2)
+    {
+        if (i + 1 >= count)
+            return DHT_DECODE_TRUNCATED;
+
+        const dht_pulse_t *low = &pulses[i];
+        const dht_pulse_t *high = &pulses[i + 1];
+        if (low->level != 0 || high->level != 1
+                || !in_range(low->duration_us, DHT_BIT_LOW_MIN_US, DHT_BIT_LOW_MAX_US)
+                || high->duration_us == 0 || high->duration_us > DHT_BIT_HIGH_MAX_US)
+            return DHT_DECODE_BAD_TIMING;
+
+        // same rule as the bit-banged reader
+        data[bit / 8] |= (high->duration_us > low->duration_us) << (7 - bit % 8);
+    }
+
+    return DHT_DECODE_OK;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file dht_decode.h
+ *
+ * Pulse-width decoder of the DHT single-wire frame. It only depends on the
+ * C library so a captured waveform can be decoded anywhere, on or off the
+ * device.
+ */
+#ifndef __DHT_DECODE_H__
+#define __DHT_DECODE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DHT_DECODE_DATA_BITS 40
+#define DHT_DECODE_DATA_BYTES (DHT_DECODE_DATA_BITS / 8)
+
+/**
+ * One level of the line and how long it lasted
+ */
+typedef struct
+{
+    uint8_t level;          //!< 0 low, 1 high
+    uint16_t duration_us;
+} dht_pulse_t;
+
+typedef enum
+{
+    DHT_DECODE_OK = 0,
+    DHT_DECODE_NO_RESPONSE,   //!< no 80 us low/high response from the sensor
+    DHT_DECODE_TRUNCATED,     //!< the frame ends before the 40 bits
+    DHT_DECODE_BAD_TIMING     //!< a bit pulse out of the protocol ranges
+} dht_decode_result_t;
+
+/**
+ * @brief Decode the 40 data bits of a captured frame
+ *
+ * The pulses may start with the end of the start signal, everything before
+ * the sensor response is skipped. A bit is a ~50 us low followed by a high
+ * that is shorter than the low for a '0' and longer for a '1'.
+ * The checksum is not verified.
+ *
+ * @param pulses Captured levels in order
+ * @param count Number of pulses
+ * @param[out] data The 5 bytes of the frame
+ * @return `DHT_DECODE_OK` on success
+ */
+dht_decode_result_t dht_decode_pulses(const dht_pulse_t *pulses, size_t count,
+        uint8_t data[DHT_DECODE_DATA_BYTES]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __DHT_DECODE_H__
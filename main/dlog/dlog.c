@@ -0,0 +1,235 @@
+#include "dlog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "rtos_alloc/rtos_alloc.h"
+
+#define DLOG_TAG "dlog"
+
+#ifndef CONFIG_MESH_DLOG_BUFFER_SIZE
+#define CONFIG_MESH_DLOG_BUFFER_SIZE 4096
+#endif
+
+// longest formatted line, longer ones are truncated
+#define DLOG_LINE_LENGTH 256
+
+/*
+  * A record in the ring buffer: this header, count slots of dlog_arg_t and
+  * the copied strings, a string slot holds the offset of its copy from the
+  * start of the record instead of the pointer.
+*/
+typedef struct {
+    uint32_t timestamp;
+    const char *tag;
+    const char *format;
+    uint8_t level;
+    uint8_t count;
+} dlog_record_t;
+
+static RingbufHandle_t s_ring = NULL;
+static uint32_t s_dropped = 0;
+
+/*******************************************************
+ *                Formatting
+ *******************************************************/
+
+/*
+  * Function: dlog_format
+  * ----------------------------
+  *   printf of a recorded line. The length modifiers of the format are
+  *   ignored, the integers were recorded as long long. A conversion without
+  *   a matching argument prints ?
+  *
+  * returns: the length of the line in out
+*/
+size_t dlog_format(char *out, size_t size, const char *format, size_t count, const dlog_arg_t *args) {
+    size_t length = 0;
+    size_t next = 0;
+    if (size == 0) {
+        return 0;
+    }
+    while (*format != '\0' && length < size - 1) {
+        if (*format != '%') {
+            out[length++] = *format++;
+            continue;
+        }
+        if (format[1] == '%') {
+            out[length++] = '%';
+            format += 2;
+            continue;
+        }
+        // %[flags][width][.precision][length]conversion, rebuilt without the length
+        char spec[24] = "%";
+        size_t spec_length = 1;
+        format++;
+        while (*format != '\0' && strchr("-+ #0123456789.", *format) != NULL) {
+            if (spec_length < sizeof(spec) - 4) {
+                spec[spec_length++] = *format;
+            }
+            format++;
+        }
+        while (*format != '\0' && strchr("hlLqjzt", *format) != NULL) {
+            format++;
+        }
+        char conversion = *format;
+        if (conversion == '\0') {
+            break;
+        }
+        format++;
+
+        const dlog_arg_t *arg = next < count ? &args[next++] : NULL;
+        int written = -1;
+        if (arg != NULL && strchr("diouxXc", conversion) != NULL && arg->type == DLOG_ARG_INT) {
+            if (conversion == 'c') {
+                spec[spec_length++] = 'c';
+                spec[spec_length] = '\0';
+                written = snprintf(out + length, size - length, spec, (int) arg->i);
+            } else {
+                spec[spec_length++] = 'l';
+                spec[spec_length++] = 'l';
+                spec[spec_length++] = conversion;
+                spec[spec_length] = '\0';
+                written = snprintf(out + length, size - length, spec, arg->i);
+            }
+        } else if (arg != NULL && strchr("fFeEgGaA", conversion) != NULL && arg->type != DLOG_ARG_STR) {
+            spec[spec_length++] = conversion;
+            spec[spec_length] = '\0';
+            written = snprintf(out + length, size - length, spec,
+                               arg->type == DLOG_ARG_DOUBLE ? arg->d : (double) arg->i);
+        } else if (arg != NULL && conversion == 's' && arg->type == DLOG_ARG_STR) {
+            spec[spec_length++] = 's';
+            spec[spec_length] = '\0';
+            written = snprintf(out + length, size - length, spec, arg->s != NULL ? arg->s : "(null)");
+        } else if (arg != NULL && conversion == 'p') {
+            written = snprintf(out + length, size - length, "%p", arg->type == DLOG_ARG_PTR ? arg->p : (const void *) (intptr_t) arg->i);
+        }
+        if (written < 0) {
+            out[length++] = '?';
+        } else {
+            length += (size_t) written < size - length ? (size_t) written : size - length - 1;
+        }
+    }
+    out[length] = '\0';
+    return length;
+}
+
+static void dlog_print(esp_log_level_t level, uint32_t timestamp, const char *tag, const char *format, size_t count, const dlog_arg_t *args) {
+    char line[DLOG_LINE_LENGTH];
+    dlog_format(line, sizeof(line), format, count, args);
+    esp_log_write(level, tag, "%c (%lu) %s: %s\n", "NEWIDV"[level], (unsigned long) timestamp, tag, line);
+}
+
+/*******************************************************
+ *                Recording
+ *******************************************************/
+
+/*
+  * Function: dlog_write
+  * ----------------------------
+  *   Records a line, called by the DLOG macros. Before dlog_init the line
+  *   is printed at once, when the ring buffer is full it is dropped and
+  *   counted
+  *
+*/
+void dlog_write(esp_log_level_t level, const char *tag, const char *format, size_t count, const dlog_arg_t *args) {
+    uint32_t timestamp = esp_log_timestamp();
+    if (count > DLOG_MAX_ARGS) {
+        count = DLOG_MAX_ARGS;
+    }
+    if (s_ring == NULL) {
+        dlog_print(level, timestamp, tag, format, count, args);
+        return;
+    }
+
+    size_t strings[DLOG_MAX_ARGS];
+    size_t size = sizeof(dlog_record_t) + count * sizeof(dlog_arg_t);
+    for (size_t i = 0; i < count; i++) {
+        if (args[i].type == DLOG_ARG_STR) {
+            strings[i] = args[i].s != NULL ? strnlen(args[i].s, DLOG_MAX_STRING - 1) : 0;
+            size += strings[i] + 1;
+        }
+    }
+
+    uint8_t *item = NULL;
+    if (xRingbufferSendAcquire(s_ring, (void **) &item, size, 0) != pdTRUE) {
+        __atomic_add_fetch(&s_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    dlog_record_t record = {
+        .timestamp = timestamp,
+        .tag = tag,
+        .format = format,
+        .level = level,
+        .count = count
+    };
+    memcpy(item, &record, sizeof(record));
+    size_t offset = sizeof(dlog_record_t) + count * sizeof(dlog_arg_t);
+    for (size_t i = 0; i < count; i++) {
+        dlog_arg_t slot = args[i];
+        if (slot.type == DLOG_ARG_STR) {
+            if (args[i].s != NULL) {
+                memcpy(item + offset, args[i].s, strings[i]);
+            }
+            item[offset + strings[i]] = '\0';
+            slot.i = offset;
+            offset += strings[i] + 1;
+        }
+        // the ring buffer only aligns the items to 4 bytes
+        memcpy(item + sizeof(dlog_record_t) + i * sizeof(dlog_arg_t), &slot, sizeof(slot));
+    }
+    xRingbufferSendComplete(s_ring, item);
+}
+
+/*******************************************************
+ *                Printing task
+ *******************************************************/
+
+static void task_dlog(void *args) {
+    for (;;) {
+        size_t size = 0;
+        uint8_t *item = xRingbufferReceive(s_ring, &size, portMAX_DELAY);
+        if (item == NULL) {
+            continue;
+        }
+        dlog_record_t record;
+        dlog_arg_t slots[DLOG_MAX_ARGS];
+        memcpy(&record, item, sizeof(record));
+        memcpy(slots, item + sizeof(dlog_record_t), record.count * sizeof(dlog_arg_t));
+        for (size_t i = 0; i < record.count; i++) {
+            if (slots[i].type == DLOG_ARG_STR) {
+                slots[i].s = (const char *) item + slots[i].i;
+            }
+        }
+        dlog_print(record.level, record.timestamp, record.tag, record.format, record.count, slots);
+        vRingbufferReturnItem(s_ring, item);
+
+        uint32_t dropped = __atomic_exchange_n(&s_dropped, 0, __ATOMIC_RELAXED);
+        if (dropped != 0) {
+            ESP_LOGW(DLOG_TAG, "%lu log lines dropped, the buffer was full", (unsigned long) dropped);
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t dlog_init() {
+    if (s_ring != NULL) {
+        return ESP_OK;
+    }
+    RingbufHandle_t ring = rtos_alloc_ringbuf(RTOS_RINGBUF_DLOG);
+    if (ring == NULL) {
+        ESP_LOGE(DLOG_TAG, "Unable to create the log buffer");
+        return ESP_ERR_NO_MEM;
+    }
+    s_ring = ring;
+    // below every application task, the lines are printed when nothing else runs
+    if (rtos_alloc_task(RTOS_TASK_DLOG, task_dlog, NULL, NULL) != ESP_OK) {
+        s_ring = NULL;
+        vRingbufferDelete(ring);
+        ESP_LOGE(DLOG_TAG, "Unable to create the log task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,108 @@
+/*
+*   Deferred logger
+*   DLOG_E/W/I/D/V record the format string and the raw arguments in a RAM
+*   ring buffer, the formatting and the UART output happen later in a low
+*   priority task, so a log line costs the caller a copy instead of
+*   milliseconds of UART. Strings are copied (truncated to
+*   DLOG_MAX_STRING), other arguments by value. The tag and the format
+*   are kept by pointer, they must outlive the line (literals, MESH_TAG).
+*   Not for ISRs.
+*
+*   The level is checked at compile time: a file defines DLOG_LOCAL_LEVEL
+*   before including dlog.h to log more or less than CONFIG_MESH_DLOG_LEVEL.
+*   Without CONFIG_MESH_DLOG the macros are the ESP_LOG ones.
+*/
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_log.h"
+
+#ifndef CONFIG_MESH_DLOG_LEVEL
+#define CONFIG_MESH_DLOG_LEVEL ESP_LOG_INFO
+#endif
+
+#ifndef DLOG_LOCAL_LEVEL
+#define DLOG_LOCAL_LEVEL CONFIG_MESH_DLOG_LEVEL
+#endif
+
+// longest string argument kept, terminator included
+#define DLOG_MAX_STRING 96
+// arguments of a log line
+#define DLOG_MAX_ARGS 8
+
+typedef enum {
+    DLOG_ARG_INT = 0,
+    DLOG_ARG_DOUBLE,
+    DLOG_ARG_STR,
+    DLOG_ARG_PTR
+} dlog_arg_type_t;
+
+typedef struct {
+    uint8_t type;
+    union {
+        long long i;
+        double d;
+        const char *s;
+        const void *p;
+    };
+} dlog_arg_t;
+
+static inline dlog_arg_t dlog_arg_int(long long value) { return (dlog_arg_t) { .type = DLOG_ARG_INT, .i = value }; }
+static inline dlog_arg_t dlog_arg_double(double value) { return (dlog_arg_t) { .type = DLOG_ARG_DOUBLE, .d = value }; }
+static inline dlog_arg_t dlog_arg_str(const char *value) { return (dlog_arg_t) { .type = DLOG_ARG_STR, .s = value }; }
+static inline dlog_arg_t dlog_arg_ptr(const void *value) { return (dlog_arg_t) { .type = DLOG_ARG_PTR, .p = value }; }
+
+#define DLOG_ARG(x) _Generic((x),                                   \
+    char *: dlog_arg_str, const char *: dlog_arg_str,               \
+    float: dlog_arg_double, double: dlog_arg_double,                \
+    void *: dlog_arg_ptr, const void *: dlog_arg_ptr,               \
+    default: dlog_arg_int)(x)
+
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+#define DLOG_NARGS(...) DLOG_NARGS_(_, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_MAP_0()
+#define DLOG_MAP_1(a) DLOG_ARG(a)
+#define DLOG_MAP_2(a, ...) DLOG_ARG(a), DLOG_MAP_1(__VA_ARGS__)
+#define DLOG_MAP_3(a, ...) DLOG_ARG(a), DLOG_MAP_2(__VA_ARGS__)
+#define DLOG_MAP_4(a, ...) DLOG_ARG(a), DLOG_MAP_3(__VA_ARGS__)
+#define DLOG_MAP_5(a, ...) DLOG_ARG(a), DLOG_MAP_4(__VA_ARGS__)
+#define DLOG_MAP_6(a, ...) DLOG_ARG(a), DLOG_MAP_5(__VA_ARGS__)
+#define DLOG_MAP_7(a, ...) DLOG_ARG(a), DLOG_MAP_6(__VA_ARGS__)
+#define DLOG_MAP_8(a, ...) DLOG_ARG(a), DLOG_MAP_7(__VA_ARGS__)
+#define DLOG_CAT_(a, b) a##b
+#define DLOG_CAT(a, b) DLOG_CAT_(a, b)
+#define DLOG_MAP(n, ...) DLOG_CAT(DLOG_MAP_, n)(__VA_ARGS__)
+
+#if CONFIG_MESH_DLOG
+#define DLOG_LEVEL(level, tag, format, ...) do {                                        \
+        if ((level) <= DLOG_LOCAL_LEVEL) {                                              \
+            dlog_write((level), (tag), (format), DLOG_NARGS(__VA_ARGS__),               \
+                       (const dlog_arg_t []) { DLOG_MAP(DLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__) }); \
+        }                                                                               \
+    } while (0)
+#else
+#define DLOG_LEVEL(level, tag, format, ...) ESP_LOG_LEVEL_LOCAL(level, tag, format, ##__VA_ARGS__)
+#endif
+
+#define DLOG_E(tag, format, ...) DLOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define DLOG_W(tag, format, ...) DLOG_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define DLOG_I(tag, format, ...) DLOG_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define DLOG_D(tag, format, ...) DLOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define DLOG_V(tag, format, ...) DLOG_LEVEL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+/*
+  * Function: dlog_init
+  * ----------------------------
+  *   Creates the ring buffer and the task printing it. The lines logged
+  *   before are printed at once by the caller
+  *
+*/
+esp_err_t dlog_init(void);
+
+void dlog_write(esp_log_level_t level, const char *tag, const char *format, size_t count, const dlog_arg_t *args);
+size_t dlog_format(char *out, size_t size, const char *format, size_t count, const dlog_arg_t *args);
+
+#endif // DLOG_H
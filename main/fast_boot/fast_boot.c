@@ -0,0 +1,213 @@
+/*
+*   Fast boot path
+*   A node that already knows the router channel/BSSID skips the blocking
+*   all-channel scan of check_wifi_channel and starts the mesh on the cached
+*   channel. After a soft reset it also goes straight back to the parent it
+*   had, kept in RTC memory. If the warm join cannot find a parent the node
+*   restarts once into the cold path (full scan).
+*/
+#include "fast_boot.h"
+
+#include <stddef.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_system.h"
+#include "esp_attr.h"
+#include "esp_wifi.h"
+#include "persistence.h"
+#include "network_manager/provisioning.h"
+#include "timeline/timeline.h"
+
+#define FAST_BOOT_TAG "fast_boot"
+
+#ifndef CONFIG_MESH_FAST_BOOT
+#define CONFIG_MESH_FAST_BOOT 0
+#endif
+#ifndef CONFIG_MESH_FAST_BOOT_REUSE_PARENT
+#define CONFIG_MESH_FAST_BOOT_REUSE_PARENT 0
+#endif
+#ifndef CONFIG_MESH_FAST_BOOT_SCAN_LIMIT
+#define CONFIG_MESH_FAST_BOOT_SCAN_LIMIT 2
+#endif
+
+#define FAST_BOOT_RTC_MAGIC 0x46424F54 // "FBOT"
+#define FAST_BOOT_BSSID_KEY "router_bssid"
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef struct {
+    uint32_t magic;
+    uint8_t force_scan;      // set before restarting out of a failed warm boot
+    uint8_t parent_valid;
+    uint8_t parent_bssid[6];
+    uint8_t parent_ssid[32];
+    uint8_t parent_ssid_len;
+    uint8_t channel;
+    int8_t layer;
+    uint8_t was_root;
+    uint32_t checksum;
+} fast_boot_rtc_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+// survives esp_restart and panics, garbage after a power-on
+static RTC_NOINIT_ATTR fast_boot_rtc_t s_rtc;
+
+static fast_boot_mode_t s_mode = FAST_BOOT_COLD;
+static uint8_t s_channel = 0;
+static uint8_t s_router_bssid[6] = { 0 };
+static bool s_router_bssid_valid = false;
+static bool s_reuse_parent = false;
+// a parent was found since the boot, a later loss goes through the ESP-MESH reconnect
+static bool s_joined = false;
+
+/*******************************************************
+ *                RTC state
+ *******************************************************/
+
+static uint32_t rtc_checksum(const fast_boot_rtc_t *rtc) {
+    const uint8_t *bytes = (const uint8_t *) rtc;
+    uint32_t sum = 0x811C9DC5;
+    for (size_t i = 0; i < offsetof(fast_boot_rtc_t, checksum); i++) {
+        sum = (sum ^ bytes[i]) * 0x01000193;
+    }
+    return sum;
+}
+
+static void rtc_commit(void) {
+    s_rtc.magic = FAST_BOOT_RTC_MAGIC;
+    s_rtc.checksum = rtc_checksum(&s_rtc);
+}
+
+static bool rtc_is_valid(void) {
+    esp_reset_reason_t reason = esp_reset_reason();
+    if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT || reason == ESP_RST_UNKNOWN) {
+        return false;
+    }
+    return s_rtc.magic == FAST_BOOT_RTC_MAGIC && s_rtc.checksum == rtc_checksum(&s_rtc);
+}
+
+/*******************************************************
+ *                Public API
+ *******************************************************/
+
+fast_boot_mode_t fast_boot_init(void) {
+    bool force_scan = false;
+    if (rtc_is_valid()) {
+        force_scan = s_rtc.force_scan;
+        s_reuse_parent = CONFIG_MESH_FAST_BOOT_REUSE_PARENT && s_rtc.parent_valid && !s_rtc.was_root && !force_scan;
+    } else {
+        memset(&s_rtc, 0, sizeof(s_rtc));
+    }
+    // the flag only applies to the boot right after the failed warm join
+    s_rtc.force_scan = 0;
+    rtc_commit();
+
+    persistence_cached_get_u8(NETWORK_MANAGER_PERSISTENCE_NAMESPACE, "channel", &s_channel);
+    s_router_bssid_valid = persistence_cached_get_blob(NETWORK_MANAGER_PERSISTENCE_NAMESPACE, FAST_BOOT_BSSID_KEY,
+            s_router_bssid, sizeof(s_router_bssid)) == PERSISTENCE_OP_OK;
+
+    if (CONFIG_MESH_FAST_BOOT && !force_scan && s_channel != 0) {
+        s_mode = FAST_BOOT_WARM;
+    } else {
+        s_mode = FAST_BOOT_COLD;
+        s_reuse_parent = false;
+    }
+    if (s_mode == FAST_BOOT_WARM) {
+        timeline_set_flag(TIMELINE_FLAG_WARM_BOOT);
+    }
+    if (s_reuse_parent) {
+        timeline_set_flag(TIMELINE_FLAG_PARENT_REUSED);
+    }
+    ESP_LOGI(FAST_BOOT_TAG, "%s boot, channel:%d, router:%s, parent:%s",
+             s_mode == FAST_BOOT_WARM ? "warm" : "cold", s_channel,
+             s_router_bssid_valid ? "cached" : "unknown", s_reuse_parent ? "cached" : "search");
+    return s_mode;
+}
+
+fast_boot_mode_t fast_boot_get_mode(void) {
+    return s_mode;
+}
+
+uint8_t fast_boot_get_channel(void) {
+    return s_channel;
+}
+
+void fast_boot_apply_config(mesh_cfg_t *cfg) {
+    if (s_mode != FAST_BOOT_WARM) {
+        return;
+    }
+    cfg->channel = s_channel;
+    if (s_router_bssid_valid) {
+        memcpy(cfg->router.bssid, s_router_bssid, sizeof(s_router_bssid));
+    }
+}
+
+void fast_boot_reuse_parent(const mesh_cfg_t *cfg) {
+    if (!s_reuse_parent) {
+        return;
+    }
+    wifi_config_t parent = { 0 };
+    memcpy(parent.sta.ssid, s_rtc.parent_ssid, s_rtc.parent_ssid_len);
+    memcpy(parent.sta.bssid, s_rtc.parent_bssid, sizeof(parent.sta.bssid));
+    memcpy(parent.sta.password, cfg->mesh_ap.password, sizeof(parent.sta.password));
+    parent.sta.bssid_set = true;
+    parent.sta.channel = s_rtc.channel;
+
+    esp_err_t err = esp_mesh_set_parent(&parent, &cfg->mesh_id, MESH_NODE, s_rtc.layer);
+    if (err == ESP_OK) {
+        ESP_LOGI(FAST_BOOT_TAG, "Rejoining parent " MACSTR " on layer %d", MAC2STR(s_rtc.parent_bssid), s_rtc.layer);
+    } else {
+        ESP_LOGW(FAST_BOOT_TAG, "Unable to reuse the parent: %s", esp_err_to_name(err));
+    }
+}
+
+void fast_boot_save_router(uint8_t channel, const uint8_t *bssid) {
+    bool channel_changed = channel != 0 && channel != s_channel;
+    bool bssid_changed = bssid != NULL && (!s_router_bssid_valid || memcmp(bssid, s_router_bssid, sizeof(s_router_bssid)) != 0);
+    if (!channel_changed && !bssid_changed) {
+        return;
+    }
+    // cached, a burst of channel switches ends in a single NVS commit
+    if (channel_changed) {
+        s_channel = channel;
+        persistence_cached_set_u8(NETWORK_MANAGER_PERSISTENCE_NAMESPACE, "channel", channel);
+    }
+    if (bssid_changed) {
+        memcpy(s_router_bssid, bssid, sizeof(s_router_bssid));
+        s_router_bssid_valid = true;
+        persistence_cached_set_blob(NETWORK_MANAGER_PERSISTENCE_NAMESPACE, FAST_BOOT_BSSID_KEY, s_router_bssid, sizeof(s_router_bssid));
+    }
+    ESP_LOGI(FAST_BOOT_TAG, "Router cache updated, channel:%d, bssid:" MACSTR, s_channel, MAC2STR(s_router_bssid));
+}
+
+void fast_boot_on_parent_connected(const wifi_event_sta_connected_t *parent, int layer, bool is_root) {
+    memcpy(s_rtc.parent_bssid, parent->bssid, sizeof(s_rtc.parent_bssid));
+    s_rtc.parent_ssid_len = parent->ssid_len > sizeof(s_rtc.parent_ssid) ? sizeof(s_rtc.parent_ssid) : parent->ssid_len;
+    memcpy(s_rtc.parent_ssid, parent->ssid, s_rtc.parent_ssid_len);
+    s_rtc.channel = parent->channel;
+    s_rtc.layer = (int8_t) layer;
+    s_rtc.was_root = is_root;
+    s_rtc.parent_valid = 1;
+    rtc_commit();
+    s_joined = true;
+
+    // the parent of the root is the router
+    fast_boot_save_router(parent->channel, is_root ? parent->bssid : NULL);
+}
+
+void fast_boot_on_no_parent(int scan_times) {
+    // only before the first join: after it a root or router outage would
+    // restart every warm booted node of the mesh at once
+    if (s_mode != FAST_BOOT_WARM || s_joined || scan_times < CONFIG_MESH_FAST_BOOT_SCAN_LIMIT) {
+        return;
+    }
+    ESP_LOGW(FAST_BOOT_TAG, "No parent after %d scans on the cached channel, restarting with a full scan", scan_times);
+    s_rtc.force_scan = 1;
+    s_rtc.parent_valid = 0;
+    rtc_commit();
+    esp_restart();
+}
@@ -0,0 +1,80 @@
+#ifndef FAST_BOOT_H
+#define FAST_BOOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_wifi.h"
+#include "esp_mesh.h"
+
+typedef enum {
+    FAST_BOOT_COLD = 0, // full channel scan before starting the mesh
+    FAST_BOOT_WARM      // cached channel/BSSID, join straight away
+} fast_boot_mode_t;
+
+/*
+  * Function: fast_boot_init
+  * ----------------------------
+  *   Loads the cached router channel/BSSID from NVS and the parent of the
+  *   previous run from RTC memory and decides how this boot joins the mesh.
+  *   Must be called after persistence_init.
+  *
+  *   returns: FAST_BOOT_WARM if the scan can be skipped
+*/
+fast_boot_mode_t fast_boot_init(void);
+
+fast_boot_mode_t fast_boot_get_mode(void);
+
+/*
+  * Function: fast_boot_get_channel
+  * ----------------------------
+  *   returns: cached router channel, 0 if unknown
+*/
+uint8_t fast_boot_get_channel(void);
+
+/*
+  * Function: fast_boot_apply_config
+  * ----------------------------
+  *   On a warm boot fills the router channel and BSSID of the mesh config
+  *
+*/
+void fast_boot_apply_config(mesh_cfg_t *cfg);
+
+/*
+  * Function: fast_boot_reuse_parent
+  * ----------------------------
+  *   After a soft reset points the node at the parent it had before the reset
+  *   (CONFIG_MESH_FAST_BOOT_REUSE_PARENT). Call after esp_mesh_set_config.
+  *
+*/
+void fast_boot_reuse_parent(const mesh_cfg_t *cfg);
+
+/*
+  * Function: fast_boot_save_router
+  * ----------------------------
+  *   Caches the router channel and BSSID for the next boot, only written to
+  *   NVS when they change
+  *
+*/
+void fast_boot_save_router(uint8_t channel, const uint8_t *bssid);
+
+/*
+  * Function: fast_boot_on_parent_connected
+  * ----------------------------
+  *   Keeps the parent in RTC memory for the next soft reset. The root's parent
+  *   is the router, so it also refreshes the router cache.
+  *
+*/
+void fast_boot_on_parent_connected(const wifi_event_sta_connected_t *parent, int layer, bool is_root);
+
+/*
+  * Function: fast_boot_on_no_parent
+  * ----------------------------
+  *   A warm boot that cannot find a parent after CONFIG_MESH_FAST_BOOT_SCAN_LIMIT
+  *   scans restarts into a cold boot. Once the node joined, a lost parent is
+  *   left to the reconnect of ESP-MESH
+  *
+*/
+void fast_boot_on_no_parent(int scan_times);
+
+#endif // FAST_BOOT_H
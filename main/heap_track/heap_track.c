@@ -0,0 +1,197 @@
+/*
+*   Allocation tracker (debug builds)
+*   Records the live allocations with the call stack that made them through
+*   the IDF heap tracing in leak mode, and groups them by call stack so the
+*   sites holding the most memory come first. The callers are reported as
+*   PCs, symbolize them with xtensa-esp32-elf-addr2line -pfiaC -e <elf> <pcs>.
+*   The smallest largest free block of every diagnostics interval is kept so
+*   the fragmentation is visible over time.
+*/
+#include "heap_track.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#if CONFIG_MESH_HEAP_TRACKING
+#include "esp_heap_trace.h"
+
+#define HEAP_TRACK_TAG "heap_track"
+
+#ifndef CONFIG_MESH_HEAP_TRACK_RECORDS
+#define CONFIG_MESH_HEAP_TRACK_RECORDS 300
+#endif
+
+// distinct call stacks grouped by a report, the allocations of the others are summed
+#define HEAP_TRACK_SITES 48
+// diagnostics intervals kept in the history
+#define HEAP_TRACK_HISTORY 24
+
+typedef struct {
+    void *callers[CONFIG_HEAP_TRACING_STACK_DEPTH];
+    uint32_t count;
+    size_t bytes;
+} heap_track_site_t;
+
+static heap_trace_record_t s_records[CONFIG_MESH_HEAP_TRACK_RECORDS];
+// only the diagnostics task reads the records and the history
+static heap_track_site_t s_sites[HEAP_TRACK_SITES];
+static uint32_t s_history_largest[HEAP_TRACK_HISTORY];
+static uint32_t s_history_free[HEAP_TRACK_HISTORY];
+static size_t s_history_head = 0;
+static size_t s_history_stored = 0;
+static uint32_t s_window_largest = UINT32_MAX;
+static uint32_t s_window_free = UINT32_MAX;
+
+esp_err_t heap_track_init() {
+    esp_err_t err = heap_trace_init_standalone(s_records, CONFIG_MESH_HEAP_TRACK_RECORDS);
+    if (err == ESP_OK) {
+        err = heap_trace_start(HEAP_TRACE_LEAKS);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(HEAP_TRACK_TAG, "Unable to start the heap tracing: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+void heap_track_sample() {
+    uint32_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+    uint32_t free_bytes = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    if (largest < s_window_largest) {
+        s_window_largest = largest;
+    }
+    if (free_bytes < s_window_free) {
+        s_window_free = free_bytes;
+    }
+}
+
+void heap_track_next_window() {
+    if (s_window_largest == UINT32_MAX) {
+        heap_track_sample();
+    }
+    s_history_largest[s_history_head] = s_window_largest;
+    s_history_free[s_history_head] = s_window_free;
+    s_history_head = (s_history_head + 1) % HEAP_TRACK_HISTORY;
+    if (s_history_stored < HEAP_TRACK_HISTORY) {
+        s_history_stored++;
+    }
+    s_window_largest = UINT32_MAX;
+    s_window_free = UINT32_MAX;
+}
+
+/*
+  * Function: heap_track_get_summary
+  * ----------------------------
+  *   Counters of the heap tracing and, oldest first, the minimum free
+  *   memory and largest free block of the last diagnostics intervals
+  *
+  * returns: a cJSON object, owned by the caller
+*/
+cJSON * heap_track_get_summary() {
+    cJSON *summary = cJSON_CreateObject();
+    heap_trace_summary_t trace;
+    if (heap_trace_summary(&trace) == ESP_OK) {
+        cJSON_AddNumberToObject(summary, "live", trace.count);
+        cJSON_AddNumberToObject(summary, "capacity", trace.capacity);
+        cJSON_AddNumberToObject(summary, "high_water_mark", trace.high_water_mark);
+        cJSON_AddBoolToObject(summary, "overflowed", trace.has_overflowed);
+        cJSON_AddNumberToObject(summary, "allocations", trace.total_allocations);
+        cJSON_AddNumberToObject(summary, "frees", trace.total_frees);
+    }
+    cJSON *largest = cJSON_CreateArray();
+    cJSON *free_bytes = cJSON_CreateArray();
+    for (size_t i = 0; i < s_history_stored; i++) {
+        size_t index = (s_history_head + HEAP_TRACK_HISTORY - s_history_stored + i) % HEAP_TRACK_HISTORY;
+        cJSON_AddItemToArray(largest, cJSON_CreateNumber(s_history_largest[index]));
+        cJSON_AddItemToArray(free_bytes, cJSON_CreateNumber(s_history_free[index]));
+    }
+    cJSON_AddItemToObject(summary, "largest_free_block", largest);
+    cJSON_AddItemToObject(summary, "free", free_bytes);
+    return summary;
+}
+
+static int site_compare(const void *a, const void *b) {
+    const heap_track_site_t *site_a = a, *site_b = b;
+    return site_a->bytes < site_b->bytes ? 1 : site_a->bytes > site_b->bytes ? -1 : 0;
+}
+
+/*
+  * Function: heap_track_get_sites
+  * ----------------------------
+  *   Live bytes and allocations per call stack, the biggest first. The
+  *   call stacks after the top ones are summed in a last entry without
+  *   callers. A snapshot of a live heap: the allocations and frees done
+  *   while it is taken may be missed or counted twice
+  *
+  * returns: a cJSON array, owned by the caller
+*/
+cJSON * heap_track_get_sites(size_t top) {
+    heap_track_site_t other = { 0 };
+    size_t sites = 0;
+
+    // The tracing keeps running: stopping it would miss the frees done
+    // meanwhile and report their blocks as leaks forever. heap_trace_get
+    // copies a record under the lock of the tracer, but the list can change
+    // between two calls, so a free or an allocation made during the report
+    // may skip or repeat a record in it. The next report is right again.
+    size_t count = heap_trace_get_count();
+    for (size_t i = 0; i < count; i++) {
+        heap_trace_record_t record;
+        if (heap_trace_get(i, &record) != ESP_OK) {
+            // records freed meanwhile, the list is shorter
+            break;
+        }
+        if (record.address == NULL) {
+            continue;
+        }
+        heap_track_site_t *site = NULL;
+        for (size_t j = 0; j < sites; j++) {
+            if (memcmp(s_sites[j].callers, record.alloced_by, sizeof(s_sites[j].callers)) == 0) {
+                site = &s_sites[j];
+                break;
+            }
+        }
+        if (site == NULL && sites < HEAP_TRACK_SITES) {
+            site = &s_sites[sites++];
+            memcpy(site->callers, record.alloced_by, sizeof(site->callers));
+            site->count = 0;
+            site->bytes = 0;
+        }
+        if (site == NULL) {
+            site = &other;
+        }
+        site->count++;
+        site->bytes += record.size;
+    }
+
+    qsort(s_sites, sites, sizeof(heap_track_site_t), site_compare);
+    cJSON *result = cJSON_CreateArray();
+    for (size_t i = 0; i < sites; i++) {
+        if (i >= top) {
+            other.count += s_sites[i].count;
+            other.bytes += s_sites[i].bytes;
+            continue;
+        }
+        cJSON *site = cJSON_CreateObject();
+        cJSON_AddNumberToObject(site, "bytes", s_sites[i].bytes);
+        cJSON_AddNumberToObject(site, "count", s_sites[i].count);
+        cJSON *callers = cJSON_CreateArray();
+        for (size_t depth = 0; depth < CONFIG_HEAP_TRACING_STACK_DEPTH && s_sites[i].callers[depth] != NULL; depth++) {
+            char pc[12];
+            snprintf(pc, sizeof(pc), "0x%08lx", (unsigned long) (uintptr_t) s_sites[i].callers[depth]);
+            cJSON_AddItemToArray(callers, cJSON_CreateString(pc));
+        }
+        cJSON_AddItemToObject(site, "callers", callers);
+        cJSON_AddItemToArray(result, site);
+    }
+    if (other.count != 0) {
+        cJSON *site = cJSON_CreateObject();
+        cJSON_AddNumberToObject(site, "bytes", other.bytes);
+        cJSON_AddNumberToObject(site, "count", other.count);
+        cJSON_AddItemToArray(result, site);
+    }
+    return result;
+}
+#endif
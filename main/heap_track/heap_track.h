@@ -0,0 +1,24 @@
+#ifndef HEAP_TRACK_H
+#define HEAP_TRACK_H
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "cJSON.h"
+
+/*
+  * Function: heap_track_init
+  * ----------------------------
+  *   Starts recording the live allocations, as early as possible so the
+  *   allocations done at boot are attributed too
+  *
+*/
+esp_err_t heap_track_init(void);
+
+// called by the diagnostics task, every second and at every report
+void heap_track_sample(void);
+void heap_track_next_window(void);
+
+cJSON * heap_track_get_summary(void);
+cJSON * heap_track_get_sites(size_t top);
+
+#endif // HEAP_TRACK_H
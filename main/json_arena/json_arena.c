@@ -0,0 +1,161 @@
+#include "json_arena.h"
+
+#include <stdlib.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "esp_log.h"
+#include "cJSON.h"
+
+#define JSON_ARENA_TAG "json_arena"
+
+#ifndef CONFIG_MESH_JSON_ARENA_SIZE
+#define CONFIG_MESH_JSON_ARENA_SIZE 16384
+#endif
+#ifndef CONFIG_MESH_JSON_ARENA_BLOCKS
+#define CONFIG_MESH_JSON_ARENA_BLOCKS 1
+#endif
+
+// cJSON nodes hold doubles and pointers
+#define JSON_ARENA_ALIGN 8
+// a command waiting longer for a block runs on the heap
+#define JSON_ARENA_WAIT_MS 10000
+
+// arena of the scope open in the calling task
+static __thread json_arena_t *s_current = NULL;
+
+static uint8_t s_blocks[CONFIG_MESH_JSON_ARENA_BLOCKS][CONFIG_MESH_JSON_ARENA_SIZE] __attribute__((aligned(JSON_ARENA_ALIGN)));
+static bool s_block_used[CONFIG_MESH_JSON_ARENA_BLOCKS];
+// counts the free blocks
+static SemaphoreHandle_t s_blocks_free = NULL;
+
+// scopes open in all the tasks, the hooks are installed while it is not 0,
+// the lock also guards s_block_used
+static int s_open_scopes = 0;
+static portMUX_TYPE s_hooks_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/*******************************************************
+ *                cJSON hooks
+ *******************************************************/
+
+static void * arena_malloc(size_t size) {
+    json_arena_t *arena = s_current;
+    if (arena == NULL) {
+        return malloc(size);
+    }
+    size_t start = (arena->used + JSON_ARENA_ALIGN - 1) & ~((size_t) JSON_ARENA_ALIGN - 1);
+    if (arena->failed || start + size > arena->size) {
+        // no heap fallback: the command must fail, not grow without bound
+        arena->failed = true;
+        arena->overflow += size;
+        return NULL;
+    }
+    arena->used = start + size;
+    return arena->base + start;
+}
+
+/*
+  * Function: arena_free
+  * ----------------------------
+  *   A block of the arena is released with the arena. Anything else was
+  *   allocated on the heap: by another task or before the scope.
+  *
+*/
+static void arena_free(void *ptr) {
+    json_arena_t *arena = s_current;
+    if (arena != NULL && (uint8_t *) ptr >= arena->base && (uint8_t *) ptr < arena->base + arena->size) {
+        return;
+    }
+    free(ptr);
+}
+
+/*
+  * Function: hooks_acquire
+  * ----------------------------
+  *   cJSON has a single set of hooks for all the tasks: installed by the
+  *   first scope, removed by the last one, so outside the scopes cJSON
+  *   keeps realloc, which it only uses with the default hooks
+  *
+*/
+static void hooks_acquire(void) {
+    static cJSON_Hooks hooks = { .malloc_fn = arena_malloc, .free_fn = arena_free };
+    portENTER_CRITICAL(&s_hooks_lock);
+    if (s_open_scopes++ == 0) {
+        cJSON_InitHooks(&hooks);
+    }
+    portEXIT_CRITICAL(&s_hooks_lock);
+}
+
+static void hooks_release(void) {
+    portENTER_CRITICAL(&s_hooks_lock);
+    if (--s_open_scopes == 0) {
+        cJSON_InitHooks(NULL);
+    }
+    portEXIT_CRITICAL(&s_hooks_lock);
+}
+
+/*******************************************************
+ *                Public API
+ *******************************************************/
+
+void json_arena_init(void) {
+    if (s_blocks_free == NULL) {
+        s_blocks_free = xSemaphoreCreateCounting(CONFIG_MESH_JSON_ARENA_BLOCKS, CONFIG_MESH_JSON_ARENA_BLOCKS);
+    }
+}
+
+bool json_arena_begin(json_arena_t *arena) {
+    *arena = (json_arena_t) { 0 };
+    if (s_current != NULL) {
+        return true;
+    }
+    if (s_blocks_free == NULL || xSemaphoreTake(s_blocks_free, pdMS_TO_TICKS(JSON_ARENA_WAIT_MS)) != pdTRUE) {
+        ESP_LOGW(JSON_ARENA_TAG, "No free arena, the command allocates on the heap");
+        return false;
+    }
+    portENTER_CRITICAL(&s_hooks_lock);
+    for (size_t i = 0; i < CONFIG_MESH_JSON_ARENA_BLOCKS && arena->base == NULL; i++) {
+        if (!s_block_used[i]) {
+            s_block_used[i] = true;
+            arena->base = s_blocks[i];
+        }
+    }
+    portEXIT_CRITICAL(&s_hooks_lock);
+    arena->size = CONFIG_MESH_JSON_ARENA_SIZE;
+    hooks_acquire();
+    s_current = arena;
+    return true;
+}
+
+bool json_arena_end(json_arena_t *arena) {
+    if (arena->base == NULL) {
+        return true;
+    }
+    s_current = NULL;
+    hooks_release();
+    if (arena->failed) {
+        ESP_LOGE(JSON_ARENA_TAG, "Arena of %u bytes full, %u more bytes refused",
+                 (unsigned) arena->size, (unsigned) arena->overflow);
+    } else {
+        ESP_LOGD(JSON_ARENA_TAG, "%u of %u bytes used", (unsigned) arena->used, (unsigned) arena->size);
+    }
+    portENTER_CRITICAL(&s_hooks_lock);
+    s_block_used[(arena->base - &s_blocks[0][0]) / CONFIG_MESH_JSON_ARENA_SIZE] = false;
+    portEXIT_CRITICAL(&s_hooks_lock);
+    xSemaphoreGive(s_blocks_free);
+    arena->base = NULL;
+    return !arena->failed;
+}
+
+bool json_arena_failed(void) {
+    return s_current != NULL && s_current->failed;
+}
+
+size_t json_arena_mark(void) {
+    return s_current != NULL ? s_current->used : 0;
+}
+
+void json_arena_rewind(size_t mark) {
+    if (s_current != NULL && mark <= s_current->used) {
+        s_current->used = mark;
+    }
+}
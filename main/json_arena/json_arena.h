@@ -0,0 +1,82 @@
+/*
+*   cJSON arena
+*   A command handler parses the request and builds its answers with dozens
+*   of small cJSON allocations. Between json_arena_begin and json_arena_end
+*   every cJSON allocation of the calling task is carved out of a block of
+*   CONFIG_MESH_JSON_ARENA_SIZE bytes, and the block is released in one go
+*   at the end: the command cannot fragment the heap nor leak a tree it
+*   forgot to delete. The blocks are reserved once at boot and lent to the
+*   scopes, a command waits for a free one. Once the block is full every
+*   cJSON allocation of the scope fails: the command is answered with an
+*   error and publish refuses its partial answers. The cJSON hooks are only
+*   installed while a scope is open, the other tasks keep allocating on the
+*   heap meanwhile.
+*
+*   Nothing allocated by cJSON inside a scope may outlive it, and a string
+*   printed by cJSON inside a scope is released with cJSON_free, not free.
+*/
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint8_t *base;      // NULL when the scope did not get an arena
+    size_t size;
+    size_t used;
+    size_t overflow;    // bytes refused once the block was full
+    bool failed;        // an allocation was refused, the command must fail
+} json_arena_t;
+
+/*
+  * Function: json_arena_init
+  * ----------------------------
+  *   Prepares the blocks lent to the scopes, before the first command
+  *
+*/
+void json_arena_init(void);
+
+/*
+  * Function: json_arena_begin
+  * ----------------------------
+  *   Opens an arena scope for the calling task, waiting for a free block.
+  *   A scope opened inside another one of the same task uses the outer
+  *   arena.
+  *
+  *   returns: false when no block was free in time, cJSON then allocates
+  *            on the heap
+*/
+bool json_arena_begin(json_arena_t *arena);
+
+/*
+  * Function: json_arena_end
+  * ----------------------------
+  *   Closes the scope opened with arena and releases every cJSON
+  *   allocation made in it
+  *
+  *   returns: false when the block was too small for the command
+*/
+bool json_arena_end(json_arena_t *arena);
+
+/*
+  * Function: json_arena_failed
+  * ----------------------------
+  *   returns: true when the scope of the calling task ran out of memory
+*/
+bool json_arena_failed(void);
+
+/*
+  * Function: json_arena_mark / json_arena_rewind
+  * ----------------------------
+  *   A command that streams its answer rewinds the arena to a mark after
+  *   every part, so it needs a block for a single part only. Nothing
+  *   allocated by cJSON after the mark may be used after the rewind.
+  *   Without a scope they do nothing.
+  *
+*/
+size_t json_arena_mark(void);
+void json_arena_rewind(size_t mark);
+
+#endif // JSON_ARENA_H
@@ -14,31 +14,50 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_mesh.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 #include "mesh_netif/mesh_netif.h"
 #include "driver/gpio.h"
 #include "freertos/semphr.h"
 #include "mqtt/client/aws_mqtt.h"
 #include "network_transport.h"
-#include "esp_netif_sntp.h"
 #include <freertos/FreeRTOS.h>
 #include "network_manager/provisioning.h"
 #include "persistence/persistence.h"
 #include "suscription_handlers/suscription_event_handlers.h"
 #include "mqtt/utils/mqtt_utils.h"
+#include "mqtt/latency/mqtt_latency.h"
 #include "performance/performance.h"
-#include "sensors/tasks/sensor_tasks.h"
+#include "sensors/descriptors/sensor_descriptors.h"
+#include "sensors/scheduler/sensor_scheduler.h"
 #include "sensors/utils/sensor_utils.h"
 #include "tasks_config/tasks_config.h"
 #include "relays/relays.h"
 #include "reset_button/reset_button.h"
 #include "status_led/status_led.h"
+#include "benchmark/benchmark.h"
+#include "time_sync/time_sync.h"
+#include "fast_boot/fast_boot.h"
+#include "timeline/timeline.h"
+#include "tsdb/tsdb.h"
+#include "heap_track/heap_track.h"
+#include "dlog/dlog.h"
+#include "topology/topology.h"
+#include "rtos_alloc/rtos_alloc.h"
+#include "json_arena/json_arena.h"
 
 /*******************************************************
  *                Macros MESH
  *******************************************************/
 #define CMD_ROUTE_TABLE 0x56
 
+// QoS of the queued messages, QoS1 waits for the PUBACK of the broker
+#if CONFIG_MQTT_PUBLISH_QOS1
+#define MQTT_PUBLISH_QOS MQTTQoS1
+#else
+#define MQTT_PUBLISH_QOS MQTTQoS0
+#endif
+
 /*******************************************************
  *                Constants
  *******************************************************/
@@ -86,6 +105,18 @@ void static recv_cb(mesh_addr_t *from, mesh_data_t *data) {
         memcpy(&s_route_table, data->data + 1, size);
         xSemaphoreGive(s_route_table_lock);
     }
+    else if (data->data[0] == CMD_BENCHMARK)
+    {
+        benchmark_raw_recv(from, data);
+    }
+    else if (data->data[0] == CMD_TIME_SYNC_REQ || data->data[0] == CMD_TIME_SYNC_RESP)
+    {
+        time_sync_raw_recv(from, data);
+    }
+    else if (data->data[0] == CMD_TOPOLOGY_STATUS)
+    {
+        topology_raw_recv(from, data);
+    }
     else
     {
         ESP_LOGE(MESH_TAG, "Error in receiving raw mesh data: Unknown command");
@@ -124,7 +155,7 @@ char * new_device() {
     cJSON * device_id = cJSON_CreateObject();
     cJSON_AddStringToObject(device_id, "mesh_id", MESH_TAG);
     cJSON_AddStringToObject(device_id, "device_id", macAp);
-    cJSON * tasks_array = get_all_tasks_metrics_json();
+    cJSON * tasks_array = sensor_descriptors_json();
     cJSON_AddItemToObject(device_id, "tasks", tasks_array);
     // if we have relays we add the relay state
     cJSON * relays_array = get_relay_state();
@@ -158,17 +189,17 @@ void task_notify_new_device(void *args) {
         char * new_user_msg = new_user(USER_EMAIL == NULL? SUPPORT_EMAIL: USER_EMAIL, new_user_message_sent++);
         char * device_msg = new_device();
         if (new_user_msg != NULL) {
-            ESP_LOGI(MESH_TAG, "Trying to queue message: %s", new_user_msg);
+            DLOG_I(MESH_TAG, "Trying to queue message: %s", new_user_msg);
             if (mqtt_queues->mqttPublisherQueue != NULL) {
                 publish(new_user_topic, new_user_msg);
-                ESP_LOGI(MESH_TAG, "queued done: %s", new_user_msg);
+                DLOG_I(MESH_TAG, "queued done: %s", new_user_msg);
             }
         }
         if (device_msg != NULL) {
-            ESP_LOGI(MESH_TAG, "Trying to queue message: %s", device_msg);
+            DLOG_I(MESH_TAG, "Trying to queue message: %s", device_msg);
             if (mqtt_queues->mqttPublisherQueue != NULL) {
                 publish(device_topic, device_msg);
-                ESP_LOGI(MESH_TAG, "queued done: %s", device_msg);
+                DLOG_I(MESH_TAG, "queued done: %s", device_msg);
             }
         }
         free(device_msg);
@@ -184,71 +215,6 @@ void task_notify_new_device(void *args) {
 }
 
 
-void task_mqtt_graph(void *args) {
-    ESP_LOGI(MESH_TAG, "STARTED: task_mqtt_graph");
-
-    is_running = true;
-    char *graph_message;
-    mqtt_queues_t *mqtt_queues = (mqtt_queues_t *)args;
-
-    // get the parent of this node
-    mesh_addr_t parent;
-    esp_mesh_get_parent_bssid(&parent);
-    char * parent_mac = (char*) malloc(18 * sizeof(char));
-    sprintf(parent_mac, MACSTR, MAC2STR(parent.addr));
-
-    // mac addr STA of this node to string
-    char * macSta = get_mac_sta();
-    // mac addr AP of this node to string
-    char * macAp = get_mac_ap();
-
-    char * topic = create_topic("graph", "report", false);
-
-    while (is_running) {
-        log_memory(); // for debugging memory leaks
-
-        cJSON * memory_stats = get_memory_stats();
-
-        // create cJSON object with the data
-        cJSON *graph_data = cJSON_CreateObject();
-        cJSON_AddNumberToObject(graph_data, "layer", esp_mesh_get_layer());
-
-        if (esp_mesh_is_root()) {
-            cJSON_AddStringToObject(graph_data, "root", "true");
-            cJSON_AddStringToObject(graph_data, "macSta", macSta);
-            cJSON_AddStringToObject(graph_data, "macSoftap", macAp);
-            // the root node has no parent so instead we get the WIFI_IF_AP -> WIFI_IF_STA
-        } else {
-            cJSON_AddStringToObject(graph_data, "root", "false");
-            cJSON_AddStringToObject(graph_data, "macSta", parent_mac);
-            cJSON_AddStringToObject(graph_data, "macSoftap", macAp);
-        }
-
-        // Adding perfomance metrics
-        cJSON_AddNumberToObject(graph_data, "uptime", get_uptime());
-        cJSON_AddItemToObject(graph_data, "memory", memory_stats);
-
-        graph_message = cJSON_PrintUnformatted(graph_data);
-        cJSON_Delete(graph_data);
-
-        char *message = create_mqtt_message(graph_message);
-
-        ESP_LOGI(MESH_TAG, "Trying to queue message: %s", message);
-        if (mqtt_queues->mqttPublisherQueue != NULL) {
-            publish(topic, message);
-            ESP_LOGI(MESH_TAG, "queued done: %s", message);
-        }
-        free(message);
-        free(graph_message);
-        vTaskDelay(pdMS_TO_TICKS(5000));
-    }
-    free(topic);
-    free(parent_mac);
-    free(macSta);
-    free(macAp);
-    vTaskDelete(NULL);
-}
-
 void task_mqtt_client_start(void *args) {
     // read mqtt queues from arg
     mqtt_queues_t *mqtt_queues = (mqtt_queues_t *)args;
@@ -289,16 +255,30 @@ void task_mqtt_client_start(void *args) {
             {
                 if (xQueueReceive(mqtt_queues->mqttPublisherQueue, (void *)buffer, 0) == pdTRUE)
                 {
-                    ESP_LOGI(MESH_TAG, "Received message to publish: %s on topic: %s", buffer->message, buffer->topic);
-                    int returnStatus = publishToTopic(&mqttContext, buffer->message, buffer->topic, MQTTQoS0);
+                    buffer->trace.dequeue_us = esp_timer_get_time();
+                    DLOG_I(MESH_TAG, "Received message to publish: %s on topic: %s", buffer->message, buffer->topic);
+                    uint16_t packet_id;
+                    int returnStatus = publishToTopic(&mqttContext, buffer->message, buffer->topic, MQTT_PUBLISH_QOS, &packet_id);
+#if CONFIG_MQTT_LATENCY_TRACE
+                    if (returnStatus == EXIT_SUCCESS) {
+                        mqtt_latency_sent(&buffer->trace, buffer->topic, packet_id);
+                    }
+#endif
                     if (returnStatus != EXIT_SUCCESS)
                     {
                         ESP_LOGI(MESH_TAG, "Error in publishLoop");
                         mqtt_connection_status = EXIT_FAILURE;
+                        timeline_begin_reconnect(TIMELINE_REASON_PUBLISH_FAILED);
+                    }
+                    else if (timeline_is_open())
+                    {
+                        timeline_stamp(TIMELINE_PHASE_FIRST_PUBLISH);
                     }
                 }
             }
         }
+        // timelines that did not fit in the publisher queue when the connection came up
+        timeline_retry_pending();
         /* Calling MQTT_ProcessLoop to process incoming publish. This function also
          * sends ping request to broker if 1 second has expired since the last MQTT packet sent and receive ping responses.
          */
@@ -311,6 +291,9 @@ void task_mqtt_client_start(void *args) {
             LogError( ( "MQTT_ProcessLoop returned with status = %s.",
                         MQTT_Status_strerror( mqttStatus ) ) );
             
+            if (mqtt_connection_status == EXIT_SUCCESS) {
+                timeline_begin_reconnect(TIMELINE_REASON_PROCESS_LOOP_FAILED);
+            }
             mqtt_connection_status = EXIT_FAILURE;
         }
         free(buffer);
@@ -322,11 +305,7 @@ void task_mqtt_client_start(void *args) {
 void task_suscriber_event_executor(void *args) {
     // this task only executes the event handler for the suscriber and then finishes the task
     ESP_LOGI(MESH_TAG, "STARTED: task_suscriber_event_executor");
-    suscription_event_handler_t *event_handler = (suscription_event_handler_t *)args;
-    event_handler->handler(event_handler->topic, event_handler->message);
-    free(event_handler->message);
-    free(event_handler->topic);
-    free(event_handler);
+    suscriber_run_event((suscription_event_handler_t *) args);
     vTaskDelete(NULL);
 }
 
@@ -337,26 +316,10 @@ void task_suscribers_events(void *args) {
     while (1) {
         // looping though each topic queue and check if we have an incoming message
         for(size_t i = 0; topics_list[i] != NULL; i++) {
-            char * topic = topics_list[i];
-            // suscriber_get_message handles also the correct event handler
-            char * message = suscriber_get_message(topic);
-            SuscriptionTopicsHash_t *s = suscriber_find_topic(topic);
-            if (s != NULL) {
-                if (message != NULL) {
-                    ESP_LOGI(MESH_TAG, "Received message from topic: %s", topic);
-                    ESP_LOGI(MESH_TAG, "Message: %s", message);
-                    if (s->event_handler != NULL) {
-                        // create new suscription_event_handler_t
-                        suscription_event_handler_t *event_handler_data = (suscription_event_handler_t *) malloc(sizeof(suscription_event_handler_t));
-                        event_handler_data->topic = strdup(topic);
-                        // copy the message to the event handler data
-                        event_handler_data->message = strdup(message);
-                        event_handler_data->handler = s->event_handler;
-                        // create a new task to execute the event handler so that this receiver task doesnt block by the handler
-                        xTaskCreate(task_suscriber_event_executor, "task_suscriber_event_executor", 5072, (void *)event_handler_data, 5, NULL);
-                    }
-                    free(message);
-                }
+            suscription_event_handler_t *event_handler_data = suscriber_next_event(topics_list[i]);
+            if (event_handler_data != NULL) {
+                // create a new task to execute the event handler so that this receiver task doesnt block by the handler
+                rtos_alloc_transient_task(RTOS_TRANSIENT_SUSCRIBER_EXECUTOR, task_suscriber_event_executor, (void *)event_handler_data);
             }
         }
         vTaskDelay(100 / portTICK_PERIOD_MS);   
@@ -371,14 +334,17 @@ esp_err_t esp_tasks_runner(void) {
     s_route_table_lock = xSemaphoreCreateMutex();
 
     mqtt_queues = (mqtt_queues_t *) malloc(sizeof(mqtt_queues_t));
-    mqtt_queues->mqttPublisherQueue = xQueueCreate(queueSize, sizeof(mqtt_message_t));
+    mqtt_queues->mqttPublisherQueue = rtos_alloc_queue(RTOS_QUEUE_MQTT_PUBLISHER);
     init_suscriber_hash();
-    mqtt_queues->mqttSuscriberHash = suscription_topics;
+    mqtt_queues->mqttSuscriberHash = &suscription_topics;
+    // the arenas of the command handlers run by the suscribers task
+    json_arena_init();
 
     if (mqtt_queues->mqttPublisherQueue == NULL)
     {
         ESP_LOGI(MESH_TAG, "Error creating the mqttPublisherQueue");
     }
+    performance_watch_queue("mqttPublisherQueue", mqtt_queues->mqttPublisherQueue);
 
     /* Adding topics that we want to subscribe to */
     /* Config */
@@ -391,41 +357,72 @@ esp_err_t esp_tasks_runner(void) {
     suscriber_add_topic(create_topic("relay", "", true), relay_event_handler);
 
     if (!is_comm_mqtt_task_started) {
-        xTaskCreate(task_mesh_table_routing, "mqtt routing-table", 2048, NULL, 5, NULL);
+        rtos_alloc_task(RTOS_TASK_ROUTING_TABLE, task_mesh_table_routing, NULL, NULL);
         vTaskDelay(2000 / portTICK_PERIOD_MS);
-        xTaskCreate(task_mqtt_client_start, "mqtt task-aws", 8096, (void *)mqtt_queues, 5, NULL);
-        xTaskCreate(task_suscribers_events, "Task that reads suscription events", 8096, NULL, 5, NULL);
+        rtos_alloc_task(RTOS_TASK_MQTT_CLIENT, task_mqtt_client_start, (void *)mqtt_queues, NULL);
+        rtos_alloc_task(RTOS_TASK_SUSCRIBERS, task_suscribers_events, NULL, NULL);
         
         vTaskDelay(1000 / portTICK_PERIOD_MS);
 
-        char * sensor_dht11_metrics[] = {"temperature", "humidity", NULL};
-        char * sensor_dht11_units[] = {"C", "%", NULL};
-        create_sensor_task("task_sensor_dht11", "dht11", sensor_dht11_metrics, sensor_dht11_units, task_sensor_dht11, (void *) mqtt_queues, (Config_t) {
-            .max_polling_time = 0,  // 0 means no max time restriction
-            .min_polling_time = 1000, // 1 second
-            .polling_time = 30000, // 30 seconds
-            .active = 1 // active
-        },
-        3072
-        );
-        char * sensor_performance_metrics[] = {"free_memory", "min_free_memory", "memory_usage", NULL};
-        char * sensor_performance_units[] = {"KBytes", "KBytes", "%", NULL};
-        create_sensor_task("task_sensor_performance", "esp32-performance", sensor_performance_metrics, sensor_performance_units, task_sensor_performance, (void *) mqtt_queues, (Config_t) {
-            .max_polling_time = 0,  // 0 means no max time restriction
-            .min_polling_time = 5000, // 5 second
-            .polling_time = 10000, // 10 seconds
-            .active = 1 // active
-        },
-        3072
-        );
-        xTaskCreate(task_mqtt_graph, "Graph logging task", 3072, (void *)mqtt_queues, 5, NULL);
-        xTaskCreate(task_notify_new_device, "Notify new device", 3072, (void *)mqtt_queues, 5, NULL);
+        // sensors are read by the scheduler workers, not by a task per sensor
+        ESP_ERROR_CHECK(sensor_scheduler_init());
+        // history of the readings, the sensors run without it
+        tsdb_init();
+        for (int task_id = SENSOR_TASK_NONE + 1; task_id < SENSOR_TASK_END; task_id++) {
+            create_sensor_task(task_id, mqtt_queues);
+        }
+        // the root publishes the tree of the mesh, every node reports its status to it
+        topology_start();
+        rtos_alloc_task(RTOS_TASK_NOTIFY_DEVICE, task_notify_new_device, (void *)mqtt_queues, NULL);
+#if CONFIG_MESH_DIAGNOSTICS
+        performance_diagnostics_start();
+#endif
+
+        benchmark_init();
+#if CONFIG_MESH_BENCHMARK_AUTOSTART
+        cJSON *benchmark_config = cJSON_CreateObject();
+        cJSON_AddStringToObject(benchmark_config, "path", CONFIG_MESH_BENCHMARK_AUTOSTART_PATH);
+        cJSON_AddStringToObject(benchmark_config, "target", CONFIG_MESH_BENCHMARK_AUTOSTART_TARGET);
+        cJSON_AddNumberToObject(benchmark_config, "duration", CONFIG_MESH_BENCHMARK_AUTOSTART_DURATION);
+        cJSON_AddNumberToObject(benchmark_config, "size", CONFIG_MESH_BENCHMARK_AUTOSTART_SIZE);
+        benchmark_params_t benchmark_params;
+        if (benchmark_parse_params(benchmark_config, &benchmark_params)) {
+            benchmark_start(&benchmark_params);
+        } else {
+            ESP_LOGE(MESH_TAG, "Invalid benchmark autostart configuration");
+        }
+        cJSON_Delete(benchmark_config);
+#endif
         is_comm_mqtt_task_started = true;
     }
     return ESP_OK;
 }
 
 
+void task_start_on_mesh_time(void *args) {
+    ESP_LOGI(MESH_TAG, "STARTED: task_start_on_mesh_time");
+    TickType_t timeout = CONFIG_MESH_TIME_SYNC_BOOT_TIMEOUT == 0 ? portMAX_DELAY : pdMS_TO_TICKS(CONFIG_MESH_TIME_SYNC_BOOT_TIMEOUT);
+    bool synced = time_sync_wait(timeout);
+    if (synced) {
+        timeline_stamp(TIMELINE_PHASE_TIME_SYNCED);
+    } else {
+        ESP_LOGW(MESH_TAG, "No mesh time after %d ms, starting the tasks anyway", CONFIG_MESH_TIME_SYNC_BOOT_TIMEOUT);
+    }
+
+    // Setting the perfomance uptime value
+    set_uptime();
+
+    esp_tasks_runner();
+    timeline_stamp(TIMELINE_PHASE_TASKS_STARTED);
+
+    if (!synced) {
+        // the clock was still at epoch when the uptime was taken
+        time_sync_wait(portMAX_DELAY);
+        set_uptime();
+    }
+    vTaskDelete(NULL);
+}
+
 void mesh_event_handler(void *arg, esp_event_base_t event_base,
                         int32_t event_id, void *event_data) {
     mesh_addr_t id = {
@@ -453,6 +450,7 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
         ESP_LOGI(MESH_TAG, "<MESH_EVENT_CHILD_CONNECTED>aid:%d, " MACSTR "",
                  child_connected->aid,
                  MAC2STR(child_connected->mac));
+        topology_mesh_changed();
     }
     break;
     case MESH_EVENT_CHILD_DISCONNECTED:
@@ -461,6 +459,7 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
         ESP_LOGI(MESH_TAG, "<MESH_EVENT_CHILD_DISCONNECTED>aid:%d, " MACSTR "",
                  child_disconnected->aid,
                  MAC2STR(child_disconnected->mac));
+        topology_mesh_changed();
     }
     break;
     case MESH_EVENT_ROUTING_TABLE_ADD:
@@ -469,6 +468,7 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
         ESP_LOGW(MESH_TAG, "<MESH_EVENT_ROUTING_TABLE_ADD>add %d, new:%d",
                  routing_table->rt_size_change,
                  routing_table->rt_size_new);
+        topology_mesh_changed();
     }
     break;
     case MESH_EVENT_ROUTING_TABLE_REMOVE:
@@ -477,6 +477,7 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
         ESP_LOGW(MESH_TAG, "<MESH_EVENT_ROUTING_TABLE_REMOVE>remove %d, new:%d",
                  routing_table->rt_size_change,
                  routing_table->rt_size_new);
+        topology_mesh_changed();
     }
     break;
     case MESH_EVENT_NO_PARENT_FOUND:
@@ -484,8 +485,10 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
         mesh_event_no_parent_found_t *no_parent = (mesh_event_no_parent_found_t *)event_data;
         ESP_LOGI(MESH_TAG, "<MESH_EVENT_NO_PARENT_FOUND>scan times:%d",
                  no_parent->scan_times);
+        timeline_note_no_parent(no_parent->scan_times);
+        // a warm boot falls back to the full scan
+        fast_boot_on_no_parent(no_parent->scan_times);
     }
-    /* TODO handler for the failure */
     break;
     case MESH_EVENT_PARENT_CONNECTED:
     {
@@ -500,7 +503,10 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
                                                                    : "",
                  MAC2STR(id.addr));
         last_layer = mesh_layer;
+        timeline_stamp(TIMELINE_PHASE_PARENT_CONNECTED);
+        fast_boot_on_parent_connected(&connected->connected, mesh_layer, esp_mesh_is_root());
         mesh_netifs_start(esp_mesh_is_root());
+        topology_mesh_changed();
     }
     break;
     case MESH_EVENT_PARENT_DISCONNECTED:
@@ -522,6 +528,7 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
                  esp_mesh_is_root() ? "<ROOT>" : (mesh_layer == 2) ? "<layer2>"
                                                                    : "");
         last_layer = mesh_layer;
+        topology_mesh_changed();
     }
     break;
     case MESH_EVENT_ROOT_ADDRESS:
@@ -529,6 +536,8 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
         mesh_event_root_address_t *root_addr = (mesh_event_root_address_t *)event_data;
         ESP_LOGI(MESH_TAG, "<MESH_EVENT_ROOT_ADDRESS>root address:" MACSTR "",
                  MAC2STR(root_addr->addr));
+        // a new root knows no node until their next status
+        topology_mesh_changed();
     }
     break;
     case MESH_EVENT_VOTE_STARTED:
@@ -591,9 +600,7 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
         mesh_event_channel_switch_t *channel_switch = (mesh_event_channel_switch_t *)event_data;
         ESP_LOGI(MESH_TAG, "<MESH_EVENT_CHANNEL_SWITCH>new channel:%d", channel_switch->channel);
         // save channel in nvs
-        persistence_handler_t handler = persistence_open(NETWORK_MANAGER_PERSISTENCE_NAMESPACE);
-        persistence_set_u8(handler, "channel", channel_switch->channel);
-        persistence_close(handler);
+        fast_boot_save_router(channel_switch->channel, NULL);
     }
     break;
     case MESH_EVENT_SCAN_DONE:
@@ -620,6 +627,7 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
         mesh_event_find_network_t *find_network = (mesh_event_find_network_t *)event_data;
         ESP_LOGI(MESH_TAG, "<MESH_EVENT_FIND_NETWORK>new channel:%d, router BSSID:" MACSTR "",
                  find_network->channel, MAC2STR(find_network->router_bssid));
+        fast_boot_save_router(find_network->channel, find_network->router_bssid);
     }
     break;
     case MESH_EVENT_ROUTER_SWITCH:
@@ -627,6 +635,7 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
         mesh_event_router_switch_t *router_switch = (mesh_event_router_switch_t *)event_data;
         ESP_LOGI(MESH_TAG, "<MESH_EVENT_ROUTER_SWITCH>new router:%s, channel:%d, " MACSTR "",
                  router_switch->ssid, router_switch->channel, MAC2STR(router_switch->bssid));
+        fast_boot_save_router(router_switch->channel, router_switch->bssid);
     }
     break;
     default:
@@ -640,6 +649,7 @@ void ip_event_handler(void *arg, esp_event_base_t event_base,
     ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
     ESP_LOGI(MESH_TAG, "<IP_EVENT_STA_GOT_IP>IP:" IPSTR, IP2STR(&event->ip_info.ip));
     s_current_ip.addr = event->ip_info.ip.addr;
+    timeline_stamp(TIMELINE_PHASE_GOT_IP);
 #if !CONFIG_MESH_USE_GLOBAL_DNS_IP
     esp_netif_t *netif = event->esp_netif;
     esp_netif_dns_info_t dns;
@@ -647,27 +657,14 @@ void ip_event_handler(void *arg, esp_event_base_t event_base,
     mesh_netif_start_root_ap(esp_mesh_is_root(), dns.ip.u_addr.ip4.addr);
 #endif
 
-    /* Before running the tasks we should try to sync with NTP*/
-    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG_MULTIPLE(2,
-                           ESP_SNTP_SERVER_LIST("time.windows.com", "pool.ntp.org" ) );
-    // config.start = true;                       // start the SNTP service explicitly (after connecting)
-    // config.server_from_dhcp = true;             // accept the NTP offers from DHCP server
-    // config.renew_servers_after_new_IP = true;   // let esp-netif update the configured SNTP server(s) after receiving the DHCP lease
-    // config.index_of_first_server = 1;           // updates from server num 1, leaving server 0 (from DHCP) intact
-    // config.ip_event_to_renew = IP_EVENT_STA_GOT_IP;  // IP event on which we refresh the configuration
+    /* The root syncs with NTP, the rest of the nodes take the time from the root */
+    time_sync_start();
 
-
-    esp_netif_sntp_init(&config);
-    if (esp_netif_sntp_sync_wait(pdMS_TO_TICKS(10000)) != ESP_OK)
-    {
-        ESP_LOGE("[task_suscribers_events]", " Failed to update system time within 10s timeout");
-        esp_restart();
+    static bool is_tasks_starter_created = false;
+    if (!is_tasks_starter_created) {
+        rtos_alloc_transient_task(RTOS_TRANSIENT_TASKS_STARTER, task_start_on_mesh_time, NULL);
+        is_tasks_starter_created = true;
     }
-
-    // Setting the perfomance uptime value
-    set_uptime();
-
-    esp_tasks_runner();
 }
 
 void check_wifi_channel(char * ssid, uint8_t * channel) {
@@ -699,10 +696,9 @@ void check_wifi_channel(char * ssid, uint8_t * channel) {
             ESP_LOGI(MESH_TAG, "Found target SSID: %s on channel: %d", ssid, current_channel);
             if (*channel != current_channel) {
                 ESP_LOGI(MESH_TAG, "Channel changed from %d to %d", *channel, current_channel);
-                persistence_handler_t handler = persistence_open(NETWORK_MANAGER_PERSISTENCE_NAMESPACE);
-                persistence_set_u8(handler, "channel", current_channel);
-                persistence_close(handler);
             }
+            // cache channel and BSSID so the next boot can skip this scan
+            fast_boot_save_router(current_channel, ap_info[i].bssid);
             *channel = current_channel;
             break;
         }
@@ -747,8 +743,14 @@ void app_start(void) {
     /*  crete network interfaces for mesh (only station instance saved for further manipulation, soft AP instance ignored */
     ESP_ERROR_CHECK(mesh_netifs_init(recv_cb));
 
-    // This function check the active channel and changes it if necessary
-    check_wifi_channel(ssid, &channel);    
+    // A warm boot reuses the cached router channel/BSSID, otherwise this function
+    // checks the active channel and changes it if necessary
+    if (fast_boot_init() == FAST_BOOT_WARM) {
+        channel = fast_boot_get_channel();
+    } else {
+        check_wifi_channel(ssid, &channel);
+    }
+    timeline_stamp(TIMELINE_PHASE_WIFI_READY);
 
     /*  wifi initialization */
     wifi_init_config_t config = WIFI_INIT_CONFIG_DEFAULT();
@@ -773,6 +775,7 @@ void app_start(void) {
     cfg.router.ssid_len = strlen(ssid);
     memcpy((uint8_t *)&cfg.router.ssid, ssid, cfg.router.ssid_len);
     memcpy((uint8_t *)&cfg.router.password, pwd, strlen(pwd));
+    fast_boot_apply_config(&cfg);
 
     /* mesh softAP */
     ESP_ERROR_CHECK(esp_mesh_set_ap_authmode(CONFIG_MESH_AP_AUTHMODE));
@@ -781,8 +784,10 @@ void app_start(void) {
     memcpy((uint8_t *)&cfg.mesh_ap.password, CONFIG_MESH_AP_PASSWD,
            strlen(CONFIG_MESH_AP_PASSWD));
     ESP_ERROR_CHECK(esp_mesh_set_config(&cfg));
+    fast_boot_reuse_parent(&cfg);
     /* mesh start */
     ESP_ERROR_CHECK(esp_mesh_start());
+    timeline_stamp(TIMELINE_PHASE_MESH_STARTED);
     ESP_LOGI(MESH_TAG, "mesh starts successfully, heap:%" PRId32 ", %s", esp_get_free_heap_size(),
              esp_mesh_is_root_fixed() ? "root fixed" : "root not fixed");
 
@@ -792,6 +797,15 @@ void app_start(void) {
 }
 
 void app_main(void) {
+#if CONFIG_MESH_HEAP_TRACKING
+    // first so the allocations done at boot are attributed too
+    heap_track_init();
+#endif
+    timeline_init();
+#if CONFIG_MESH_DLOG
+    dlog_init();
+#endif
+    rtos_alloc_report();
     init_config_button();
     init_config_led();
     init_status_led();
@@ -810,7 +824,7 @@ void app_main(void) {
         persistence_handler_t handler = persistence_open(NETWORK_MANAGER_PERSISTENCE_NAMESPACE);
         uint8_t is_configured;
         persistence_err = persistence_get_u8(handler, "configured", &is_configured);
-        xTaskCreate(check_pin_status, "button", 3072, NULL,5,NULL );
+        rtos_alloc_task(RTOS_TASK_BUTTON, check_pin_status, NULL, NULL);
         if (is_configured == CONFIGURED_FLAG) {
             ESP_LOGI(MESH_TAG, "[app_main] The device has been configured");
             status_led_set_blue();
@@ -7,6 +7,7 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 #include "mesh_netif.h"
+#include "rtos_alloc/rtos_alloc.h"
 
 /*******************************************************
  *                Macros
@@ -234,7 +235,7 @@ mesh_netif_driver_t mesh_create_if_driver(bool is_ap, bool is_root) {
 
     if (!receive_task_is_running) {
         receive_task_is_running = true;
-        xTaskCreate(receive_task, "netif rx task", 3072, NULL, 5, NULL);
+        rtos_alloc_task(RTOS_TASK_NETIF_RX, receive_task, NULL, NULL);
     }
 
     // save station mac address to exclude it from routing-table on broadcast
@@ -28,6 +28,11 @@
  *******************************************************/
 typedef void (mesh_raw_recv_cb_t)(mesh_addr_t *from, mesh_data_t *data);
 
+/*******************************************************
+ *                Constants
+ *******************************************************/
+extern const esp_netif_ip_info_t g_mesh_netif_subnet_ip; // mesh subnet IP info (root AP address)
+
 /*******************************************************
  *                Function Declarations
  *******************************************************/
@@ -18,11 +18,13 @@ int disconnectMqttSession( MQTTContext_t * pMqttContext );
  * the top of the file.
  *
  * @param[in] pMqttContext MQTT context pointer.
+ * @param[out] pPacketId Packet identifier of the PUBLISH when a PUBACK is
+ * expected (QoS1), MQTT_PACKET_ID_INVALID otherwise. Can be NULL.
  *
  * @return EXIT_SUCCESS if PUBLISH was successfully sent;
  * EXIT_FAILURE otherwise.
  */
-int publishToTopic( MQTTContext_t * pMqttContext, char * message, char *topic, MQTTQoS_t qos );
+int publishToTopic( MQTTContext_t * pMqttContext, char * message, char *topic, MQTTQoS_t qos, uint16_t * pPacketId );
 
 int publishLoop( MQTTContext_t * pMqttContext, char * message, char *topic);
 
@@ -58,6 +58,8 @@
 
 /* proyect includes */
 #include "../mqtt_queue.h"
+#include "timeline/timeline.h"
+#include "mqtt/latency/mqtt_latency.h"
 
 
 /* POSIX includes. */
@@ -483,7 +485,7 @@ static int unsubscribeFromTopic( MQTTContext_t * pMqttContext );
  * @return EXIT_SUCCESS if PUBLISH was successfully sent;
  * EXIT_FAILURE otherwise.
  */
-int publishToTopic( MQTTContext_t * pMqttContext, char * message, char *topic, MQTTQoS_t qos);
+int publishToTopic( MQTTContext_t * pMqttContext, char * message, char *topic, MQTTQoS_t qos, uint16_t * pPacketId );
 
 /**
  * @brief Function to get the free index at which an outgoing publish
@@ -710,6 +712,8 @@ int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext,
 
         if( tlsStatus == TLS_TRANSPORT_SUCCESS )
         {
+            timeline_stamp( TIMELINE_PHASE_TLS_CONNECTED );
+
             /* A clean MQTT session needs to be created, if there is no session saved
              * in this MQTT client. */
             createCleanSession = ( *pClientSessionPresent == true ) ? false : true;
@@ -718,7 +722,11 @@ int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext,
              * then waits for connection acknowledgment (CONNACK) packet. */
             returnStatus = establishMqttSession( pMqttContext, createCleanSession, pBrokerSessionPresent, clientIdentifier );
 
-            if( returnStatus == EXIT_FAILURE )
+            if( returnStatus == EXIT_SUCCESS )
+            {
+                timeline_stamp( TIMELINE_PHASE_MQTT_CONNECTED );
+            }
+            else
             {
                 /* End TLS session, then close TCP connection. */
                 cleanupESPSecureMgrCerts( pNetworkContext );
@@ -899,38 +907,10 @@ void handleIncomingPublish( MQTTPublishInfo_t * pPublishInfo,
     /* Process incoming Publish. */
     LogInfo( ( "Incoming QOS : %d.", pPublishInfo->qos ) );
 
-    // search for the topic in the hash of suscribed topics
-    // if found, add the message to the queue of the topic
-    // if not found, ignore the message and print a warning
-
-    // copy topic name to a new string
-    // do not use the one from pPublishInfo->pTopicName because it is not null terminated
-    char *topic_ = malloc(pPublishInfo->topicNameLength + 1);
-    memcpy(topic_, pPublishInfo->pTopicName, pPublishInfo->topicNameLength);
-    topic_[pPublishInfo->topicNameLength] = '\0';
-
-    char *message_ = malloc(pPublishInfo->payloadLength + 1);
-    memcpy(message_, pPublishInfo->pPayload, pPublishInfo->payloadLength);
-    message_[pPublishInfo->payloadLength] = '\0';
-    
-    // ESP_LOGI("[handleIncomingPublish]","------>>>> new received topic: %s message: %s \n", topic_,(char *) pPublishInfo->pPayload);
-    SuscriptionTopicsHash_t *topic = suscriber_find_topic(topic_);
-    // ESP_LOGI("[handleIncomingPublish]","------>>>> topic found: %p \n", topic->topic);
-    if (topic != NULL) {
-        // add the message to the queue
-        if (pPublishInfo->payloadLength > 255) {
-            ESP_LOGI("[handleIncomingPublish]", "------>>>> ERROR pPublishInfo->pPayload == 255 \n");
-            return;
-        }
-        ESP_LOGI("[handleIncomingPublish]", "------>>>> add message to queue, topic: %s message: %s \n", topic_, message_);
-        suscriber_add_message(topic_, message_);
-    } else {
-        ESP_LOGW("[handleIncomingPublish]", "Incoming Publish Topic Name: %.*s does not match subscribed topic.",
-                   pPublishInfo->topicNameLength,
-                   pPublishInfo->pTopicName );
-    }
-    free(topic_);
-    free(message_);
+    // the message goes to the queue of its topic, a topic without
+    // suscription is ignored with a warning
+    suscriber_receive_publish(pPublishInfo->pTopicName, pPublishInfo->topicNameLength,
+                              pPublishInfo->pPayload, pPublishInfo->payloadLength);
 }
 
 /*-----------------------------------------------------------*/
@@ -1096,6 +1076,9 @@ static void eventCallback( MQTTContext_t * pMqttContext,
                            packetIdentifier ) );
                 /* Cleanup publish packet when a PUBACK is received. */
                 cleanupOutgoingPublishWithPacketID( packetIdentifier );
+#if CONFIG_MQTT_LATENCY_TRACE
+                mqtt_latency_acked( packetIdentifier );
+#endif
 
                 /* Update the global ACK packet identifier. */
                 globalAckPacketIdentifier = packetIdentifier;
@@ -1289,13 +1272,17 @@ static int unsubscribeFromTopic( MQTTContext_t * pMqttContext ) {
 
 /*-----------------------------------------------------------*/
 
-int publishToTopic( MQTTContext_t * pMqttContext, char * message, char *topic, MQTTQoS_t qos ) {
+int publishToTopic( MQTTContext_t * pMqttContext, char * message, char *topic, MQTTQoS_t qos, uint16_t * pPacketId ) {
     int returnStatus = EXIT_SUCCESS;
     MQTTStatus_t mqttStatus = MQTTSuccess;
     uint8_t publishIndex = MAX_OUTGOING_PUBLISHES;
 
     assert( pMqttContext != NULL );
 
+    if( pPacketId != NULL ) {
+        *pPacketId = MQTT_PACKET_ID_INVALID;
+    }
+
     /* Get the next free index for the outgoing publish. All QoS1 outgoing
      * publishes are stored until a PUBACK is received. These messages are
      * stored for supporting a resend if a network connection is broken before
@@ -1332,6 +1319,10 @@ int publishToTopic( MQTTContext_t * pMqttContext, char * message, char *topic, M
                        outgoingPublishPackets[ publishIndex ].pubInfo.topicNameLength,
                        outgoingPublishPackets[ publishIndex ].pubInfo.pTopicName,
                        outgoingPublishPackets[ publishIndex ].packetId ) );
+
+            if( ( pPacketId != NULL ) && ( qos != MQTTQoS0 ) ) {
+                *pPacketId = outgoingPublishPackets[ publishIndex ].packetId;
+            }
         }
     }
 
@@ -1412,7 +1403,7 @@ int publishLoop( MQTTContext_t * pMqttContext, char * message, char *topic) {
             LogInfo( ( "Sending Publish to the MQTT topic %.*s.",
                        strlen(topic),
                        topic ) );
-            returnStatus = publishToTopic( pMqttContext, message, topic, MQTTQoS1);
+            returnStatus = publishToTopic( pMqttContext, message, topic, MQTTQoS1, NULL );
 
             /* Calling MQTT_ProcessLoop to process incoming publish echo, since
              * application subscribed to the same topic the broker will send
@@ -1614,6 +1605,9 @@ int start_mqtt_connection(MQTTContext_t * mqttContext, NetworkContext_t * xNetwo
 
                 }
             }
+            if( returnStatus == EXIT_SUCCESS ) {
+                timeline_stamp( TIMELINE_PHASE_SUBSCRIBED );
+            }
 
             // /* Calling MQTT_ProcessLoop to process incoming publish echo, since
             //  * application subscribed to the same topic the broker will send
@@ -0,0 +1,222 @@
+#include "mqtt_latency.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+// PUBLISH waiting for their PUBACK, the oldest is given up when it is full
+#define MQTT_LATENCY_PENDING 8
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t unacked;   // only in the ack stage, PUBLISH given up without PUBACK
+    uint32_t buckets[MQTT_LATENCY_BUCKETS];
+} latency_histogram_t;
+
+typedef struct {
+    uint16_t packet_id;
+    uint8_t topic_class;
+    int64_t start_us;
+    int64_t sent_us;
+} latency_pending_t;
+
+// the class of a topic is its type, see create_topic, the last one takes the rest
+static const char *s_class_names[] = { "sensor", "topology", "config", "relay", "diagnostics", "other" };
+#define MQTT_LATENCY_CLASSES (sizeof(s_class_names) / sizeof(s_class_names[0]))
+
+static const char *s_stage_names[MQTT_LATENCY_STAGE_COUNT] = { "capture", "queue", "send", "ack", "total" };
+static const uint32_t s_bounds_ms[MQTT_LATENCY_BUCKETS - 1] = MQTT_LATENCY_BUCKET_BOUNDS_MS;
+
+static latency_histogram_t s_histograms[MQTT_LATENCY_CLASSES][MQTT_LATENCY_STAGE_COUNT];
+static latency_pending_t s_pending[MQTT_LATENCY_PENDING];
+static size_t s_pending_next = 0;
+// the MQTT task adds, the diagnostics task reads and resets
+static portMUX_TYPE s_latency_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+  * Function: topic_class
+  * ----------------------------
+  *   Class of /mesh/[mesh_id]/[type]/... and
+  *   /mesh/[mesh_id]/devices/[device_id]/[type]/...
+  *
+*/
+static uint8_t topic_class(const char *topic) {
+    const char *type = topic;
+    for (int i = 0; i < 3 && type != NULL; i++) {
+        type = strchr(type, '/');
+        if (type != NULL) {
+            type++;
+        }
+    }
+    if (type != NULL && strncmp(type, "devices/", 8) == 0) {
+        type = strchr(type + 8, '/');
+        if (type != NULL) {
+            type++;
+        }
+    }
+    if (type == NULL) {
+        return MQTT_LATENCY_CLASSES - 1;
+    }
+    size_t length = strcspn(type, "/");
+    for (uint8_t i = 0; i < MQTT_LATENCY_CLASSES - 1; i++) {
+        if (strlen(s_class_names[i]) == length && strncmp(type, s_class_names[i], length) == 0) {
+            return i;
+        }
+    }
+    return MQTT_LATENCY_CLASSES - 1;
+}
+
+// the caller holds s_latency_lock
+static void histogram_add(latency_histogram_t *histogram, int64_t latency_us) {
+    if (latency_us < 0) {
+        latency_us = 0;
+    }
+    size_t bucket = 0;
+    while (bucket < MQTT_LATENCY_BUCKETS - 1 && latency_us > (int64_t) s_bounds_ms[bucket] * 1000) {
+        bucket++;
+    }
+    histogram->count++;
+    histogram->sum_us += latency_us;
+    if (latency_us > histogram->max_us) {
+        histogram->max_us = latency_us > UINT32_MAX ? UINT32_MAX : (uint32_t) latency_us;
+    }
+    histogram->buckets[bucket]++;
+}
+
+/*
+  * Function: histogram_percentile
+  * ----------------------------
+  *   Upper bound of the bucket holding the percentile, capped by the maximum
+  *
+  * returns: the percentile in ms
+*/
+static double histogram_percentile(const latency_histogram_t *histogram, double quantile) {
+    double max_ms = histogram->max_us / 1000.0;
+    uint32_t rank = (uint32_t) ceil(quantile * histogram->count);
+    uint32_t cumulative = 0;
+    for (size_t bucket = 0; bucket < MQTT_LATENCY_BUCKETS - 1; bucket++) {
+        cumulative += histogram->buckets[bucket];
+        if (cumulative >= rank) {
+            return s_bounds_ms[bucket] < max_ms ? s_bounds_ms[bucket] : max_ms;
+        }
+    }
+    return max_ms;
+}
+
+/*
+  * Function: mqtt_latency_sent
+  * ----------------------------
+  *   Called by the MQTT task once the PUBLISH of a message is sent
+  *
+  * trace: The stamps carried by the message
+  * topic: The topic of the message, gives its class
+  * packet_id: The packet id when a PUBACK is expected (QoS1), 0 otherwise
+*/
+void mqtt_latency_sent(const mqtt_trace_t *trace, const char *topic, uint16_t packet_id) {
+    int64_t now_us = esp_timer_get_time();
+    uint8_t class = topic_class(topic);
+    // producers that do not trace the capture start at publish
+    int64_t start_us = trace->capture_us != 0 ? trace->capture_us : trace->enqueue_us;
+
+    portENTER_CRITICAL(&s_latency_lock);
+    latency_histogram_t *histograms = s_histograms[class];
+    if (trace->capture_us != 0) {
+        histogram_add(&histograms[MQTT_LATENCY_STAGE_CAPTURE], trace->enqueue_us - trace->capture_us);
+    }
+    histogram_add(&histograms[MQTT_LATENCY_STAGE_QUEUE], trace->dequeue_us - trace->enqueue_us);
+    histogram_add(&histograms[MQTT_LATENCY_STAGE_SEND], now_us - trace->dequeue_us);
+    if (packet_id == 0) {
+        histogram_add(&histograms[MQTT_LATENCY_STAGE_TOTAL], now_us - start_us);
+    } else {
+        latency_pending_t *pending = &s_pending[s_pending_next];
+        s_pending_next = (s_pending_next + 1) % MQTT_LATENCY_PENDING;
+        if (pending->packet_id != 0) {
+            s_histograms[pending->topic_class][MQTT_LATENCY_STAGE_ACK].unacked++;
+        }
+        pending->packet_id = packet_id;
+        pending->topic_class = class;
+        pending->start_us = start_us;
+        pending->sent_us = now_us;
+    }
+    portEXIT_CRITICAL(&s_latency_lock);
+}
+
+/*
+  * Function: mqtt_latency_acked
+  * ----------------------------
+  *   Called by the MQTT event callback when a PUBACK arrives
+  *
+*/
+void mqtt_latency_acked(uint16_t packet_id) {
+    if (packet_id == 0) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&s_latency_lock);
+    for (size_t i = 0; i < MQTT_LATENCY_PENDING; i++) {
+        latency_pending_t *pending = &s_pending[i];
+        if (pending->packet_id == packet_id) {
+            latency_histogram_t *histograms = s_histograms[pending->topic_class];
+            histogram_add(&histograms[MQTT_LATENCY_STAGE_ACK], now_us - pending->sent_us);
+            histogram_add(&histograms[MQTT_LATENCY_STAGE_TOTAL], now_us - pending->start_us);
+            pending->packet_id = 0;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_latency_lock);
+}
+
+/*
+  * Function: mqtt_latency_get_stats
+  * ----------------------------
+  *   Histograms since the previous call, one entry per class and stage with
+  *   messages. The buckets are kept so the nodes can be merged, a p99 can
+  *   not be averaged
+  *
+  * returns: a cJSON array, owned by the caller
+*/
+cJSON * mqtt_latency_get_stats() {
+    cJSON *stats = cJSON_CreateArray();
+    latency_histogram_t (*histograms)[MQTT_LATENCY_STAGE_COUNT] = malloc(sizeof(s_histograms));
+    if (histograms == NULL) {
+        return stats;
+    }
+    portENTER_CRITICAL(&s_latency_lock);
+    memcpy(histograms, s_histograms, sizeof(s_histograms));
+    memset(s_histograms, 0, sizeof(s_histograms));
+    portEXIT_CRITICAL(&s_latency_lock);
+
+    for (size_t class = 0; class < MQTT_LATENCY_CLASSES; class++) {
+        for (size_t stage = 0; stage < MQTT_LATENCY_STAGE_COUNT; stage++) {
+            const latency_histogram_t *histogram = &histograms[class][stage];
+            if (histogram->count == 0 && histogram->unacked == 0) {
+                continue;
+            }
+            cJSON *entry = cJSON_CreateObject();
+            cJSON_AddStringToObject(entry, "class", s_class_names[class]);
+            cJSON_AddStringToObject(entry, "stage", s_stage_names[stage]);
+            cJSON_AddNumberToObject(entry, "count", histogram->count);
+            if (histogram->count != 0) {
+                cJSON_AddNumberToObject(entry, "mean_ms", histogram->sum_us / 1000.0 / histogram->count);
+                cJSON_AddNumberToObject(entry, "p50_ms", histogram_percentile(histogram, 0.50));
+                cJSON_AddNumberToObject(entry, "p90_ms", histogram_percentile(histogram, 0.90));
+                cJSON_AddNumberToObject(entry, "p99_ms", histogram_percentile(histogram, 0.99));
+                cJSON_AddNumberToObject(entry, "max_ms", histogram->max_us / 1000.0);
+            }
+            if (stage == MQTT_LATENCY_STAGE_ACK) {
+                cJSON_AddNumberToObject(entry, "unacked", histogram->unacked);
+            }
+            cJSON *buckets = cJSON_CreateArray();
+            for (size_t bucket = 0; bucket < MQTT_LATENCY_BUCKETS; bucket++) {
+                cJSON_AddItemToArray(buckets, cJSON_CreateNumber(histogram->buckets[bucket]));
+            }
+            cJSON_AddItemToObject(entry, "buckets", buckets);
+            cJSON_AddItemToArray(stats, entry);
+        }
+    }
+    free(histograms);
+    return stats;
+}
@@ -0,0 +1,32 @@
+/*
+*   MQTT latency tracing
+*   Every message carries the time it was captured, queued by publish and
+*   dequeued by the MQTT task (mqtt_trace_t). When the PUBLISH is sent, and
+*   with QoS1 when its PUBACK arrives, the stage latencies are added to a
+*   histogram per stage and per topic class, reported with the diagnostics.
+*/
+#ifndef MQTT_LATENCY_H
+#define MQTT_LATENCY_H
+
+#include <stdint.h>
+#include "cJSON.h"
+#include "mqtt_queue.h"
+
+typedef enum {
+    MQTT_LATENCY_STAGE_CAPTURE = 0, // reading to publish, only for traced producers
+    MQTT_LATENCY_STAGE_QUEUE,       // publish to the MQTT task
+    MQTT_LATENCY_STAGE_SEND,        // MQTT task to PUBLISH written to the TLS socket
+    MQTT_LATENCY_STAGE_ACK,         // PUBLISH sent to PUBACK, only with QoS1
+    MQTT_LATENCY_STAGE_TOTAL,       // capture (or publish) to PUBACK (or sent)
+    MQTT_LATENCY_STAGE_COUNT
+} mqtt_latency_stage_t;
+
+// upper bounds of the histogram buckets in ms, the last bucket has no bound
+#define MQTT_LATENCY_BUCKET_BOUNDS_MS { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000 }
+#define MQTT_LATENCY_BUCKETS 14
+
+void mqtt_latency_sent(const mqtt_trace_t *trace, const char *topic, uint16_t packet_id);
+void mqtt_latency_acked(uint16_t packet_id);
+cJSON * mqtt_latency_get_stats(void);
+
+#endif // MQTT_LATENCY_H
@@ -1,16 +1,23 @@
 #include "mqtt_queue.h"
+#include <stdlib.h>
+#include <string.h>
 #include "esp_log.h"
+#include "performance.h"
+#include "dlog/dlog.h"
+#include "rtos_alloc/rtos_alloc.h"
 
 
-int queueSize = 10;
-int suscriberQueueSize = 3;
-SuscriptionTopicsHash_t *suscription_topics = NULL;
+int queueSize = MQTT_PUBLISHER_QUEUE_LENGTH;
+int suscriberQueueSize = MQTT_SUSCRIBER_QUEUE_LENGTH;
+flat_map_t suscription_topics = { 0 };
 
 // create mutex for suscription_topics
 SemaphoreHandle_t xHashMutex = NULL;
 
 void init_suscriber_hash() {
-    suscription_topics = NULL;
+    if (flat_map_init(&suscription_topics, MQTT_MAX_SUSCRIPTION_TOPICS, sizeof(SuscriptionTopicsHash_t), MQTT_SUSCRIPTION_TOPICS_BYTES) != ESP_OK) {
+        ESP_LOGE("SUSCRIBER", "No memory for the suscription topics");
+    }
     xHashMutex = xSemaphoreCreateMutex();
 }
 
@@ -22,16 +29,18 @@ void init_suscriber_hash() {
 void suscriber_add_topic(char *topic,void (*event_handler)(char* topic, char *message)) {
     SuscriptionTopicsHash_t *s;
     xSemaphoreTake(xHashMutex, portMAX_DELAY);
-    HASH_FIND_STR(suscription_topics, topic, s);  /* id already in the hash? */
+    s = flat_map_find_str(&suscription_topics, topic);  /* id already in the hash? */
     if (s == NULL) {
-        s = (SuscriptionTopicsHash_t *) malloc(sizeof(SuscriptionTopicsHash_t));
-        strcpy(s->topic, topic);
-        s->queue = xQueueCreate(suscriberQueueSize, sizeof(mqtt_message_t));
-        s->event_handler = event_handler;
-        HASH_ADD_STR(suscription_topics, topic, s);
-
-        HASH_FIND_STR(suscription_topics, topic, s);
-        if (s) ESP_LOGI("SUSCRIBER", "topic %s succesfully added to hash", s->topic);
+        s = flat_map_insert_str(&suscription_topics, topic);
+        if (s != NULL) {
+            s->topic = flat_map_str_key(&suscription_topics, s);
+            s->queue = rtos_alloc_queue(RTOS_QUEUE_MQTT_SUSCRIBER);
+            s->event_handler = event_handler;
+            performance_watch_queue(s->topic, s->queue);
+            ESP_LOGI("SUSCRIBER", "topic %s succesfully added to hash", s->topic);
+        } else {
+            ESP_LOGE("SUSCRIBER", "topic %s not added, the hash is full", topic);
+        }
     } else {
         ESP_LOGI("SUSCRIBER", "topic %s already exists in hash", s->topic);
     }
@@ -42,11 +51,8 @@ void suscriber_add_topic(char *topic,void (*event_handler)(char* topic, char *me
 *  Description: Finds a topic in the hash table
 */
 SuscriptionTopicsHash_t * suscriber_find_topic(const char * topic) {
-    xSemaphoreTake(xHashMutex, portMAX_DELAY);
-    SuscriptionTopicsHash_t *s = NULL;
-    HASH_FIND_STR(suscription_topics, topic, s);  /* s: output pointer */
-    xSemaphoreGive(xHashMutex);
-    return s;
+    // the hash is safe to read while a topic is added, no need of the mutex
+    return flat_map_find_str(&suscription_topics, topic);
 }
 
 /* suscriber_get_message
@@ -62,10 +68,10 @@ char * suscriber_get_message(const char *topic) {
         if (s->queue != NULL && available_messages > 0) {
             if ( xQueueReceive(s->queue, &s_message, 10) == pdPASS ) {
                 // ESP_LOG_BUFFER_HEXDUMP("SUSCRIBER", &s_message, sizeof(s_message), ESP_LOG_INFO);
-                ESP_LOGI("[suscriber_get_message]", "Message: %s", s_message.message);
-                ESP_LOGI("[suscriber_get_message]", "Topic: %s", s_message.topic);
-                message = (char *) calloc((sizeof(char)) * MAX_MESSAGE_LENGTH, 1);
-                strcpy(message, s_message.message);
+                DLOG_I("[suscriber_get_message]", "Message: %s", s_message.message);
+                DLOG_I("[suscriber_get_message]", "Topic: %s", s_message.topic);
+                // sized to the message, not to MAX_MESSAGE_LENGTH
+                message = strdup(s_message.message);
             } else {
                 ESP_LOGI("SUSCRIBER", "Failed to receive message from queue");
             }
@@ -79,18 +85,17 @@ char * suscriber_get_message(const char *topic) {
 *  Description: Adds a message to the queue of a topic
 */
 void suscriber_add_message(const char *topic, const char *message) {
-    ESP_LOGI("SUSCRIBER", "Adding message to topic %s", topic);
+    DLOG_I("SUSCRIBER", "Adding message to topic %s", topic);
     SuscriptionTopicsHash_t *s = suscriber_find_topic(topic);
 
     // making a static message so that the queue copies the struct and not the pointer
     mqtt_message_t s_message;
-    // copy message by message_length in msg.message
-    const size_t message_length = strlen(message);
-    strncpy(s_message.message, message, message_length);
+    // the message and the topic are cut to the buffers of the queue item
+    const size_t message_length = strnlen(message, sizeof(s_message.message) - 1);
+    memcpy(s_message.message, message, message_length);
     s_message.message[message_length] = '\0';
-    // copy topic by topic_length in msg.topic
-    const size_t topic_length = strlen(topic);
-    strncpy(s_message.topic, topic, topic_length);
+    const size_t topic_length = strnlen(topic, sizeof(s_message.topic) - 1);
+    memcpy(s_message.topic, topic, topic_length);
     s_message.topic[topic_length] = '\0';
 
     xSemaphoreTake(xHashMutex, portMAX_DELAY);
@@ -99,9 +104,9 @@ void suscriber_add_message(const char *topic, const char *message) {
         ESP_LOGD("[suscriber_add_message]", "--->>>>> pointer message: %p", &message);
         // Note: do not change xTicksToWait because it is a blocking call
         if ( xQueueGenericSend(s->queue, ( void * ) &s_message, 0, queueSEND_TO_BACK) != pdPASS ) {
-            ESP_LOGI("SUSCRIBER", "Failed to send message to queue");
+            DLOG_I("SUSCRIBER", "Failed to send message to queue");
         } else {
-            ESP_LOGI("SUSCRIBER", "Message sent to queue");
+            DLOG_I("SUSCRIBER", "Message sent to queue");
         }
     }
     xSemaphoreGive(xHashMutex);
@@ -113,8 +118,8 @@ void suscriber_add_message(const char *topic, const char *message) {
 void suscriber_delete_topic(SuscriptionTopicsHash_t *s) {
     xSemaphoreTake(xHashMutex, portMAX_DELAY);
     if (s) {
-        HASH_DEL(suscription_topics, s);  /* user: pointer to deletee */
-        free(s);
+        performance_unwatch_queue(s->queue);
+        flat_map_remove(&suscription_topics, s);
     }
     xSemaphoreGive(xHashMutex);
 }
@@ -123,20 +128,85 @@ void suscriber_delete_topic(SuscriptionTopicsHash_t *s) {
 * Description: Returns a list of topics in the hash table
 */
 char ** get_topics_list() {
-    SuscriptionTopicsHash_t *s, *tmp;
-    char **topics = NULL;
+    SuscriptionTopicsHash_t *s;
     int i = 0;
 
     xSemaphoreTake(xHashMutex, portMAX_DELAY);
-    HASH_ITER(hh, suscription_topics, s, tmp) {
-        topics = realloc(topics, (i + 1) * sizeof(char *));
-        topics[i] = s->topic;
+    char **topics = malloc((suscription_topics.count + 1) * sizeof(char *));
+    for (uint32_t index = 0; (s = flat_map_next(&suscription_topics, &index)) != NULL;) {
+        topics[i] = (char *) s->topic;
         i++;
     }
     // end with NULL
-    topics = realloc(topics, (i + 1) * sizeof(char *));
     topics[i] = NULL;
 
     xSemaphoreGive(xHashMutex);
     return topics;
-}
\ No newline at end of file
+}
+
+/* suscriber_receive_publish
+*  Description: Adds an incoming publish to the queue of its topic, the
+*  topic and the payload are not null terminated. A topic without
+*  suscription is ignored
+*/
+void suscriber_receive_publish(const char *topic, size_t topic_length, const char *payload, size_t payload_length) {
+    char *topic_ = malloc(topic_length + 1);
+    memcpy(topic_, topic, topic_length);
+    topic_[topic_length] = '\0';
+
+    char *message_ = malloc(payload_length + 1);
+    memcpy(message_, payload, payload_length);
+    message_[payload_length] = '\0';
+
+    if (suscriber_find_topic(topic_) != NULL) {
+        if (payload_length > 255) {
+            ESP_LOGI("[suscriber_receive_publish]", "------>>>> ERROR payload longer than 255 \n");
+        } else {
+            DLOG_I("[suscriber_receive_publish]", "------>>>> add message to queue, topic: %s message: %s \n", topic_, message_);
+            suscriber_add_message(topic_, message_);
+        }
+    } else {
+        ESP_LOGW("[suscriber_receive_publish]", "Incoming Publish Topic Name: %s does not match subscribed topic.", topic_);
+    }
+    free(topic_);
+    free(message_);
+}
+
+/* suscriber_next_event
+*  Description: Takes the next message of a topic with its event handler
+*  Returns: the event to give to suscriber_run_event, or NULL when the
+*  topic has no message or no handler
+*/
+suscription_event_handler_t * suscriber_next_event(const char *topic) {
+    char *message = suscriber_get_message(topic);
+    if (message == NULL) {
+        return NULL;
+    }
+    SuscriptionTopicsHash_t *s = suscriber_find_topic(topic);
+    if (s == NULL || s->event_handler == NULL) {
+        free(message);
+        return NULL;
+    }
+    DLOG_I("SUSCRIBER", "Received message from topic: %s", topic);
+    DLOG_I("SUSCRIBER", "Message: %s", message);
+    suscription_event_handler_t *event = malloc(sizeof(suscription_event_handler_t));
+    if (event == NULL) {
+        free(message);
+        return NULL;
+    }
+    event->topic = strdup(topic);
+    // the copy made by suscriber_get_message is handed over
+    event->message = message;
+    event->handler = s->event_handler;
+    return event;
+}
+
+/* suscriber_run_event
+*  Description: Runs the event handler and frees the event
+*/
+void suscriber_run_event(suscription_event_handler_t *event) {
+    event->handler(event->topic, event->message);
+    free(event->message);
+    free(event->topic);
+    free(event);
+}
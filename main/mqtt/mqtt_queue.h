@@ -2,34 +2,59 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
-#include "utils/uthash.h" // https://troydhanson.github.io/uthash/userguide.html
+#include "utils/flat_map.h"
 
 #ifndef MQTT_QUEUE_H
 #define MQTT_QUEUE_H
 
+// messages waiting to be published
+#define MQTT_PUBLISHER_QUEUE_LENGTH 10
+// messages waiting for the handler of a suscription topic
+#define MQTT_SUSCRIBER_QUEUE_LENGTH 3
+// suscription topics with a static queue (config, config of the node, relay),
+// a topic beyond them gets its queue from the heap
+#define MQTT_MAX_SUSCRIPTIONS 3
+// suscription topics in the hash, and the bytes of their names
+#define MQTT_MAX_SUSCRIPTION_TOPICS 8
+#define MQTT_SUSCRIPTION_TOPICS_BYTES (MQTT_MAX_SUSCRIPTION_TOPICS * 96)
+
 extern int queueSize;
 extern int suscriberQueueSize;
 #define MAX_TOPIC_LENGTH 255
 #define MAX_MESSAGE_LENGTH 1024
 
 typedef struct {
-    char topic[MAX_TOPIC_LENGTH];                    /* key topic */
+    const char *topic;         /* key topic, interned by the hash */
     QueueHandle_t queue;       /* value */
     void (*event_handler)(char*topic, char *message); /* event handler function pointer */
-    UT_hash_handle hh;         /* makes this structure hashable */
 } SuscriptionTopicsHash_t;
 
-extern SuscriptionTopicsHash_t *suscription_topics;
+extern flat_map_t suscription_topics;
+
+// a received message and the handler of its topic, run by suscriber_run_event
+typedef struct {
+    char *topic;
+    char *message;
+    void (*handler)(char*, char*);
+} suscription_event_handler_t;
 
 
 typedef struct {
     QueueHandle_t mqttPublisherQueue;
-    SuscriptionTopicsHash_t *mqttSuscriberHash;
+    flat_map_t *mqttSuscriberHash;
 } mqtt_queues_t;
 
+// esp_timer_get_time stamps (us) of a message, see mqtt_latency.h
+typedef struct {
+    int64_t capture_us; // 0 when the producer does not trace the capture
+    int64_t enqueue_us;
+    int64_t dequeue_us;
+} mqtt_trace_t;
+
 typedef struct {
     char message[MAX_MESSAGE_LENGTH];
     char topic[MAX_TOPIC_LENGTH];
+    mqtt_trace_t trace;
 } mqtt_message_t;
 
 void init_suscriber_hash();
@@ -40,5 +65,9 @@ SuscriptionTopicsHash_t * suscriber_find_topic(const char* topic);
 void suscriber_delete_topic(SuscriptionTopicsHash_t *s);
 void suscriber_add_message(const char* topic, const char* message);
 char * suscriber_get_message(const char* topic);
+// dispatch of an incoming publish, shared by the MQTT client, the suscribers task and the host bench
+void suscriber_receive_publish(const char *topic, size_t topic_length, const char *payload, size_t payload_length);
+suscription_event_handler_t * suscriber_next_event(const char *topic);
+void suscriber_run_event(suscription_event_handler_t *event);
 
 #endif
\ No newline at end of file
@@ -1,18 +1,86 @@
 
 #include "mqtt_utils.h"
+#include <freertos/task.h>
+#include "esp_timer.h"
+#include "json_arena/json_arena.h"
 
 extern mqtt_queues_t *mqtt_queues;
 extern char *MESH_TAG;
-void publish(const char *topic, const char *message) {
+bool publish(const char *topic, const char *message) {
+    return publish_traced(topic, message, 0);
+}
+
+/*
+  * Function: publish_traced
+  * ----------------------------
+  *   Queues a message for the MQTT task, like publish
+  *
+  * capture_us: esp_timer_get_time of the reading behind the message, the
+  *   latency trace starts there instead of at the queueing
+*/
+bool publish_traced(const char *topic, const char *message, int64_t capture_us) {
     if(mqtt_queues == NULL) {
         ESP_LOGE(MESH_TAG, "Error in publish: mqtt_queues is NULL");
-        return;
+        return false;
+    }
+    // a command out of arena memory may have built a partial answer, it
+    // is answered with an error once the arena is released
+    if (message == NULL || json_arena_failed()) {
+        ESP_LOGE(MESH_TAG, "Error in publish: no message built on %s", topic);
+        return false;
+    }
+    if (strlen(topic) >= MAX_TOPIC_LENGTH || strlen(message) >= MAX_MESSAGE_LENGTH) {
+        ESP_LOGE(MESH_TAG, "Error in publish: message on %s is too long", topic);
+        return false;
     }
     QueueHandle_t publishQueue = mqtt_queues->mqttPublisherQueue;
     mqtt_message_t mqtt_message;
     strcpy(mqtt_message.topic, topic);
     strcpy(mqtt_message.message, message);
-    xQueueSend(publishQueue, &mqtt_message, 0);
+    mqtt_message.trace.capture_us = capture_us;
+    mqtt_message.trace.enqueue_us = esp_timer_get_time();
+    mqtt_message.trace.dequeue_us = 0;
+    return xQueueSend(publishQueue, &mqtt_message, 0) == pdTRUE;
+}
+
+/*
+  * Function: publish_parts
+  * ----------------------------
+  *   Publishes the items of an array in as many messages as needed so that
+  *   every one fits the publisher queue. Each message is a copy of header
+  *   with "part", "parts" and up to per_message items under key. The
+  *   publisher queue is shared and does not wait, the parts are spaced by
+  *   gap_ms. Frees items, not header
+  *
+  * returns: false when a part could not be queued, the next ones are not sent
+*/
+bool publish_parts(const char *topic, const cJSON *header, const char *key, cJSON *items, int per_message, uint32_t gap_ms) {
+    int count = cJSON_GetArraySize(items);
+    int parts = count == 0 ? 1 : (count + per_message - 1) / per_message;
+    bool queued = true;
+    for (int part = 0; part < parts && queued; part++) {
+        cJSON *payload = cJSON_Duplicate(header, 1);
+        cJSON_AddNumberToObject(payload, "part", part);
+        cJSON_AddNumberToObject(payload, "parts", parts);
+        cJSON *chunk = cJSON_CreateArray();
+        for (int i = 0; i < per_message && cJSON_GetArraySize(items) > 0; i++) {
+            cJSON_AddItemToArray(chunk, cJSON_DetachItemFromArray(items, 0));
+        }
+        cJSON_AddItemToObject(payload, key, chunk);
+
+        char *data = cJSON_PrintUnformatted(payload);
+        cJSON_Delete(payload);
+        char *message = create_mqtt_message(data);
+        queued = publish(topic, message);
+        if (!queued) {
+            ESP_LOGW(MESH_TAG, "Part %d of %d on %s not queued", part, parts, topic);
+        }
+        cJSON_free(message);
+        cJSON_free(data);
+        vTaskDelay(pdMS_TO_TICKS(gap_ms));
+    }
+    cJSON_Delete(items);
+    return queued;
 }
 
 cJSON * merge_json_objects(cJSON *a, cJSON *b) {
@@ -73,7 +141,7 @@ char * create_mqtt_message(char *message) {
         return NULL;
     }
 
-    char *new_message = cJSON_PrintUnformatted(merged);
+    char *new_message = cJSON_PrintBuffered(merged, MAX_MESSAGE_LENGTH, false);
     cJSON_Delete(merged);
     return new_message;
 }
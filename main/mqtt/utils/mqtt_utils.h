@@ -11,7 +11,13 @@
 #include "cJSON.h"
 #include "../../mesh_netif/mesh_netif.h"
 
-void publish(const char *topic, const char *message);
+// true if the message was queued, the publisher queue does not wait when it is full.
+// False also for the answers of a command out of json_arena memory
+bool publish(const char *topic, const char *message);
+bool publish_traced(const char *topic, const char *message, int64_t capture_us);
+// an array too large for one message, in parts spaced by gap_ms. Frees items
+bool publish_parts(const char *topic, const cJSON *header, const char *key, cJSON *items, int per_message, uint32_t gap_ms);
+// printed by cJSON, inside a json_arena scope it is released with cJSON_free
 char * create_mqtt_message(char *message);
 char * create_topic(char* topic_type, char* topic_suffix, bool withDeviceIndicator);
 char * create_client_identifier();
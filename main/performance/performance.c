@@ -1,7 +1,67 @@
 #include "performance.h"
+#include <string.h>
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "mqtt/utils/mqtt_utils.h"
+#include "mqtt/latency/mqtt_latency.h"
+#include "heap_track/heap_track.h"
+#include "rtos_alloc/rtos_alloc.h"
+
+#ifndef CONFIG_MESH_DIAGNOSTICS_INTERVAL
+#define CONFIG_MESH_DIAGNOSTICS_INTERVAL 60
+#endif
+
+#define DIAGNOSTICS_TAG "diagnostics"
+// the queue depths are sampled more often than they are published so the
+// high-water marks catch the bursts between two reports
+#define DIAGNOSTICS_SAMPLE_PERIOD_MS 1000
+#define DIAGNOSTICS_PART_GAP_MS 100
+// entries per message, a message has to fit MAX_MESSAGE_LENGTH
+#define DIAGNOSTICS_TASKS_PER_MESSAGE 8
+#define DIAGNOSTICS_QUEUES_PER_MESSAGE 6
+#define DIAGNOSTICS_HEAPS_PER_MESSAGE 4
+#define DIAGNOSTICS_LATENCY_PER_MESSAGE 3
+#define DIAGNOSTICS_HEAP_SITES_PER_MESSAGE 6
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+#define DIAGNOSTICS_TASK_STATS 1
+#else
+#define DIAGNOSTICS_TASK_STATS 0
+#endif
+
+typedef struct {
+    const char *name;
+    QueueHandle_t queue;
+    UBaseType_t max_depth;
+} performance_queue_t;
 
 uint64_t uptime = 0;
 
+static performance_queue_t s_queues[PERFORMANCE_MAX_QUEUES];
+static portMUX_TYPE s_queues_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const struct {
+    const char *name;
+    uint32_t caps;
+} s_heap_caps[] = {
+    { "default", MALLOC_CAP_DEFAULT },
+    { "internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT },
+    { "dma", MALLOC_CAP_DMA },
+    { "spiram", MALLOC_CAP_SPIRAM },
+};
+
+#if CONFIG_MESH_HEAP_TRACKING
+// call stacks in the requested heap report, 0 when none is pending
+static size_t s_heap_report_top = 0;
+#endif
+
+#if DIAGNOSTICS_TASK_STATS
+// previous snapshot of the tasks, the CPU usage is the difference with it
+static performance_task_snapshot_t s_prev_tasks = { 0 };
+#endif
+// sections the publisher queue dropped since the boot
+static uint32_t s_dropped_sections = 0;
+
 void log_memory() {
     uint32_t free_heap_size = 0, min_free_heap_size = 0;
     free_heap_size = esp_get_free_heap_size();
@@ -29,4 +89,305 @@ cJSON* get_memory_stats() {
     cJSON_AddNumberToObject(memory_stats, "free_heap_size", free_heap_size);
     cJSON_AddNumberToObject(memory_stats, "min_free_heap_size", min_free_heap_size);
     return memory_stats;
-}
\ No newline at end of file
+}
+
+/*
+  * Function: performance_heap_size
+  * ----------------------------
+  *   Size of the heap the default malloc uses, it depends on the chip and
+  *   on what the IDF reserves so it is read instead of assumed
+  *
+*/
+size_t performance_heap_size() {
+    return heap_caps_get_total_size(MALLOC_CAP_DEFAULT);
+}
+
+/*
+  * Function: get_heap_stats
+  * ----------------------------
+  *   Free, minimum free and largest free block of every heap capability
+  *   present on the chip. The largest block shows the fragmentation, an
+  *   allocation bigger than it fails even with enough free memory
+  *
+  * returns: a cJSON array, owned by the caller
+*/
+cJSON* get_heap_stats() {
+    cJSON *heaps = cJSON_CreateArray();
+    for (size_t i = 0; i < sizeof(s_heap_caps) / sizeof(s_heap_caps[0]); i++) {
+        size_t total = heap_caps_get_total_size(s_heap_caps[i].caps);
+        if (total == 0) {
+            continue;
+        }
+        multi_heap_info_t info;
+        heap_caps_get_info(&info, s_heap_caps[i].caps);
+        cJSON *heap = cJSON_CreateObject();
+        cJSON_AddStringToObject(heap, "caps", s_heap_caps[i].name);
+        cJSON_AddNumberToObject(heap, "total", total);
+        cJSON_AddNumberToObject(heap, "free", info.total_free_bytes);
+        cJSON_AddNumberToObject(heap, "min_free", info.minimum_free_bytes);
+        cJSON_AddNumberToObject(heap, "largest_free_block", info.largest_free_block);
+        cJSON_AddItemToArray(heaps, heap);
+    }
+    return heaps;
+}
+
+/*
+  * Function: performance_watch_queue
+  * ----------------------------
+  *   Adds a queue to the diagnostics, its depth and high-water mark are
+  *   reported until performance_unwatch_queue
+  *
+  * name: Name in the report, it has to outlive the queue
+  * queue: The queue
+*/
+void performance_watch_queue(const char *name, QueueHandle_t queue) {
+    if (queue == NULL) {
+        return;
+    }
+    portENTER_CRITICAL(&s_queues_lock);
+    for (size_t i = 0; i < PERFORMANCE_MAX_QUEUES; i++) {
+        if (s_queues[i].queue == NULL) {
+            s_queues[i].name = name;
+            s_queues[i].queue = queue;
+            s_queues[i].max_depth = 0;
+            portEXIT_CRITICAL(&s_queues_lock);
+            return;
+        }
+    }
+    portEXIT_CRITICAL(&s_queues_lock);
+    ESP_LOGW(DIAGNOSTICS_TAG, "No room to watch queue %s", name);
+}
+
+/*
+  * Function: performance_unwatch_queue
+  * ----------------------------
+  *   Removes a queue from the diagnostics, before it or its name is freed
+  *
+*/
+void performance_unwatch_queue(QueueHandle_t queue) {
+    portENTER_CRITICAL(&s_queues_lock);
+    for (size_t i = 0; i < PERFORMANCE_MAX_QUEUES; i++) {
+        if (s_queues[i].queue == queue) {
+            s_queues[i].queue = NULL;
+            s_queues[i].name = NULL;
+        }
+    }
+    portEXIT_CRITICAL(&s_queues_lock);
+}
+
+static void sample_queues() {
+    portENTER_CRITICAL(&s_queues_lock);
+    for (size_t i = 0; i < PERFORMANCE_MAX_QUEUES; i++) {
+        if (s_queues[i].queue == NULL) {
+            continue;
+        }
+        UBaseType_t depth = uxQueueMessagesWaiting(s_queues[i].queue);
+        if (depth > s_queues[i].max_depth) {
+            s_queues[i].max_depth = depth;
+        }
+    }
+    portEXIT_CRITICAL(&s_queues_lock);
+}
+
+/*
+  * Function: get_queue_stats
+  * ----------------------------
+  *   Depth, capacity and sampled high-water mark of the watched queues
+  *
+  * returns: a cJSON array, owned by the caller
+*/
+cJSON* get_queue_stats() {
+    performance_queue_t queues[PERFORMANCE_MAX_QUEUES];
+    sample_queues();
+    // the JSON is built outside of the critical section
+    portENTER_CRITICAL(&s_queues_lock);
+    memcpy(queues, s_queues, sizeof(queues));
+    portEXIT_CRITICAL(&s_queues_lock);
+
+    cJSON *stats = cJSON_CreateArray();
+    for (size_t i = 0; i < PERFORMANCE_MAX_QUEUES; i++) {
+        if (queues[i].queue == NULL) {
+            continue;
+        }
+        UBaseType_t depth = uxQueueMessagesWaiting(queues[i].queue);
+        cJSON *queue = cJSON_CreateObject();
+        cJSON_AddStringToObject(queue, "name", queues[i].name);
+        cJSON_AddNumberToObject(queue, "depth", depth);
+        cJSON_AddNumberToObject(queue, "max_depth", queues[i].max_depth);
+        cJSON_AddNumberToObject(queue, "capacity", depth + uxQueueSpacesAvailable(queues[i].queue));
+        cJSON_AddItemToArray(stats, queue);
+    }
+    return stats;
+}
+
+#if DIAGNOSTICS_TASK_STATS
+bool performance_task_snapshot(performance_task_snapshot_t *snapshot) {
+    // some slack in case tasks are created meanwhile
+    UBaseType_t size = uxTaskGetNumberOfTasks() + 4;
+    *snapshot = (performance_task_snapshot_t) { 0 };
+    snapshot->tasks = calloc(size, sizeof(TaskStatus_t));
+    if (snapshot->tasks == NULL) {
+        return false;
+    }
+    snapshot->count = uxTaskGetSystemState(snapshot->tasks, size, &snapshot->total);
+    return true;
+}
+
+void performance_task_snapshot_free(performance_task_snapshot_t *snapshot) {
+    free(snapshot->tasks);
+    *snapshot = (performance_task_snapshot_t) { 0 };
+}
+
+double performance_task_cpu(const performance_task_snapshot_t *before, const performance_task_snapshot_t *after, UBaseType_t index) {
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    // the counters wrap, the differences are taken on 32 bits
+    uint32_t elapsed = (uint32_t) (after->total - before->total) * portNUM_PROCESSORS;
+    if (before->tasks == NULL || elapsed == 0) {
+        return -1;
+    }
+    uint32_t start = 0;
+    for (UBaseType_t j = 0; j < before->count; j++) {
+        if (before->tasks[j].xHandle == after->tasks[index].xHandle) {
+            start = before->tasks[j].ulRunTimeCounter;
+            break;
+        }
+    }
+    return 100.0 * (uint32_t) (after->tasks[index].ulRunTimeCounter - start) / elapsed;
+#else
+    return -1;
+#endif
+}
+
+/*
+  * Function: get_task_stats
+  * ----------------------------
+  *   Priority, free stack (high-water mark, bytes) and CPU usage of every
+  *   task. The CPU usage is over the time since the previous call, it needs
+  *   FREERTOS_GENERATE_RUN_TIME_STATS and is -1 without it
+  *
+  * returns: a cJSON array, owned by the caller
+*/
+static cJSON* get_task_stats() {
+    cJSON *stats = cJSON_CreateArray();
+    performance_task_snapshot_t now;
+    if (!performance_task_snapshot(&now)) {
+        return stats;
+    }
+    for (UBaseType_t i = 0; i < now.count; i++) {
+        cJSON *task = cJSON_CreateObject();
+        cJSON_AddStringToObject(task, "name", now.tasks[i].pcTaskName);
+        cJSON_AddNumberToObject(task, "priority", now.tasks[i].uxCurrentPriority);
+        cJSON_AddNumberToObject(task, "stack_free", now.tasks[i].usStackHighWaterMark);
+        cJSON_AddNumberToObject(task, "cpu", performance_task_cpu(&s_prev_tasks, &now, i));
+        cJSON_AddItemToArray(stats, task);
+    }
+    performance_task_snapshot_free(&s_prev_tasks);
+    s_prev_tasks = now;
+    return stats;
+}
+#endif
+
+/*******************************************************
+ *                Diagnostics report
+ *******************************************************/
+
+/*
+  * Function: diagnostics_publish_section
+  * ----------------------------
+  *   Publishes the items of a section in as many parts as needed so that
+  *   every message fits the publisher queue, the sections dropped by the
+  *   queue are counted. Frees items
+  *
+*/
+static bool diagnostics_publish_section(const char *topic, const char *section, cJSON *items, int per_message) {
+    cJSON *header = cJSON_CreateObject();
+    cJSON_AddStringToObject(header, "section", section);
+    bool queued = publish_parts(topic, header, section, items, per_message, DIAGNOSTICS_PART_GAP_MS);
+    cJSON_Delete(header);
+    if (!queued) {
+        s_dropped_sections++;
+        ESP_LOGW(DIAGNOSTICS_TAG, "Section %s not fully published, %lu sections dropped since the boot",
+                 section, (unsigned long) s_dropped_sections);
+    }
+    return queued;
+}
+
+/*
+  * Function: task_diagnostics
+  * ----------------------------
+  *   Samples the queues every second and publishes the heaps, the queues,
+  *   the tasks and the MQTT latencies every CONFIG_MESH_DIAGNOSTICS_INTERVAL
+  *   seconds on
+  *   /mesh/[mesh_id]/devices/[device_id]/diagnostics
+  *
+*/
+static void task_diagnostics(void *args) {
+    char *topic = create_topic("diagnostics", "", true);
+    uint32_t elapsed_ms = 0;
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(DIAGNOSTICS_SAMPLE_PERIOD_MS));
+        sample_queues();
+#if CONFIG_MESH_HEAP_TRACKING
+        heap_track_sample();
+        size_t heap_report_top = __atomic_exchange_n(&s_heap_report_top, 0, __ATOMIC_RELAXED);
+        if (heap_report_top != 0) {
+            cJSON *summary = cJSON_CreateArray();
+            cJSON_AddItemToArray(summary, heap_track_get_summary());
+            diagnostics_publish_section(topic, "heap_summary", summary, 1);
+            diagnostics_publish_section(topic, "heap_sites", heap_track_get_sites(heap_report_top), DIAGNOSTICS_HEAP_SITES_PER_MESSAGE);
+        }
+#endif
+        elapsed_ms += DIAGNOSTICS_SAMPLE_PERIOD_MS;
+        if (elapsed_ms < CONFIG_MESH_DIAGNOSTICS_INTERVAL * 1000) {
+            continue;
+        }
+        elapsed_ms = 0;
+
+#if CONFIG_MESH_HEAP_TRACKING
+        heap_track_next_window();
+#endif
+
+        diagnostics_publish_section(topic, "heaps", get_heap_stats(), DIAGNOSTICS_HEAPS_PER_MESSAGE);
+        diagnostics_publish_section(topic, "queues", get_queue_stats(), DIAGNOSTICS_QUEUES_PER_MESSAGE);
+#if DIAGNOSTICS_TASK_STATS
+        diagnostics_publish_section(topic, "tasks", get_task_stats(), DIAGNOSTICS_TASKS_PER_MESSAGE);
+#endif
+#if CONFIG_MQTT_LATENCY_TRACE
+        diagnostics_publish_section(topic, "latency", mqtt_latency_get_stats(), DIAGNOSTICS_LATENCY_PER_MESSAGE);
+#endif
+    }
+    free(topic);
+    vTaskDelete(NULL);
+}
+
+#if CONFIG_MESH_HEAP_TRACKING
+/*
+  * Function: performance_request_heap_report
+  * ----------------------------
+  *   Asks the diagnostics task for the heap tracking report, published with
+  *   the diagnostics within a second
+  *
+  * top: Call stacks reported, the biggest first
+*/
+void performance_request_heap_report(size_t top) {
+    __atomic_store_n(&s_heap_report_top, top, __ATOMIC_RELAXED);
+}
+#endif
+
+/*
+  * Function: performance_diagnostics_start
+  * ----------------------------
+  *   Starts the periodic diagnostics report
+  *
+  * returns: ESP_OK or ESP_FAIL if the task could not be created
+*/
+esp_err_t performance_diagnostics_start() {
+#if !DIAGNOSTICS_TASK_STATS
+    ESP_LOGW(DIAGNOSTICS_TAG, "FREERTOS_USE_TRACE_FACILITY is disabled, tasks are not reported");
+#endif
+    if (rtos_alloc_task(RTOS_TASK_DIAGNOSTICS, task_diagnostics, NULL, NULL) != ESP_OK) {
+        ESP_LOGE(DIAGNOSTICS_TAG, "Unable to create the diagnostics task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
@@ -4,10 +4,55 @@
 #include "esp_log.h"
 #include "cJSON.h"
 #include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+// queues whose depth is sampled for the diagnostics
+#define PERFORMANCE_MAX_QUEUES 12
 
 void log_memory(void);
 void set_uptime(void);
 uint64_t get_uptime(void);
 cJSON* get_memory_stats(void);
 
-#endif // PERFOMANCE_H
\ No newline at end of file
+// diagnostics
+void performance_watch_queue(const char *name, QueueHandle_t queue);
+void performance_unwatch_queue(QueueHandle_t queue);
+size_t performance_heap_size(void);
+cJSON* get_heap_stats(void);
+cJSON* get_queue_stats(void);
+esp_err_t performance_diagnostics_start(void);
+void performance_request_heap_report(size_t top);
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+// the tasks and their run time counters at an instant
+typedef struct {
+    TaskStatus_t *tasks;
+    UBaseType_t count;
+    configRUN_TIME_COUNTER_TYPE total;
+} performance_task_snapshot_t;
+
+/*
+  * Function: performance_task_snapshot
+  * ----------------------------
+  *   Takes the state of every task, released with performance_task_snapshot_free
+  *
+  *   returns: false without memory, the snapshot is then empty
+*/
+bool performance_task_snapshot(performance_task_snapshot_t *snapshot);
+void performance_task_snapshot_free(performance_task_snapshot_t *snapshot);
+
+/*
+  * Function: performance_task_cpu
+  * ----------------------------
+  *   Share of the CPU time of all the cores used by after->tasks[index]
+  *   since before, a task created meanwhile counts from 0
+  *
+  *   returns: a percentage, -1 without FREERTOS_GENERATE_RUN_TIME_STATS or
+  *            an empty before snapshot
+*/
+double performance_task_cpu(const performance_task_snapshot_t *before, const performance_task_snapshot_t *after, UBaseType_t index);
+#endif
+
+#endif // PERFOMANCE_H
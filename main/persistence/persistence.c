@@ -1,30 +1,64 @@
 #include "persistence.h"
 
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "rtos_alloc/rtos_alloc.h"
+
+static persistence_err_t persistence_cache_init(void);
+static void cache_drop(const char *namespace);
+
 persistence_err_t persistence_init(void) {
     esp_err_t err = nvs_flash_init();
-    return err == ESP_OK ? INITIALIZED_PERSISTENCE : UNABLE_INITIALIZE_PERSISTENCE;
+    if (err != ESP_OK) {
+        return UNABLE_INITIALIZE_PERSISTENCE;
+    }
+    if (persistence_cache_init() != PERSISTENCE_OP_OK) {
+        ESP_LOGE(PERSISTENCE_TAG, "Unable to start the write-back cache");
+        return UNABLE_INITIALIZE_PERSISTENCE;
+    }
+    return INITIALIZED_PERSISTENCE;
 }
 
 
 persistence_err_t persistence_erase_all(void) {
-    ESP_ERROR_CHECK(nvs_flash_erase());
-    return PERSISTENCE_OP_OK;
+    cache_drop(NULL);
+    esp_err_t err = nvs_flash_erase();
+    if (err != ESP_OK) {
+        ESP_LOGE(PERSISTENCE_TAG, "Unable to erase the NVS: %s", esp_err_to_name(err));
+    }
+    return err == ESP_OK ? PERSISTENCE_OP_OK : PERSISTENCE_OP_FAIL;
 }
 
 
 persistence_err_t persistence_erase_namespace(char *namespace) {
+    cache_drop(namespace);
     nvs_handle_t nvs_handle;
-    ESP_ERROR_CHECK(nvs_open(namespace, NVS_READWRITE, &nvs_handle));
-    ESP_ERROR_CHECK(nvs_erase_all(nvs_handle));
-    nvs_commit(nvs_handle);
-    nvs_close(nvs_handle);
-    return PERSISTENCE_OP_OK;
+    esp_err_t err = nvs_open(namespace, NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK) {
+        err = nvs_erase_all(nvs_handle);
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(PERSISTENCE_TAG, "Unable to erase %s: %s", namespace, esp_err_to_name(err));
+    }
+    return err == ESP_OK ? PERSISTENCE_OP_OK : PERSISTENCE_OP_FAIL;
 }
 
 
+// returns 0 on failure, the getters and setters then fail with an invalid handle
 persistence_handler_t persistence_open(char *namespace) {
     nvs_handle_t nvs_handle;
-    ESP_ERROR_CHECK(nvs_open(namespace, NVS_READWRITE, &nvs_handle));
+    esp_err_t err = nvs_open(namespace, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(PERSISTENCE_TAG, "Unable to open %s: %s", namespace, esp_err_to_name(err));
+        return 0;
+    }
     return (persistence_handler_t) nvs_handle;
 }
 
@@ -42,6 +76,9 @@ persistence_err_t persistence_get_str(persistence_handler_t handler, const char
     size_t nvs_str_size;
 
     esp_err_t err = nvs_get_str(nvs_handle, key, NULL, &nvs_str_size);
+    if (err != ESP_OK) {
+        return PERSISTENCE_OP_FAIL;
+    }
     *value = (char*) malloc(nvs_str_size * sizeof(char));
     err = nvs_get_str(nvs_handle, key, *value, &nvs_str_size);
     return err == ESP_OK ? PERSISTENCE_OP_OK : PERSISTENCE_OP_FAIL;
@@ -67,3 +104,290 @@ persistence_err_t persistence_get_u8(persistence_handler_t handler, const char *
     esp_err_t err = nvs_get_u8(nvs_handle, key, value);
     return err == ESP_OK ? PERSISTENCE_OP_OK : PERSISTENCE_OP_FAIL;
 }
+
+
+persistence_err_t persistence_set_blob(persistence_handler_t handler, const char *key, const void *value, size_t length) {
+    nvs_handle_t nvs_handle = (nvs_handle_t) handler;
+    esp_err_t err = nvs_set_blob(nvs_handle, key, value, length);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    return err == ESP_OK ? PERSISTENCE_OP_OK : PERSISTENCE_OP_FAIL;
+}
+
+
+persistence_err_t persistence_get_blob(persistence_handler_t handler, const char *key, void *value, size_t length) {
+    nvs_handle_t nvs_handle = (nvs_handle_t) handler;
+    size_t nvs_blob_size = length;
+    // a stored blob of a different size is treated as missing
+    esp_err_t err = nvs_get_blob(nvs_handle, key, NULL, &nvs_blob_size);
+    if (err != ESP_OK || nvs_blob_size != length) {
+        return PERSISTENCE_OP_FAIL;
+    }
+    err = nvs_get_blob(nvs_handle, key, value, &nvs_blob_size);
+    return err == ESP_OK ? PERSISTENCE_OP_OK : PERSISTENCE_OP_FAIL;
+}
+
+
+/*******************************************************
+ *                Write-back cache
+ *******************************************************/
+
+#ifndef CONFIG_PERSISTENCE_CACHE_ENTRIES
+#define CONFIG_PERSISTENCE_CACHE_ENTRIES 16
+#endif
+#ifndef CONFIG_PERSISTENCE_FLUSH_DELAY
+#define CONFIG_PERSISTENCE_FLUSH_DELAY 2000
+#endif
+#ifndef CONFIG_PERSISTENCE_FLUSH_MAX_DELAY
+#define CONFIG_PERSISTENCE_FLUSH_MAX_DELAY 10000
+#endif
+
+typedef enum {
+    CACHE_ENTRY_FREE = 0,
+    CACHE_ENTRY_U8,
+    CACHE_ENTRY_BLOB
+} cache_entry_type_t;
+
+typedef struct {
+    cache_entry_type_t type;
+    char namespace[NVS_NS_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    void *value;
+    size_t length;
+    bool dirty;
+} cache_entry_t;
+
+static cache_entry_t s_cache[CONFIG_PERSISTENCE_CACHE_ENTRIES];
+static SemaphoreHandle_t s_cache_lock = NULL;
+static TaskHandle_t s_flush_task = NULL;
+
+static cache_entry_t * cache_find(const char *namespace, const char *key) {
+    for (size_t i = 0; i < CONFIG_PERSISTENCE_CACHE_ENTRIES; i++) {
+        if (s_cache[i].type != CACHE_ENTRY_FREE && strcmp(s_cache[i].namespace, namespace) == 0
+                && strcmp(s_cache[i].key, key) == 0) {
+            return &s_cache[i];
+        }
+    }
+    return NULL;
+}
+
+// drops the entries of a namespace (all of them if NULL), an erase must not be undone by a flush
+static void cache_drop(const char *namespace) {
+    if (s_cache_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    for (size_t i = 0; i < CONFIG_PERSISTENCE_CACHE_ENTRIES; i++) {
+        if (s_cache[i].type != CACHE_ENTRY_FREE && (namespace == NULL || strcmp(s_cache[i].namespace, namespace) == 0)) {
+            free(s_cache[i].value);
+            memset(&s_cache[i], 0, sizeof(cache_entry_t));
+        }
+    }
+    xSemaphoreGive(s_cache_lock);
+}
+
+// stores a value in the cache, must be called with s_cache_lock held
+static persistence_err_t cache_store(cache_entry_type_t type, const char *namespace, const char *key,
+        const void *value, size_t length, bool dirty) {
+    if (strlen(namespace) >= NVS_NS_NAME_MAX_SIZE || strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        ESP_LOGE(PERSISTENCE_TAG, "Namespace %s or key %s too long", namespace, key);
+        return PERSISTENCE_OP_FAIL;
+    }
+    cache_entry_t *entry = cache_find(namespace, key);
+    if (entry == NULL) {
+        for (size_t i = 0; i < CONFIG_PERSISTENCE_CACHE_ENTRIES && entry == NULL; i++) {
+            if (s_cache[i].type == CACHE_ENTRY_FREE) {
+                entry = &s_cache[i];
+            }
+        }
+        if (entry == NULL) {
+            ESP_LOGE(PERSISTENCE_TAG, "Cache full, %s/%s not stored", namespace, key);
+            return PERSISTENCE_OP_FAIL;
+        }
+        strcpy(entry->namespace, namespace);
+        strcpy(entry->key, key);
+    } else if (entry->length == length && memcmp(entry->value, value, length) == 0) {
+        // same value, nothing to write
+        return PERSISTENCE_OP_OK;
+    }
+    if (entry->length != length) {
+        void *buffer = realloc(entry->value, length);
+        if (buffer == NULL) {
+            ESP_LOGE(PERSISTENCE_TAG, "No memory to cache %s/%s", namespace, key);
+            return PERSISTENCE_OP_FAIL;
+        }
+        entry->value = buffer;
+        entry->length = length;
+    }
+    memcpy(entry->value, value, length);
+    entry->type = type;
+    entry->dirty = entry->dirty || dirty;
+    return PERSISTENCE_OP_OK;
+}
+
+static persistence_err_t cache_set(cache_entry_type_t type, const char *namespace, const char *key,
+        const void *value, size_t length) {
+    if (s_cache_lock == NULL) {
+        return PERSISTENCE_OP_FAIL;
+    }
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    persistence_err_t err = cache_store(type, namespace, key, value, length, true);
+    xSemaphoreGive(s_cache_lock);
+    if (err == PERSISTENCE_OP_OK) {
+        // restarts the quiet period of the flush task
+        xTaskNotifyGive(s_flush_task);
+    }
+    return err;
+}
+
+static persistence_err_t cache_get(cache_entry_type_t type, const char *namespace, const char *key,
+        void *value, size_t length) {
+    if (s_cache_lock == NULL) {
+        return PERSISTENCE_OP_FAIL;
+    }
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    persistence_err_t err = PERSISTENCE_OP_FAIL;
+    cache_entry_t *entry = cache_find(namespace, key);
+    if (entry != NULL) {
+        if (entry->type == type && entry->length == length) {
+            memcpy(value, entry->value, length);
+            err = PERSISTENCE_OP_OK;
+        }
+        xSemaphoreGive(s_cache_lock);
+        return err;
+    }
+
+    // miss, read NVS once and keep the value for the next reads
+    nvs_handle_t nvs_handle;
+    if (nvs_open(namespace, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        esp_err_t nvs_err;
+        if (type == CACHE_ENTRY_U8) {
+            nvs_err = nvs_get_u8(nvs_handle, key, (uint8_t *) value);
+        } else {
+            size_t nvs_blob_size = 0;
+            nvs_err = nvs_get_blob(nvs_handle, key, NULL, &nvs_blob_size);
+            if (nvs_err == ESP_OK && nvs_blob_size != length) {
+                nvs_err = ESP_ERR_NVS_INVALID_LENGTH;
+            }
+            if (nvs_err == ESP_OK) {
+                nvs_err = nvs_get_blob(nvs_handle, key, value, &nvs_blob_size);
+            }
+        }
+        nvs_close(nvs_handle);
+        if (nvs_err == ESP_OK) {
+            cache_store(type, namespace, key, value, length, false);
+            err = PERSISTENCE_OP_OK;
+        }
+    }
+    xSemaphoreGive(s_cache_lock);
+    return err;
+}
+
+persistence_err_t persistence_cached_set_u8(const char *namespace, const char *key, uint8_t value) {
+    return cache_set(CACHE_ENTRY_U8, namespace, key, &value, sizeof(value));
+}
+
+persistence_err_t persistence_cached_get_u8(const char *namespace, const char *key, uint8_t *value) {
+    return cache_get(CACHE_ENTRY_U8, namespace, key, value, sizeof(*value));
+}
+
+persistence_err_t persistence_cached_set_blob(const char *namespace, const char *key, const void *value, size_t length) {
+    return cache_set(CACHE_ENTRY_BLOB, namespace, key, value, length);
+}
+
+persistence_err_t persistence_cached_get_blob(const char *namespace, const char *key, void *value, size_t length) {
+    return cache_get(CACHE_ENTRY_BLOB, namespace, key, value, length);
+}
+
+persistence_err_t persistence_flush(void) {
+    if (s_cache_lock == NULL) {
+        return PERSISTENCE_OP_OK;
+    }
+    persistence_err_t result = PERSISTENCE_OP_OK;
+    bool flushed[CONFIG_PERSISTENCE_CACHE_ENTRIES] = { 0 };
+
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    for (size_t i = 0; i < CONFIG_PERSISTENCE_CACHE_ENTRIES; i++) {
+        if (flushed[i] || s_cache[i].type == CACHE_ENTRY_FREE || !s_cache[i].dirty) {
+            continue;
+        }
+        // one open and one commit for every dirty entry of the namespace
+        const char *namespace = s_cache[i].namespace;
+        nvs_handle_t nvs_handle;
+        esp_err_t err = nvs_open(namespace, NVS_READWRITE, &nvs_handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(PERSISTENCE_TAG, "Unable to open %s: %s", namespace, esp_err_to_name(err));
+            result = PERSISTENCE_OP_FAIL;
+            continue;
+        }
+        size_t written = 0;
+        for (size_t j = i; j < CONFIG_PERSISTENCE_CACHE_ENTRIES; j++) {
+            cache_entry_t *entry = &s_cache[j];
+            if (entry->type == CACHE_ENTRY_FREE || !entry->dirty || strcmp(entry->namespace, namespace) != 0) {
+                continue;
+            }
+            flushed[j] = true;
+            if (entry->type == CACHE_ENTRY_U8) {
+                err = nvs_set_u8(nvs_handle, entry->key, *(uint8_t *) entry->value);
+            } else {
+                err = nvs_set_blob(nvs_handle, entry->key, entry->value, entry->length);
+            }
+            if (err != ESP_OK) {
+                ESP_LOGE(PERSISTENCE_TAG, "Unable to write %s/%s: %s", namespace, entry->key, esp_err_to_name(err));
+                result = PERSISTENCE_OP_FAIL;
+                continue;
+            }
+            entry->dirty = false;
+            written++;
+        }
+        err = nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(PERSISTENCE_TAG, "Unable to commit %s: %s", namespace, esp_err_to_name(err));
+            result = PERSISTENCE_OP_FAIL;
+        } else {
+            ESP_LOGI(PERSISTENCE_TAG, "Flushed %zu entries of %s", written, namespace);
+        }
+    }
+    xSemaphoreGive(s_cache_lock);
+    return result;
+}
+
+static void task_persistence_flush(void *args) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // waits for a quiet period, a burst of writes ends in a single flush
+        TickType_t first_write = xTaskGetTickCount();
+        while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_PERSISTENCE_FLUSH_DELAY)) != 0) {
+            if (xTaskGetTickCount() - first_write >= pdMS_TO_TICKS(CONFIG_PERSISTENCE_FLUSH_MAX_DELAY)) {
+                break;
+            }
+        }
+        if (persistence_flush() != PERSISTENCE_OP_OK) {
+            // the failed entries are still dirty, retried after the next quiet period
+            xTaskNotifyGive(s_flush_task);
+        }
+    }
+}
+
+static void persistence_shutdown_handler(void) {
+    persistence_flush();
+}
+
+static persistence_err_t persistence_cache_init(void) {
+    if (s_cache_lock != NULL) {
+        return PERSISTENCE_OP_OK;
+    }
+    s_cache_lock = xSemaphoreCreateMutex();
+    if (s_cache_lock == NULL) {
+        return PERSISTENCE_OP_FAIL;
+    }
+    if (rtos_alloc_task(RTOS_TASK_PERSISTENCE_FLUSH, task_persistence_flush, NULL, &s_flush_task) != ESP_OK) {
+        vSemaphoreDelete(s_cache_lock);
+        s_cache_lock = NULL;
+        return PERSISTENCE_OP_FAIL;
+    }
+    esp_register_shutdown_handler(persistence_shutdown_handler);
+    return PERSISTENCE_OP_OK;
+}
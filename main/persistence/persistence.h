@@ -4,6 +4,8 @@
 #include "esp_log.h"
 #include "nvs_flash.h"
 
+#define PERSISTENCE_TAG "persistence"
+
 typedef uint32_t persistence_handler_t;
 typedef enum {
     UNABLE_INITIALIZE_PERSISTENCE = 0,
@@ -21,5 +23,32 @@ persistence_err_t persistence_get_str(persistence_handler_t handler, const char
 persistence_err_t persistence_set_str(persistence_handler_t handler, const char *key, const char *value);
 persistence_err_t persistence_set_u8(persistence_handler_t handler, const char *key, uint8_t value);
 persistence_err_t persistence_get_u8(persistence_handler_t handler, const char *key, uint8_t *value);
+persistence_err_t persistence_set_blob(persistence_handler_t handler, const char *key, const void *value, size_t length);
+persistence_err_t persistence_get_blob(persistence_handler_t handler, const char *key, void *value, size_t length);
+
+/*
+  * Write-back cache
+  * ----------------------------
+  *   The writes are kept in RAM and marked dirty, a flush task writes them
+  *   once no write happened for CONFIG_PERSISTENCE_FLUSH_DELAY (or after
+  *   CONFIG_PERSISTENCE_FLUSH_MAX_DELAY of continuous writes), with a single
+  *   open and commit per namespace. The dirty entries are also flushed by
+  *   esp_restart. A failed write stays dirty and is retried on the next flush.
+  *
+  *   Values written through the cache must be read through the cache.
+*/
+persistence_err_t persistence_cached_set_u8(const char *namespace, const char *key, uint8_t value);
+persistence_err_t persistence_cached_get_u8(const char *namespace, const char *key, uint8_t *value);
+persistence_err_t persistence_cached_set_blob(const char *namespace, const char *key, const void *value, size_t length);
+persistence_err_t persistence_cached_get_blob(const char *namespace, const char *key, void *value, size_t length);
+
+/*
+  * Function: persistence_flush
+  * ----------------------------
+  *   Writes the dirty entries now
+  *
+  *   returns: PERSISTENCE_OP_FAIL if any entry could not be written
+*/
+persistence_err_t persistence_flush(void);
 
 #endif // PERSISTENCE_H
\ No newline at end of file
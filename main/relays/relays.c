@@ -1,17 +1,83 @@
 #include "relays.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "time_sync/time_sync.h"
 
 
 typedef struct relays {
     int id;
     char * name;
     int pin;
-    int onTimeTaskActive; // 1 if the onTime task is active, 0 if the onTime task is not active
-    size_t onTimeFinish; // epoch time when the onTime task should finish
+    esp_timer_handle_t timer; // runs the scheduled action
+    int actionState; // state set by the scheduled action, -1 if nothing is scheduled
+    int64_t actionDue; // esp_timer_get_time when the scheduled action runs
+    int onTimeActive; // 1 if the scheduled action ends an onTime pulse
 } relays_t;
 
 relays_t **relaysConfig;
 size_t RELAYS_LEN = 0;
 
+// serializes the commands and the timer callbacks on the action slots
+static SemaphoreHandle_t relays_lock = NULL;
+
+static relays_t * find_relay(int relay_id) {
+    for (size_t i = 0; relaysConfig != NULL && relaysConfig[i] != NULL; i++) {
+        if (relaysConfig[i]->id == relay_id) {
+            return relaysConfig[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+  * Function: relay_timer_callback
+  * ----------------------------
+  *   Runs the scheduled action of a relay, from the esp_timer task
+  *
+*/
+static void relay_timer_callback(void *args) {
+    relays_t *relay = (relays_t *) args;
+    xSemaphoreTake(relays_lock, portMAX_DELAY);
+    // a command may have moved or cancelled the action while the callback waited for the lock
+    if (relay->actionState != -1 && esp_timer_get_time() >= relay->actionDue) {
+        gpio_set_level(relay->pin, relay->actionState);
+        ESP_LOGI("[relay_timer_callback]", "Relay id: %d set to %d by its scheduled action", relay->id, relay->actionState);
+        relay->actionState = -1;
+        relay->onTimeActive = 0;
+    }
+    xSemaphoreGive(relays_lock);
+}
+
+/*
+  * Function: schedule_action
+  * ----------------------------
+  *   Replaces the action slot of a relay, the relays lock is held
+  *
+*/
+static void schedule_action(relays_t *relay, int state, int64_t delay_us, int onTime) {
+    esp_timer_stop(relay->timer);
+    relay->actionState = state;
+    relay->actionDue = esp_timer_get_time() + delay_us;
+    relay->onTimeActive = onTime;
+    esp_timer_start_once(relay->timer, delay_us);
+}
+
+static void cancel_action(relays_t *relay) {
+    esp_timer_stop(relay->timer);
+    relay->actionState = -1;
+    relay->onTimeActive = 0;
+}
+
+// epoch time of the scheduled action of a relay, 0 if nothing is scheduled
+static time_t action_epoch(const relays_t *relay) {
+    if (relay->actionState == -1) {
+        return 0;
+    }
+    time_t now;
+    time(&now);
+    return now + (relay->actionDue - esp_timer_get_time() + 500000) / 1000000;
+}
+
 /* 
   * Function: add_relay
   * ----------------------------
@@ -23,8 +89,10 @@ void add_relay(char *name, int pin) {
     new_relay->name = name;
     new_relay->id = RELAYS_LEN + 1;
     new_relay->pin = pin;
-    new_relay->onTimeTaskActive = 0;
-    new_relay->onTimeFinish = 0;
+    new_relay->timer = NULL;
+    new_relay->actionState = -1;
+    new_relay->actionDue = 0;
+    new_relay->onTimeActive = 0;
     // relaysConfig is a null terminated array
     relaysConfig = realloc(relaysConfig, (RELAYS_LEN + 2) * sizeof(relays_t *));
     relaysConfig[RELAYS_LEN] = new_relay;
@@ -36,7 +104,7 @@ void add_relay(char *name, int pin) {
 /* 
   * Function: relay_init
   * ----------------------------
-  *   Initialize the relay pins
+  *   Initialize the relay pins and the timers of their scheduled actions
   *
 */
 void relay_init() {
@@ -44,8 +112,22 @@ void relay_init() {
         ESP_LOGI("[relay_init]", "No relays configured");
         return;
     }
+    if (relays_lock == NULL) {
+        relays_lock = xSemaphoreCreateMutex();
+    }
     for(size_t i = 0; relaysConfig[i] != NULL; i++) {
         int pin = relaysConfig[i]->pin;
+        if (relaysConfig[i]->timer == NULL) {
+            const esp_timer_create_args_t timer_args = {
+                .callback = relay_timer_callback,
+                .arg = relaysConfig[i],
+                .dispatch_method = ESP_TIMER_TASK,
+                .name = "relay",
+            };
+            if (esp_timer_create(&timer_args, &relaysConfig[i]->timer) != ESP_OK) {
+                ESP_LOGE("[relay_init]", "Unable to create the timer of relay %s", relaysConfig[i]->name);
+            }
+        }
         // Configure GPIO pin as output
         gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT);
 
@@ -73,8 +155,13 @@ cJSON* get_relay_state() {
         cJSON_AddStringToObject(relay, "name", relaysConfig[i]->name);
         ESP_LOGI("[get_relay_state]", "Relay id: %d, pin: %d name: %s, state: %d", relaysConfig[i]->id, relaysConfig[i]->pin, relaysConfig[i]->name, gpio_get_level(relaysConfig[i]->pin));
         cJSON_AddNumberToObject(relay, "state", gpio_get_level(relaysConfig[i]->pin));
-        cJSON_AddNumberToObject(relay, "onTimeActive", relaysConfig[i]->onTimeTaskActive);
-        cJSON_AddNumberToObject(relay, "onTimeFinish", relaysConfig[i]->onTimeFinish);
+        xSemaphoreTake(relays_lock, portMAX_DELAY);
+        time_t action_at = action_epoch(relaysConfig[i]);
+        cJSON_AddNumberToObject(relay, "onTimeActive", relaysConfig[i]->onTimeActive);
+        cJSON_AddNumberToObject(relay, "onTimeFinish", relaysConfig[i]->onTimeActive ? action_at : 0);
+        cJSON_AddNumberToObject(relay, "scheduledState", relaysConfig[i]->actionState);
+        cJSON_AddNumberToObject(relay, "scheduledAt", action_at);
+        xSemaphoreGive(relays_lock);
         cJSON_AddItemToArray(relays, relay);
     }
     return relays;
@@ -83,96 +170,120 @@ cJSON* get_relay_state() {
 /*
   * Function: set_relay_state
   * ----------------------------
-  *   Set the state of the relays
+  *   Set the state of a relay now, the action scheduled on it is cancelled
   *
-  *   returns: cJSON object with the state of the relays
+  *   returns: RELAY_OK, RELAY_NOT_FOUND or RELAY_INVALID_STATE
 */
 int set_relay_state(int relay_id, int state) {
-    
-    // get relay id from relaysConfig
-    int relay_index = -1;
-    for(size_t i = 0; relaysConfig[i] != NULL; i++) {
-        if (relaysConfig[i]->id == relay_id) {
-            relay_index = i;
-            break;
-        }
-    }
-    if (relay_index == -1) {
-        return -1;
+    relays_t *relay = find_relay(relay_id);
+    if (relay == NULL) {
+        return RELAY_NOT_FOUND;
     }
     if ( state != 0 && state != 1) {
-        return -2;
+        return RELAY_INVALID_STATE;
     }
     ESP_LOGI("[set_relay_state]", "Relay id: %d set to %d", relay_id, state);
-    gpio_set_level(relaysConfig[relay_index]->pin, state);
-    return 0;
+    xSemaphoreTake(relays_lock, portMAX_DELAY);
+    cancel_action(relay);
+    gpio_set_level(relay->pin, state);
+    xSemaphoreGive(relays_lock);
+    return RELAY_OK;
 }
 
 /*
-  * Function: get_on_time_status
+  * Function: relay_pulse
   * ----------------------------
-  *   Get the status of the onTime task for a relay
+  *   Turns a relay on and off again after onTime milliseconds. A pulse
+  *   sent while another one runs restarts it with the new duration.
   *
-  *   returns: 1 if the task is active, 0 if the task is not active, -1 if the relay is not found
+  *   returns: RELAY_OK or RELAY_NOT_FOUND
 */
-int get_on_time_status(int relay_id) {
-    for (size_t i = 0; relaysConfig[i] != NULL; i++) {
-        if (relaysConfig[i]->id == relay_id) {
-            return relaysConfig[i]->onTimeTaskActive;
-        }
+int relay_pulse(int relay_id, size_t onTime) {
+    relays_t *relay = find_relay(relay_id);
+    if (relay == NULL) {
+        return RELAY_NOT_FOUND;
     }
-    return -1;
+    xSemaphoreTake(relays_lock, portMAX_DELAY);
+    gpio_set_level(relay->pin, 1);
+    schedule_action(relay, 0, (int64_t) onTime * 1000, 1);
+    xSemaphoreGive(relays_lock);
+    ESP_LOGI("[relay_pulse]", "Relay id: %d on for %zu milliseconds", relay_id, onTime);
+    return RELAY_OK;
 }
 
 /*
-  * Function: set_on_time_status
+  * Function: relay_schedule
   * ----------------------------
-  *   Set the status of the onTime task for a relay
-  *   The onTime task will finish after onTime milliseconds
+  *   Sets the state of a relay at an epoch time (seconds), needs the
+  *   synchronised clock
   *
+  *   returns: RELAY_OK, RELAY_NOT_FOUND, RELAY_INVALID_STATE,
+  *            RELAY_CLOCK_NOT_SYNCED or RELAY_TIME_PASSED
 */
-void set_on_time_status(int relay_id, size_t onTime) {
-    for (size_t i = 0; relaysConfig[i] != NULL; i++) {
-        if (relaysConfig[i]->id == relay_id) {
-            relaysConfig[i]->onTimeTaskActive = 1;
-            time_t now;
-            time(&now);
-            relaysConfig[i]->onTimeFinish = now + onTime/1000;
-            return;
-        }
+int relay_schedule(int relay_id, int state, time_t at) {
+    relays_t *relay = find_relay(relay_id);
+    if (relay == NULL) {
+        return RELAY_NOT_FOUND;
+    }
+    if (state != 0 && state != 1) {
+        return RELAY_INVALID_STATE;
     }
+    if (!time_sync_is_synced()) {
+        return RELAY_CLOCK_NOT_SYNCED;
+    }
+    time_t now;
+    time(&now);
+    if (at <= now) {
+        return RELAY_TIME_PASSED;
+    }
+    xSemaphoreTake(relays_lock, portMAX_DELAY);
+    schedule_action(relay, state, (int64_t) (at - now) * 1000000, 0);
+    xSemaphoreGive(relays_lock);
+    ESP_LOGI("[relay_schedule]", "Relay id: %d set to %d at %lld", relay_id, state, (long long) at);
+    return RELAY_OK;
 }
 
 /*
-  * Function: release_on_time_status
+  * Function: relay_extend
   * ----------------------------
-  *   Release the status of the onTime task for a relay
+  *   Delays the scheduled action of a relay by extra milliseconds
   *
+  *   returns: RELAY_OK, RELAY_NOT_FOUND or RELAY_NOT_SCHEDULED
 */
-void release_on_time_status(int relay_id) {
-    for (size_t i = 0; relaysConfig[i] != NULL; i++) {
-        if (relaysConfig[i]->id == relay_id) {
-            relaysConfig[i]->onTimeTaskActive = 0;
-            relaysConfig[i]->onTimeFinish = 0;
-            return;
-        }
+int relay_extend(int relay_id, size_t extra) {
+    relays_t *relay = find_relay(relay_id);
+    if (relay == NULL) {
+        return RELAY_NOT_FOUND;
+    }
+    int status = RELAY_NOT_SCHEDULED;
+    xSemaphoreTake(relays_lock, portMAX_DELAY);
+    if (relay->actionState != -1) {
+        int64_t delay_us = relay->actionDue - esp_timer_get_time() + (int64_t) extra * 1000;
+        schedule_action(relay, relay->actionState, delay_us > 0 ? delay_us : 0, relay->onTimeActive);
+        status = RELAY_OK;
     }
+    xSemaphoreGive(relays_lock);
+    return status;
 }
 
 /*
-  * Function: onTimeTask
+  * Function: relay_cancel
   * ----------------------------
-  *   Task to turn off the relay after a certain time
+  *   Drops the scheduled action of a relay, the relay keeps its state
   *
+  *   returns: RELAY_OK, RELAY_NOT_FOUND or RELAY_NOT_SCHEDULED
 */
-void onTimeTask(void *args) {
-    struct onTimeTaskArgs *task_args = (struct onTimeTaskArgs *) args;
-    set_relay_state(task_args->relay_id, 1);
-    set_on_time_status(task_args->relay_id, task_args->onTime);
-    vTaskDelay(task_args->onTime / portTICK_PERIOD_MS);
-    set_relay_state(task_args->relay_id, 0);
-    release_on_time_status(task_args->relay_id);
-    ESP_LOGI("[onTimeTask]", "Relay id: %d turned off after %d milliseconds", task_args->relay_id, task_args->onTime);
-    free(task_args);
-    vTaskDelete(NULL);
-}
\ No newline at end of file
+int relay_cancel(int relay_id) {
+    relays_t *relay = find_relay(relay_id);
+    if (relay == NULL) {
+        return RELAY_NOT_FOUND;
+    }
+    int status = RELAY_NOT_SCHEDULED;
+    xSemaphoreTake(relays_lock, portMAX_DELAY);
+    if (relay->actionState != -1) {
+        cancel_action(relay);
+        status = RELAY_OK;
+    }
+    xSemaphoreGive(relays_lock);
+    return status;
+}
@@ -1,6 +1,7 @@
 #ifndef RELAYS_H
 #define RELAYS_H
 
+#include <time.h>
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "cJSON.h"
@@ -22,14 +23,23 @@ void relay_init();
 cJSON* get_relay_state();
 int set_relay_state(int relay_id, int state);
 
-// struct related to onTime Feature for relays
-typedef struct onTimeTaskArgs {
-  int relay_id;
-  int onTime;
-} onTimeTaskArgs_t;
-void onTimeTask(void *args);
-int get_on_time_status(int relay_id);
-void set_on_time_status(int relay_id, size_t onTime);
-void release_on_time_status(int relay_id);
+// results of the relay writes
+#define RELAY_OK 0
+#define RELAY_NOT_FOUND -1
+#define RELAY_INVALID_STATE -2
+#define RELAY_NOT_SCHEDULED -3
+#define RELAY_CLOCK_NOT_SYNCED -4
+#define RELAY_TIME_PASSED -5
+
+/*
+  * Every relay has one action slot run by its esp_timer: the end of an
+  * onTime pulse or a state scheduled at an absolute time. A new pulse or
+  * schedule replaces the pending action, a direct write with
+  * set_relay_state cancels it.
+*/
+int relay_pulse(int relay_id, size_t onTime);
+int relay_schedule(int relay_id, int state, time_t at);
+int relay_extend(int relay_id, size_t extra);
+int relay_cancel(int relay_id);
 
 #endif // RELAYS_H
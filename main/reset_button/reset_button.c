@@ -1,4 +1,5 @@
 #include "./reset_button.h"
+#include "rtos_alloc/rtos_alloc.h"
 
 // Global variables to track the button state
 bool last_status_is_pressed = false;
@@ -55,7 +56,7 @@ void check_pin_status(void *arg) {
                 // Button was just pressed
                 ESP_LOGI(MESH_TAG, "[check_pin_status] >>> Button press detected <<<");
                 pressed_start_time = now;
-                xTaskCreate(blink_config_led, "blink_config_led", 1024, (void *) led_ctrl, 5, NULL);
+                rtos_alloc_transient_task(RTOS_TRANSIENT_BLINK_CONFIG_LED, blink_config_led, (void *) led_ctrl);
             } else if (now - pressed_start_time >= press_duration) {
                 // Button has been pressed for `press_duration` seconds
                 ESP_LOGI(MESH_TAG, "[check_pin_status] >>> Button press duration met <<<");
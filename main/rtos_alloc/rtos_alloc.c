@@ -0,0 +1,257 @@
+#include "rtos_alloc.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+
+#define RTOS_ALLOC_TAG "rtos_alloc"
+
+// subsystems of the report, see rtos_alloc_specs.h
+#define RTOS_ALLOC_MAX_SUBSYSTEMS 16
+
+#define STACK_WORDS(stack) (((stack) + sizeof(StackType_t) - 1) / sizeof(StackType_t))
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef struct {
+    const char *name;
+    const char *subsystem;
+    uint32_t stack;
+    UBaseType_t priority;
+    uint8_t instances;
+} task_spec_t;
+
+typedef struct {
+    const char *subsystem;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    uint8_t instances;
+} queue_spec_t;
+
+typedef struct {
+    const char *subsystem;
+    size_t size;
+    RingbufferType_t type;
+    uint8_t instances;
+} ringbuf_spec_t;
+
+typedef struct {
+    const char *name;
+    const char *subsystem;
+    uint32_t stack;
+    UBaseType_t priority;
+} transient_spec_t;
+
+typedef struct {
+    const char *name;
+    size_t bytes;
+    int tasks;
+    int queues;
+} subsystem_budget_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+#define TASK_SPEC(id, subsystem, name, stack, priority, instances) \
+    [RTOS_TASK_##id] = { name, #subsystem, STACK_WORDS(stack) * sizeof(StackType_t), priority, instances },
+#define QUEUE_SPEC(id, subsystem, length, item_size, instances) \
+    [RTOS_QUEUE_##id] = { #subsystem, length, item_size, instances },
+#define RINGBUF_SPEC(id, subsystem, size, type, instances) \
+    [RTOS_RINGBUF_##id] = { #subsystem, size, type, instances },
+#define TRANSIENT_SPEC(id, subsystem, name, stack, priority) \
+    [RTOS_TRANSIENT_##id] = { name, #subsystem, stack, priority },
+
+static const task_spec_t s_tasks[] = { RTOS_ALLOC_TASKS(TASK_SPEC) };
+static const queue_spec_t s_queues[] = { RTOS_ALLOC_QUEUES(QUEUE_SPEC) };
+static const ringbuf_spec_t s_ringbufs[] = { RTOS_ALLOC_RINGBUFS(RINGBUF_SPEC) };
+static const transient_spec_t s_transients[] = { RTOS_ALLOC_TRANSIENT_TASKS(TRANSIENT_SPEC) };
+
+// instances created so far
+static uint8_t s_tasks_used[RTOS_TASK_MAX];
+
+#if CONFIG_MESH_STATIC_ALLOCATION
+static uint8_t s_queues_used[RTOS_QUEUE_MAX];
+static uint8_t s_ringbufs_used[RTOS_RINGBUF_MAX];
+
+/*
+  * Every array gets its own input section .rtos_static.<subsystem>.<array>,
+  * main/linker.lf places them together in DRAM and tools/memory_budget.py
+  * adds them up per subsystem from the map file.
+*/
+#define RTOS_STATIC(subsystem, array) __attribute__((section(".rtos_static." #subsystem "." #array)))
+
+#define TASK_STORAGE(id, subsystem, name, stack, priority, instances) \
+    static StackType_t s_stack_##id[instances][STACK_WORDS(stack)] RTOS_STATIC(subsystem, stack_##id) __attribute__((aligned(16))); \
+    static StaticTask_t s_tcb_##id[instances] RTOS_STATIC(subsystem, tcb_##id);
+#define QUEUE_STORAGE(id, subsystem, length, item_size, instances) \
+    static uint8_t s_queue_storage_##id[instances][(length) * (item_size)] RTOS_STATIC(subsystem, queue_storage_##id) __attribute__((aligned(4))); \
+    static StaticQueue_t s_queue_##id[instances] RTOS_STATIC(subsystem, queue_##id);
+#define RINGBUF_STORAGE(id, subsystem, size, type, instances) \
+    static uint8_t s_ringbuf_storage_##id[instances][size] RTOS_STATIC(subsystem, ringbuf_storage_##id) __attribute__((aligned(4))); \
+    static StaticRingbuffer_t s_ringbuf_##id[instances] RTOS_STATIC(subsystem, ringbuf_##id);
+
+RTOS_ALLOC_TASKS(TASK_STORAGE)
+RTOS_ALLOC_QUEUES(QUEUE_STORAGE)
+RTOS_ALLOC_RINGBUFS(RINGBUF_STORAGE)
+
+#define TASK_STACKS(id, subsystem, name, stack, priority, instances) [RTOS_TASK_##id] = &s_stack_##id[0][0],
+#define TASK_TCBS(id, subsystem, name, stack, priority, instances) [RTOS_TASK_##id] = s_tcb_##id,
+#define QUEUE_STORAGES(id, subsystem, length, item_size, instances) [RTOS_QUEUE_##id] = &s_queue_storage_##id[0][0],
+#define QUEUE_BUFFERS(id, subsystem, length, item_size, instances) [RTOS_QUEUE_##id] = s_queue_##id,
+#define RINGBUF_STORAGES(id, subsystem, size, type, instances) [RTOS_RINGBUF_##id] = &s_ringbuf_storage_##id[0][0],
+#define RINGBUF_BUFFERS(id, subsystem, size, type, instances) [RTOS_RINGBUF_##id] = s_ringbuf_##id,
+
+static StackType_t * const s_task_stacks[] = { RTOS_ALLOC_TASKS(TASK_STACKS) };
+static StaticTask_t * const s_task_tcbs[] = { RTOS_ALLOC_TASKS(TASK_TCBS) };
+static uint8_t * const s_queue_storages[] = { RTOS_ALLOC_QUEUES(QUEUE_STORAGES) };
+static StaticQueue_t * const s_queue_buffers[] = { RTOS_ALLOC_QUEUES(QUEUE_BUFFERS) };
+static uint8_t * const s_ringbuf_storages[] = { RTOS_ALLOC_RINGBUFS(RINGBUF_STORAGES) };
+static StaticRingbuffer_t * const s_ringbuf_buffers[] = { RTOS_ALLOC_RINGBUFS(RINGBUF_BUFFERS) };
+
+// SURROUND(rtos_static) in main/linker.lf
+extern uint8_t _rtos_static_start;
+extern uint8_t _rtos_static_end;
+#endif
+
+/*******************************************************
+ *                Creation
+ *******************************************************/
+
+// index of the next instance of id, past the instances of the spec once the pool is exhausted
+static uint8_t next_instance(uint8_t *used) {
+    return __atomic_fetch_add(used, 1, __ATOMIC_RELAXED);
+}
+
+esp_err_t rtos_alloc_task_with_stack(rtos_task_id_t id, uint32_t stack, TaskFunction_t code, void *arg, TaskHandle_t *handle) {
+    const task_spec_t *spec = &s_tasks[id];
+    uint8_t instance = next_instance(&s_tasks_used[id]);
+    char name[configMAX_TASK_NAME_LEN];
+    if (spec->instances > 1) {
+        snprintf(name, sizeof(name), "%s %d", spec->name, instance);
+    } else {
+        snprintf(name, sizeof(name), "%s", spec->name);
+    }
+
+    TaskHandle_t task = NULL;
+#if CONFIG_MESH_STATIC_ALLOCATION
+    if (instance < spec->instances && stack <= spec->stack) {
+        StackType_t *stack_buffer = s_task_stacks[id] + instance * (spec->stack / sizeof(StackType_t));
+        task = xTaskCreateStatic(code, name, spec->stack / sizeof(StackType_t), arg, spec->priority,
+                                 stack_buffer, &s_task_tcbs[id][instance]);
+    } else {
+        ESP_LOGW(RTOS_ALLOC_TAG, "No static slot for task %s (%lu bytes of stack), created on the heap",
+                 name, (unsigned long) stack);
+    }
+#endif
+    if (task == NULL && xTaskCreate(code, name, stack / sizeof(StackType_t), arg, spec->priority, &task) != pdPASS) {
+        ESP_LOGE(RTOS_ALLOC_TAG, "Unable to create the task %s", name);
+        return ESP_ERR_NO_MEM;
+    }
+    if (handle != NULL) {
+        *handle = task;
+    }
+    return ESP_OK;
+}
+
+esp_err_t rtos_alloc_task(rtos_task_id_t id, TaskFunction_t code, void *arg, TaskHandle_t *handle) {
+    return rtos_alloc_task_with_stack(id, s_tasks[id].stack, code, arg, handle);
+}
+
+esp_err_t rtos_alloc_transient_task(rtos_transient_id_t id, TaskFunction_t code, void *arg) {
+    const transient_spec_t *spec = &s_transients[id];
+    if (xTaskCreate(code, spec->name, spec->stack / sizeof(StackType_t), arg, spec->priority, NULL) != pdPASS) {
+        ESP_LOGE(RTOS_ALLOC_TAG, "Unable to create the task %s", spec->name);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+QueueHandle_t rtos_alloc_queue(rtos_queue_id_t id) {
+    const queue_spec_t *spec = &s_queues[id];
+#if CONFIG_MESH_STATIC_ALLOCATION
+    uint8_t instance = next_instance(&s_queues_used[id]);
+    if (instance < spec->instances) {
+        uint8_t *storage = s_queue_storages[id] + (size_t) instance * spec->length * spec->item_size;
+        return xQueueCreateStatic(spec->length, spec->item_size, storage, &s_queue_buffers[id][instance]);
+    }
+    ESP_LOGW(RTOS_ALLOC_TAG, "No static slot for %s queue %d, created on the heap", spec->subsystem, id);
+#endif
+    return xQueueCreate(spec->length, spec->item_size);
+}
+
+RingbufHandle_t rtos_alloc_ringbuf(rtos_ringbuf_id_t id) {
+    const ringbuf_spec_t *spec = &s_ringbufs[id];
+#if CONFIG_MESH_STATIC_ALLOCATION
+    uint8_t instance = next_instance(&s_ringbufs_used[id]);
+    if (instance < spec->instances) {
+        uint8_t *storage = s_ringbuf_storages[id] + (size_t) instance * spec->size;
+        return xRingbufferCreateStatic(spec->size, spec->type, storage, &s_ringbuf_buffers[id][instance]);
+    }
+    ESP_LOGW(RTOS_ALLOC_TAG, "No static slot for %s ring buffer %d, created on the heap", spec->subsystem, id);
+#endif
+    return xRingbufferCreate(spec->size, spec->type);
+}
+
+/*******************************************************
+ *                Report
+ *******************************************************/
+
+static subsystem_budget_t * budget_of(subsystem_budget_t *budgets, int *count, const char *subsystem) {
+    for (int i = 0; i < *count; i++) {
+        if (strcmp(budgets[i].name, subsystem) == 0) {
+            return &budgets[i];
+        }
+    }
+    if (*count == RTOS_ALLOC_MAX_SUBSYSTEMS) {
+        return &budgets[*count - 1];
+    }
+    budgets[*count] = (subsystem_budget_t) { .name = subsystem };
+    return &budgets[(*count)++];
+}
+
+void rtos_alloc_report(void) {
+    subsystem_budget_t budgets[RTOS_ALLOC_MAX_SUBSYSTEMS];
+    int count = 0;
+    size_t total = 0;
+
+    for (int i = 0; i < RTOS_TASK_MAX; i++) {
+        subsystem_budget_t *budget = budget_of(budgets, &count, s_tasks[i].subsystem);
+        size_t bytes = (size_t) s_tasks[i].instances * (s_tasks[i].stack + sizeof(StaticTask_t));
+        budget->bytes += bytes;
+        budget->tasks += s_tasks[i].instances;
+        total += bytes;
+    }
+    for (int i = 0; i < RTOS_QUEUE_MAX; i++) {
+        subsystem_budget_t *budget = budget_of(budgets, &count, s_queues[i].subsystem);
+        size_t bytes = (size_t) s_queues[i].instances * (s_queues[i].length * s_queues[i].item_size + sizeof(StaticQueue_t));
+        budget->bytes += bytes;
+        budget->queues += s_queues[i].instances;
+        total += bytes;
+    }
+    for (int i = 0; i < RTOS_RINGBUF_MAX; i++) {
+        subsystem_budget_t *budget = budget_of(budgets, &count, s_ringbufs[i].subsystem);
+        size_t bytes = (size_t) s_ringbufs[i].instances * (s_ringbufs[i].size + sizeof(StaticRingbuffer_t));
+        budget->bytes += bytes;
+        budget->queues += s_ringbufs[i].instances;
+        total += bytes;
+    }
+
+#if CONFIG_MESH_STATIC_ALLOCATION
+    ESP_LOGI(RTOS_ALLOC_TAG, "Long-lived tasks and queues, reserved at link time:");
+#else
+    ESP_LOGI(RTOS_ALLOC_TAG, "Long-lived tasks and queues, allocated on the heap:");
+#endif
+    for (int i = 0; i < count; i++) {
+        ESP_LOGI(RTOS_ALLOC_TAG, "  %-12s %6u bytes, %d tasks, %d queues",
+                 budgets[i].name, (unsigned) budgets[i].bytes, budgets[i].tasks, budgets[i].queues);
+    }
+    ESP_LOGI(RTOS_ALLOC_TAG, "  %-12s %6u bytes", "total", (unsigned) total);
+#if CONFIG_MESH_STATIC_ALLOCATION
+    ESP_LOGI(RTOS_ALLOC_TAG, "  .rtos_static section %u bytes", (unsigned) (&_rtos_static_end - &_rtos_static_start));
+#endif
+    for (int i = 0; i < RTOS_TRANSIENT_MAX; i++) {
+        ESP_LOGI(RTOS_ALLOC_TAG, "  %-12s %6lu bytes of heap while %s runs",
+                 s_transients[i].subsystem, (unsigned long) s_transients[i].stack, s_transients[i].name);
+    }
+}
@@ -0,0 +1,105 @@
+/*
+*   Task and queue allocation
+*   Creates the long-lived tasks, queues and ring buffers listed in
+*   rtos_alloc_specs.h. With CONFIG_MESH_STATIC_ALLOCATION their memory is
+*   reserved at link time in the .rtos_static section (xTaskCreateStatic,
+*   xQueueCreateStatic), so the RAM they take is known before the node boots
+*   and the heap only serves the short-lived allocations. A create beyond the
+*   instances of its spec, or a stack bigger than the spec, falls back to the
+*   heap with a warning. Without it everything is allocated on the heap with
+*   the sizes of the table.
+*/
+#ifndef RTOS_ALLOC_H
+#define RTOS_ALLOC_H
+
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/ringbuf.h>
+#include "esp_err.h"
+#include "rtos_alloc/rtos_alloc_specs.h"
+
+#define RTOS_ALLOC_TASK_ID(id, subsystem, name, stack, priority, instances) RTOS_TASK_##id,
+#define RTOS_ALLOC_QUEUE_ID(id, subsystem, length, item_size, instances) RTOS_QUEUE_##id,
+#define RTOS_ALLOC_RINGBUF_ID(id, subsystem, size, type, instances) RTOS_RINGBUF_##id,
+#define RTOS_ALLOC_TRANSIENT_ID(id, subsystem, name, stack, priority) RTOS_TRANSIENT_##id,
+
+typedef enum {
+    RTOS_ALLOC_TASKS(RTOS_ALLOC_TASK_ID)
+    RTOS_TASK_MAX
+} rtos_task_id_t;
+
+typedef enum {
+    RTOS_ALLOC_QUEUES(RTOS_ALLOC_QUEUE_ID)
+    RTOS_QUEUE_MAX
+} rtos_queue_id_t;
+
+typedef enum {
+    RTOS_ALLOC_RINGBUFS(RTOS_ALLOC_RINGBUF_ID)
+    RTOS_RINGBUF_MAX
+} rtos_ringbuf_id_t;
+
+typedef enum {
+    RTOS_ALLOC_TRANSIENT_TASKS(RTOS_ALLOC_TRANSIENT_ID)
+    RTOS_TRANSIENT_MAX
+} rtos_transient_id_t;
+
+/*
+  * Function: rtos_alloc_task
+  * ----------------------------
+  *   Creates the task id of the table with its name, stack and priority.
+  *   The instances of a pool are named "<name> <n>".
+  *
+  *   handle: the created task, may be NULL
+  *
+  *   returns: ESP_OK or ESP_ERR_NO_MEM
+*/
+esp_err_t rtos_alloc_task(rtos_task_id_t id, TaskFunction_t code, void *arg, TaskHandle_t *handle);
+
+/*
+  * Function: rtos_alloc_task_with_stack
+  * ----------------------------
+  *   rtos_alloc_task with a stack only known at run time. The task runs on
+  *   its static slot when the stack fits the one of the table, else on the
+  *   heap.
+  *
+*/
+esp_err_t rtos_alloc_task_with_stack(rtos_task_id_t id, uint32_t stack, TaskFunction_t code, void *arg, TaskHandle_t *handle);
+
+/*
+  * Function: rtos_alloc_transient_task
+  * ----------------------------
+  *   Creates a short-lived task of the table on the heap
+  *
+  *   returns: ESP_OK or ESP_ERR_NO_MEM
+*/
+esp_err_t rtos_alloc_transient_task(rtos_transient_id_t id, TaskFunction_t code, void *arg);
+
+/*
+  * Function: rtos_alloc_queue
+  * ----------------------------
+  *   returns: a queue with the length and item size of the table, NULL
+  *            when out of memory
+*/
+QueueHandle_t rtos_alloc_queue(rtos_queue_id_t id);
+
+/*
+  * Function: rtos_alloc_ringbuf
+  * ----------------------------
+  *   returns: a ring buffer with the size and type of the table, NULL
+  *            when out of memory
+*/
+RingbufHandle_t rtos_alloc_ringbuf(rtos_ringbuf_id_t id);
+
+/*
+  * Function: rtos_alloc_report
+  * ----------------------------
+  *   Logs the RAM the table takes per subsystem and the size of the
+  *   .rtos_static section, tools/memory_budget.py prints the same from the
+  *   map file at build time
+  *
+*/
+void rtos_alloc_report(void);
+
+#endif // RTOS_ALLOC_H
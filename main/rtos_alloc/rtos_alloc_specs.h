@@ -0,0 +1,90 @@
+/*
+*   Long-lived tasks and queues
+*   The only place where the stack, priority and length of the tasks and
+*   queues that live until the node restarts are set. One line per task or
+*   queue, instances is how many of them run at the same time (0 when the
+*   feature is disabled). With CONFIG_MESH_STATIC_ALLOCATION their stacks,
+*   control blocks and storage are reserved in the .rtos_static section at
+*   link time, tools/memory_budget.py reports the RAM of every subsystem
+*   after each build.
+*
+*   Stacks are in bytes, as xTaskCreate takes them on ESP-IDF.
+*/
+#ifndef RTOS_ALLOC_SPECS_H
+#define RTOS_ALLOC_SPECS_H
+
+#include <freertos/FreeRTOS.h>
+#include "mqtt/mqtt_queue.h"
+#include "time_sync/time_sync.h"
+
+#ifndef CONFIG_MESH_DLOG_BUFFER_SIZE
+#define CONFIG_MESH_DLOG_BUFFER_SIZE 4096
+#endif
+#ifndef CONFIG_SENSOR_SCHEDULER_MAX_JOBS
+#define CONFIG_SENSOR_SCHEDULER_MAX_JOBS 32
+#endif
+#ifndef CONFIG_SENSOR_SCHEDULER_WORKERS
+#define CONFIG_SENSOR_SCHEDULER_WORKERS 2
+#endif
+#ifndef CONFIG_SENSOR_SCHEDULER_WORKER_STACK
+#define CONFIG_SENSOR_SCHEDULER_WORKER_STACK 4096
+#endif
+
+#if CONFIG_MESH_DLOG
+#define RTOS_ALLOC_DLOG 1
+#else
+#define RTOS_ALLOC_DLOG 0
+#endif
+#if CONFIG_MESH_DIAGNOSTICS
+#define RTOS_ALLOC_DIAGNOSTICS 1
+#else
+#define RTOS_ALLOC_DIAGNOSTICS 0
+#endif
+#if CONFIG_MESH_BENCHMARK_ENABLE
+#define RTOS_ALLOC_BENCHMARK 1
+#else
+#define RTOS_ALLOC_BENCHMARK 0
+#endif
+
+// X(id, subsystem, name, stack, priority, instances)
+#define RTOS_ALLOC_TASKS(X) \
+    X(DLOG,              logging,     "dlog",                               3072, tskIDLE_PRIORITY + 1, RTOS_ALLOC_DLOG) \
+    X(ROUTING_TABLE,     mesh,        "mqtt routing-table",                 2048, 5, 1) \
+    X(NETIF_RX,          mesh,        "netif rx task",                      3072, 5, 1) \
+    X(TIME_SYNC,         mesh,        "time sync",                          3072, 5, 1) \
+    X(TOPOLOGY,          mesh,        "topology",                           3072, 5, 1) \
+    X(MQTT_CLIENT,       mqtt,        "mqtt task-aws",                      8096, 5, 1) \
+    X(SUSCRIBERS,        mqtt,        "Task that reads suscription events", 8096, 5, 1) \
+    X(NOTIFY_DEVICE,     mqtt,        "Notify new device",                  3072, 5, 1) \
+    X(SENSOR_DISPATCHER, sensors,     "sensor dispatcher",                  2048, 5, 1) \
+    X(SENSOR_WORKER,     sensors,     "sensor worker",                      CONFIG_SENSOR_SCHEDULER_WORKER_STACK, 5, CONFIG_SENSOR_SCHEDULER_WORKERS) \
+    X(PERSISTENCE_FLUSH, storage,     "persistence flush",                  3072, 4, 1) \
+    X(BUTTON,            ui,          "button",                             3072, 5, 1) \
+    X(DIAGNOSTICS,       diagnostics, "diagnostics",                        3072, 4, RTOS_ALLOC_DIAGNOSTICS) \
+    X(BENCH_SINK,        diagnostics, "bench sink",                         3072, 4, RTOS_ALLOC_BENCHMARK)
+
+// X(id, subsystem, length, item size, instances)
+#define RTOS_ALLOC_QUEUES(X) \
+    X(MQTT_PUBLISHER,    mqtt,        MQTT_PUBLISHER_QUEUE_LENGTH,      sizeof(mqtt_message_t),     1) \
+    X(MQTT_SUSCRIBER,    mqtt,        MQTT_SUSCRIBER_QUEUE_LENGTH,      sizeof(mqtt_message_t),     MQTT_MAX_SUSCRIPTIONS) \
+    X(TIME_SYNC_SAMPLE,  mesh,        1,                                sizeof(time_sync_sample_t), 1) \
+    X(SENSOR_RUN,        sensors,     CONFIG_SENSOR_SCHEDULER_MAX_JOBS, sizeof(int),                1)
+
+// X(id, subsystem, size, type, instances)
+#define RTOS_ALLOC_RINGBUFS(X) \
+    X(DLOG,              logging,     CONFIG_MESH_DLOG_BUFFER_SIZE, RINGBUF_TYPE_NOSPLIT, RTOS_ALLOC_DLOG)
+
+/*
+  * Short-lived tasks, always on the heap: they come and go, a static slot
+  * would stay reserved for nothing most of the time. Listed so the report
+  * shows the heap they need while they run.
+*/
+// X(id, subsystem, name, stack, priority)
+#define RTOS_ALLOC_TRANSIENT_TASKS(X) \
+    X(SUSCRIBER_EXECUTOR, mqtt,       "task_suscriber_event_executor",      5072, 5) \
+    X(TASKS_STARTER,     mesh,        "tasks starter",                      3072, 5) \
+    X(BLINK_CONFIG_LED,  ui,          "blink_config_led",                   1024, 5) \
+    X(BENCH_RUN,         diagnostics, "bench run",                          4096, 4) \
+    X(BENCH_TCP_SINK,    diagnostics, "bench tcp sink",                     3072, 4)
+
+#endif // RTOS_ALLOC_SPECS_H
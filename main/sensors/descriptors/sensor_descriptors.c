@@ -0,0 +1,101 @@
+/*
+*   Sensor descriptors
+*   The sensors of the node are declared once here. The table is const, so
+*   the names, metrics and default configs stay in flash and a lookup by
+*   task id is an index instead of a hash over the task names.
+*/
+#include "sensor_descriptors.h"
+
+#include <string.h>
+#include "sensors/tasks/sensor_tasks.h"
+
+static const sensor_descriptor_t sensor_descriptors[SENSOR_TASK_END] = {
+    [SENSOR_TASK_DHT11] = {
+        .task_name = "task_sensor_dht11",
+        .sensor_name = "dht11",
+        .read = task_sensor_dht11,
+        .metrics = {
+            { .type = "temperature", .unit = "C" },
+            { .type = "humidity", .unit = "%" }
+        },
+        .metric_count = 2,
+        .default_config = {
+            .task_id = SENSOR_TASK_DHT11,
+            .max_polling_time = 0,  // 0 means no max time restriction
+            .min_polling_time = 1000, // 1 second
+            .polling_time = 30000, // 30 seconds
+            .active = 1 // active
+        },
+        .stack_hint = 3072,
+        .priority_hint = 1
+    },
+    [SENSOR_TASK_PERFORMANCE] = {
+        .task_name = "task_sensor_performance",
+        .sensor_name = "esp32-performance",
+        .read = task_sensor_performance,
+        .metrics = {
+            { .type = "free_memory", .unit = "KBytes" },
+            { .type = "min_free_memory", .unit = "KBytes" },
+            { .type = "memory_usage", .unit = "%" }
+        },
+        .metric_count = 3,
+        .default_config = {
+            .task_id = SENSOR_TASK_PERFORMANCE,
+            .max_polling_time = 0,  // 0 means no max time restriction
+            .min_polling_time = 5000, // 5 second
+            .polling_time = 10000, // 10 seconds
+            .active = 1 // active
+        },
+        .stack_hint = 2048,
+        .priority_hint = 0
+    }
+};
+
+const sensor_descriptor_t * sensor_descriptor_get(int task_id) {
+    if (task_id <= SENSOR_TASK_NONE || task_id >= SENSOR_TASK_END) {
+        return NULL;
+    }
+    return &sensor_descriptors[task_id];
+}
+
+int sensor_descriptor_find(const char *task_name) {
+    for (int id = SENSOR_TASK_NONE + 1; id < SENSOR_TASK_END; id++) {
+        if (strcmp(sensor_descriptors[id].task_name, task_name) == 0) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+uint32_t sensor_descriptor_max_stack(void) {
+    uint32_t max = 0;
+    for (int id = SENSOR_TASK_NONE + 1; id < SENSOR_TASK_END; id++) {
+        if (sensor_descriptors[id].stack_hint > max) {
+            max = sensor_descriptors[id].stack_hint;
+        }
+    }
+    return max;
+}
+
+cJSON * sensor_descriptors_json(void) {
+    cJSON *tasks_array = cJSON_CreateArray();
+
+    for (int id = SENSOR_TASK_NONE + 1; id < SENSOR_TASK_END; id++) {
+        const sensor_descriptor_t *descriptor = &sensor_descriptors[id];
+        cJSON *task_object = cJSON_CreateObject();
+        cJSON_AddItemToObject(task_object, "id", cJSON_CreateNumber(id));
+        cJSON_AddItemToObject(task_object, "name", cJSON_CreateStringReference(descriptor->task_name));
+        cJSON_AddItemToObject(task_object, "sensor", cJSON_CreateStringReference(descriptor->sensor_name));
+
+        cJSON *sensor_metrics_array = cJSON_CreateArray();
+        for (size_t i = 0; i < descriptor->metric_count; i++) {
+            cJSON *sensor_metric = cJSON_CreateObject();
+            cJSON_AddItemToObject(sensor_metric, "type", cJSON_CreateStringReference(descriptor->metrics[i].type));
+            cJSON_AddItemToObject(sensor_metric, "unit", cJSON_CreateStringReference(descriptor->metrics[i].unit));
+            cJSON_AddItemToArray(sensor_metrics_array, sensor_metric);
+        }
+        cJSON_AddItemToObject(task_object, "metrics", sensor_metrics_array);
+        cJSON_AddItemToArray(tasks_array, task_object);
+    }
+    return tasks_array;
+}
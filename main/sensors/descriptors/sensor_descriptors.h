@@ -0,0 +1,47 @@
+#ifndef SENSOR_DESCRIPTORS_H
+#define SENSOR_DESCRIPTORS_H
+
+#include "cJSON.h"
+#include "sensors/utils/sensor_utils.h"
+
+// Task ids, dense and stable: they are the NVS keys and the task_id of the config topic
+typedef enum {
+    SENSOR_TASK_NONE = 0,
+    SENSOR_TASK_DHT11,
+    SENSOR_TASK_PERFORMANCE,
+    SENSOR_TASK_END
+} sensor_task_id_t;
+
+#define SENSOR_TASK_COUNT (SENSOR_TASK_END - 1)
+
+/*
+  * Function: sensor_descriptor_get
+  * ----------------------------
+  *   returns: the descriptor of the task id, NULL if there is no such task
+*/
+const sensor_descriptor_t * sensor_descriptor_get(int task_id);
+
+/*
+  * Function: sensor_descriptor_find
+  * ----------------------------
+  *   returns: the task id with that task name, -1 if not found
+*/
+int sensor_descriptor_find(const char *task_name);
+
+/*
+  * Function: sensor_descriptor_max_stack
+  * ----------------------------
+  *   returns: the largest stack_hint of the table
+*/
+uint32_t sensor_descriptor_max_stack(void);
+
+/*
+  * Function: sensor_descriptors_json
+  * ----------------------------
+  *   The tasks with their sensor and metrics, as announced in the device report
+  *
+  *   returns: a cJSON array owned by the caller
+*/
+cJSON * sensor_descriptors_json(void);
+
+#endif // SENSOR_DESCRIPTORS_H
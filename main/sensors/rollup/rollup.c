@@ -0,0 +1,67 @@
+/*
+*   Sensor rollup
+*   Aggregates the samples of a metric over a reporting window so a sensor
+*   can be sampled fast and reported slow without losing short spikes.
+*/
+#include "rollup.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int compare_float(const void *a, const void *b) {
+    float fa = *(const float *) a;
+    float fb = *(const float *) b;
+    return (fa > fb) - (fa < fb);
+}
+
+void rollup_reset(rollup_t *rollup, int64_t now_ms) {
+    rollup->head = 0;
+    rollup->stored = 0;
+    rollup->count = 0;
+    rollup->min = 0;
+    rollup->max = 0;
+    rollup->sum = 0;
+    rollup->window_start_ms = now_ms;
+}
+
+void rollup_add(rollup_t *rollup, float value) {
+    if (rollup->count == 0 || value < rollup->min) {
+        rollup->min = value;
+    }
+    if (rollup->count == 0 || value > rollup->max) {
+        rollup->max = value;
+    }
+    rollup->count++;
+    rollup->sum += value;
+    rollup->last = value;
+
+    rollup->samples[rollup->head] = value;
+    rollup->head = (rollup->head + 1) % CONFIG_SENSOR_ROLLUP_SAMPLES;
+    if (rollup->stored < CONFIG_SENSOR_ROLLUP_SAMPLES) {
+        rollup->stored++;
+    }
+}
+
+bool rollup_is_due(const rollup_t *rollup, int64_t now_ms, uint32_t interval_ms) {
+    return rollup->count > 0 && now_ms - rollup->window_start_ms >= interval_ms;
+}
+
+void rollup_close(rollup_t *rollup, int64_t now_ms, bool with_p95, rollup_report_t *report) {
+    report->count = rollup->count;
+    report->min = rollup->min;
+    report->max = rollup->max;
+    report->last = rollup->last;
+    report->mean = rollup->count > 0 ? (float) (rollup->sum / rollup->count) : 0;
+    report->window_ms = (uint32_t) (now_ms - rollup->window_start_ms);
+    report->p95 = report->max;
+
+    if (with_p95 && rollup->stored > 0) {
+        float sorted[CONFIG_SENSOR_ROLLUP_SAMPLES];
+        memcpy(sorted, rollup->samples, rollup->stored * sizeof(float));
+        qsort(sorted, rollup->stored, sizeof(float), compare_float);
+        // nearest rank
+        size_t rank = (size_t) ((95 * rollup->stored + 99) / 100);
+        report->p95 = sorted[rank > 0 ? rank - 1 : 0];
+    }
+    rollup_reset(rollup, now_ms);
+}
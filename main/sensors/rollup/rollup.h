@@ -0,0 +1,60 @@
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef CONFIG_SENSOR_ROLLUP_SAMPLES
+#define CONFIG_SENSOR_ROLLUP_SAMPLES 64
+#endif
+
+typedef struct {
+    float min;
+    float max;
+    float mean;
+    float last;
+    float p95;          // over the last CONFIG_SENSOR_ROLLUP_SAMPLES samples
+    uint32_t count;
+    uint32_t window_ms;
+} rollup_report_t;
+
+typedef struct {
+    float samples[CONFIG_SENSOR_ROLLUP_SAMPLES]; // ring, only used for the percentile
+    uint16_t head;
+    uint16_t stored;
+    uint32_t count;
+    float min;
+    float max;
+    double sum;
+    float last;
+    int64_t window_start_ms;
+} rollup_t;
+
+/*
+  * Function: rollup_reset
+  * ----------------------------
+  *   Empties the window, it starts at now_ms
+  *
+*/
+void rollup_reset(rollup_t *rollup, int64_t now_ms);
+
+void rollup_add(rollup_t *rollup, float value);
+
+/*
+  * Function: rollup_is_due
+  * ----------------------------
+  *   returns: true if the window has samples and is at least interval_ms long
+*/
+bool rollup_is_due(const rollup_t *rollup, int64_t now_ms, uint32_t interval_ms);
+
+/*
+  * Function: rollup_close
+  * ----------------------------
+  *   Computes the aggregates of the window and starts the next one
+  *
+  *   with_p95: the percentile sorts a copy of the samples, skip it when not needed
+*/
+void rollup_close(rollup_t *rollup, int64_t now_ms, bool with_p95, rollup_report_t *report);
+
+#endif // ROLLUP_H
@@ -0,0 +1,383 @@
+/*
+*   Sensor scheduler
+*   Every sensor job is kept in a min-heap ordered by the time of its next run.
+*   A single dispatcher task sleeps until the earliest job is due and hands it
+*   to a small pool of workers, so the number of sensors is no longer bound by
+*   one task stack per sensor. The period is measured from the due time, so a
+*   slow read does not make the sensor drift. Tasks with the aligned config
+*   sample on the boundaries of the synchronised wall clock instead, so every
+*   node reads the same epoch (plus a small per-node phase offset).
+*/
+#include "sensor_scheduler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_mac.h"
+#include "time_sync/time_sync.h"
+#include "sensors/descriptors/sensor_descriptors.h"
+#include "performance/performance.h"
+#include "rtos_alloc/rtos_alloc.h"
+
+#define SENSOR_SCHEDULER_TAG "sensor_scheduler"
+
+#ifndef CONFIG_SENSOR_SCHEDULER_MAX_JOBS
+#define CONFIG_SENSOR_SCHEDULER_MAX_JOBS 32
+#endif
+#ifndef CONFIG_SENSOR_SCHEDULER_WORKERS
+#define CONFIG_SENSOR_SCHEDULER_WORKERS 2
+#endif
+#ifndef CONFIG_SENSOR_SCHEDULER_WORKER_STACK
+#define CONFIG_SENSOR_SCHEDULER_WORKER_STACK 4096
+#endif
+#ifndef CONFIG_SENSOR_ALIGNED_SPREAD
+#define CONFIG_SENSOR_ALIGNED_SPREAD 1000
+#endif
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef enum {
+    JOB_PARKED = 0, // config not active, out of the heap
+    JOB_WAITING,    // in the heap
+    JOB_QUEUED,     // due, waiting for a worker
+    JOB_RUNNING,
+    JOB_STOPPED     // the job gave up, never scheduled again
+} job_state_t;
+
+typedef struct {
+    sensor_job_t job;
+    TaskJobArgs_t *args;
+    int64_t due_ms;
+    int64_t period_start_ms;    // due time of the last run
+    TaskConfigSlot_t *config_slot;
+    uint32_t config_version;    // version the due time was computed from
+    int64_t epoch_ms;           // wall clock boundary of the next aligned run, 0 when free running
+    int64_t last_epoch_ms;
+    bool has_run;
+    uint8_t priority;           // priority_hint of the descriptor
+    int heap_pos;               // -1 when not in the heap
+    job_state_t state;
+} scheduled_job_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static scheduled_job_t s_jobs[CONFIG_SENSOR_SCHEDULER_MAX_JOBS];
+static int s_job_count = 0;
+static int s_heap[CONFIG_SENSOR_SCHEDULER_MAX_JOBS];
+static int s_heap_size = 0;
+
+static SemaphoreHandle_t s_lock = NULL;
+static QueueHandle_t s_run_queue = NULL;
+static TaskHandle_t s_dispatcher = NULL;
+static uint32_t s_phase_offset_ms = 0;
+
+/*******************************************************
+ *                Min-heap by due time
+ *******************************************************/
+
+static int64_t now_ms(void) {
+    return esp_timer_get_time() / 1000;
+}
+
+// jobs due at the same time are handed out by the priority hint of their sensor
+static bool heap_less(int a, int b) {
+    scheduled_job_t *job_a = &s_jobs[s_heap[a]];
+    scheduled_job_t *job_b = &s_jobs[s_heap[b]];
+    if (job_a->due_ms != job_b->due_ms) {
+        return job_a->due_ms < job_b->due_ms;
+    }
+    return job_a->priority > job_b->priority;
+}
+
+static void heap_swap(int a, int b) {
+    int tmp = s_heap[a];
+    s_heap[a] = s_heap[b];
+    s_heap[b] = tmp;
+    s_jobs[s_heap[a]].heap_pos = a;
+    s_jobs[s_heap[b]].heap_pos = b;
+}
+
+static void heap_sift_up(int pos) {
+    while (pos > 0 && heap_less(pos, (pos - 1) / 2)) {
+        heap_swap(pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
+    }
+}
+
+static void heap_sift_down(int pos) {
+    while (1) {
+        int smallest = pos;
+        int left = 2 * pos + 1;
+        int right = left + 1;
+        if (left < s_heap_size && heap_less(left, smallest)) {
+            smallest = left;
+        }
+        if (right < s_heap_size && heap_less(right, smallest)) {
+            smallest = right;
+        }
+        if (smallest == pos) {
+            return;
+        }
+        heap_swap(pos, smallest);
+        pos = smallest;
+    }
+}
+
+static void heap_push(int index) {
+    s_heap[s_heap_size] = index;
+    s_jobs[index].heap_pos = s_heap_size;
+    s_heap_size++;
+    heap_sift_up(s_heap_size - 1);
+}
+
+static void heap_remove(int index) {
+    int pos = s_jobs[index].heap_pos;
+    s_jobs[index].heap_pos = -1;
+    s_heap_size--;
+    if (pos == s_heap_size) {
+        return;
+    }
+    s_heap[pos] = s_heap[s_heap_size];
+    s_jobs[s_heap[pos]].heap_pos = pos;
+    heap_sift_up(pos);
+    heap_sift_down(s_jobs[s_heap[pos]].heap_pos);
+}
+
+/*******************************************************
+ *                Scheduling
+ *******************************************************/
+
+/*
+  * Function: aligned_due
+  * ----------------------------
+  *   Next run of an aligned job: the next multiple of polling_time of the
+  *   wall clock plus the phase offset of this node, never the same boundary
+  *   twice
+  *
+  *   returns: due time in the esp_timer clock
+*/
+static int64_t aligned_due(scheduled_job_t *job, int64_t polling_time, int64_t now) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t wall_ms = (int64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    // the offset spreads the nodes without moving them out of their epoch
+    int64_t offset = polling_time >= 4 ? s_phase_offset_ms % (polling_time / 4) : 0;
+
+    int64_t boundary = (wall_ms - offset) / polling_time * polling_time + polling_time;
+    if (boundary <= job->last_epoch_ms) {
+        boundary = job->last_epoch_ms + polling_time;
+    }
+    job->epoch_ms = boundary;
+    return now + (boundary + offset - wall_ms);
+}
+
+// places the job according to its current config, must be called with s_lock held
+static void schedule_locked(int index, int64_t now) {
+    scheduled_job_t *job = &s_jobs[index];
+    bool active = false;
+    int64_t due = now;
+
+    // the slot holds a validated config, read without allocating
+    if (job->config_slot != NULL) {
+        Config_t config;
+        job->config_version = read_task_config(job->config_slot, &config);
+        active = config.active == 1;
+        job->epoch_ms = 0;
+        if (config.aligned && config.polling_time > 0 && time_sync_is_synced()) {
+            due = aligned_due(job, config.polling_time, now);
+        } else if (job->has_run) {
+            due = job->period_start_ms + config.polling_time;
+        }
+    }
+
+    if (!active) {
+        if (job->heap_pos >= 0) {
+            heap_remove(index);
+        }
+        job->state = JOB_PARKED;
+        return;
+    }
+    // a late job runs now and keeps its period from there
+    job->due_ms = due < now ? now : due;
+    job->state = JOB_WAITING;
+    if (job->heap_pos >= 0) {
+        heap_sift_up(job->heap_pos);
+        heap_sift_down(job->heap_pos);
+    } else {
+        heap_push(index);
+    }
+}
+
+static void task_sensor_dispatcher(void *args) {
+    while (1) {
+        TickType_t wait = portMAX_DELAY;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        int64_t now = now_ms();
+        while (s_heap_size > 0 && s_jobs[s_heap[0]].due_ms <= now) {
+            int index = s_heap[0];
+            heap_remove(index);
+            s_jobs[index].period_start_ms = s_jobs[index].due_ms;
+            s_jobs[index].state = JOB_QUEUED;
+            // the queue has a slot per job, it cannot be full
+            xQueueSend(s_run_queue, &index, 0);
+        }
+        if (s_heap_size > 0) {
+            wait = pdMS_TO_TICKS(s_jobs[s_heap[0]].due_ms - now);
+            if (wait == 0) {
+                wait = 1;
+            }
+        }
+        xSemaphoreGive(s_lock);
+
+        // woken earlier when a job is added, finished or rescheduled
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+static void task_sensor_worker(void *args) {
+    int index;
+    while (1) {
+        if (xQueueReceive(s_run_queue, &index, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        scheduled_job_t *job = &s_jobs[index];
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (job->config_slot != NULL && job->config_slot->version != job->config_version) {
+            Config_t config;
+            uint32_t version = read_task_config(job->config_slot, &config);
+            if (job->epoch_ms != 0 && config.active == 1 && config.aligned && config.polling_time > 0) {
+                // still aligned: the boundary the job was dispatched for is kept,
+                // recomputing it from now would skip it for the next one
+                job->config_version = version;
+            } else {
+                // the config changed after the job was due, only run it if it still is
+                schedule_locked(index, now_ms());
+                if (job->state != JOB_WAITING || job->due_ms > now_ms()) {
+                    xSemaphoreGive(s_lock);
+                    xTaskNotifyGive(s_dispatcher);
+                    continue;
+                }
+                heap_remove(index);
+                job->period_start_ms = job->due_ms;
+            }
+        }
+        job->state = JOB_RUNNING;
+        job->last_epoch_ms = job->epoch_ms;
+        job->args->epoch_ms = job->epoch_ms;
+        xSemaphoreGive(s_lock);
+
+        sensor_job_status_t status = job->job(job->args);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        job->has_run = true;
+        if (status == SENSOR_JOB_STOP) {
+            job->state = JOB_STOPPED;
+            ESP_LOGW(SENSOR_SCHEDULER_TAG, "Sensor job %d stopped", job->args->id);
+        } else {
+            schedule_locked(index, now_ms());
+        }
+        xSemaphoreGive(s_lock);
+        xTaskNotifyGive(s_dispatcher);
+    }
+}
+
+/*******************************************************
+ *                Public API
+ *******************************************************/
+
+esp_err_t sensor_scheduler_init(void) {
+    if (s_lock != NULL) {
+        return ESP_OK;
+    }
+    // same offset on every boot, different on every node
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    uint32_t hash = 0x811C9DC5;
+    for (size_t i = 0; i < sizeof(mac); i++) {
+        hash = (hash ^ mac[i]) * 0x01000193;
+    }
+    s_phase_offset_ms = CONFIG_SENSOR_ALIGNED_SPREAD > 0 ? hash % CONFIG_SENSOR_ALIGNED_SPREAD : 0;
+
+    s_lock = xSemaphoreCreateMutex();
+    s_run_queue = rtos_alloc_queue(RTOS_QUEUE_SENSOR_RUN);
+    if (s_lock == NULL || s_run_queue == NULL) {
+        ESP_LOGE(SENSOR_SCHEDULER_TAG, "Unable to create the scheduler queue");
+        return ESP_ERR_NO_MEM;
+    }
+    performance_watch_queue("sensor run queue", s_run_queue);
+    if (rtos_alloc_task(RTOS_TASK_SENSOR_DISPATCHER, task_sensor_dispatcher, NULL, &s_dispatcher) != ESP_OK) {
+        ESP_LOGE(SENSOR_SCHEDULER_TAG, "Unable to create the dispatcher task");
+        return ESP_ERR_NO_MEM;
+    }
+    // any worker may run any job, the stack fits the most demanding sensor
+    uint32_t worker_stack = CONFIG_SENSOR_SCHEDULER_WORKER_STACK;
+    if (sensor_descriptor_max_stack() > worker_stack) {
+        worker_stack = sensor_descriptor_max_stack();
+    }
+    for (int i = 0; i < CONFIG_SENSOR_SCHEDULER_WORKERS; i++) {
+        if (rtos_alloc_task_with_stack(RTOS_TASK_SENSOR_WORKER, worker_stack, task_sensor_worker, NULL, NULL) != ESP_OK) {
+            ESP_LOGE(SENSOR_SCHEDULER_TAG, "Unable to create the worker %d", i);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    // woken by update_task_config, the config topic applies within milliseconds
+    set_task_config_listener(sensor_scheduler_reschedule);
+    ESP_LOGI(SENSOR_SCHEDULER_TAG, "Started with %d workers", CONFIG_SENSOR_SCHEDULER_WORKERS);
+    return ESP_OK;
+}
+
+esp_err_t sensor_scheduler_add(sensor_job_t job, TaskJobArgs_t *args) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_job_count == CONFIG_SENSOR_SCHEDULER_MAX_JOBS) {
+        xSemaphoreGive(s_lock);
+        ESP_LOGE(SENSOR_SCHEDULER_TAG, "No room for sensor job %d", args->id);
+        return ESP_ERR_NO_MEM;
+    }
+    int index = s_job_count++;
+    s_jobs[index] = (scheduled_job_t) {
+        .job = job,
+        .args = args,
+        .config_slot = get_task_config_slot(args->id),
+        .priority = args->descriptor != NULL ? args->descriptor->priority_hint : 0,
+        .heap_pos = -1,
+        .state = JOB_PARKED
+    };
+    schedule_locked(index, now_ms());
+    xSemaphoreGive(s_lock);
+    xTaskNotifyGive(s_dispatcher);
+    return ESP_OK;
+}
+
+void sensor_scheduler_reschedule(int task_id) {
+    if (s_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < s_job_count; i++) {
+        if (s_jobs[i].args->id != task_id) {
+            continue;
+        }
+        switch (s_jobs[i].state) {
+            case JOB_PARKED:
+            case JOB_WAITING:
+                schedule_locked(i, now_ms());
+                break;
+            default:
+                // a queued job checks the config version before running,
+                // a running one reads the config when it finishes
+                break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    xTaskNotifyGive(s_dispatcher);
+}
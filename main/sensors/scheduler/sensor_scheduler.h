@@ -0,0 +1,38 @@
+#ifndef SENSOR_SCHEDULER_H
+#define SENSOR_SCHEDULER_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sensors/utils/sensor_utils.h"
+
+/*
+  * Function: sensor_scheduler_init
+  * ----------------------------
+  *   Starts the dispatcher and the worker pool that run every sensor job.
+  *   Must be called before the first create_sensor_task.
+  *
+  *   returns: ESP_OK, ESP_ERR_NO_MEM if the tasks cannot be created
+*/
+esp_err_t sensor_scheduler_init(void);
+
+/*
+  * Function: sensor_scheduler_add
+  * ----------------------------
+  *   Registers a sensor job, the first run is due straight away if the task
+  *   config is active. The args are owned by the scheduler from now on.
+  *
+  *   returns: ESP_ERR_NO_MEM when CONFIG_SENSOR_SCHEDULER_MAX_JOBS is reached
+*/
+esp_err_t sensor_scheduler_add(sensor_job_t job, TaskJobArgs_t *args);
+
+/*
+  * Function: sensor_scheduler_reschedule
+  * ----------------------------
+  *   Applies a new polling_time/active of the task config without waiting for
+  *   the current period to expire. Registered as the task config listener, so
+  *   update_task_config calls it.
+  *
+*/
+void sensor_scheduler_reschedule(int task_id);
+
+#endif // SENSOR_SCHEDULER_H
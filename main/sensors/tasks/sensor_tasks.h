@@ -1,9 +1,11 @@
 #ifndef SENSOR_TASKS_H
 #define SENSOR_TASKS_H
 
-// Tasks function prototypes
-void task_sensor_dht11(void *args);
-void task_sensor_performance(void *args);
-// void task_sensor_template(void *args);
+#include "../utils/sensor_utils.h"
 
-#endif // SENSOR_TASKS_H
\ No newline at end of file
+// Sensor reads, run by sensor_read_job
+esp_err_t task_sensor_dht11(TaskJobArgs_t *args, float values[]);
+esp_err_t task_sensor_performance(TaskJobArgs_t *args, float values[]);
+// esp_err_t task_sensor_template(TaskJobArgs_t *args, float values[]);
+
+#endif // SENSOR_TASKS_H
@@ -1,58 +1,38 @@
 #include "sensor_utils.h"
+#include "sensors/scheduler/sensor_scheduler.h"
+#include "sensors/descriptors/sensor_descriptors.h"
+#include "esp_timer.h"
+#include "time_sync/time_sync.h"
+#include "tsdb/tsdb.h"
+#include "dlog/dlog.h"
+#include "esp_wifi.h"
+#include "esp_mac.h"
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
 
-/*
-  * Function: task_job_guard
-  * ----------------------------
-  *   Decorator wrapper for the sensor task
-  *
-  */
-static void task_job_guard(void *args) {
-    sensor_task_t *sensor_task = (sensor_task_t *) args;
-    ESP_LOGI(MESH_TAG, "STARTED: %s", sensor_task->task_name);
-
-    // get task args
-    TaskJobArgs_t *task_args = malloc(sizeof(TaskJobArgs_t));
-    task_args->id = get_task_id_by_name(sensor_task->task_name);
-    task_args->mqtt_queues = sensor_task->mqtt_queues;
-    // execute task job
-    sensor_task->task_job((void *) task_args);
-    free(sensor_task);
-}
+#define SENSOR_READ_MAX_FAILURES 10
 
 /*
   * Function: create_sensor_task
   * ----------------------------
-  *   Creates a new sensor task
+  *   Registers the sensor of a task id of the descriptor table and hands its
+  *   job to the sensor scheduler
   *
   */
-void create_sensor_task(char *task_name, char * sensor_type, char * sensor_metrics[], char* sensor_units[], TaskFunction_t task_job , mqtt_queues_t *mqtt_queues, Config_t config, const configSTACK_DEPTH_TYPE usStackDepth) {
-
-    sensor_task_t *sensor_task = malloc(sizeof(sensor_task_t));
-    sensor_task->task_job = task_job; // adding task job so that it can be executed with the guard task
-    sensor_task->task_name = task_name;
-    sensor_task->mqtt_queues = mqtt_queues;
-
-    // add task mapping task_name to id
-    int task_id = add_task_mapping(task_name, sensor_type);
-    
-    if (task_id == -1) {
-        ESP_LOGI(MESH_TAG, "Task mapping already exists");
+void create_sensor_task(int task_id, mqtt_queues_t *mqtt_queues) {
+    const sensor_descriptor_t *descriptor = sensor_descriptor_get(task_id);
+    if (descriptor == NULL) {
+        ESP_LOGE(MESH_TAG, "No sensor descriptor for task id %d", task_id);
         return;
     }
-
-    // add sensor metrics
-    for (size_t i = 0; sensor_metrics[i] != NULL; i++) {
-        char * metric_type = sensor_metrics[i];
-        char * metric_unit = sensor_units[i];
-        if (metric_type == NULL) {
-            ESP_LOGE(MESH_TAG, "Error in create_sensor_task: metric_type or metric_unit is NULL");
-        } else {
-            add_sensor_metric(task_name, metric_type, metric_unit!=NULL ? metric_unit : "");
-        }
+    if (get_task_config_slot(task_id) != NULL) {
+        ESP_LOGI(MESH_TAG, "Task %s already created", descriptor->task_name);
+        return;
     }
 
     // adding task config to the tasks_config
-    add_task_config(task_id, sensor_type, config);
+    add_task_config(task_id, descriptor->sensor_name, descriptor->default_config);
 
     // load values from nvs if exists
     esp_err_t ret = load_task_config(task_id);
@@ -63,22 +43,181 @@ void create_sensor_task(char *task_name, char * sensor_type, char * sensor_metri
         ESP_LOGI(MESH_TAG, "Loaded config from NVS");
     }
 
-    xTaskCreate(task_job_guard, task_name, usStackDepth, (void *) sensor_task, 5, NULL);
+    // the topics are resolved once, not on every reading
+    TaskJobArgs_t *task_args = calloc(1, sizeof(TaskJobArgs_t));
+    task_args->id = task_id;
+    task_args->descriptor = descriptor;
+    task_args->mqtt_queues = mqtt_queues;
+    task_args->sensor_length = descriptor->metric_count;
+    task_args->sensor_topics = malloc(sizeof(char *) * (task_args->sensor_length + 1));
+    for (size_t i = 0; i < task_args->sensor_length; i++) {
+        task_args->sensor_topics[i] = create_topic("sensor", (char *) descriptor->metrics[i].type, true);
+    }
+    task_args->sensor_topics[task_args->sensor_length] = NULL;
+    uint8_t mac_ap[6];
+    esp_wifi_get_mac(WIFI_IF_AP, mac_ap);
+    snprintf(task_args->device_id, sizeof(task_args->device_id), MACSTR, MAC2STR(mac_ap));
+    task_args->config_slot = get_task_config_slot(task_id);
+    task_args->rollups = malloc(sizeof(rollup_t) * task_args->sensor_length);
+    task_args->report_states = calloc(task_args->sensor_length, sizeof(metric_report_state_t));
+    for (size_t i = 0; i < task_args->sensor_length; i++) {
+        rollup_reset(&task_args->rollups[i], esp_timer_get_time() / 1000);
+    }
+
+    sensor_job_t job = descriptor->job != NULL ? descriptor->job : sensor_read_job;
+    if (sensor_scheduler_add(job, task_args) != ESP_OK) {
+        ESP_LOGE(MESH_TAG, "Unable to schedule %s", descriptor->task_name);
+    } else {
+        ESP_LOGI(MESH_TAG, "SCHEDULED: %s", descriptor->task_name);
+    }
 }
 
 /*
-  * Function: get_sensor_count
+  * Function: sensor_read_job
   * ----------------------------
-  *   Get the sensor count
+  *   Job of the sensors that only provide a read function: reads every
+  *   metric and reports them. Nothing is allocated, the values and the
+  *   message are formatted in the buffers of the job.
   *
 */
-size_t get_sensor_count(char * sensor_metrics[]) {
-    size_t count = 0;
-    for (size_t i = 0; sensor_metrics[i] != NULL; i++) {
-        count++;
+sensor_job_status_t sensor_read_job(TaskJobArgs_t *args) {
+    args->capture_us = esp_timer_get_time();
+    if (args->descriptor->read(args, args->values) != ESP_OK) {
+        // stopping reading sensor if it fails too many times
+        args->failures++;
+        if (args->failures > SENSOR_READ_MAX_FAILURES) {
+            return SENSOR_JOB_STOP;
+        }
+        DLOG_I(MESH_TAG, "Could not read data from sensor %s", args->descriptor->sensor_name);
+        return SENSOR_JOB_OK;
+    }
+    for (size_t i = 0; i < args->sensor_length; i++) {
+        sensor_report_value(args, i, args->values[i]);
+    }
+    return SENSOR_JOB_OK;
+}
+
+/*
+  * Function: should_report
+  * ----------------------------
+  *   Report by exception: published when one of the values moved more than
+  *   the deadband from the last published value or the heartbeat elapsed
+  *
+  * values: the reading, or the aggregates of a rollup window
+*/
+static bool should_report(const MetricFilter_t *filter, metric_report_state_t *state, const float values[], size_t count, int64_t now_ms) {
+    if (!state->published) {
+        return true;
+    }
+    if (filter->heartbeat != 0 && now_ms - state->time_ms >= (int64_t) filter->heartbeat) {
+        return true;
     }
-    return count;
+    float deadband = filter->deadband;
+    if (filter->deadband_percent) {
+        deadband = fabsf(state->value) * filter->deadband / 100.0f;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (fabsf(values[i] - state->value) >= deadband) {
+            return true;
+        }
+    }
+    return false;
 }
 
+/*
+  * Function: sensor_report_value
+  * ----------------------------
+  *   Publishes a reading of a metric. With a report_interval in the task
+  *   config the reading goes to the rollup window of the metric instead, and
+  *   the aggregates are published once the window is over. A reading is
+  *   dropped while it stays within the deadband of the metric, a window
+  *   while its min, max, mean, last (and p95) all stay within it, so a
+  *   short spike is still published.
+  *
+*/
+void sensor_report_value(TaskJobArgs_t *args, size_t metric, float value) {
+    Config_t *config = &args->config;
+    if (args->config_slot != NULL) {
+        read_task_config(args->config_slot, config);
+    }
+    int64_t now_ms = esp_timer_get_time() / 1000;
+
+    // every reading is stored, published or not, a timestamp needs the synchronised clock
+    if (time_sync_is_synced()) {
+        int64_t epoch_ms = args->epoch_ms;
+        if (epoch_ms == 0) {
+            struct timeval tv;
+            gettimeofday(&tv, NULL);
+            epoch_ms = (int64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+        }
+        tsdb_append(SENSOR_SERIES(args->id, metric), epoch_ms, value);
+    }
+
+    rollup_report_t report;
+    float reported = value;
+    // compared to the deadband
+    float checked[5] = { value };
+    size_t checked_count = 1;
+    if (config->report_interval != 0) {
+        rollup_t *rollup = &args->rollups[metric];
+        rollup_add(rollup, value);
+        if (!rollup_is_due(rollup, now_ms, config->report_interval)) {
+            return;
+        }
+        rollup_close(rollup, now_ms, config->rollup_p95, &report);
+        // sensor_value keeps the mean so the existing consumers still plot it
+        reported = report.mean;
+        checked[0] = report.mean;
+        checked[1] = report.min;
+        checked[2] = report.max;
+        checked[3] = report.last;
+        checked[4] = report.p95;
+        checked_count = config->rollup_p95 ? 5 : 4;
+    }
+
+    if (metric < TASKS_CONFIG_MAX_METRICS) {
+        metric_report_state_t *state = &args->report_states[metric];
+        if (!should_report(&config->metric_filters[metric], state, checked, checked_count, now_ms)) {
+            DLOG_D(MESH_TAG, "%s within the deadband, not published", args->descriptor->metrics[metric].type);
+            return;
+        }
+        state->value = reported;
+        state->time_ms = now_ms;
+        state->published = true;
+    }
 
+    // same fields as create_mqtt_message, formatted in place instead of through cJSON
+    char *message = args->message;
+    size_t length = snprintf(message, MAX_MESSAGE_LENGTH,
+                             "{\"mesh_id\":\"%s\",\"device_id\":\"%s\",\"timestamp_value\":%lld,\"sensor_type\":\"%s\",\"sensor_value\":%.1f",
+                             MESH_TAG, args->device_id, (long long) time(NULL), args->descriptor->metrics[metric].type, reported);
+    if (config->report_interval != 0 && length < MAX_MESSAGE_LENGTH) {
+        length += snprintf(message + length, MAX_MESSAGE_LENGTH - length,
+                           ",\"rollup\":{\"count\":%lu,\"min\":%.1f,\"max\":%.1f,\"mean\":%.1f,\"last\":%.1f,\"window\":%lu",
+                           (unsigned long) report.count, report.min, report.max, report.mean, report.last,
+                           (unsigned long) report.window_ms);
+        if (config->rollup_p95 && length < MAX_MESSAGE_LENGTH) {
+            length += snprintf(message + length, MAX_MESSAGE_LENGTH - length, ",\"p95\":%.1f", report.p95);
+        }
+        if (length < MAX_MESSAGE_LENGTH) {
+            length += snprintf(message + length, MAX_MESSAGE_LENGTH - length, "}");
+        }
+    }
+    // readings of the same epoch from every node can be grouped by it
+    if (args->epoch_ms != 0 && length < MAX_MESSAGE_LENGTH) {
+        length += snprintf(message + length, MAX_MESSAGE_LENGTH - length, ",\"epoch\":%lld", (long long) args->epoch_ms);
+    }
+    if (length < MAX_MESSAGE_LENGTH) {
+        length += snprintf(message + length, MAX_MESSAGE_LENGTH - length, "}");
+    }
+    if (length >= MAX_MESSAGE_LENGTH) {
+        ESP_LOGE(MESH_TAG, "Message of %s too long, not published", args->descriptor->metrics[metric].type);
+        return;
+    }
 
+    DLOG_I(MESH_TAG, "Trying to queue message: %s", message);
+    if (args->mqtt_queues->mqttPublisherQueue != NULL) {
+        publish_traced(args->sensor_topics[metric], message, args->capture_us);
+        DLOG_I(MESH_TAG, "queued done: %s", message);
+    }
+}
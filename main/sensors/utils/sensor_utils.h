@@ -7,21 +7,75 @@
 #include "mqtt_queue.h"
 #include "../mqtt/utils/mqtt_utils.h"
 #include "../tasks_config/tasks_config.h"
+#include "../rollup/rollup.h"
 
 
 extern char * MESH_TAG;
+
+typedef enum {
+    SENSOR_JOB_OK = 0,
+    SENSOR_JOB_STOP     // the sensor is not scheduled again
+} sensor_job_status_t;
+
 typedef struct {
-    char * task_name;
-    TaskFunction_t task_job;
-    mqtt_queues_t * mqtt_queues;
-} sensor_task_t;
+    float value;            // last published value
+    int64_t time_ms;
+    bool published;
+} metric_report_state_t;
+
+typedef struct task_job_args TaskJobArgs_t;
+
+// one reading of the sensor, called by the scheduler every polling_time
+typedef sensor_job_status_t (*sensor_job_t)(TaskJobArgs_t *args);
+
+// reads every metric of the sensor, values has one slot per metric of the descriptor
+typedef esp_err_t (*sensor_read_t)(TaskJobArgs_t *args, float values[]);
 
 typedef struct {
+    const char *type;
+    const char *unit;
+} sensor_metric_descriptor_t;
+
+/*
+  * Everything known about a sensor at build time, see sensor_descriptors.c.
+  * The table is const so it stays in flash, the task id is the index.
+*/
+typedef struct {
+    const char *task_name;
+    const char *sensor_name;
+    sensor_read_t read;
+    sensor_job_t job;       // custom job, NULL runs read through sensor_read_job
+    sensor_metric_descriptor_t metrics[TASKS_CONFIG_MAX_METRICS];
+    size_t metric_count;
+    Config_t default_config;
+    uint32_t stack_hint;    // bytes of worker stack the job needs
+    uint8_t priority_hint;  // higher runs first among the jobs due at the same time
+} sensor_descriptor_t;
+
+struct task_job_args {
     int id;
+    const sensor_descriptor_t *descriptor;
     mqtt_queues_t *mqtt_queues;
-} TaskJobArgs_t;
+    char **sensor_topics;   // one topic per metric
+    size_t sensor_length;
+    int failures;
+    TaskConfigSlot_t *config_slot;
+    rollup_t *rollups;      // one window per metric, used when report_interval is set
+    metric_report_state_t *report_states; // one per metric, for the deadband and heartbeat
+    int64_t epoch_ms;       // wall clock boundary of the reading in aligned mode, 0 otherwise
+    int64_t capture_us;     // esp_timer_get_time of the reading, start of its latency trace
+    // owned by the job so a reading never touches the heap
+    Config_t config;        // snapshot of the task config for the current reading
+    float values[TASKS_CONFIG_MAX_METRICS];
+    char device_id[18];
+    char message[MAX_MESSAGE_LENGTH];
+};
+
+// series of a metric in the time-series store
+#define SENSOR_SERIES(task_id, metric) ((uint16_t) ((task_id) * TASKS_CONFIG_MAX_METRICS + (metric)))
 
-void create_sensor_task(char *task_name, char *sensor_type, char * sensor_metrics[], char * sensor_units[], TaskFunction_t task_job , mqtt_queues_t *mqtt_queues, Config_t config, const configSTACK_DEPTH_TYPE usStackDepth);
-size_t get_sensor_count(char * sensor_metrics[]);
+void create_sensor_task(int task_id, mqtt_queues_t *mqtt_queues);
+sensor_job_status_t sensor_read_job(TaskJobArgs_t *args);
+void sensor_report_value(TaskJobArgs_t *args, size_t metric, float value);
 
 #endif // SENSOR_UTILS_H
\ No newline at end of file
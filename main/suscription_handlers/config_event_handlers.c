@@ -5,6 +5,15 @@
 *   Publishes on different topic: /mesh/[mesh_id]/config/dashboard
 */
 #include "suscription_event_handlers.h"
+#include "benchmark/benchmark.h"
+#include "sensors/descriptors/sensor_descriptors.h"
+#include "tsdb/tsdb.h"
+#include "dlog/dlog.h"
+#include "topology/topology.h"
+#include "performance/performance.h"
+#include "json_arena/json_arena.h"
+#include <math.h>
+#include <sys/time.h>
 
 extern char * clientIdentifier;
 extern mqtt_queues_t mqtt_queues;
@@ -20,12 +29,12 @@ char * create_message_config(char* action, cJSON* payload) {
     cJSON_AddStringToObject(firmware, "revision", FIRMWARE_REVISION);
     cJSON_AddItemToObject(root, "firmware", firmware);
 
-    ESP_LOGI(MESH_TAG, "%s", cJSON_Print(payload));
+    DLOG_D(MESH_TAG, "Config answer %s", action);
 
     if (payload != NULL)
         cJSON_AddItemToObject(root, "payload", payload);
     
-    char *message = cJSON_PrintUnformatted(root);
+    char *message = cJSON_PrintBuffered(root, MAX_MESSAGE_LENGTH, false);
     cJSON_Delete(root);
     return message;
 
@@ -36,18 +45,132 @@ cJSON* make_pool_object(Config_t *config) {
     cJSON_AddNumberToObject(pool_object, "actual_time", config->polling_time);
     cJSON_AddNumberToObject(pool_object, "max", config->max_polling_time);
     cJSON_AddNumberToObject(pool_object, "min", config->min_polling_time);
+    cJSON_AddBoolToObject(pool_object, "aligned", config->aligned);
     return pool_object;
 }
 
+// Metric filters in the order of the metrics of the task, named by metric type
+cJSON* make_metrics_filter_array(Config_t *config) {
+    cJSON *metrics_array = cJSON_CreateArray();
+    const sensor_descriptor_t *descriptor = sensor_descriptor_get(config->task_id);
+    if (descriptor == NULL) {
+        return metrics_array;
+    }
+    for (size_t i = 0; i < descriptor->metric_count; i++) {
+        cJSON *metric_object = cJSON_CreateObject();
+        cJSON_AddItemToObject(metric_object, "type", cJSON_CreateStringReference(descriptor->metrics[i].type));
+        cJSON_AddNumberToObject(metric_object, "deadband", config->metric_filters[i].deadband);
+        cJSON_AddBoolToObject(metric_object, "percent", config->metric_filters[i].deadband_percent);
+        cJSON_AddNumberToObject(metric_object, "heartbeat", config->metric_filters[i].heartbeat);
+        cJSON_AddItemToArray(metrics_array, metric_object);
+    }
+    return metrics_array;
+}
+
+// Updates the filters of the metrics listed in the payload, matched by type
+void parse_metrics_filter_array(cJSON *metrics, Config_t *config) {
+    const sensor_descriptor_t *descriptor = sensor_descriptor_get(config->task_id);
+    if (descriptor == NULL) {
+        return;
+    }
+    cJSON *metric_object = NULL;
+    cJSON_ArrayForEach(metric_object, metrics) {
+        cJSON *type = cJSON_GetObjectItem(metric_object, "type");
+        if (!cJSON_IsString(type)) {
+            continue;
+        }
+        for (size_t i = 0; i < descriptor->metric_count; i++) {
+            if (strcmp(descriptor->metrics[i].type, type->valuestring) != 0) {
+                continue;
+            }
+            MetricFilter_t *filter = &config->metric_filters[i];
+            cJSON *deadband = cJSON_GetObjectItem(metric_object, "deadband");
+            if (cJSON_IsNumber(deadband)) {
+                filter->deadband = (float) deadband->valuedouble;
+            }
+            cJSON *percent = cJSON_GetObjectItem(metric_object, "percent");
+            if (percent != NULL) {
+                filter->deadband_percent = cJSON_IsTrue(percent);
+            }
+            cJSON *heartbeat = cJSON_GetObjectItem(metric_object, "heartbeat");
+            if (cJSON_IsNumber(heartbeat) && heartbeat->valueint >= 0) {
+                filter->heartbeat = heartbeat->valueint;
+            }
+        }
+    }
+}
+
 cJSON* make_sensors_item_object(Config_t *config) {
     cJSON *item = cJSON_CreateObject();
     cJSON_AddNumberToObject(item, "task_id", config->task_id);
     cJSON *pool_object = make_pool_object(config);
     cJSON_AddItemToObject(item, "pool", pool_object);
+    cJSON *rollup_object = cJSON_CreateObject();
+    cJSON_AddNumberToObject(rollup_object, "interval", config->report_interval);
+    cJSON_AddBoolToObject(rollup_object, "p95", config->rollup_p95);
+    cJSON_AddItemToObject(item, "rollup", rollup_object);
+    cJSON_AddItemToObject(item, "metrics", make_metrics_filter_array(config));
     cJSON_AddBoolToObject(item, "active", config->active);
     return item;
 }
 
+// Chunked answer of the query action
+typedef struct {
+    char *topic;
+    cJSON *request;     // echoed in every chunk
+    size_t mark;        // json_arena mark after the request, a chunk is released at once
+    cJSON *points;
+    size_t count;
+    size_t chunk;
+    size_t total;       // points sent, at most CONFIG_TSDB_QUERY_MAX_POINTS
+    bool truncated;
+    int64_t resume_ms;  // time of the first point not sent
+} query_response_t;
+
+static void publish_query_chunk(query_response_t *response, bool last) {
+    cJSON *payload = cJSON_Duplicate(response->request, 1);
+    cJSON_AddNumberToObject(payload, "chunk", response->chunk++);
+    cJSON_AddBoolToObject(payload, "last", last);
+    cJSON_AddItemToObject(payload, "points", response->points);
+    // create_message_config takes the payload and its points
+    char *msg_query = create_message_config("query", payload);
+    char *message = create_mqtt_message(msg_query);
+    if (message != NULL) {
+        publish(response->topic, message);
+    }
+    cJSON_free(message);
+    cJSON_free(msg_query);
+    response->points = NULL;
+    response->count = 0;
+    if (!last) {
+        // the request is not changed before the last chunk, the rest of the
+        // chunk goes with the rewind
+        json_arena_rewind(response->mark);
+        response->points = cJSON_CreateArray();
+    }
+}
+
+static bool query_point_cb(int64_t time_ms, float value, void *ctx) {
+    query_response_t *response = (query_response_t *) ctx;
+    if (response->total == CONFIG_TSDB_QUERY_MAX_POINTS) {
+        response->truncated = true;
+        response->resume_ms = time_ms;
+        return false;
+    }
+    if (response->count == CONFIG_TSDB_QUERY_CHUNK) {
+        publish_query_chunk(response, false);
+        // publish drops the message when the queue is full, let it drain
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    cJSON *point = cJSON_CreateArray();
+    cJSON_AddItemToArray(point, cJSON_CreateNumber((double) time_ms));
+    cJSON_AddItemToArray(point, cJSON_CreateNumber(round(value * 100.0) / 100.0));
+    cJSON_AddItemToArray(response->points, point);
+    response->count++;
+    response->total++;
+    return true;
+}
+
 cJSON * create_read_sensor_response_json(Config_t *config[]) {
     // Create the payload object
     cJSON *payload = cJSON_CreateObject();
@@ -93,24 +216,31 @@ void new_config_message(char* action, char* type, char *payload) {
 
             char * msg_read = create_message_config("read", payloadRet);
             message = create_mqtt_message(msg_read);
-            publish(create_topic("config", "dashboard", false), message);
-            free(message);
-            free(msg_read);
+            char *topic = create_topic("config", "dashboard", false);
+            publish(topic, message);
+            free(topic);
+            cJSON_free(message);
+            cJSON_free(msg_read);
+            cJSON_Delete(payloadObj);
             return;
         }
 
         // print the config
         for (size_t i = 0; config[i] != NULL; i++) {
-            ESP_LOGI("[new_config_message]", "Task: %d", config[i]->task_id);
-            ESP_LOGI("[new_config_message]", "Polling Time: %d", config[i]->polling_time);
+            ESP_LOGI("[new_config_message]", "Task: %zu", config[i]->task_id);
+            ESP_LOGI("[new_config_message]", "Polling Time: %zu", config[i]->polling_time);
             ESP_LOGI("[new_config_message]", "Active: %d", config[i]->active);
         }
 
         cJSON * payloadRet = create_read_sensor_response_json(config);
+        for (size_t i = 0; config[i] != NULL; i++) {
+            free(config[i]);
+        }
+        free(config);
 
         char * msg_read = create_message_config("read", payloadRet);
         message = create_mqtt_message(msg_read);
-        free(msg_read);
+        cJSON_free(msg_read);
 
     } else if (!strcmp(action, "write")) {
         // Write the configuration
@@ -122,11 +252,19 @@ void new_config_message(char* action, char* type, char *payload) {
         //     "payload": { 
         //         "sensors": [{
         //             "task_id": 1,
-        //             "pool": { "actual_time": 15000 },
+        //             "pool": { "actual_time": 15000, "aligned": true },
+        //             "rollup": { "interval": 60000, "p95": true },
+        //             "metrics": [{ "type": "temperature", "deadband": 0.5, "percent": false, "heartbeat": 600000 }],
         //             "active": true
         //         }]
         //     }
         // }
+        // rollup is optional: the readings are aggregated and published every
+        // interval ms, an interval of 0 publishes every reading
+        // aligned is optional: readings on the multiples of actual_time of the mesh clock
+        // metrics is optional: a value is only published when it moves more than
+        // the deadband (absolute or % of the last published value) or when the
+        // heartbeat (ms) elapsed since the last publish
         // Minified Example:
         // {"action":"write","sender_client_id":"iotconsole-a7124307-8b16-4083-ad16-a23a60eb898b","type":"config","payload":{"sensors":[{"task_id":1,"pool":{"actual_time":15000},"active":true}]}}
 
@@ -138,9 +276,11 @@ void new_config_message(char* action, char* type, char *payload) {
 
             char * msg_write = create_message_config("write", payloadRet);
             message = create_mqtt_message(msg_write);
-            publish(create_topic("config", "dashboard", false), message);
-            free(message);
-            free(msg_write);
+            char *topic = create_topic("config", "dashboard", false);
+            publish(topic, message);
+            free(topic);
+            cJSON_free(message);
+            cJSON_free(msg_write);
             return;
         }
         
@@ -154,19 +294,45 @@ void new_config_message(char* action, char* type, char *payload) {
         cJSON *sensors_array = cJSON_CreateArray();
 
         for (int i = 0; i < sensors_len; i++) {
-            Config_t newConfig;
+            Config_t newConfig = { 0 };
             cJSON *sensor_config = cJSON_GetArrayItem(sensors, i);
             newConfig.task_id = cJSON_GetObjectItem(sensor_config,"task_id")->valueint;
-            ESP_LOGW("[new_config_message]", "Writing config for task id: %d", newConfig.task_id);
+            // fields left out of the payload keep their current value
+            TaskConfigSlot_t *slot = get_task_config_slot(newConfig.task_id);
+            if (slot != NULL) {
+                read_task_config(slot, &newConfig);
+            }
+            ESP_LOGW("[new_config_message]", "Writing config for task id: %zu", newConfig.task_id);
             newConfig.active = cJSON_GetObjectItem(sensor_config,"active")->valueint;
 
             cJSON *pool = cJSON_GetObjectItem(sensor_config,"pool");
             newConfig.polling_time = cJSON_GetObjectItem(pool,"actual_time")->valueint;
+            cJSON *aligned = cJSON_GetObjectItem(pool,"aligned");
+            if (aligned != NULL) {
+                newConfig.aligned = cJSON_IsTrue(aligned);
+            }
+
+            cJSON *rollup = cJSON_GetObjectItem(sensor_config,"rollup");
+            if (rollup != NULL) {
+                cJSON *interval = cJSON_GetObjectItem(rollup,"interval");
+                if (cJSON_IsNumber(interval) && interval->valueint >= 0) {
+                    newConfig.report_interval = interval->valueint;
+                }
+                cJSON *p95 = cJSON_GetObjectItem(rollup,"p95");
+                if (p95 != NULL) {
+                    newConfig.rollup_p95 = cJSON_IsTrue(p95);
+                }
+            }
+
+            cJSON *metrics = cJSON_GetObjectItem(sensor_config,"metrics");
+            if (slot != NULL && cJSON_IsArray(metrics)) {
+                parse_metrics_filter_array(metrics, &newConfig);
+            }
 
-            // check if task_id exists
-            char *task_name = get_task_name_by_id(newConfig.task_id);
-            if (task_name == NULL) {
-                ESP_LOGE("[new_config_message]", "Task %d not found", newConfig.task_id);  
+            // check if task_id exists and its sensor was created on this node
+            const sensor_descriptor_t *descriptor = sensor_descriptor_get(newConfig.task_id);
+            if (descriptor == NULL || slot == NULL) {
+                ESP_LOGE("[new_config_message]", "Task %zu not found", newConfig.task_id);  
                 cJSON *sensor_object = cJSON_CreateObject();
                 cJSON_AddNumberToObject(sensor_object, "task_id", newConfig.task_id);
                 cJSON_AddStringToObject(sensor_object, "status", "error");
@@ -176,6 +342,11 @@ void new_config_message(char* action, char* type, char *payload) {
             }
             // Update the task config with new values
             Config_t *settedConfig = update_task_config(newConfig.task_id, newConfig);
+            // keeps the filters (and the rest of the config) across reboots,
+            // written to flash once the burst of edits is over
+            if (save_task_config(newConfig.task_id) != ESP_OK) {
+                ESP_LOGW("[new_config_message]", "Task %zu config not persisted", newConfig.task_id);
+            }
 
             // Create sensor object for the response
             cJSON *sensor_object = make_sensors_item_object(settedConfig);
@@ -183,16 +354,168 @@ void new_config_message(char* action, char* type, char *payload) {
             // Set the status anb the message for the sensor object
             cJSON_AddStringToObject(sensor_object, "status", "ok");
             char * message_str;
-            asprintf(&message_str, "Configuration saved task id: %d, task name: %s", newConfig.task_id, task_name);
+            asprintf(&message_str, "Configuration saved task id: %zu, task name: %s", newConfig.task_id, descriptor->task_name);
             cJSON_AddStringToObject(sensor_object, "message", message_str);
             free(message_str);
+            free(settedConfig);
             cJSON_AddItemToArray(sensors_array, sensor_object);
         }
 
         cJSON_AddItemToObject(payloadRet, "sensors", sensors_array);
         char * msg_write = create_message_config("write", payloadRet);
         message = create_mqtt_message(msg_write);
-        free(msg_write);
+        cJSON_free(msg_write);
+    } else if (!strcmp(action, "benchmark")) {
+        // Start a throughput benchmark from this node (only on the particular topic)
+        // Example:
+        // {
+        //     "action": "benchmark",
+        //     "sender_client_id": "iotconsole-a7124307-8b16-4083-ad16-a23a60eb898b",
+        //     "type": "config",
+        //     "payload": { "path": "raw", "target": "root", "duration": 10000, "size": 1000 }
+        // }
+        // path: raw (esp_mesh_send), udp or tcp (mesh netifs)
+        // target: STA MAC for raw, mesh IP for udp/tcp, or "root"
+        // Minified Example:
+        // {"action":"benchmark","sender_client_id":"iotconsole-a7124307-8b16-4083-ad16-a23a60eb898b","type":"config","payload":{"path":"udp","target":"10.0.0.1","duration":10000,"size":1000}}
+        cJSON *payloadRet = cJSON_CreateObject();
+        benchmark_params_t params;
+        if (!benchmark_parse_params(payloadObj, &params)) {
+            cJSON_AddStringToObject(payloadRet, "status", "error");
+            cJSON_AddStringToObject(payloadRet, "message", "Invalid benchmark payload");
+        } else {
+            esp_err_t err = benchmark_start(&params);
+            cJSON_AddStringToObject(payloadRet, "status", err == ESP_OK ? "ok" : "error");
+            cJSON_AddStringToObject(payloadRet, "message", err == ESP_OK ? "Benchmark started" : esp_err_to_name(err));
+        }
+        char * msg_benchmark = create_message_config("benchmark", payloadRet);
+        message = create_mqtt_message(msg_benchmark);
+        cJSON_free(msg_benchmark);
+    } else if (!strcmp(action, "query")) {
+        // Readings stored on the node, answered in chunks of CONFIG_TSDB_QUERY_CHUNK points
+        // Example:
+        // {
+        //     "action": "query",
+        //     "sender_client_id": "iotconsole-a7124307-8b16-4083-ad16-a23a60eb898b",
+        //     "type": "config",
+        //     "payload": { "task_id": 1, "metric": "temperature", "from": 1700000000000, "to": 1700003600000, "step": 60000 }
+        // }
+        // from and to are epoch ms, to defaults to now. step is optional: the
+        // readings are averaged per step ms, without it every reading is sent.
+        // Every chunk echoes the request with "chunk" (from 0), "last" and
+        // "points": [[epoch_ms, value], ...]
+        // At most CONFIG_TSDB_QUERY_MAX_POINTS points are sent per query. Past
+        // it the last chunk has "truncated": true and "resume_from", the from
+        // of the query that gets the next points (or use a larger step)
+        // Minified Example:
+        // {"action":"query","sender_client_id":"iotconsole-a7124307-8b16-4083-ad16-a23a60eb898b","type":"config","payload":{"task_id":1,"metric":"temperature","from":1700000000000}}
+        cJSON *task_id = cJSON_GetObjectItem(payloadObj, "task_id");
+        cJSON *metric = cJSON_GetObjectItem(payloadObj, "metric");
+        cJSON *from = cJSON_GetObjectItem(payloadObj, "from");
+        cJSON *to = cJSON_GetObjectItem(payloadObj, "to");
+        cJSON *step = cJSON_GetObjectItem(payloadObj, "step");
+
+        const sensor_descriptor_t *descriptor = cJSON_IsNumber(task_id) ? sensor_descriptor_get(task_id->valueint) : NULL;
+        int metric_index = -1;
+        for (size_t i = 0; descriptor != NULL && cJSON_IsString(metric) && i < descriptor->metric_count; i++) {
+            if (strcmp(descriptor->metrics[i].type, metric->valuestring) == 0) {
+                metric_index = i;
+            }
+        }
+
+        if (metric_index < 0 || !cJSON_IsNumber(from)) {
+            cJSON *payloadRet = cJSON_CreateObject();
+            cJSON_AddStringToObject(payloadRet, "status", "error");
+            cJSON_AddStringToObject(payloadRet, "message", "Invalid query payload");
+            char * msg_query = create_message_config("query", payloadRet);
+            message = create_mqtt_message(msg_query);
+            cJSON_free(msg_query);
+        } else {
+            int64_t to_ms;
+            if (cJSON_IsNumber(to)) {
+                to_ms = (int64_t) to->valuedouble;
+            } else {
+                struct timeval tv;
+                gettimeofday(&tv, NULL);
+                to_ms = (int64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+            }
+            uint32_t step_ms = cJSON_IsNumber(step) && step->valuedouble > 0 ? (uint32_t) step->valuedouble : 0;
+
+            query_response_t response = {
+                .topic = create_topic("config", "dashboard", false),
+                .request = cJSON_CreateObject()
+            };
+            cJSON_AddNumberToObject(response.request, "task_id", task_id->valueint);
+            cJSON_AddStringToObject(response.request, "metric", metric->valuestring);
+            cJSON_AddNumberToObject(response.request, "from", from->valuedouble);
+            cJSON_AddNumberToObject(response.request, "to", (double) to_ms);
+            cJSON_AddNumberToObject(response.request, "step", step_ms);
+            response.mark = json_arena_mark();
+            response.points = cJSON_CreateArray();
+
+            esp_err_t err = tsdb_query(SENSOR_SERIES(task_id->valueint, metric_index), (int64_t) from->valuedouble,
+                                       to_ms, step_ms, query_point_cb, &response);
+            if (err != ESP_OK) {
+                cJSON_AddStringToObject(response.request, "status", "error");
+                cJSON_AddStringToObject(response.request, "message", err == ESP_ERR_NOT_FOUND ? "No readings stored on this node" : esp_err_to_name(err));
+            } else {
+                cJSON_AddStringToObject(response.request, "status", "ok");
+            }
+            if (response.truncated) {
+                cJSON_AddBoolToObject(response.request, "truncated", true);
+                cJSON_AddNumberToObject(response.request, "resume_from", (double) response.resume_ms);
+            }
+            publish_query_chunk(&response, true);
+            cJSON_Delete(response.request);
+            free(response.topic);
+        }
+    } else if (!strcmp(action, "heap")) {
+        // Live allocations per call stack, with MESH_HEAP_TRACKING (debug builds)
+        // Example:
+        // {
+        //     "action": "heap",
+        //     "sender_client_id": "iotconsole-a7124307-8b16-4083-ad16-a23a60eb898b",
+        //     "type": "config",
+        //     "payload": { "top": 10 }
+        // }
+        // The report is published on /mesh/[mesh_id]/devices/[device_id]/diagnostics
+        // as the heap_summary and heap_sites sections
+        // Minified Example:
+        // {"action":"heap","sender_client_id":"iotconsole-a7124307-8b16-4083-ad16-a23a60eb898b","type":"config","payload":{"top":10}}
+        cJSON *payloadRet = cJSON_CreateObject();
+#if CONFIG_MESH_HEAP_TRACKING
+        cJSON *top = cJSON_GetObjectItem(payloadObj, "top");
+        performance_request_heap_report(cJSON_IsNumber(top) && top->valueint > 0 ? top->valueint : 10);
+        cJSON_AddStringToObject(payloadRet, "status", "ok");
+        cJSON_AddStringToObject(payloadRet, "message", "Heap report requested");
+#else
+        cJSON_AddStringToObject(payloadRet, "status", "error");
+        cJSON_AddStringToObject(payloadRet, "message", "Heap tracking is disabled");
+#endif
+        char * msg_heap = create_message_config("heap", payloadRet);
+        message = create_mqtt_message(msg_heap);
+        cJSON_free(msg_heap);
+    } else if (!strcmp(action, "topology")) {
+        // Full snapshot of the mesh tree, for a dashboard that missed the last one
+        // Example:
+        // {
+        //     "action": "topology",
+        //     "sender_client_id": "iotconsole-a7124307-8b16-4083-ad16-a23a60eb898b",
+        //     "type": "config",
+        //     "payload": {}
+        // }
+        // Only the root answers, the snapshot is published on /mesh/[mesh_id]/topology
+        // Minified Example:
+        // {"action":"topology","sender_client_id":"iotconsole-a7124307-8b16-4083-ad16-a23a60eb898b","type":"config","payload":{}}
+        if (esp_mesh_is_root()) {
+            topology_request_snapshot();
+            cJSON *payloadRet = cJSON_CreateObject();
+            cJSON_AddStringToObject(payloadRet, "status", "ok");
+            cJSON_AddStringToObject(payloadRet, "message", "Topology snapshot requested");
+            char * msg_topology = create_message_config("topology", payloadRet);
+            message = create_mqtt_message(msg_topology);
+            cJSON_free(msg_topology);
+        }
     } else {
         ESP_LOGE("[new_config_message]", "Unknown action");
         cJSON *payloadRet = cJSON_CreateObject();
@@ -200,22 +523,22 @@ void new_config_message(char* action, char* type, char *payload) {
         cJSON_AddStringToObject(payloadRet, "message", "Unknown Action");
         char * msg_write = create_message_config("write", payloadRet);
         message = create_mqtt_message(msg_write);
-        free(msg_write);
+        cJSON_free(msg_write);
     }
 
     if (message != NULL) {
-        publish(create_topic("config", "dashboard", false), message);
+        char *topic = create_topic("config", "dashboard", false);
+        publish(topic, message);
+        free(topic);
     }
-    free(message);
+    cJSON_free(message);
+    cJSON_Delete(payloadObj);
 }
 
 
-/* suscriber_particular_config_handler
-*  Description: Event handler for the config particular suscription
-*/
-void suscriber_particular_config_handler(char* topic, char* message) {
+static void particular_config_handler(char* topic, char* message) {
     ESP_LOGI("[suscriber_particular_config_handler]", "Config EVENT HANDLER");
-    ESP_LOGI("[suscriber_particular_config_handler]", "Message: %s", message);
+    DLOG_I("[suscriber_particular_config_handler]", "Message: %s", message);
     cJSON *root = cJSON_Parse(message);
     if (root == NULL) {
         ESP_LOGE("[suscriber_particular_config_handler]", "Error parsing JSON");
@@ -228,6 +551,7 @@ void suscriber_particular_config_handler(char* topic, char* message) {
     // if the sender_client_id is the same as the current client_id then ignore the message
     if (strcmp(sender_client_id, clientIdentifier) == 0) {
         ESP_LOGI("[suscriber_particular_config_handler]", "Ignoring message from self");
+        cJSON_Delete(root);
         return;
     }
 
@@ -242,7 +566,7 @@ void suscriber_particular_config_handler(char* topic, char* message) {
     if (payload != NULL) {
         // convert cJson payload to string
         payload_str = cJSON_Print(payload);
-        ESP_LOGI("[suscriber_particular_config_handler]", "Payload: %s", payload_str);
+        DLOG_I("[suscriber_particular_config_handler]", "Payload: %s", payload_str);
     }
 
     if (!strcmp(type, "config")) {
@@ -252,20 +576,24 @@ void suscriber_particular_config_handler(char* topic, char* message) {
         cJSON *sensor_object = cJSON_CreateObject();
         cJSON_AddStringToObject(sensor_object, "status", "error");
         cJSON_AddStringToObject(sensor_object, "message", "Unknown Type");
-        char *msg_payload = cJSON_Print(sensor_object);  
-        asprintf(&message, "{\"action\": \"%s\", \"sender_client_id\": \"%s\", \"type\": \"config\", \"payload\": %s }", action, clientIdentifier, msg_payload);
-        publish(create_topic("config", "dashboard", true), message);
-        free(msg_payload);
+        char *msg_payload = cJSON_Print(sensor_object);
+        cJSON_Delete(sensor_object);
+        char *response;
+        asprintf(&response, "{\"action\": \"%s\", \"sender_client_id\": \"%s\", \"type\": \"config\", \"payload\": %s }", action, clientIdentifier, msg_payload);
+        char *response_topic = create_topic("config", "dashboard", true);
+        publish(response_topic, response);
+        free(response_topic);
+        free(response);
+        cJSON_free(msg_payload);
     }
+    cJSON_free(payload_str);
+    cJSON_Delete(root);
 }
 
 
-/* suscriber_global_config_handler
-*  Description: Event handler for the config global suscription
-*/
-void suscriber_global_config_handler(char* topic, char* message) {
+static void global_config_handler(char* topic, char* message) {
     ESP_LOGI("[suscriber_config_handler]", "Config EVENT HANDLER");
-    ESP_LOGI("[suscriber_config_handler]", "Message: %s", message);
+    DLOG_I("[suscriber_config_handler]", "Message: %s", message);
     cJSON *root = cJSON_Parse(message);
     if (root == NULL) {
         ESP_LOGE("[suscriber_config_handler]", "Error parsing JSON");
@@ -277,6 +605,7 @@ void suscriber_global_config_handler(char* topic, char* message) {
     // if the sender_client_id is the same as the current client_id then ignore the message
     if (strcmp(sender_client_id, clientIdentifier) == 0) {
         ESP_LOGI("[suscriber_config_handler]", "Ignoring message from self");
+        cJSON_Delete(root);
         return;
     }
     // get the action of the message
@@ -290,7 +619,7 @@ void suscriber_global_config_handler(char* topic, char* message) {
         // get the payload
         cJSON *payload = cJSON_GetObjectItem(root,"payload");
         payload_str = cJSON_Print(payload);
-        ESP_LOGI("[suscriber_particular_config_handler]", "Payload: %s", payload_str);
+        DLOG_I("[suscriber_particular_config_handler]", "Payload: %s", payload_str);
     }
 
     if (!strcmp(type, "config")) {
@@ -299,9 +628,61 @@ void suscriber_global_config_handler(char* topic, char* message) {
         ESP_LOGE("[suscriber_global_config_handler]", "Unknown type");
         char *msg_payload;
         asprintf(&msg_payload, "\"status\": \"ok\", \"message\": \"Unknown Type\"");
-        asprintf(&message, "{\"action\": \"%s\", \"sender_client_id\": \"%s\", \"type\": \"config\", \"payload\": {%s}}", action, clientIdentifier, msg_payload);
-        publish(create_topic("config", "dashboard", false), message);
+        char *response;
+        asprintf(&response, "{\"action\": \"%s\", \"sender_client_id\": \"%s\", \"type\": \"config\", \"payload\": {%s}}", action, clientIdentifier, msg_payload);
+        char *response_topic = create_topic("config", "dashboard", false);
+        publish(response_topic, response);
+        free(response_topic);
+        free(response);
         free(msg_payload);
     }
+    cJSON_free(payload_str);
+    cJSON_Delete(root);
+}
+
+/* publish_arena_error
+*  Description: Answers a command that ran out of arena memory, its partial
+*  answers were not published. Called once the arena is released, the
+*  answer is built on the heap
+*/
+static void publish_arena_error(char* message) {
+    cJSON *root = cJSON_Parse(message);
+    cJSON *action = cJSON_GetObjectItem(root, "action");
+    cJSON *payloadRet = cJSON_CreateObject();
+    cJSON_AddStringToObject(payloadRet, "status", "error");
+    cJSON_AddStringToObject(payloadRet, "message", "Answer too large for the JSON arena");
+    char *msg_error = create_message_config(cJSON_IsString(action) ? action->valuestring : "unknown", payloadRet);
+    char *response = create_mqtt_message(msg_error);
+    char *topic = create_topic("config", "dashboard", false);
+    publish(topic, response);
+    free(topic);
+    cJSON_free(response);
+    cJSON_free(msg_error);
+    cJSON_Delete(root);
 }
 
+/* suscriber_particular_config_handler
+*  Description: Event handler for the config particular suscription, the
+*  command runs in a cJSON arena released when it returns
+*/
+void suscriber_particular_config_handler(char* topic, char* message) {
+    json_arena_t arena;
+    json_arena_begin(&arena);
+    particular_config_handler(topic, message);
+    if (!json_arena_end(&arena)) {
+        publish_arena_error(message);
+    }
+}
+
+/* suscriber_global_config_handler
+*  Description: Event handler for the config global suscription, the
+*  command runs in a cJSON arena released when it returns
+*/
+void suscriber_global_config_handler(char* topic, char* message) {
+    json_arena_t arena;
+    json_arena_begin(&arena);
+    global_config_handler(topic, message);
+    if (!json_arena_end(&arena)) {
+        publish_arena_error(message);
+    }
+}
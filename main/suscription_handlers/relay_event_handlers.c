@@ -5,6 +5,31 @@
 */
 #include "../relays/relays.h"
 #include "../performance/performance.h"
+#include "../dlog/dlog.h"
+#include "../json_arena/json_arena.h"
+
+/*
+  * Function: add_relay_status
+  * ----------------------------
+  *   Adds the status of a relay write to its item of the answer
+  *
+*/
+static void add_relay_status(cJSON *item_relay, int status) {
+    const char *error = NULL;
+    switch (status) {
+        case RELAY_OK: break;
+        case RELAY_NOT_FOUND: error = "Invalid relay_id"; break;
+        case RELAY_INVALID_STATE: error = "Invalid state value"; break;
+        case RELAY_NOT_SCHEDULED: error = "Nothing scheduled on the relay"; break;
+        case RELAY_CLOCK_NOT_SYNCED: error = "Clock not synchronised"; break;
+        case RELAY_TIME_PASSED: error = "Time already passed"; break;
+        default: error = "Unknown error"; break;
+    }
+    cJSON_AddStringToObject(item_relay, "status", error == NULL ? "ok" : "error");
+    if (error != NULL) {
+        cJSON_AddStringToObject(item_relay, "message", error);
+    }
+}
 
 char * create_message_relay(char* type, cJSON* payload) {
     cJSON *root = cJSON_CreateObject();
@@ -19,31 +44,36 @@ char * create_message_relay(char* type, cJSON* payload) {
     if (payload != NULL)
         cJSON_AddItemToObject(root, "payload", payload);
     
-    char *message = cJSON_PrintUnformatted(root);
+    char *message = cJSON_PrintBuffered(root, MAX_MESSAGE_LENGTH, false);
     cJSON_Delete(root);
     return message;
 }
 
 /*
-  * Function: relay_event_handler
+  * Function: handle_relay_event
   * ----------------------------
-  *   Event handler for the relay suscription
+  *   Runs a relay command and publishes its answer
   *
+  *   returns: true once a write started to act on the relays
 */
-void relay_event_handler(char* topic, char* message) {
+static bool handle_relay_event(char* topic, char* message) {
     ESP_LOGI("[relay_event_handler]", "Relay event handler");
-    ESP_LOGI("[relay_event_handler]", "Message: %s", message);
+    DLOG_I("[relay_event_handler]", "Message: %s", message);
     cJSON *root = cJSON_Parse(message);
     if (root == NULL) {
         ESP_LOGE("[relay_event_handler]", "Error parsing JSON");
         char *msg_payload;
         asprintf(&msg_payload, "\"status\": \"ok\", \"message\": \"Error parsing JSON\"");
         asprintf(&message, "{\"action\": \"write\", \"sender_client_id\": \"%s\", \"type\": \"config\", \"payload\": {%s}}", clientIdentifier, msg_payload);
-        publish(create_topic("relay", "dashboard", false), message);
+        char *topic = create_topic("relay", "dashboard", false);
+        publish(topic, message);
+        free(topic);
+        free(message);
         free(msg_payload);
-        return;
+        return false;
     }
 
+    bool applied = false;
     // get the action of the message
     char* action = cJSON_GetObjectItem(root,"action")->valuestring;
     // get the type
@@ -74,13 +104,13 @@ void relay_event_handler(char* topic, char* message) {
                 cJSON_AddItemToObject(payload_resp, "relay", payload_array);
                 char * msg_read = create_message_relay("read", payload_resp);
                 message = create_mqtt_message(msg_read);
-                free(msg_read);
+                cJSON_free(msg_read);
                 char *topic = create_topic("relay", "dashboard", false);
                 publish(topic, message);
                 free(topic);
-                free(message);
+                cJSON_free(message);
                 cJSON_Delete(root);
-                return;
+                return false;
             }
 
             // Create the payload object
@@ -91,7 +121,7 @@ void relay_event_handler(char* topic, char* message) {
             
             char * msg_read = create_message_relay("read", payload_resp);
             message = create_mqtt_message(msg_read);
-            free(msg_read);
+            cJSON_free(msg_read);
 
             // Create the topic
             char *topic = create_topic("relay", "dashboard", false);
@@ -99,7 +129,7 @@ void relay_event_handler(char* topic, char* message) {
             // Publish the message
             publish(topic, message);
             free(topic);
-            free(message);
+            cJSON_free(message);
         } else if (!strcmp(action, "write")) {
             // Write the relay configuration
             // Example:
@@ -116,6 +146,8 @@ void relay_event_handler(char* topic, char* message) {
             // }
             // Minified Example:
             // {"action":"write","sender_client_id":"iotconsole-a7124307-8b16-4083-ad16-a23a60eb898b","type":"relay","payload":{relay:[{"id": 1,"state":1}]}}
+            // Besides "state", a relay item takes "onTime" (ms) to pulse the relay, "at" (epoch seconds)
+            // to set "state" later, "extend" (ms) to delay its pulse or schedule and "cancel": true to drop it
 
             // create array for payload
             cJSON *payload_resp = cJSON_CreateObject();
@@ -130,17 +162,18 @@ void relay_event_handler(char* topic, char* message) {
                 cJSON_AddItemToObject(payload_resp, "relay", payload_array);
                 char * msg_read = create_message_relay("write", payload_resp);
                 message = create_mqtt_message(msg_read);
-                free(msg_read);
+                cJSON_free(msg_read);
                 char *topic = create_topic("relay", "dashboard", false);
                 publish(topic, message);
                 free(topic);
-                free(message);
+                cJSON_free(message);
                 cJSON_Delete(root);
-                return;
+                return false;
             }
                         
             cJSON* payload_relay = cJSON_GetObjectItem(payload, "relay");
             int relay_len = cJSON_GetArraySize(payload_relay);
+            applied = relay_len > 0;
             // for each element of the array of relays
             for (size_t i = 0; i< relay_len; i++) {
                 // get the relay item from the array
@@ -158,10 +191,25 @@ void relay_event_handler(char* topic, char* message) {
                 if (cJSON_HasObjectItem(payload_item, "onTime")) {
                     onTime = cJSON_GetObjectItem(payload_item, "onTime")->valueint;
                 }
+                // epoch time (seconds) at which state is set
+                cJSON *at = cJSON_GetObjectItem(payload_item, "at");
+                // milliseconds added to the pulse or schedule of the relay
+                cJSON *extend = cJSON_GetObjectItem(payload_item, "extend");
 
                 cJSON *item_relay = cJSON_CreateObject();
                 cJSON_AddNumberToObject(item_relay, "id", relay_id);
-                
+
+                if (cJSON_IsTrue(cJSON_GetObjectItem(payload_item, "cancel"))) {
+                    add_relay_status(item_relay, relay_cancel(relay_id));
+                    cJSON_AddItemToArray(payload_array, item_relay);
+                    continue;
+                }
+                if (cJSON_IsNumber(extend) && extend->valueint > 0) {
+                    add_relay_status(item_relay, relay_extend(relay_id, extend->valueint));
+                    cJSON_AddItemToArray(payload_array, item_relay);
+                    continue;
+                }
+
                 // Check values of state if onTime is not present
                 if ( onTime == -1 && state != 0 && state != 1) {
                     cJSON_AddStringToObject(item_relay, "status", "error");
@@ -173,38 +221,13 @@ void relay_event_handler(char* topic, char* message) {
                 cJSON_AddNumberToObject(item_relay, "state", state);
 
                 if (onTime > 0) {
-                    // if relay->onTimeTaskActive is 1 then return and do not turn off the relay
-                    int onTimeStatus = get_on_time_status(relay_id);
-                    if (onTimeStatus == 1) {
-                        ESP_LOGI("[onTimeTask]", "Relay id: %d already has an onTimeTask active", relay_id);
-                        cJSON_AddStringToObject(item_relay, "status", "error");
-                        cJSON_AddStringToObject(item_relay, "message", "Relay already has an onTimeTask active");
-                    } else if (onTimeStatus == -1) {
-                        ESP_LOGI("[onTimeTask]", "Relay id: %d not found", relay_id);
-                        cJSON_AddStringToObject(item_relay, "status", "error");
-                        cJSON_AddStringToObject(item_relay, "message", "Relay not found");
-                    } else {
-                        // Create the task to swith off the relay
-                        onTimeTaskArgs_t *args = malloc(sizeof(struct onTimeTaskArgs));
-                        args->relay_id = relay_id;
-                        args->onTime = onTime;
-                        xTaskCreate(onTimeTask, "onTimeTask", 2048, (void *) args, 5, NULL);
-                        log_memory();
-                    }
+                    // a pulse on a relay that already runs one restarts it
+                    add_relay_status(item_relay, relay_pulse(relay_id, onTime));
+                } else if (cJSON_IsNumber(at)) {
+                    add_relay_status(item_relay, relay_schedule(relay_id, state, (time_t) at->valuedouble));
                 } else {
                     // Set the relay state
-                    int status = set_relay_state(relay_id, state);
-                    if (status == -1) {
-                        cJSON_AddStringToObject(item_relay, "status", "error");
-                        cJSON_AddStringToObject(item_relay, "message", "Invalid relay_id");
-                        continue;
-                    } else if (status == -2) {
-                        cJSON_AddStringToObject(item_relay, "status", "error");
-                        cJSON_AddStringToObject(item_relay, "message", "Invalid state value");
-                        continue;
-                    } else {
-                        cJSON_AddStringToObject(item_relay, "status", "ok");
-                    }
+                    add_relay_status(item_relay, set_relay_state(relay_id, state));
                 }
                 cJSON_AddItemToArray(payload_array, item_relay);
             }
@@ -214,7 +237,7 @@ void relay_event_handler(char* topic, char* message) {
             
             char * msg_read = create_message_relay("write", payload_resp);
             message = create_mqtt_message(msg_read);
-            free(msg_read);
+            cJSON_free(msg_read);
 
             // Create the topic
             char *topic = create_topic("relay", "dashboard", false);
@@ -222,8 +245,41 @@ void relay_event_handler(char* topic, char* message) {
             // Publish the message
             publish(topic, message);
             free(topic);
-            free(message);
+            cJSON_free(message);
         }
     }
     cJSON_Delete(root);
-}
\ No newline at end of file
+    return applied;
+}
+
+/*
+  * Function: relay_event_handler
+  * ----------------------------
+  *   Event handler for the relay suscription, the command runs in a cJSON
+  *   arena released when it returns. When the arena is too small the
+  *   command is answered with an error, unless the relays were already
+  *   written: the answer then says so, a retry would apply an extend twice
+  *
+*/
+void relay_event_handler(char* topic, char* message) {
+    json_arena_t arena;
+    json_arena_begin(&arena);
+    bool applied = handle_relay_event(topic, message);
+    if (!json_arena_end(&arena)) {
+        // its partial answer was not published, answered on the heap now
+        cJSON *root = cJSON_Parse(message);
+        cJSON *action = cJSON_GetObjectItem(root, "action");
+        cJSON *payload_resp = cJSON_CreateObject();
+        cJSON_AddStringToObject(payload_resp, "status", applied ? "ok" : "error");
+        cJSON_AddStringToObject(payload_resp, "message", applied ? "Applied, answer too large for the JSON arena: read the relays for their state"
+                                                                 : "Answer too large for the JSON arena");
+        char *msg_error = create_message_relay(cJSON_IsString(action) ? action->valuestring : "write", payload_resp);
+        char *response = create_mqtt_message(msg_error);
+        char *response_topic = create_topic("relay", "dashboard", false);
+        publish(response_topic, response);
+        free(response_topic);
+        cJSON_free(response);
+        cJSON_free(msg_error);
+        cJSON_Delete(root);
+    }
+}
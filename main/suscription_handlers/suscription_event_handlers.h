@@ -21,12 +21,6 @@ void suscriber_particular_config_handler(char* topic, char* message);
 void relay_event_handler(char* topic, char* message);
 void relay_init();
 
-typedef struct {
-    char *topic;
-    char *message;
-    void (*handler)(char*, char*);
-} suscription_event_handler_t;
-
 extern const char FIRMWARE_VERSION[];
 extern const char FIRMWARE_REVISION[];
 
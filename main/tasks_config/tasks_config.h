@@ -6,12 +6,21 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "string.h"
-#include "../utils/uthash.h"
+#include "../utils/flat_map.h"
 #include "nvs_flash.h"
 #include "cJSON.h"
 
-#define TASKS_NAME_SIZE 255
 #define TASKS_CONFIG_PERSISTENCE_NAMESPACE "tasks_config"
+#define TASKS_CONFIG_MAX_METRICS 4
+// tasks with a config, one per sensor task
+#define TASKS_CONFIG_MAX_TASKS 16
+
+// Report by exception, per metric in the order the metrics were added
+typedef struct {
+    float deadband; // Minimum change from the last published value, 0 publishes every value
+    int deadband_percent; // If the deadband is a percentage of the last published value
+    size_t heartbeat; // Maximum time without publishing in ms, 0 means no heartbeat
+} MetricFilter_t;
 
 typedef struct {
     size_t task_id; // The task id
@@ -19,50 +28,40 @@ typedef struct {
     int min_polling_time; // The minimum time to wait for the next polling
     size_t polling_time; // The actual ammount of time to wait for the next polling
     int active; // If the task is active
+    size_t report_interval; // Rollup window, 0 publishes every reading
+    int rollup_p95; // If the rollup reports include the 95th percentile
+    MetricFilter_t metric_filters[TASKS_CONFIG_MAX_METRICS];
+    int aligned; // If the polling follows the synchronised wall clock (epoch-aligned)
 } Config_t;
 
+/*
+  * Versioned config of a task (seqlock). The version is odd while
+  * update_task_config writes it, readers copy the config and retry if the
+  * version changed meanwhile, so a read never locks nor allocates.
+*/
 typedef struct {
-    int task_id;                    /* key */
-    QueueHandle_t config;                        /* value: queue of 1 element to handle the peek and update of config */
-    UT_hash_handle hh;
-} TasksConfig_t;
+    volatile uint32_t version;
+    Config_t config;
+} TaskConfigSlot_t;
 
-typedef struct sensor_metric{
-    char * metric_type;
-    char * metric_unit;
-    struct sensor_metric * next;
-} SensorMetric_t;
+typedef void (*task_config_listener_t)(int task_id);
 
 typedef struct {
-    char task_name[TASKS_NAME_SIZE]; /* key */
-    int id;
-    char * sensor_name;
-    SensorMetric_t *sensor_metrics; // Metrics list
-    UT_hash_handle hh;
-} TasksMapping_t;
-
+    TaskConfigSlot_t slot;          /* value: the config, always validated, keyed by task id */
+} TasksConfig_t;
 
 // config functions
-void add_task_config(int task_id, char * type, Config_t config);
+void add_task_config(int task_id, const char * type, Config_t config);
 Config_t * get_task_config(int task_id);
 Config_t* update_task_config(int task_id, Config_t config);
 void validate_task_config(Config_t *config);
 Config_t ** get_all_tasks_config();
-void save_task_config(int task_id);
+esp_err_t save_task_config(int task_id);
 esp_err_t load_task_config(int task_id);
 
-// tasks mapping functions
-int get_task_id_by_name(char * task_name);
-char * get_task_name_by_id(int id);
-int add_task_mapping(char * task_name, char * sensor_name);
-
-// sensor metrics functions
-void add_sensor_metric(char* task_name, char * metric_type, char * metric_unit);
-
-char ** get_sensor_metrics_by_task_id(int id);
-cJSON * get_all_tasks_metrics_json();
-
-int ** get_all_tasks_ids();
-
+// lock-free access for the sensor jobs
+TaskConfigSlot_t * get_task_config_slot(int task_id);
+uint32_t read_task_config(const TaskConfigSlot_t *slot, Config_t *config);
+void set_task_config_listener(task_config_listener_t listener);
 
 #endif // TASKS_CONFIG_H
@@ -0,0 +1,316 @@
+/*
+*   Mesh time synchronisation
+*   Only the root talks to the NTP servers. Every other node runs an NTP style
+*   four timestamp exchange with the root over the raw mesh channel, keeps the
+*   sample with the smallest path delay out of a short burst and steps or slews
+*   its clock with the resulting offset. The exchange is repeated every
+*   CONFIG_MESH_TIME_SYNC_INTERVAL seconds to correct the drift.
+*/
+#include "time_sync.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/event_groups.h>
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "rtos_alloc/rtos_alloc.h"
+
+#define TIME_SYNC_TAG "time_sync"
+
+#ifndef CONFIG_MESH_TIME_SYNC_INTERVAL
+#define CONFIG_MESH_TIME_SYNC_INTERVAL 60
+#endif
+#ifndef CONFIG_MESH_TIME_SYNC_STEP_THRESHOLD
+#define CONFIG_MESH_TIME_SYNC_STEP_THRESHOLD 500
+#endif
+
+#define TIME_SYNC_FLAG_VALID     0x01 // the root clock has been set
+#define TIME_SYNC_BURST          4    // exchanges per sync, the fastest one wins
+#define TIME_SYNC_BURST_GAP_MS   50
+#define TIME_SYNC_RESP_WAIT_MS   500
+#define TIME_SYNC_RETRY_MS       2000 // until the first sync
+#define TIME_SYNC_SYNCED_BIT     BIT0
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef enum {
+    TIME_SOURCE_NONE = 0,
+    TIME_SOURCE_SNTP,
+    TIME_SOURCE_MESH
+} time_source_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static EventGroupHandle_t s_time_events = NULL;
+static QueueHandle_t s_sample_queue = NULL;
+static uint16_t s_seq = 0;
+static bool s_sntp_running = false;
+static time_source_t s_source = TIME_SOURCE_NONE;
+static int64_t s_last_offset_us = 0;
+static int64_t s_last_delay_us = 0;
+static uint32_t s_corrections = 0;
+
+static int64_t wall_time_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t) tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static void mark_synced(time_source_t source) {
+    s_source = source;
+    xEventGroupSetBits(s_time_events, TIME_SYNC_SYNCED_BIT);
+}
+
+/*******************************************************
+ *                Root: SNTP
+ *******************************************************/
+
+static void sntp_sync_cb(struct timeval *tv) {
+    ESP_LOGI(TIME_SYNC_TAG, "Root clock set by SNTP");
+    mark_synced(TIME_SOURCE_SNTP);
+}
+
+static void root_sntp_start(void) {
+    if (s_sntp_running) {
+        return;
+    }
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG_MULTIPLE(2,
+                           ESP_SNTP_SERVER_LIST("time.windows.com", "pool.ntp.org" ) );
+    config.sync_cb = sntp_sync_cb;
+    if (esp_netif_sntp_init(&config) == ESP_OK) {
+        s_sntp_running = true;
+        ESP_LOGI(TIME_SYNC_TAG, "SNTP started on the root");
+    }
+}
+
+static void root_sntp_stop(void) {
+    if (!s_sntp_running) {
+        return;
+    }
+    // only the root talks to the NTP servers, a demoted root goes back to mesh time
+    esp_netif_sntp_deinit();
+    s_sntp_running = false;
+    ESP_LOGI(TIME_SYNC_TAG, "SNTP stopped, no longer root");
+}
+
+/*
+  * Function: root_handle_request
+  * ----------------------------
+  *   Answers a node request with the receive and transmit timestamps of the
+  *   root. t2 is taken as soon as the frame is out of esp_mesh_recv.
+  *
+*/
+static void root_handle_request(mesh_addr_t *from, const time_sync_frame_t *request, int64_t t2_us) {
+    time_sync_frame_t response = *request;
+    response.cmd = CMD_TIME_SYNC_RESP;
+    response.flags = time_sync_is_synced() ? TIME_SYNC_FLAG_VALID : 0;
+    response.t2_us = t2_us;
+
+    mesh_data_t data;
+    data.data = (uint8_t *) &response;
+    data.size = sizeof(response);
+    data.proto = MESH_PROTO_BIN;
+    data.tos = MESH_TOS_P2P;
+    response.t3_us = wall_time_us();
+    // non blocking: we are running inside the netif rx task, a node that
+    // gets no response retries with its next request
+    esp_err_t err = esp_mesh_send(from, &data, MESH_DATA_P2P | MESH_DATA_NONBLOCK, NULL, 0);
+    if (err != ESP_OK) {
+        ESP_LOGW(TIME_SYNC_TAG, "Response to " MACSTR " failed: %s", MAC2STR(from->addr), esp_err_to_name(err));
+    }
+}
+
+/*******************************************************
+ *                Nodes: mesh time
+ *******************************************************/
+
+/*
+  * Function: exchange
+  * ----------------------------
+  *   One request/response round trip with the root
+  *
+  *   returns: true if a valid sample was received
+*/
+static bool exchange(time_sync_sample_t *sample) {
+    time_sync_frame_t request = {
+        .cmd = CMD_TIME_SYNC_REQ,
+        .seq = ++s_seq
+    };
+    mesh_data_t data;
+    data.data = (uint8_t *) &request;
+    data.size = sizeof(request);
+    data.proto = MESH_PROTO_BIN;
+    data.tos = MESH_TOS_P2P;
+
+    xQueueReset(s_sample_queue);
+    request.t1_us = wall_time_us();
+    // NULL destination without flags goes to the root
+    if (esp_mesh_send(NULL, &data, 0, NULL, 0) != ESP_OK) {
+        return false;
+    }
+    if (xQueueReceive(s_sample_queue, sample, pdMS_TO_TICKS(TIME_SYNC_RESP_WAIT_MS)) != pdTRUE) {
+        return false;
+    }
+    return sample->frame.seq == request.seq && (sample->frame.flags & TIME_SYNC_FLAG_VALID);
+}
+
+/*
+  * Function: apply_offset
+  * ----------------------------
+  *   Steps the clock on the first sync or when it is off by more than
+  *   CONFIG_MESH_TIME_SYNC_STEP_THRESHOLD ms, otherwise slews it with adjtime
+  *   so timestamps never jump backwards while the tasks are running
+  *
+*/
+static void apply_offset(int64_t offset_us) {
+    if (!time_sync_is_synced() || llabs(offset_us) > CONFIG_MESH_TIME_SYNC_STEP_THRESHOLD * 1000LL) {
+        int64_t now = wall_time_us() + offset_us;
+        struct timeval tv = {
+            .tv_sec = now / 1000000LL,
+            .tv_usec = now % 1000000LL
+        };
+        settimeofday(&tv, NULL);
+        ESP_LOGI(TIME_SYNC_TAG, "Clock stepped by %" PRId64 " us", offset_us);
+    } else {
+        struct timeval delta = {
+            .tv_sec = offset_us / 1000000LL,
+            .tv_usec = offset_us % 1000000LL
+        };
+        adjtime(&delta, NULL);
+        ESP_LOGD(TIME_SYNC_TAG, "Clock slewed by %" PRId64 " us", offset_us);
+    }
+}
+
+/*
+  * Function: node_sync
+  * ----------------------------
+  *   Runs a burst of exchanges and applies the offset of the one with the
+  *   smallest round trip, the least affected by queueing on the way
+  *
+  *   offset = ((t2 - t1) + (t3 - t4)) / 2
+  *   delay  = (t4 - t1) - (t3 - t2)
+  *
+  *   returns: true if the clock was corrected
+*/
+static bool node_sync(void) {
+    bool found = false;
+    int64_t best_offset = 0;
+    int64_t best_delay = INT64_MAX;
+    time_sync_sample_t sample;
+
+    for (int i = 0; i < TIME_SYNC_BURST; i++) {
+        if (exchange(&sample)) {
+            const time_sync_frame_t *f = &sample.frame;
+            int64_t delay = (sample.t4_us - f->t1_us) - (f->t3_us - f->t2_us);
+            if (delay >= 0 && delay < best_delay) {
+                best_delay = delay;
+                best_offset = ((f->t2_us - f->t1_us) + (f->t3_us - sample.t4_us)) / 2;
+                found = true;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(TIME_SYNC_BURST_GAP_MS));
+    }
+    if (!found) {
+        return false;
+    }
+
+    apply_offset(best_offset);
+    s_last_offset_us = best_offset;
+    s_last_delay_us = best_delay;
+    s_corrections++;
+    mark_synced(TIME_SOURCE_MESH);
+    return true;
+}
+
+void task_time_sync(void *args) {
+    ESP_LOGI(TIME_SYNC_TAG, "STARTED: task_time_sync");
+    while (1) {
+        uint32_t wait_ms = CONFIG_MESH_TIME_SYNC_INTERVAL * 1000;
+        if (esp_mesh_is_root()) {
+            root_sntp_start();
+        } else {
+            root_sntp_stop();
+            if (!node_sync()) {
+                ESP_LOGW(TIME_SYNC_TAG, "No valid answer from the root");
+                if (!time_sync_is_synced()) {
+                    wait_ms = TIME_SYNC_RETRY_MS;
+                }
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(wait_ms));
+    }
+    vTaskDelete(NULL);
+}
+
+/*******************************************************
+ *                Public API
+ *******************************************************/
+
+esp_err_t time_sync_start(void) {
+    static bool is_started = false;
+    if (is_started) {
+        return ESP_OK;
+    }
+    s_time_events = xEventGroupCreate();
+    s_sample_queue = rtos_alloc_queue(RTOS_QUEUE_TIME_SYNC_SAMPLE);
+    if (s_time_events == NULL || s_sample_queue == NULL) {
+        ESP_LOGE(TIME_SYNC_TAG, "Error creating the time sync queue");
+        return ESP_ERR_NO_MEM;
+    }
+    if (rtos_alloc_task(RTOS_TASK_TIME_SYNC, task_time_sync, NULL, NULL) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+    is_started = true;
+    return ESP_OK;
+}
+
+bool time_sync_wait(TickType_t timeout) {
+    if (s_time_events == NULL) {
+        return false;
+    }
+    EventBits_t bits = xEventGroupWaitBits(s_time_events, TIME_SYNC_SYNCED_BIT, pdFALSE, pdTRUE, timeout);
+    return (bits & TIME_SYNC_SYNCED_BIT) != 0;
+}
+
+bool time_sync_is_synced(void) {
+    return s_time_events != NULL && (xEventGroupGetBits(s_time_events) & TIME_SYNC_SYNCED_BIT);
+}
+
+void time_sync_raw_recv(mesh_addr_t *from, mesh_data_t *data) {
+    int64_t now = wall_time_us();
+    if (s_time_events == NULL || data->size != sizeof(time_sync_frame_t)) {
+        ESP_LOGE(TIME_SYNC_TAG, "Error in receiving time sync frame: Unexpected size");
+        return;
+    }
+    time_sync_frame_t frame;
+    memcpy(&frame, data->data, sizeof(frame));
+
+    if (frame.cmd == CMD_TIME_SYNC_REQ) {
+        if (esp_mesh_is_root()) {
+            root_handle_request(from, &frame, now);
+        }
+    } else if (frame.cmd == CMD_TIME_SYNC_RESP) {
+        time_sync_sample_t sample = {
+            .frame = frame,
+            .t4_us = now
+        };
+        xQueueOverwrite(s_sample_queue, &sample);
+    }
+}
+
+cJSON * time_sync_get_status(void) {
+    cJSON *status = cJSON_CreateObject();
+    const char *source = s_source == TIME_SOURCE_SNTP ? "sntp" : s_source == TIME_SOURCE_MESH ? "mesh" : "none";
+    cJSON_AddStringToObject(status, "source", source);
+    cJSON_AddBoolToObject(status, "synced", time_sync_is_synced());
+    cJSON_AddNumberToObject(status, "offset_us", (double) s_last_offset_us);
+    cJSON_AddNumberToObject(status, "delay_us", (double) s_last_delay_us);
+    cJSON_AddNumberToObject(status, "corrections", s_corrections);
+    return status;
+}
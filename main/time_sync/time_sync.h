@@ -0,0 +1,68 @@
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include "esp_err.h"
+#include "esp_mesh.h"
+#include "cJSON.h"
+
+/* Raw mesh commands used by the time exchange (see recv_cb in mesh_main.c) */
+#define CMD_TIME_SYNC_REQ  0x58
+#define CMD_TIME_SYNC_RESP 0x59
+
+typedef struct __attribute__((packed)) {
+    uint8_t cmd;        // CMD_TIME_SYNC_REQ or CMD_TIME_SYNC_RESP
+    uint8_t flags;      // TIME_SYNC_FLAG_*
+    uint16_t seq;
+    int64_t t1_us;      // node: request sent
+    int64_t t2_us;      // root: request received
+    int64_t t3_us;      // root: response sent
+} time_sync_frame_t;
+
+// a response as queued by the receive callback for the time sync task
+typedef struct {
+    time_sync_frame_t frame;
+    int64_t t4_us;      // node: response received
+} time_sync_sample_t;
+
+/*
+  * Function: time_sync_start
+  * ----------------------------
+  *   Starts the time sync task. The root keeps its clock with SNTP, every
+  *   other node asks the root over the raw mesh channel and corrects its
+  *   clock for the path delay. Safe to call more than once.
+  *
+*/
+esp_err_t time_sync_start(void);
+
+/*
+  * Function: time_sync_wait
+  * ----------------------------
+  *   Blocks until the clock has been set once (SNTP on the root, mesh time
+  *   on the rest of the nodes)
+  *
+  *   returns: true if the clock is valid, false on timeout
+*/
+bool time_sync_wait(TickType_t timeout);
+
+bool time_sync_is_synced(void);
+
+/*
+  * Function: time_sync_raw_recv
+  * ----------------------------
+  *   Handles CMD_TIME_SYNC_REQ/RESP frames received on the raw mesh channel
+  *
+*/
+void time_sync_raw_recv(mesh_addr_t *from, mesh_data_t *data);
+
+/*
+  * Function: time_sync_get_status
+  * ----------------------------
+  *   returns: cJSON object with the source, the last offset/path delay and
+  *            the number of corrections
+*/
+cJSON * time_sync_get_status(void);
+
+#endif // TIME_SYNC_H
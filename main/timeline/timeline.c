@@ -0,0 +1,290 @@
+/*
+*   Boot and reconnect timeline
+*   Stamps every phase from app_main to the first successful publish, and again
+*   from each MQTT reconnect to the next publish, so a slow recovery shows up as
+*   a number per phase. The last timelines are kept in RTC memory, unfinished
+*   ones included, so reboot loops are visible once the node gets online.
+*/
+#include "timeline.h"
+
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "mqtt/utils/mqtt_utils.h"
+
+#define TIMELINE_TAG "timeline"
+
+#ifndef CONFIG_MESH_TIMELINE_HISTORY
+#define CONFIG_MESH_TIMELINE_HISTORY 4
+#endif
+
+#define TIMELINE_RTC_MAGIC 0x544C494E // "TLIN"
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef struct {
+    uint32_t seq;
+    uint32_t start_ms;          // uptime at the start, 0 for a boot
+    uint32_t phases_ms[TIMELINE_PHASE_COUNT];
+    uint16_t reached;           // bit per phase
+    uint8_t kind;
+    uint8_t reason;
+    uint8_t flags;
+    uint8_t no_parent_scans;
+    uint8_t published;
+} timeline_entry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint8_t head;               // slot of the current timeline
+    timeline_entry_t entries[CONFIG_MESH_TIMELINE_HISTORY];
+    uint32_t checksum;
+} timeline_rtc_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+// survives esp_restart and panics, garbage after a power-on
+static RTC_NOINIT_ATTR timeline_rtc_t s_rtc;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_start_us = 0;
+static uint32_t s_boot_seq = 0;     // timelines before it belong to previous runs
+static volatile bool s_open = false;
+static volatile bool s_unpublished = false; // a report did not fit in the publisher queue
+
+static const char *s_phase_names[TIMELINE_PHASE_COUNT] = {
+    "app_main",
+    "wifi_ready",
+    "mesh_started",
+    "parent_connected",
+    "got_ip",
+    "time_synced",
+    "tasks_started",
+    "tls_connected",
+    "mqtt_connected",
+    "subscribed",
+    "first_publish"
+};
+
+static const char *s_reconnect_reasons[] = {
+    "publish_failed",
+    "process_loop_failed"
+};
+
+/*******************************************************
+ *                RTC state
+ *******************************************************/
+
+static uint32_t rtc_checksum(const timeline_rtc_t *rtc) {
+    const uint8_t *bytes = (const uint8_t *) rtc;
+    uint32_t sum = 0x811C9DC5;
+    for (size_t i = 0; i < offsetof(timeline_rtc_t, checksum); i++) {
+        sum = (sum ^ bytes[i]) * 0x01000193;
+    }
+    return sum;
+}
+
+static void rtc_commit(void) {
+    s_rtc.magic = TIMELINE_RTC_MAGIC;
+    s_rtc.checksum = rtc_checksum(&s_rtc);
+}
+
+static bool rtc_is_valid(void) {
+    esp_reset_reason_t reason = esp_reset_reason();
+    if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT || reason == ESP_RST_UNKNOWN) {
+        return false;
+    }
+    return s_rtc.magic == TIMELINE_RTC_MAGIC && s_rtc.checksum == rtc_checksum(&s_rtc)
+           && s_rtc.head < CONFIG_MESH_TIMELINE_HISTORY;
+}
+
+// must be called with s_lock held
+static timeline_entry_t *begin_locked(timeline_kind_t kind, uint8_t reason, int64_t now_us) {
+    s_rtc.head = (s_rtc.head + 1) % CONFIG_MESH_TIMELINE_HISTORY;
+    timeline_entry_t *entry = &s_rtc.entries[s_rtc.head];
+    memset(entry, 0, sizeof(*entry));
+    entry->seq = ++s_rtc.seq;
+    entry->kind = kind;
+    entry->reason = reason;
+    entry->start_ms = (uint32_t) (now_us / 1000);
+    s_start_us = now_us;
+    s_open = true;
+    return entry;
+}
+
+/*******************************************************
+ *                Report
+ *******************************************************/
+
+/*
+  * Function: publish_entry
+  * ----------------------------
+  *   Queues the report of a timeline
+  *
+  *   returns: false if the publisher queue was full
+*/
+static bool publish_entry(const timeline_entry_t *entry) {
+    cJSON *report = cJSON_CreateObject();
+    cJSON_AddNumberToObject(report, "seq", entry->seq);
+    if (entry->kind == TIMELINE_BOOT) {
+        cJSON_AddStringToObject(report, "kind", "boot");
+        cJSON_AddNumberToObject(report, "reset_reason", entry->reason);
+        cJSON_AddBoolToObject(report, "warm", (entry->flags & TIMELINE_FLAG_WARM_BOOT) != 0);
+        cJSON_AddBoolToObject(report, "parent_reused", (entry->flags & TIMELINE_FLAG_PARENT_REUSED) != 0);
+    } else {
+        cJSON_AddStringToObject(report, "kind", "reconnect");
+        cJSON_AddStringToObject(report, "reason", entry->reason < sizeof(s_reconnect_reasons) / sizeof(s_reconnect_reasons[0])
+                                                  ? s_reconnect_reasons[entry->reason] : "unknown");
+        cJSON_AddNumberToObject(report, "start_ms", entry->start_ms);
+    }
+    // an incomplete timeline of a previous run points at a reboot loop
+    cJSON_AddBoolToObject(report, "complete", (entry->reached & (1 << TIMELINE_PHASE_FIRST_PUBLISH)) != 0);
+    cJSON_AddBoolToObject(report, "previous_run", entry->seq < s_boot_seq);
+    cJSON_AddNumberToObject(report, "no_parent_scans", entry->no_parent_scans);
+    cJSON *phases = cJSON_AddObjectToObject(report, "phases_ms");
+    for (int i = 0; i < TIMELINE_PHASE_COUNT; i++) {
+        if (entry->reached & (1 << i)) {
+            cJSON_AddNumberToObject(phases, s_phase_names[i], entry->phases_ms[i]);
+        }
+    }
+    char *report_message = cJSON_PrintUnformatted(report);
+    cJSON_Delete(report);
+
+    char *message = create_mqtt_message(report_message);
+    char *topic = create_topic("timeline", "", true);
+    bool queued = message != NULL && publish(topic, message);
+    if (queued) {
+        ESP_LOGI(TIMELINE_TAG, "Timeline queued: %s", message);
+    }
+
+    free(topic);
+    free(message);
+    free(report_message);
+    return queued;
+}
+
+/*
+  * Function: publish_pending
+  * ----------------------------
+  *   Queues the unpublished timelines, oldest first. A timeline is marked
+  *   published once its report is in the publisher queue; when the queue
+  *   is full the rest waits for timeline_retry_pending.
+  *
+*/
+static void publish_pending(void) {
+    timeline_entry_t pending[CONFIG_MESH_TIMELINE_HISTORY];
+    int pending_count = 0;
+
+    // snapshot under the lock and build the messages outside of it
+    portENTER_CRITICAL(&s_lock);
+    uint8_t head = s_rtc.head;
+    for (int i = 1; i <= CONFIG_MESH_TIMELINE_HISTORY; i++) {
+        timeline_entry_t *entry = &s_rtc.entries[(head + i) % CONFIG_MESH_TIMELINE_HISTORY];
+        if (entry->seq != 0 && !entry->published) {
+            pending[pending_count++] = *entry;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    s_unpublished = false;
+    for (int i = 0; i < pending_count; i++) {
+        if (!publish_entry(&pending[i])) {
+            s_unpublished = true;
+            return;
+        }
+        portENTER_CRITICAL(&s_lock);
+        // the slot may have been reused by a new timeline meanwhile
+        for (int slot = 0; slot < CONFIG_MESH_TIMELINE_HISTORY; slot++) {
+            if (s_rtc.entries[slot].seq == pending[i].seq) {
+                s_rtc.entries[slot].published = 1;
+                rtc_commit();
+                break;
+            }
+        }
+        portEXIT_CRITICAL(&s_lock);
+    }
+}
+
+/*******************************************************
+ *                Public API
+ *******************************************************/
+
+void timeline_init(void) {
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    if (!rtc_is_valid()) {
+        memset(&s_rtc, 0, sizeof(s_rtc));
+    }
+    // a boot is measured from the reset, not from app_main
+    timeline_entry_t *entry = begin_locked(TIMELINE_BOOT, (uint8_t) esp_reset_reason(), 0);
+    entry->phases_ms[TIMELINE_PHASE_APP_MAIN] = (uint32_t) (now_us / 1000);
+    entry->reached |= 1 << TIMELINE_PHASE_APP_MAIN;
+    s_boot_seq = entry->seq;
+    rtc_commit();
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void timeline_begin_reconnect(timeline_reconnect_reason_t reason) {
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    begin_locked(TIMELINE_RECONNECT, (uint8_t) reason, now_us);
+    rtc_commit();
+    portEXIT_CRITICAL(&s_lock);
+    ESP_LOGW(TIMELINE_TAG, "Reconnect timeline started: %s", s_reconnect_reasons[reason]);
+}
+
+void timeline_stamp(timeline_phase_t phase) {
+    if (phase >= TIMELINE_PHASE_COUNT || !s_open) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+    bool closed = false;
+
+    portENTER_CRITICAL(&s_lock);
+    timeline_entry_t *entry = &s_rtc.entries[s_rtc.head];
+    if (!(entry->reached & (1 << phase))) {
+        entry->phases_ms[phase] = (uint32_t) ((now_us - s_start_us) / 1000);
+        entry->reached |= 1 << phase;
+        if (phase == TIMELINE_PHASE_FIRST_PUBLISH) {
+            s_open = false;
+            closed = true;
+        }
+        rtc_commit();
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (closed) {
+        publish_pending();
+    }
+}
+
+void timeline_set_flag(timeline_flag_t flag) {
+    portENTER_CRITICAL(&s_lock);
+    s_rtc.entries[s_rtc.head].flags |= flag;
+    rtc_commit();
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void timeline_note_no_parent(int scan_times) {
+    portENTER_CRITICAL(&s_lock);
+    s_rtc.entries[s_rtc.head].no_parent_scans = scan_times > UINT8_MAX ? UINT8_MAX : (uint8_t) scan_times;
+    rtc_commit();
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void timeline_retry_pending(void) {
+    if (s_unpublished && !s_open) {
+        publish_pending();
+    }
+}
+
+bool timeline_is_open(void) {
+    return s_open;
+}
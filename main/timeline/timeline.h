@@ -0,0 +1,93 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    TIMELINE_BOOT = 0,  // starts at reset, reason is the esp_reset_reason_t
+    TIMELINE_RECONNECT  // starts when the MQTT client loses the broker
+} timeline_kind_t;
+
+typedef enum {
+    TIMELINE_PHASE_APP_MAIN = 0,
+    TIMELINE_PHASE_WIFI_READY,
+    TIMELINE_PHASE_MESH_STARTED,
+    TIMELINE_PHASE_PARENT_CONNECTED,
+    TIMELINE_PHASE_GOT_IP,
+    TIMELINE_PHASE_TIME_SYNCED,
+    TIMELINE_PHASE_TASKS_STARTED,
+    TIMELINE_PHASE_TLS_CONNECTED,
+    TIMELINE_PHASE_MQTT_CONNECTED,
+    TIMELINE_PHASE_SUBSCRIBED,
+    TIMELINE_PHASE_FIRST_PUBLISH,
+    TIMELINE_PHASE_COUNT
+} timeline_phase_t;
+
+typedef enum {
+    TIMELINE_REASON_PUBLISH_FAILED = 0,
+    TIMELINE_REASON_PROCESS_LOOP_FAILED
+} timeline_reconnect_reason_t;
+
+typedef enum {
+    TIMELINE_FLAG_WARM_BOOT = 0x01,
+    TIMELINE_FLAG_PARENT_REUSED = 0x02
+} timeline_flag_t;
+
+/*
+  * Function: timeline_init
+  * ----------------------------
+  *   Recovers the timelines of the previous runs from RTC memory and starts
+  *   the boot timeline. Must be the first call of app_main.
+  *
+*/
+void timeline_init(void);
+
+/*
+  * Function: timeline_begin_reconnect
+  * ----------------------------
+  *   Starts a new timeline when the MQTT client has to reconnect. A timeline
+  *   already in progress is kept in the history as unfinished.
+  *
+*/
+void timeline_begin_reconnect(timeline_reconnect_reason_t reason);
+
+/*
+  * Function: timeline_stamp
+  * ----------------------------
+  *   Records the time since the start of the current timeline of the first
+  *   time a phase is reached. Reaching TIMELINE_PHASE_FIRST_PUBLISH closes the
+  *   timeline and queues every unpublished timeline on
+  *   /mesh/[mesh_id]/devices/[device_id]/timeline
+  *
+*/
+void timeline_stamp(timeline_phase_t phase);
+
+void timeline_set_flag(timeline_flag_t flag);
+
+/*
+  * Function: timeline_note_no_parent
+  * ----------------------------
+  *   Keeps the number of parent scans of the current timeline
+  *
+*/
+void timeline_note_no_parent(int scan_times);
+
+/*
+  * Function: timeline_retry_pending
+  * ----------------------------
+  *   Queues the timelines that did not fit in the publisher queue when the
+  *   last one closed. Called by the MQTT client while it is connected.
+  *
+*/
+void timeline_retry_pending(void);
+
+/*
+  * Function: timeline_is_open
+  * ----------------------------
+  *   returns: true until the current timeline reaches its first publish,
+  *   lets the MQTT client skip the stamp on the hot path
+*/
+bool timeline_is_open(void);
+
+#endif // TIMELINE_H
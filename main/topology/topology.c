@@ -0,0 +1,472 @@
+/*
+*   Mesh topology
+*   Every node sends a status frame (layer, parent, heap, uptime) to the root
+*   over the raw mesh channel every CONFIG_MESH_TOPOLOGY_STATUS_INTERVAL
+*   seconds and at once when the tree changes around it. Only the root talks
+*   to the broker: it keeps the table of the nodes, checked against its
+*   routing table, publishes a versioned snapshot when the tree changes and
+*   every CONFIG_MESH_TOPOLOGY_DELTA_INTERVAL seconds a delta with the nodes
+*   whose status changed meanwhile.
+*/
+#include "topology.h"
+#include "topology_proto.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_wifi.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "cJSON.h"
+#include "time_sync/time_sync.h"
+#include "mqtt/utils/mqtt_utils.h"
+#include "mesh_netif/mesh_netif.h"
+#include "rtos_alloc/rtos_alloc.h"
+
+#define TOPOLOGY_TAG "topology"
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef struct {
+    mesh_addr_t addr;           // STA MAC, the mesh address of the node
+    bool has_status;            // false until the first frame of the node
+    topology_status_t status;
+    topology_status_t reported; // status in the last snapshot or delta
+    topology_status_t sent;     // status in the snapshot or delta being queued
+    bool sending;
+} topology_node_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static TaskHandle_t s_task = NULL;
+// the mesh receive task updates the table, the topology task publishes it
+static SemaphoreHandle_t s_lock = NULL;
+static topology_node_t s_nodes[CONFIG_MESH_ROUTE_TABLE_SIZE];
+static int s_node_count = 0;
+static mesh_addr_t s_route_table[CONFIG_MESH_ROUTE_TABLE_SIZE];
+static uint32_t s_version = 0;
+static uint32_t s_published_version = 0;
+static int64_t s_changed_ms = 0;
+static int64_t s_unpublished_since_ms = 0;
+static bool s_snapshot_requested = false;
+
+static int64_t now_ms(void) {
+    return esp_timer_get_time() / 1000;
+}
+
+/*
+  * Function: fill_status
+  * ----------------------------
+  *   Status frame of this node
+  *
+*/
+static void fill_status(topology_status_t *status) {
+    mesh_addr_t parent;
+    memset(status, 0, sizeof(*status));
+    status->cmd = CMD_TOPOLOGY_STATUS;
+    status->layer = esp_mesh_get_layer();
+    status->flags = time_sync_is_synced() ? TOPOLOGY_FLAG_TIME_SYNCED : 0;
+    esp_wifi_get_mac(WIFI_IF_AP, status->ap);
+    if (esp_mesh_get_parent_bssid(&parent) == ESP_OK) {
+        memcpy(status->parent, parent.addr, sizeof(status->parent));
+    }
+    status->uptime_s = esp_timer_get_time() / 1000000;
+    status->free_heap = esp_get_free_heap_size();
+    status->min_free_heap = esp_get_minimum_free_heap_size();
+}
+
+/*******************************************************
+ *                Nodes: status
+ *******************************************************/
+
+static bool node_send_status(topology_status_t *status) {
+    mesh_data_t data;
+    data.data = (uint8_t *) status;
+    data.size = sizeof(*status);
+    data.proto = MESH_PROTO_BIN;
+    data.tos = MESH_TOS_P2P;
+    // NULL destination without flags goes to the root
+    esp_err_t err = esp_mesh_send(NULL, &data, 0, NULL, 0);
+    if (err != ESP_OK) {
+        ESP_LOGD(TOPOLOGY_TAG, "Status not sent: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+/*******************************************************
+ *                Root: table of the nodes
+ *******************************************************/
+
+// s_lock held
+static int find_node(const mesh_addr_t *addr) {
+    for (int i = 0; i < s_node_count; i++) {
+        if (memcmp(s_nodes[i].addr.addr, addr->addr, sizeof(addr->addr)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// s_lock held
+static void mark_changed(void) {
+    s_version++;
+    s_changed_ms = now_ms();
+    if (s_unpublished_since_ms == 0) {
+        s_unpublished_since_ms = s_changed_ms;
+    }
+}
+
+// s_lock held
+static topology_node_t * add_node(const mesh_addr_t *addr) {
+    if (s_node_count == CONFIG_MESH_ROUTE_TABLE_SIZE) {
+        ESP_LOGW(TOPOLOGY_TAG, "No room for " MACSTR ", the table has %d nodes", MAC2STR(addr->addr), s_node_count);
+        return NULL;
+    }
+    topology_node_t *node = &s_nodes[s_node_count++];
+    memset(node, 0, sizeof(*node));
+    node->addr = *addr;
+    mark_changed();
+    return node;
+}
+
+/*
+  * Function: root_update
+  * ----------------------------
+  *   Stores the status of a node. A new node, a new parent or a new layer
+  *   is a new version of the tree, the rest only goes in the deltas
+  *
+*/
+static void root_update(const mesh_addr_t *addr, const topology_status_t *status) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int i = find_node(addr);
+    topology_node_t *node = i >= 0 ? &s_nodes[i] : add_node(addr);
+    if (node != NULL) {
+        if (!node->has_status
+            || node->status.layer != status->layer
+            || memcmp(node->status.parent, status->parent, sizeof(status->parent)) != 0
+            || memcmp(node->status.ap, status->ap, sizeof(status->ap)) != 0) {
+            mark_changed();
+        }
+        node->status = *status;
+        node->has_status = true;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+/*
+  * Function: root_reconcile
+  * ----------------------------
+  *   Drops the nodes that left the routing table and adds the ones that
+  *   joined without a status yet
+  *
+*/
+static void root_reconcile(void) {
+    int size = 0;
+    if (esp_mesh_get_routing_table(s_route_table, sizeof(s_route_table), &size) != ESP_OK) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < s_node_count;) {
+        bool found = false;
+        for (int j = 0; j < size && !found; j++) {
+            found = memcmp(s_nodes[i].addr.addr, s_route_table[j].addr, sizeof(s_route_table[j].addr)) == 0;
+        }
+        if (found) {
+            i++;
+        } else {
+            s_nodes[i] = s_nodes[--s_node_count];
+            mark_changed();
+        }
+    }
+    for (int j = 0; j < size; j++) {
+        if (find_node(&s_route_table[j]) < 0 && add_node(&s_route_table[j]) == NULL) {
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+static void root_reset(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_node_count = 0;
+    s_unpublished_since_ms = 0;
+    xSemaphoreGive(s_lock);
+}
+
+/*
+  * Function: status_changed
+  * ----------------------------
+  *   If the status differs enough from the reported one to be in a delta.
+  *   The uptime only counts when it went back, the node rebooted
+  *
+*/
+static bool status_changed(const topology_status_t *reported, const topology_status_t *status) {
+    return reported->flags != status->flags
+        || abs((int) (status->free_heap - reported->free_heap)) >= TOPOLOGY_HEAP_DEADBAND
+        || reported->min_free_heap - status->min_free_heap >= TOPOLOGY_HEAP_DEADBAND
+        || status->uptime_s < reported->uptime_s;
+}
+
+/*******************************************************
+ *                Root: report
+ *******************************************************/
+
+/*
+  * Function: node_json
+  * ----------------------------
+  *   A node of the report, only its mesh address until its first status
+  *
+*/
+static cJSON * node_json(const topology_node_t *node) {
+    char mac[18];
+    cJSON *item = cJSON_CreateObject();
+    if (!node->has_status) {
+        snprintf(mac, sizeof(mac), MACSTR, MAC2STR(node->addr.addr));
+        cJSON_AddStringToObject(item, "sta", mac);
+        return item;
+    }
+    const topology_status_t *status = &node->status;
+    snprintf(mac, sizeof(mac), MACSTR, MAC2STR(status->ap));
+    cJSON_AddStringToObject(item, "id", mac);
+    snprintf(mac, sizeof(mac), MACSTR, MAC2STR(status->parent));
+    cJSON_AddStringToObject(item, "parent", mac);
+    cJSON_AddNumberToObject(item, "layer", status->layer);
+    cJSON_AddNumberToObject(item, "uptime", status->uptime_s);
+    cJSON_AddNumberToObject(item, "heap", status->free_heap);
+    cJSON_AddNumberToObject(item, "min_heap", status->min_free_heap);
+    cJSON_AddBoolToObject(item, "synced", status->flags & TOPOLOGY_FLAG_TIME_SYNCED);
+    return item;
+}
+
+/*
+  * Function: publish_nodes
+  * ----------------------------
+  *   Publishes the nodes in as many parts as needed so that every message
+  *   fits the publisher queue. Frees nodes
+  *
+  * returns: false when a part was dropped by the publisher queue
+*/
+static bool publish_nodes(const char *topic, const char *type, uint32_t version, cJSON *nodes) {
+    char *root_id = get_mac_ap();
+    cJSON *header = cJSON_CreateObject();
+    cJSON_AddStringToObject(header, "type", type);
+    cJSON_AddNumberToObject(header, "version", version);
+    cJSON_AddStringToObject(header, "root", root_id);
+    bool queued = publish_parts(topic, header, "nodes", nodes, TOPOLOGY_NODES_PER_MESSAGE, TOPOLOGY_PART_GAP_MS);
+    cJSON_Delete(header);
+    free(root_id);
+    return queued;
+}
+
+/*
+  * Function: commit_sent
+  * ----------------------------
+  *   The nodes of a snapshot or delta that was fully queued are reported
+  *   with the status it carried, after a dropped part they are sent again
+  *
+*/
+static void commit_sent(bool queued) {
+    for (int i = 0; i < s_node_count; i++) {
+        if (queued && s_nodes[i].sending) {
+            s_nodes[i].reported = s_nodes[i].sent;
+        }
+        s_nodes[i].sending = false;
+    }
+}
+
+static bool root_snapshot_due(int64_t now) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool due = s_version != s_published_version
+        && (now - s_changed_ms >= TOPOLOGY_SETTLE_MS || now - s_unpublished_since_ms >= TOPOLOGY_SETTLE_MAX_MS);
+    xSemaphoreGive(s_lock);
+    return due;
+}
+
+/*
+  * Function: root_publish_snapshot
+  * ----------------------------
+  *   Publishes every node with the version of the tree. The version is
+  *   only published once every part was queued
+  *
+  * returns: false when a part was dropped, the snapshot must be sent again
+*/
+static bool root_publish_snapshot(const char *topic) {
+    cJSON *nodes = cJSON_CreateArray();
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t version = s_version;
+    for (int i = 0; i < s_node_count; i++) {
+        cJSON_AddItemToArray(nodes, node_json(&s_nodes[i]));
+        s_nodes[i].sent = s_nodes[i].status;
+        s_nodes[i].sending = true;
+    }
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TOPOLOGY_TAG, "Publishing version %lu, %d nodes", (unsigned long) version, cJSON_GetArraySize(nodes));
+    bool queued = publish_nodes(topic, "snapshot", version, nodes);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    commit_sent(queued);
+    if (queued) {
+        s_published_version = version;
+        // changes made while the parts were sent are still to publish
+        s_unpublished_since_ms = s_version == version ? 0 : s_changed_ms;
+    }
+    xSemaphoreGive(s_lock);
+    if (!queued) {
+        ESP_LOGW(TOPOLOGY_TAG, "Version %lu not fully queued, sent again", (unsigned long) version);
+    }
+    return queued;
+}
+
+/*
+  * Function: root_publish_delta
+  * ----------------------------
+  *   Publishes the nodes whose status changed since they were last
+  *   reported, nothing if none did. After a dropped part the nodes stay
+  *   changed and go in the next delta
+  *
+*/
+static void root_publish_delta(const char *topic) {
+    cJSON *nodes = cJSON_CreateArray();
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t version = s_published_version;
+    for (int i = 0; i < s_node_count; i++) {
+        topology_node_t *node = &s_nodes[i];
+        if (node->has_status && status_changed(&node->reported, &node->status)) {
+            cJSON_AddItemToArray(nodes, node_json(node));
+            node->sent = node->status;
+            node->sending = true;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (cJSON_GetArraySize(nodes) == 0) {
+        cJSON_Delete(nodes);
+        return;
+    }
+    bool queued = publish_nodes(topic, "delta", version, nodes);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    commit_sent(queued);
+    xSemaphoreGive(s_lock);
+}
+
+/*******************************************************
+ *                Topology task
+ *******************************************************/
+
+void task_topology(void *args) {
+    ESP_LOGI(TOPOLOGY_TAG, "STARTED: task_topology");
+    char *topic = create_topic("topology", "", false);
+    bool was_root = false;
+    int64_t next_status_ms = 0;
+    int64_t last_reconcile_ms = 0;
+    int64_t last_delta_ms = now_ms();
+    int64_t snapshot_retry_ms = 0;
+
+    while (1) {
+        bool changed = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TOPOLOGY_TICK_MS)) > 0;
+        int64_t now = now_ms();
+        bool is_root = esp_mesh_is_root();
+        if (is_root != was_root) {
+            // a demoted root forgets the tree, a new root builds it from the next status frames
+            root_reset();
+            if (is_root) {
+                xSemaphoreTake(s_lock, portMAX_DELAY);
+                mark_changed();
+                xSemaphoreGive(s_lock);
+            }
+            was_root = is_root;
+            changed = true;
+        }
+
+        if (changed || now >= next_status_ms) {
+            topology_status_t status;
+            fill_status(&status);
+            if (is_root) {
+                mesh_addr_t self;
+                esp_wifi_get_mac(WIFI_IF_STA, self.addr);
+                root_update(&self, &status);
+                next_status_ms = now + CONFIG_MESH_TOPOLOGY_STATUS_INTERVAL * 1000;
+            } else if (node_send_status(&status)) {
+                next_status_ms = now + CONFIG_MESH_TOPOLOGY_STATUS_INTERVAL * 1000;
+            } else {
+                next_status_ms = now + TOPOLOGY_RETRY_MS;
+            }
+        }
+        if (!is_root) {
+            continue;
+        }
+
+        if (changed || now - last_reconcile_ms >= TOPOLOGY_RECONCILE_MS) {
+            root_reconcile();
+            last_reconcile_ms = now;
+        }
+        if (now >= snapshot_retry_ms
+                && (__atomic_exchange_n(&s_snapshot_requested, false, __ATOMIC_RELAXED) || root_snapshot_due(now))) {
+            if (!root_publish_snapshot(topic)) {
+                // the dashboard needs every part of a version, the whole snapshot is sent again
+                __atomic_store_n(&s_snapshot_requested, true, __ATOMIC_RELAXED);
+                snapshot_retry_ms = now_ms() + TOPOLOGY_RETRY_MS;
+            }
+            last_delta_ms = now;
+        } else if (now - last_delta_ms >= CONFIG_MESH_TOPOLOGY_DELTA_INTERVAL * 1000) {
+            root_publish_delta(topic);
+            last_delta_ms = now;
+        }
+    }
+    free(topic);
+    vTaskDelete(NULL);
+}
+
+/*******************************************************
+ *                Public API
+ *******************************************************/
+
+esp_err_t topology_start(void) {
+    if (s_task != NULL) {
+        return ESP_OK;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        ESP_LOGE(TOPOLOGY_TAG, "Error creating the topology lock");
+        return ESP_ERR_NO_MEM;
+    }
+    if (rtos_alloc_task(RTOS_TASK_TOPOLOGY, task_topology, NULL, &s_task) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void topology_raw_recv(mesh_addr_t *from, mesh_data_t *data) {
+    if (s_task == NULL) {
+        // not started yet, the node sends its status again
+        return;
+    }
+    if (data->size != sizeof(topology_status_t)) {
+        ESP_LOGE(TOPOLOGY_TAG, "Error in receiving status frame: Unexpected size");
+        return;
+    }
+    if (!esp_mesh_is_root()) {
+        return;
+    }
+    topology_status_t status;
+    memcpy(&status, data->data, sizeof(status));
+    root_update(from, &status);
+}
+
+void topology_mesh_changed(void) {
+    if (s_task != NULL) {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+void topology_request_snapshot(void) {
+    __atomic_store_n(&s_snapshot_requested, true, __ATOMIC_RELAXED);
+}
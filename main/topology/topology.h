@@ -0,0 +1,50 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_mesh.h"
+
+/* Raw mesh command of the node status frames (see recv_cb in mesh_main.c) */
+#define CMD_TOPOLOGY_STATUS 0x5A
+
+/*
+  * Function: topology_start
+  * ----------------------------
+  *   Starts the topology task. Every node sends a compact status frame to
+  *   the root over the raw mesh channel, the root keeps the table of the
+  *   nodes and publishes it on /mesh/[mesh_id]/topology. Safe to call more
+  *   than once.
+  *
+*/
+esp_err_t topology_start(void);
+
+/*
+  * Function: topology_raw_recv
+  * ----------------------------
+  *   Handles CMD_TOPOLOGY_STATUS frames received on the raw mesh channel
+  *
+*/
+void topology_raw_recv(mesh_addr_t *from, mesh_data_t *data);
+
+/*
+  * Function: topology_mesh_changed
+  * ----------------------------
+  *   Called from the mesh events that change the tree (parent, layer,
+  *   children, routing table). The node sends its status at once and the
+  *   root checks its table against the routing table. Does not block.
+  *
+*/
+void topology_mesh_changed(void);
+
+/*
+  * Function: topology_request_snapshot
+  * ----------------------------
+  *   Asks the root for a full snapshot even if nothing changed, for a
+  *   dashboard that missed the last one. Ignored on the other nodes.
+  *
+*/
+void topology_request_snapshot(void);
+
+#endif // TOPOLOGY_H
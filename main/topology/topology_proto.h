@@ -0,0 +1,40 @@
+/*
+*   Topology protocol
+*   Status frame and timings of topology.c, without any ESP-IDF dependency
+*   so tools/mesh_simulator models the same traffic as the firmware.
+*/
+#ifndef TOPOLOGY_PROTO_H
+#define TOPOLOGY_PROTO_H
+
+#include <stdint.h>
+
+#ifndef CONFIG_MESH_TOPOLOGY_STATUS_INTERVAL
+#define CONFIG_MESH_TOPOLOGY_STATUS_INTERVAL 30
+#endif
+#ifndef CONFIG_MESH_TOPOLOGY_DELTA_INTERVAL
+#define CONFIG_MESH_TOPOLOGY_DELTA_INTERVAL 60
+#endif
+
+#define TOPOLOGY_TICK_MS           1000
+#define TOPOLOGY_RETRY_MS          2000  // status not sent, no route to the root yet
+#define TOPOLOGY_SETTLE_MS         3000  // quiet time before a snapshot, a joining branch is one snapshot
+#define TOPOLOGY_SETTLE_MAX_MS     15000 // a tree that keeps changing is still published
+#define TOPOLOGY_RECONCILE_MS      10000
+#define TOPOLOGY_HEAP_DEADBAND     2048  // smallest heap change reported in a delta
+#define TOPOLOGY_NODES_PER_MESSAGE 4     // fits MAX_MESSAGE_LENGTH with the create_mqtt_message fields
+#define TOPOLOGY_PART_GAP_MS       100   // between the parts of a report, the publisher queue is shared
+
+#define TOPOLOGY_FLAG_TIME_SYNCED  0x01
+
+typedef struct __attribute__((packed)) {
+    uint8_t cmd;            // CMD_TOPOLOGY_STATUS
+    uint8_t layer;
+    uint8_t flags;          // TOPOLOGY_FLAG_*
+    uint8_t ap[6];          // softAP MAC: the device id of the topics, the parent BSSID of the children
+    uint8_t parent[6];      // BSSID of the parent, the router for the root
+    uint32_t uptime_s;
+    uint32_t free_heap;
+    uint32_t min_free_heap;
+} topology_status_t;
+
+#endif // TOPOLOGY_PROTO_H
@@ -0,0 +1,461 @@
+/*
+*   Time-series store
+*   Keeps the readings of every metric in a ring of small pages on the "tsdb"
+*   partition, so the history of a node can be pulled after an outage. A page
+*   holds a single series: the first reading goes in the header, the next
+*   ones as the delta-of-delta of the timestamp and the delta of the
+*   fixed-point value, both zigzag varints, 2-3 bytes per reading with a
+*   regular polling time. A RAM index keeps the time range of every page so
+*   a query only reads the pages it needs.
+*/
+#include "tsdb.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+
+#ifndef CONFIG_TSDB_MAX_SERIES
+#define CONFIG_TSDB_MAX_SERIES 8
+#endif
+#ifndef CONFIG_TSDB_PAGE_MAX_AGE
+#define CONFIG_TSDB_PAGE_MAX_AGE 600
+#endif
+
+#define TSDB_PAGE_SIZE 512
+#define TSDB_SECTOR_SIZE 4096
+#define TSDB_PAGES_PER_SECTOR (TSDB_SECTOR_SIZE / TSDB_PAGE_SIZE)
+#define TSDB_PAGE_MAGIC 0x7D5B
+#define TSDB_VALUE_SCALE 100.0f     // fixed point with 2 decimals
+#define TSDB_RECORD_MAX 15          // 10 bytes of timestamp and 5 of value at worst
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint16_t series;
+    uint32_t seq;           // write order, 0 is never used
+    int64_t t_first;
+    int64_t t_last;
+    int32_t v_first;
+    uint16_t count;
+    uint16_t used;          // bytes of records after the header
+    uint32_t checksum;      // FNV-1a of the header up to here and the records
+} tsdb_page_header_t;
+
+#define TSDB_PAGE_DATA (TSDB_PAGE_SIZE - sizeof(tsdb_page_header_t))
+
+typedef struct {
+    tsdb_page_header_t header;
+    uint8_t data[TSDB_PAGE_DATA];
+} tsdb_page_t;
+
+_Static_assert(sizeof(tsdb_page_t) == TSDB_PAGE_SIZE, "a tsdb page must fill a flash page");
+
+// time range of a flash page, seconds are enough to skip pages
+typedef struct {
+    uint32_t seq;           // 0 when the page is free
+    uint32_t t_first_s;
+    uint32_t t_last_s;      // rounded up
+    uint16_t series;
+} tsdb_index_t;
+
+// page being filled in RAM
+typedef struct {
+    uint16_t series;
+    tsdb_page_t page;
+    int64_t prev_delta;
+    int32_t prev_value;
+} tsdb_open_page_t;
+
+typedef struct {
+    int64_t from_ms;
+    int64_t to_ms;
+    uint32_t step_ms;
+    tsdb_point_cb_t cb;
+    void *ctx;
+    int64_t bucket;
+    double sum;
+    uint32_t count;
+    bool stopped;           // cb refused a point
+} tsdb_query_state_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const esp_partition_t *s_partition = NULL;
+static tsdb_index_t *s_index = NULL;
+static size_t s_page_count = 0;
+static size_t s_next_page = 0;
+static uint32_t s_seq = 1;
+static tsdb_open_page_t *s_open[CONFIG_TSDB_MAX_SERIES];
+static tsdb_page_t s_scratch;
+static SemaphoreHandle_t s_lock = NULL;
+
+/*******************************************************
+ *                Encoding
+ *******************************************************/
+
+static uint32_t page_checksum(const tsdb_page_t *page) {
+    uint32_t hash = 0x811C9DC5;
+    const uint8_t *bytes = (const uint8_t *) page;
+    size_t length = offsetof(tsdb_page_header_t, checksum);
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 0x01000193;
+    }
+    for (size_t i = 0; i < page->header.used && i < TSDB_PAGE_DATA; i++) {
+        hash = (hash ^ page->data[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+static bool page_is_valid(const tsdb_page_t *page) {
+    return page->header.magic == TSDB_PAGE_MAGIC && page->header.seq != 0 && page->header.count > 0
+        && page->header.used <= TSDB_PAGE_DATA && page->header.checksum == page_checksum(page);
+}
+
+static size_t put_varint(uint8_t *buffer, int64_t value) {
+    uint64_t zigzag = ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+    size_t length = 0;
+    do {
+        uint8_t byte = zigzag & 0x7F;
+        zigzag >>= 7;
+        buffer[length++] = byte | (zigzag != 0 ? 0x80 : 0);
+    } while (zigzag != 0);
+    return length;
+}
+
+static bool get_varint(const uint8_t *buffer, size_t length, size_t *pos, int64_t *value) {
+    uint64_t zigzag = 0;
+    for (int shift = 0; shift < 64 && *pos < length; shift += 7) {
+        uint8_t byte = buffer[(*pos)++];
+        zigzag |= (uint64_t) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*******************************************************
+ *                Flash pages
+ *******************************************************/
+
+// must be called with s_lock held
+static esp_err_t write_page(tsdb_page_t *page) {
+    size_t target = s_next_page;
+    for (size_t tries = 0; tries < s_page_count; tries++) {
+        if (target % TSDB_PAGES_PER_SECTOR == 0) {
+            // entering a sector, its pages hold the oldest readings
+            esp_err_t err = esp_partition_erase_range(s_partition, target * TSDB_PAGE_SIZE, TSDB_SECTOR_SIZE);
+            if (err != ESP_OK) {
+                return err;
+            }
+            memset(&s_index[target], 0, sizeof(tsdb_index_t) * TSDB_PAGES_PER_SECTOR);
+            break;
+        }
+        // a page torn by a reset cannot be written again before the erase
+        if (esp_partition_read(s_partition, target * TSDB_PAGE_SIZE, &s_scratch, TSDB_PAGE_SIZE) == ESP_OK) {
+            const uint8_t *bytes = (const uint8_t *) &s_scratch;
+            size_t i = 0;
+            while (i < TSDB_PAGE_SIZE && bytes[i] == 0xFF) {
+                i++;
+            }
+            if (i == TSDB_PAGE_SIZE) {
+                break;
+            }
+        }
+        target = (target + 1) % s_page_count;
+    }
+
+    page->header.magic = TSDB_PAGE_MAGIC;
+    page->header.seq = s_seq++;
+    page->header.checksum = page_checksum(page);
+    esp_err_t err = esp_partition_write(s_partition, target * TSDB_PAGE_SIZE, page, TSDB_PAGE_SIZE);
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_index[target] = (tsdb_index_t) {
+        .seq = page->header.seq,
+        .t_first_s = (uint32_t) (page->header.t_first / 1000),
+        .t_last_s = (uint32_t) ((page->header.t_last + 999) / 1000),
+        .series = page->header.series
+    };
+    s_next_page = (target + 1) % s_page_count;
+    return ESP_OK;
+}
+
+// writes the RAM page of a series and starts an empty one, must be called with s_lock held
+static esp_err_t close_page(tsdb_open_page_t *open) {
+    if (open->page.header.count == 0) {
+        return ESP_OK;
+    }
+    esp_err_t err = write_page(&open->page);
+    if (err != ESP_OK) {
+        ESP_LOGE(TSDB_TAG, "Unable to write a page of series %d: %s", open->series, esp_err_to_name(err));
+    }
+    // a page that cannot be written is dropped, the RAM page must not grow
+    memset(&open->page, 0xFF, sizeof(open->page));
+    open->page.header.count = 0;
+    open->page.header.used = 0;
+    return err;
+}
+
+static tsdb_open_page_t * get_open_page(uint16_t series) {
+    tsdb_open_page_t **free_slot = NULL;
+    for (size_t i = 0; i < CONFIG_TSDB_MAX_SERIES; i++) {
+        if (s_open[i] != NULL && s_open[i]->series == series) {
+            return s_open[i];
+        }
+        if (s_open[i] == NULL && free_slot == NULL) {
+            free_slot = &s_open[i];
+        }
+    }
+    if (free_slot == NULL) {
+        return NULL;
+    }
+    tsdb_open_page_t *open = malloc(sizeof(tsdb_open_page_t));
+    if (open == NULL) {
+        return NULL;
+    }
+    // unused bytes stay erased, only the written ones are programmed
+    memset(open, 0xFF, sizeof(tsdb_open_page_t));
+    open->series = series;
+    open->page.header.count = 0;
+    open->page.header.used = 0;
+    *free_slot = open;
+    return open;
+}
+
+/*******************************************************
+ *                Query
+ *******************************************************/
+
+static void query_emit(tsdb_query_state_t *state, int64_t time_ms, int32_t fixed) {
+    if (state->stopped || time_ms < state->from_ms || time_ms > state->to_ms) {
+        return;
+    }
+    float value = fixed / TSDB_VALUE_SCALE;
+    if (state->step_ms == 0) {
+        state->stopped = !state->cb(time_ms, value, state->ctx);
+        return;
+    }
+    int64_t bucket = (time_ms - state->from_ms) / state->step_ms;
+    if (bucket != state->bucket && state->count > 0) {
+        state->stopped = !state->cb(state->from_ms + state->bucket * state->step_ms, (float) (state->sum / state->count), state->ctx);
+        if (state->stopped) {
+            return;
+        }
+        state->sum = 0;
+        state->count = 0;
+    }
+    state->bucket = bucket;
+    state->sum += value;
+    state->count++;
+}
+
+static void query_page(tsdb_query_state_t *state, const tsdb_page_t *page) {
+    int64_t time_ms = page->header.t_first;
+    int64_t delta = 0;
+    int32_t value = page->header.v_first;
+    query_emit(state, time_ms, value);
+
+    size_t pos = 0;
+    for (uint16_t i = 1; i < page->header.count && time_ms <= state->to_ms && !state->stopped; i++) {
+        int64_t dod, dv;
+        if (!get_varint(page->data, page->header.used, &pos, &dod) || !get_varint(page->data, page->header.used, &pos, &dv)) {
+            ESP_LOGW(TSDB_TAG, "Truncated page of series %d", page->header.series);
+            return;
+        }
+        delta += dod;
+        time_ms += delta;
+        value += (int32_t) dv;
+        query_emit(state, time_ms, value);
+    }
+}
+
+/*******************************************************
+ *                Public API
+ *******************************************************/
+
+esp_err_t tsdb_init(void) {
+    if (s_partition != NULL) {
+        return ESP_OK;
+    }
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, TSDB_PARTITION_LABEL);
+    if (partition == NULL) {
+        ESP_LOGW(TSDB_TAG, "No %s partition, the readings are not stored", TSDB_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_page_count = partition->size / TSDB_SECTOR_SIZE * TSDB_PAGES_PER_SECTOR;
+    s_index = calloc(s_page_count, sizeof(tsdb_index_t));
+    s_lock = xSemaphoreCreateMutex();
+    if (s_index == NULL || s_lock == NULL) {
+        ESP_LOGE(TSDB_TAG, "No memory for the index of %d pages", s_page_count);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // the page after the newest one is the next to be written
+    uint32_t newest_seq = 0;
+    size_t valid = 0;
+    for (size_t page = 0; page < s_page_count; page++) {
+        if (esp_partition_read(partition, page * TSDB_PAGE_SIZE, &s_scratch, TSDB_PAGE_SIZE) != ESP_OK || !page_is_valid(&s_scratch)) {
+            continue;
+        }
+        s_index[page] = (tsdb_index_t) {
+            .seq = s_scratch.header.seq,
+            .t_first_s = (uint32_t) (s_scratch.header.t_first / 1000),
+            .t_last_s = (uint32_t) ((s_scratch.header.t_last + 999) / 1000),
+            .series = s_scratch.header.series
+        };
+        valid++;
+        if (s_scratch.header.seq > newest_seq) {
+            newest_seq = s_scratch.header.seq;
+            s_next_page = (page + 1) % s_page_count;
+        }
+    }
+    s_seq = newest_seq + 1;
+    s_partition = partition;
+    esp_register_shutdown_handler(tsdb_flush);
+    ESP_LOGI(TSDB_TAG, "%d of %d pages in use", valid, s_page_count);
+    return ESP_OK;
+}
+
+esp_err_t tsdb_append(uint16_t series, int64_t time_ms, float value) {
+    if (s_partition == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (isnan(value) || fabsf(value) * TSDB_VALUE_SCALE >= (float) INT32_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int32_t fixed = (int32_t) lroundf(value * TSDB_VALUE_SCALE);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    tsdb_open_page_t *open = get_open_page(series);
+    if (open == NULL) {
+        xSemaphoreGive(s_lock);
+        ESP_LOGW(TSDB_TAG, "No room for series %d", series);
+        return ESP_ERR_NO_MEM;
+    }
+    tsdb_page_header_t *header = &open->page.header;
+
+    if (header->count > 0) {
+        uint8_t record[TSDB_RECORD_MAX];
+        int64_t delta = time_ms - header->t_last;
+        size_t length = put_varint(record, delta - open->prev_delta);
+        length += put_varint(record + length, (int64_t) fixed - open->prev_value);
+        if (delta < 0 || header->count == UINT16_MAX || header->used + length > TSDB_PAGE_DATA) {
+            // clock stepped back or page full, the reading starts the next page
+            close_page(open);
+        } else {
+            memcpy(open->page.data + header->used, record, length);
+            header->used += length;
+            header->count++;
+            header->t_last = time_ms;
+            open->prev_delta = delta;
+            open->prev_value = fixed;
+        }
+    }
+    if (header->count == 0) {
+        header->series = series;
+        header->t_first = time_ms;
+        header->t_last = time_ms;
+        header->v_first = fixed;
+        header->count = 1;
+        header->used = 0;
+        open->prev_delta = 0;
+        open->prev_value = fixed;
+    }
+#if CONFIG_TSDB_PAGE_MAX_AGE > 0
+    // a crash loses the RAM pages, write the old ones even when not full,
+    // those of a series that stopped reporting too
+    for (size_t i = 0; i < CONFIG_TSDB_MAX_SERIES; i++) {
+        if (s_open[i] != NULL && s_open[i]->page.header.count > 0
+                && time_ms - s_open[i]->page.header.t_first >= (int64_t) CONFIG_TSDB_PAGE_MAX_AGE * 1000) {
+            close_page(s_open[i]);
+        }
+    }
+#endif
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+void tsdb_flush(void) {
+    if (s_partition == NULL) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (size_t i = 0; i < CONFIG_TSDB_MAX_SERIES; i++) {
+        if (s_open[i] != NULL) {
+            close_page(s_open[i]);
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t tsdb_query(uint16_t series, int64_t from_ms, int64_t to_ms, uint32_t step_ms, tsdb_point_cb_t cb, void *ctx) {
+    if (s_partition == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    tsdb_page_t *page = malloc(sizeof(tsdb_page_t));
+    if (page == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    tsdb_query_state_t state = {
+        .from_ms = from_ms,
+        .to_ms = to_ms,
+        .step_ms = step_ms,
+        .cb = cb,
+        .ctx = ctx,
+        .bucket = -1
+    };
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    size_t oldest = s_next_page;
+    xSemaphoreGive(s_lock);
+
+    // ring order from the oldest page, the lock is not held while reading the flash
+    for (size_t i = 0; i < s_page_count && !state.stopped; i++) {
+        size_t index = (oldest + i) % s_page_count;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        tsdb_index_t entry = s_index[index];
+        xSemaphoreGive(s_lock);
+        if (entry.seq == 0 || entry.series != series
+                || (int64_t) entry.t_last_s * 1000 < from_ms || (int64_t) entry.t_first_s * 1000 > to_ms) {
+            continue;
+        }
+        // the page may have been erased and written again meanwhile
+        if (esp_partition_read(s_partition, index * TSDB_PAGE_SIZE, page, TSDB_PAGE_SIZE) != ESP_OK
+                || !page_is_valid(page) || page->header.seq != entry.seq) {
+            continue;
+        }
+        query_page(&state, page);
+    }
+
+    // the newest readings are still in RAM
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool has_open = false;
+    for (size_t i = 0; i < CONFIG_TSDB_MAX_SERIES; i++) {
+        if (s_open[i] != NULL && s_open[i]->series == series && s_open[i]->page.header.count > 0) {
+            *page = s_open[i]->page;
+            has_open = true;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    if (has_open && !state.stopped) {
+        query_page(&state, page);
+    }
+
+    if (state.count > 0 && !state.stopped) {
+        cb(from_ms + state.bucket * step_ms, (float) (state.sum / state.count), ctx);
+    }
+    free(page);
+    return ESP_OK;
+}
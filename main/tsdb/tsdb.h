@@ -0,0 +1,63 @@
+#ifndef TSDB_H
+#define TSDB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifndef CONFIG_TSDB_QUERY_CHUNK
+#define CONFIG_TSDB_QUERY_CHUNK 20
+#endif
+#ifndef CONFIG_TSDB_QUERY_MAX_POINTS
+#define CONFIG_TSDB_QUERY_MAX_POINTS 200
+#endif
+
+#define TSDB_TAG "tsdb"
+#define TSDB_PARTITION_LABEL "tsdb"
+
+// callback of tsdb_query, time in ms of the wall clock, false stops the query
+typedef bool (*tsdb_point_cb_t)(int64_t time_ms, float value, void *ctx);
+
+/*
+  * Function: tsdb_init
+  * ----------------------------
+  *   Scans the "tsdb" partition and rebuilds the page index. Without the
+  *   partition the store stays disabled and every call is a no-op.
+  *
+  *   returns: ESP_OK, ESP_ERR_NOT_FOUND without the partition
+*/
+esp_err_t tsdb_init(void);
+
+/*
+  * Function: tsdb_append
+  * ----------------------------
+  *   Appends a reading to the series. Readings are buffered in a RAM page
+  *   per series and written to flash when the page is full or its first
+  *   reading is CONFIG_TSDB_PAGE_MAX_AGE seconds old.
+  *
+  *   time_ms: wall clock time, must not go backwards within a series
+*/
+esp_err_t tsdb_append(uint16_t series, int64_t time_ms, float value);
+
+/*
+  * Function: tsdb_flush
+  * ----------------------------
+  *   Writes the partial RAM pages, also called by esp_restart
+  *
+*/
+void tsdb_flush(void);
+
+/*
+  * Function: tsdb_query
+  * ----------------------------
+  *   Calls cb for every reading of the series in [from_ms, to_ms], oldest
+  *   first. With a step the readings are averaged in buckets of step_ms
+  *   starting at from_ms, each bucket reported at its start. When cb
+  *   returns false no other point is reported: querying again from the
+  *   time of the refused point goes on where it stopped.
+  *
+  *   returns: ESP_ERR_NOT_FOUND when the store is disabled
+*/
+esp_err_t tsdb_query(uint16_t series, int64_t from_ms, int64_t to_ms, uint32_t step_ms, tsdb_point_cb_t cb, void *ctx);
+
+#endif // TSDB_H
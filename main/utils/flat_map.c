@@ -0,0 +1,204 @@
+#include "flat_map.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// bucket states, the hash of a key is never one of them
+#define FLAT_MAP_EMPTY 0
+#define FLAT_MAP_REMOVED 1
+
+// values hold pointers and doubles
+#define FLAT_MAP_ALIGN 8
+
+/*******************************************************
+ *                Hashing
+ *******************************************************/
+
+// finalizer of murmur3, spreads consecutive ids over the buckets
+static uint32_t hash_int(int32_t key) {
+    uint32_t h = (uint32_t) key;
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h < 2 ? h + 2 : h;
+}
+
+// FNV-1a
+static uint32_t hash_str(const char *key) {
+    uint32_t h = 2166136261u;
+    for (; *key != '\0'; key++) {
+        h ^= (uint8_t) *key;
+        h *= 16777619u;
+    }
+    return h < 2 ? h + 2 : h;
+}
+
+static size_t align_up(size_t size) {
+    return (size + FLAT_MAP_ALIGN - 1) & ~((size_t) FLAT_MAP_ALIGN - 1);
+}
+
+static void * value_at(const flat_map_t *map, uint32_t bucket) {
+    return map->values + (size_t) bucket * map->value_size;
+}
+
+static uint32_t bucket_of(const flat_map_t *map, const void *value) {
+    return (uint32_t) (((const uint8_t *) value - map->values) / map->value_size);
+}
+
+/*
+  * Function: find_bucket
+  * ----------------------------
+  *   Linear probing from the hash of the key. A removed bucket does not
+  *   stop the probe, the key may be further.
+  *
+  * insert_at: set to the first free bucket of the probe when not NULL
+  *
+  * returns: the bucket of the key or -1
+*/
+static int32_t find_bucket(const flat_map_t *map, uint32_t hash, int32_t int_key, const char *str_key, int32_t *insert_at) {
+    uint32_t mask = map->capacity - 1;
+    if (insert_at != NULL) {
+        *insert_at = -1;
+    }
+    for (uint32_t probe = 0, bucket = hash & mask; probe < map->capacity; probe++, bucket = (bucket + 1) & mask) {
+        // the key and the value of a bucket are written before its hash
+        uint32_t bucket_hash = __atomic_load_n(&map->hashes[bucket], __ATOMIC_ACQUIRE);
+        if (bucket_hash == FLAT_MAP_EMPTY) {
+            if (insert_at != NULL && *insert_at < 0) {
+                *insert_at = bucket;
+            }
+            return -1;
+        }
+        if (bucket_hash == FLAT_MAP_REMOVED) {
+            if (insert_at != NULL && *insert_at < 0) {
+                *insert_at = bucket;
+            }
+            continue;
+        }
+        if (bucket_hash != hash) {
+            continue;
+        }
+        if (str_key == NULL ? map->keys[bucket] == int_key : strcmp(map->strings + map->keys[bucket], str_key) == 0) {
+            return bucket;
+        }
+    }
+    return -1;
+}
+
+static void * insert_bucket(flat_map_t *map, uint32_t hash, int32_t key, int32_t bucket) {
+    void *value = value_at(map, bucket);
+    memset(value, 0, map->value_size);
+    map->keys[bucket] = key;
+    __atomic_store_n(&map->hashes[bucket], hash, __ATOMIC_RELEASE);
+    map->count++;
+    return value;
+}
+
+/*******************************************************
+ *                Public API
+ *******************************************************/
+
+esp_err_t flat_map_init(flat_map_t *map, size_t max_entries, size_t value_size, size_t key_bytes) {
+    *map = (flat_map_t) { 0 };
+    if (max_entries == 0 || value_size == 0 || max_entries > INT32_MAX / 2) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // at most half of the buckets are used, the probes stay short
+    uint32_t capacity = 1;
+    while (capacity < max_entries * 2) {
+        capacity <<= 1;
+    }
+    value_size = align_up(value_size);
+
+    size_t hashes_size = align_up(capacity * sizeof(uint32_t));
+    size_t keys_size = align_up(capacity * sizeof(int32_t));
+    size_t values_size = capacity * value_size;
+    uint8_t *block = calloc(1, hashes_size + keys_size + values_size + key_bytes);
+    if (block == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    map->hashes = (uint32_t *) block;
+    map->keys = (int32_t *) (block + hashes_size);
+    map->values = block + hashes_size + keys_size;
+    map->strings = key_bytes != 0 ? (char *) (map->values + values_size) : NULL;
+    map->strings_size = key_bytes;
+    map->value_size = value_size;
+    map->capacity = capacity;
+    map->max_entries = max_entries;
+    return ESP_OK;
+}
+
+void * flat_map_find_int(const flat_map_t *map, int32_t key) {
+    if (map->capacity == 0) {
+        return NULL;
+    }
+    int32_t bucket = find_bucket(map, hash_int(key), key, NULL, NULL);
+    return bucket >= 0 ? value_at(map, bucket) : NULL;
+}
+
+void * flat_map_find_str(const flat_map_t *map, const char *key) {
+    if (map->strings == NULL) {
+        return NULL;
+    }
+    int32_t bucket = find_bucket(map, hash_str(key), 0, key, NULL);
+    return bucket >= 0 ? value_at(map, bucket) : NULL;
+}
+
+void * flat_map_insert_int(flat_map_t *map, int32_t key) {
+    if (map->capacity == 0 || map->strings != NULL || map->count >= map->max_entries) {
+        return NULL;
+    }
+    uint32_t hash = hash_int(key);
+    int32_t insert_at;
+    if (find_bucket(map, hash, key, NULL, &insert_at) >= 0 || insert_at < 0) {
+        return NULL;
+    }
+    return insert_bucket(map, hash, key, insert_at);
+}
+
+void * flat_map_insert_str(flat_map_t *map, const char *key) {
+    if (map->strings == NULL || map->count >= map->max_entries) {
+        return NULL;
+    }
+    size_t length = strlen(key) + 1;
+    if (map->strings_used + length > map->strings_size) {
+        return NULL;
+    }
+    uint32_t hash = hash_str(key);
+    int32_t insert_at;
+    if (find_bucket(map, hash, 0, key, &insert_at) >= 0 || insert_at < 0) {
+        return NULL;
+    }
+    int32_t offset = (int32_t) map->strings_used;
+    memcpy(map->strings + offset, key, length);
+    map->strings_used += length;
+    return insert_bucket(map, hash, offset, insert_at);
+}
+
+void flat_map_remove(flat_map_t *map, void *value) {
+    uint32_t bucket = bucket_of(map, value);
+    if (map->hashes[bucket] < 2) {
+        return;
+    }
+    __atomic_store_n(&map->hashes[bucket], FLAT_MAP_REMOVED, __ATOMIC_RELEASE);
+    map->count--;
+}
+
+void * flat_map_next(const flat_map_t *map, uint32_t *index) {
+    for (; *index < map->capacity; (*index)++) {
+        if (__atomic_load_n(&map->hashes[*index], __ATOMIC_ACQUIRE) >= 2) {
+            return value_at(map, (*index)++);
+        }
+    }
+    return NULL;
+}
+
+int32_t flat_map_int_key(const flat_map_t *map, const void *value) {
+    return map->keys[bucket_of(map, value)];
+}
+
+const char * flat_map_str_key(const flat_map_t *map, const void *value) {
+    return map->strings + map->keys[bucket_of(map, value)];
+}
@@ -0,0 +1,97 @@
+/*
+*   Flat hash map
+*   Fixed-capacity open-addressing table for the small registries that are
+*   filled at startup and looked up on every message or reading. All the
+*   buckets, values and string keys live in a single block allocated by
+*   flat_map_init: no allocation per entry, no pointer to chase on a lookup.
+*
+*   Keys are ints or strings. A string key is copied once into the pool of
+*   the map (interned) and the copy lives as long as the map, a removed key
+*   keeps its bytes in the pool. Values are fixed-size and stay at the same
+*   address until they are removed, so callers can keep a pointer to them.
+*
+*   Writers (insert, remove) must be serialized by the caller. A lookup
+*   does not lock and may run at the same time as an insert.
+*/
+#ifndef FLAT_MAP_H
+#define FLAT_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct {
+    uint32_t *hashes;       // per bucket: empty, removed or the hash of its key
+    int32_t *keys;          // per bucket: the int key or the offset of the string key in strings
+    uint8_t *values;        // per bucket: value_size bytes
+    char *strings;          // pool of the string keys, NULL for an int map
+    size_t strings_size;
+    size_t strings_used;
+    size_t value_size;
+    uint32_t capacity;      // buckets, a power of 2
+    uint32_t max_entries;
+    uint32_t count;
+} flat_map_t;
+
+/*
+  * Function: flat_map_init
+  * ----------------------------
+  *   Allocates the map, the buckets are twice max_entries rounded up to a
+  *   power of 2
+  *
+  * max_entries: entries the map accepts
+  * value_size: bytes of a value, the values are zeroed
+  * key_bytes: bytes of the pool of the string keys (terminators included),
+  *            0 for a map with int keys
+  *
+  * returns: ESP_OK, ESP_ERR_INVALID_ARG or ESP_ERR_NO_MEM
+*/
+esp_err_t flat_map_init(flat_map_t *map, size_t max_entries, size_t value_size, size_t key_bytes);
+
+/*
+  * Function: flat_map_find_int / flat_map_find_str
+  * ----------------------------
+  *   returns: the value of key or NULL
+*/
+void * flat_map_find_int(const flat_map_t *map, int32_t key);
+void * flat_map_find_str(const flat_map_t *map, const char *key);
+
+/*
+  * Function: flat_map_insert_int / flat_map_insert_str
+  * ----------------------------
+  *   Adds key to the map, the string key is copied into the pool
+  *
+  * returns: the zeroed value of key, or NULL if key is already in the map
+  *          or the map (or its pool) is full
+*/
+void * flat_map_insert_int(flat_map_t *map, int32_t key);
+void * flat_map_insert_str(flat_map_t *map, const char *key);
+
+/*
+  * Function: flat_map_remove
+  * ----------------------------
+  *   Removes the entry of a value returned by a find or an insert
+  *
+*/
+void flat_map_remove(flat_map_t *map, void *value);
+
+/*
+  * Function: flat_map_next
+  * ----------------------------
+  *   Iterates over the entries, start with *index at 0
+  *
+  *   for (uint32_t i = 0; (value = flat_map_next(map, &i)) != NULL;) { ... }
+  *
+  * returns: the next value or NULL after the last one
+*/
+void * flat_map_next(const flat_map_t *map, uint32_t *index);
+
+/*
+  * Function: flat_map_int_key / flat_map_str_key
+  * ----------------------------
+  *   returns: the key of a value, the string is the interned copy
+*/
+int32_t flat_map_int_key(const flat_map_t *map, const void *value);
+const char * flat_map_str_key(const flat_map_t *map, const void *value);
+
+#endif // FLAT_MAP_H
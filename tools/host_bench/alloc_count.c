@@ -0,0 +1,52 @@
+/*
+ * Counts the heap allocations of the process by replacing malloc and
+ * friends with wrappers around the glibc allocator. glibc routes its own
+ * allocations (strdup, asprintf, printf buffers) through the replacement,
+ * so they are counted too.
+ */
+#include <stddef.h>
+#include "alloc_count.h"
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static uint64_t s_allocs = 0;
+static uint64_t s_bytes = 0;
+static uint64_t s_frees = 0;
+
+static void count_alloc(size_t size) {
+    __atomic_add_fetch(&s_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size) {
+    count_alloc(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    count_alloc(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    count_alloc(size);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    if (ptr != NULL) {
+        __atomic_add_fetch(&s_frees, 1, __ATOMIC_RELAXED);
+    }
+    __libc_free(ptr);
+}
+
+alloc_count_t alloc_count_get(void) {
+    return (alloc_count_t) {
+        .allocs = __atomic_load_n(&s_allocs, __ATOMIC_RELAXED),
+        .bytes = __atomic_load_n(&s_bytes, __ATOMIC_RELAXED),
+        .frees = __atomic_load_n(&s_frees, __ATOMIC_RELAXED)
+    };
+}
@@ -0,0 +1,24 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#include <stdint.h>
+
+/*****
+ *   Heap allocation counters
+ *****/
+
+typedef struct {
+    uint64_t allocs;   // malloc, calloc and realloc calls of every thread
+    uint64_t bytes;    // bytes requested by them
+    uint64_t frees;
+} alloc_count_t;
+
+/*
+  * Function: alloc_count_get
+  * ----------------------------
+  *   returns: the counters since the start of the process
+  *
+*/
+alloc_count_t alloc_count_get(void);
+
+#endif // ALLOC_COUNT_H
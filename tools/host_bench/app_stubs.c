@@ -0,0 +1,82 @@
+/*
+ * The modules of main/ the benchmarked core calls but the host build does
+ * not compile, because they need the radio, the sensors or the flash:
+ * reduced to what the handlers observe.
+ */
+#include <stdio.h>
+#include "esp_wifi.h"
+#include "esp_mac.h"
+#include "performance/performance.h"
+#include "benchmark/benchmark.h"
+#include "tsdb/tsdb.h"
+#include "topology/topology.h"
+#include "sensors/tasks/sensor_tasks.h"
+#include "mesh_netif/mesh_netif.h"
+#include "time_sync/time_sync.h"
+
+// mesh_netif.c, same allocation as on the target
+char * get_mac_ap(void) {
+    uint8_t macAp[6];
+    esp_wifi_get_mac(WIFI_IF_AP, macAp);
+    char * mac_ap = (char *) malloc(18 * sizeof(char));
+    sprintf(mac_ap, MACSTR, MAC2STR(macAp));
+    return mac_ap;
+}
+
+char * get_mac_sta(void) {
+    uint8_t macSta[6];
+    esp_wifi_get_mac(WIFI_IF_STA, macSta);
+    char * mac_sta = (char *) malloc(18 * sizeof(char));
+    sprintf(mac_sta, MACSTR, MAC2STR(macSta));
+    return mac_sta;
+}
+
+// performance.c
+void log_memory(void) {
+}
+
+void performance_watch_queue(const char *name, QueueHandle_t queue) {
+}
+
+void performance_unwatch_queue(QueueHandle_t queue) {
+}
+
+void performance_request_heap_report(size_t top) {
+}
+
+// benchmark.c, built without CONFIG_MESH_BENCHMARK_ENABLE
+bool benchmark_parse_params(cJSON *payload, benchmark_params_t *params) {
+    return false;
+}
+
+esp_err_t benchmark_start(const benchmark_params_t *params) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+// tsdb.c without its partition
+esp_err_t tsdb_query(uint16_t series, int64_t from_ms, int64_t to_ms, uint32_t step_ms, tsdb_point_cb_t cb, void *ctx) {
+    return ESP_ERR_NOT_FOUND;
+}
+
+// topology.c
+void topology_request_snapshot(void) {
+}
+
+// time_sync.c, the host clock is the wall clock
+bool time_sync_is_synced(void) {
+    return true;
+}
+
+// sensors/tasks, the descriptors are the real ones
+esp_err_t task_sensor_dht11(TaskJobArgs_t *args, float values[]) {
+    values[0] = 21.5f;
+    values[1] = 40.0f;
+    return ESP_OK;
+}
+
+esp_err_t task_sensor_performance(TaskJobArgs_t *args, float values[]) {
+    values[0] = 180.0f;
+    values[1] = 150.0f;
+    values[2] = 40.0f;
+    return ESP_OK;
+}
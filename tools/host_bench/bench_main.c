@@ -0,0 +1,336 @@
+/*
+ * Host benchmark of the MILOS application core.
+ *
+ * Runs the real mqtt_queue.c, mqtt_utils.c, tasks_config.c, persistence.c,
+ * relays.c and subscription handlers on the FreeRTOS host port, and reports
+ * messages per second and heap allocations per message of each path. See
+ * README.md for what every case covers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <sched.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "alloc_count.h"
+#include "mqtt_queue.h"
+#include "mqtt/utils/mqtt_utils.h"
+#include "persistence.h"
+#include "tasks_config.h"
+#include "relays.h"
+#include "suscription_event_handlers.h"
+#include "sensors/descriptors/sensor_descriptors.h"
+#include "json_arena/json_arena.h"
+
+// globals of mesh_main.c
+char * MESH_TAG = "esp32-mesh";
+const char FIRMWARE_VERSION[] = "v1.0.0";
+const char FIRMWARE_REVISION[] = "host";
+char * clientIdentifier = NULL;
+mqtt_queues_t *mqtt_queues = NULL;
+
+#define BENCH_TOPIC "/mesh/esp32-mesh/devices/24:0a:c4:00:00:02/bench"
+#define DASHBOARD_CLIENT "iotconsole-a7124307-8b16-4083-ad16-a23a60eb898b"
+
+typedef struct {
+    const char *name;
+    void (*setup)(void);
+    void (*run)(void);     // one message
+    const char *description;
+} bench_case_t;
+
+#define BENCH_MAX_RUNS 15
+
+static uint32_t s_messages = 20000;
+static uint32_t s_runs = 5;
+static const char *s_only = NULL;
+static int s_log_level = ESP_LOG_ERROR;
+
+static SemaphoreHandle_t s_drained = NULL;
+static uint64_t s_delivered = 0;
+
+/*******************************************************
+ *                Client loop
+ *******************************************************/
+
+/*
+  * Function: task_client_loop
+  * ----------------------------
+  *   The publisher side of task_mqtt_client_start without the network: a
+  *   buffer per message, the dequeue stamp. It blocks on the queue instead
+  *   of polling it every 100 ms, so the case measures the CPU cost of the
+  *   path, not the pacing of the loop. A message with an empty topic marks
+  *   the end of a case.
+  *
+*/
+static void task_client_loop(void *args) {
+    for (;;) {
+        mqtt_message_t *buffer = malloc(sizeof(mqtt_message_t));
+        if (xQueueReceive(mqtt_queues->mqttPublisherQueue, (void *)buffer, portMAX_DELAY) == pdTRUE) {
+            buffer->trace.dequeue_us = esp_timer_get_time();
+            if (buffer->topic[0] == '\0') {
+                xSemaphoreGive(s_drained);
+            } else {
+                __atomic_add_fetch(&s_delivered, 1, __ATOMIC_RELAXED);
+            }
+        }
+        free(buffer);
+    }
+    vTaskDelete(NULL);
+}
+
+/*
+  * Function: client_loop_wait
+  * ----------------------------
+  *   Waits for a free slot in the publisher queue. publish() drops the
+  *   message when the queue is full, so an unpaced case would mostly
+  *   measure drops
+  *
+*/
+static void client_loop_wait(void) {
+    while (uxQueueSpacesAvailable(mqtt_queues->mqttPublisherQueue) == 0) {
+        sched_yield();
+    }
+}
+
+// returns once the client loop consumed everything published before
+static void client_loop_drain(void) {
+    static mqtt_message_t marker;
+    xQueueSend(mqtt_queues->mqttPublisherQueue, &marker, portMAX_DELAY);
+    xSemaphoreTake(s_drained, portMAX_DELAY);
+}
+
+/*******************************************************
+ *                Subscription dispatch
+ *******************************************************/
+
+static void bench_event_handler(char *topic, char *message) {
+}
+
+/*
+  * Function: dispatch
+  * ----------------------------
+  *   An incoming publish through the functions of the target: the MQTT
+  *   client queues it, the suscribers task takes it out with its handler
+  *   (run here instead of in a new task)
+  *
+*/
+static void dispatch(const char *topic, const char *payload) {
+    suscriber_receive_publish(topic, strlen(topic), payload, strlen(payload));
+    suscription_event_handler_t *event = suscriber_next_event(topic);
+    if (event != NULL) {
+        suscriber_run_event(event);
+    }
+}
+
+/*******************************************************
+ *                Cases
+ *******************************************************/
+
+static const char s_reading[] = "{\"type\":\"temperature\",\"value\":21.5,\"unit\":\"C\"}";
+static char s_report[MAX_MESSAGE_LENGTH];
+
+static void setup_publish(void) {
+    char *message = create_mqtt_message((char *) s_reading);
+    strncpy(s_report, message, sizeof(s_report) - 1);
+    free(message);
+}
+
+// a prebuilt message through publish and the client loop
+static void run_publish(void) {
+    publish(BENCH_TOPIC, s_report);
+}
+
+// the envelope every handler builds before publishing
+static void run_create_publish(void) {
+    char *message = create_mqtt_message((char *) s_reading);
+    publish(BENCH_TOPIC, message);
+    free(message);
+}
+
+static void setup_dispatch(void) {
+    suscriber_add_topic(BENCH_TOPIC, bench_event_handler);
+}
+
+static void run_dispatch(void) {
+    dispatch(BENCH_TOPIC, "{\"action\":\"read\",\"sender_client_id\":\"" DASHBOARD_CLIENT "\",\"type\":\"relay\"}");
+}
+
+static void run_config_read(void) {
+    suscriber_particular_config_handler(BENCH_TOPIC,
+        "{\"action\":\"read\",\"sender_client_id\":\"" DASHBOARD_CLIENT "\",\"type\":\"config\"}");
+}
+
+static void run_config_write(void) {
+    suscriber_particular_config_handler(BENCH_TOPIC,
+        "{\"action\":\"write\",\"sender_client_id\":\"" DASHBOARD_CLIENT "\",\"type\":\"config\","
+        "\"payload\":{\"sensors\":[{\"task_id\":1,\"pool\":{\"actual_time\":15000},\"active\":true,"
+        "\"rollup\":{\"interval\":60000,\"p95\":true},"
+        "\"metrics\":[{\"type\":\"temperature\",\"deadband\":0.5,\"percent\":false,\"heartbeat\":600000}]}]}}");
+}
+
+static void run_relay_read(void) {
+    relay_event_handler(BENCH_TOPIC,
+        "{\"action\":\"read\",\"sender_client_id\":\"" DASHBOARD_CLIENT "\",\"type\":\"relay\"}");
+}
+
+static void run_relay_write(void) {
+    relay_event_handler(BENCH_TOPIC,
+        "{\"action\":\"write\",\"sender_client_id\":\"" DASHBOARD_CLIENT "\",\"type\":\"relay\","
+        "\"payload\":{\"relay\":[{\"id\":1,\"state\":1},{\"id\":2,\"state\":0}]}}");
+}
+
+static const bench_case_t s_cases[] = {
+    { "publish", setup_publish, run_publish, "prebuilt message, publish() -> client loop" },
+    { "create_publish", NULL, run_create_publish, "create_mqtt_message + publish() -> client loop" },
+    { "dispatch", setup_dispatch, run_dispatch, "incoming publish -> topic queue -> event handler" },
+    { "config_read", NULL, run_config_read, "particular config handler, read action" },
+    { "config_write", NULL, run_config_write, "particular config handler, write action" },
+    { "relay_read", NULL, run_relay_read, "relay handler, read action" },
+    { "relay_write", NULL, run_relay_write, "relay handler, write action (2 relays)" },
+};
+
+#define CASES (sizeof(s_cases) / sizeof(s_cases[0]))
+
+/*******************************************************
+ *                Runner
+ *******************************************************/
+
+static double now_s(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+  * Function: run_case
+  * ----------------------------
+  *   Runs the case s_runs times and prints the median rate. The allocations
+  *   do not depend on the run, they are the ones of the last run
+  *
+*/
+static void run_case(const bench_case_t *bench_case) {
+    if (bench_case->setup != NULL) {
+        bench_case->setup();
+    }
+    // warm up the caches and the allocator, and wait for the client loop
+    for (uint32_t i = 0; i < s_messages / 10; i++) {
+        client_loop_wait();
+        bench_case->run();
+    }
+    client_loop_drain();
+
+    double rates[BENCH_MAX_RUNS];
+    alloc_count_t before, after;
+    uint64_t delivered = 0;
+    for (uint32_t run = 0; run < s_runs; run++) {
+        delivered = __atomic_load_n(&s_delivered, __ATOMIC_RELAXED);
+        before = alloc_count_get();
+        double start = now_s();
+        for (uint32_t i = 0; i < s_messages; i++) {
+            client_loop_wait();
+            bench_case->run();
+        }
+        client_loop_drain();
+        rates[run] = s_messages / (now_s() - start);
+        after = alloc_count_get();
+        delivered = __atomic_load_n(&s_delivered, __ATOMIC_RELAXED) - delivered;
+    }
+    qsort(rates, s_runs, sizeof(double), compare_double);
+
+    printf("%-16s %10u %12.0f %10.1f %10.0f %10llu\n", bench_case->name, s_messages,
+           rates[s_runs / 2],
+           (double) (after.allocs - before.allocs) / s_messages,
+           (double) (after.bytes - before.bytes) / s_messages,
+           (unsigned long long) delivered);
+}
+
+static void usage(const char *argv0) {
+    printf("usage: %s [options]\n"
+           "  --messages N    messages per run (default %u)\n"
+           "  --runs N        runs per case, the median is reported (default %u, max %d)\n"
+           "  --case NAME     run only this case\n"
+           "  --log-level N   0 none .. 5 verbose (default %d)\n"
+           "  --list          list the cases\n", argv0, s_messages, s_runs, BENCH_MAX_RUNS, s_log_level);
+}
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        { "messages", required_argument, NULL, 'm' },
+        { "runs", required_argument, NULL, 'r' },
+        { "case", required_argument, NULL, 'c' },
+        { "log-level", required_argument, NULL, 'l' },
+        { "list", no_argument, NULL, 'L' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (option) {
+            case 'm': s_messages = strtoul(optarg, NULL, 10); break;
+            case 'r': s_runs = strtoul(optarg, NULL, 10); break;
+            case 'c': s_only = optarg; break;
+            case 'l': s_log_level = atoi(optarg); break;
+            case 'L':
+                for (size_t i = 0; i < CASES; i++) {
+                    printf("%-16s %s\n", s_cases[i].name, s_cases[i].description);
+                }
+                return 0;
+            default:
+                usage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+    if (s_messages == 0 || s_runs == 0 || s_runs > BENCH_MAX_RUNS) {
+        usage(argv[0]);
+        return 1;
+    }
+    esp_log_level_set("*", s_log_level);
+
+    // the boot of mesh_main.c, reduced to the core
+    if (persistence_init() != INITIALIZED_PERSISTENCE) {
+        fprintf(stderr, "persistence_init failed\n");
+        return 1;
+    }
+    clientIdentifier = create_client_identifier();
+    init_suscriber_hash();
+    json_arena_init();
+    mqtt_queues = malloc(sizeof(mqtt_queues_t));
+    mqtt_queues->mqttPublisherQueue = xQueueCreate(queueSize, sizeof(mqtt_message_t));
+    mqtt_queues->mqttSuscriberHash = &suscription_topics;
+    for (int task_id = SENSOR_TASK_NONE + 1; task_id < SENSOR_TASK_END; task_id++) {
+        add_task_config(task_id, sensor_descriptor_get(task_id)->task_name, sensor_descriptor_get(task_id)->default_config);
+    }
+    add_relay("relay1", RELAY1_PIN);
+    add_relay("relay2", RELAY2_PIN);
+    relay_init();
+
+    s_drained = xSemaphoreCreateBinary();
+    xTaskCreate(task_client_loop, "mqtt client", 4096, NULL, 5, NULL);
+
+    printf("%-16s %10s %12s %10s %10s %10s\n", "case", "messages", "msgs/s", "allocs/msg", "bytes/msg", "delivered");
+    bool found = false;
+    for (size_t i = 0; i < CASES; i++) {
+        if (s_only == NULL || strcmp(s_only, s_cases[i].name) == 0) {
+            run_case(&s_cases[i]);
+            found = true;
+        }
+    }
+    if (!found) {
+        fprintf(stderr, "unknown case %s, see --list\n", s_only);
+        return 1;
+    }
+    // flushes the configs the write case left in the persistence cache
+    persistence_flush();
+    return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef HOST_DHCPSERVER_DHCPSERVER_H
+#define HOST_DHCPSERVER_DHCPSERVER_H
+
+// included by mesh_netif.h, nothing of it is used by the core
+
+#endif // HOST_DHCPSERVER_DHCPSERVER_H
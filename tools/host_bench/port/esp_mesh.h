@@ -0,0 +1,43 @@
+#ifndef HOST_ESP_MESH_H
+#define HOST_ESP_MESH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_netif.h"
+
+typedef union {
+    uint8_t addr[6];
+    struct {
+        uint16_t port;
+        esp_ip4_addr_t ip4;
+    } __attribute__((packed)) mip;
+} mesh_addr_t;
+
+typedef enum {
+    MESH_PROTO_BIN,
+    MESH_PROTO_HTTP,
+    MESH_PROTO_JSON,
+    MESH_PROTO_MQTT,
+    MESH_PROTO_AP,
+    MESH_PROTO_STA
+} mesh_proto_t;
+
+typedef enum {
+    MESH_TOS_P2P,
+    MESH_TOS_E2E,
+    MESH_TOS_DEF
+} mesh_tos_t;
+
+typedef struct {
+    uint8_t *data;
+    uint16_t size;
+    mesh_proto_t proto;
+    mesh_tos_t tos;
+} mesh_data_t;
+
+// the host node is always the root
+bool esp_mesh_is_root(void);
+int esp_mesh_get_layer(void);
+
+#endif // HOST_ESP_MESH_H
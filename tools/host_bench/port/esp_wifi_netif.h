@@ -0,0 +1,6 @@
+#ifndef HOST_ESP_WIFI_NETIF_H
+#define HOST_ESP_WIFI_NETIF_H
+
+// included by mesh_netif.h, nothing of it is used by the core
+
+#endif // HOST_ESP_WIFI_NETIF_H
@@ -0,0 +1,55 @@
+/*
+ * Host port of the FreeRTOS API subset used by the application core.
+ *
+ * Tasks are pthreads, queues and mutexes are a mutex and two condition
+ * variables, one tick is one millisecond of CLOCK_MONOTONIC. There is no
+ * scheduler: priorities and core affinity are accepted and ignored.
+ */
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE ((BaseType_t) 0)
+#define pdTRUE  ((BaseType_t) 1)
+#define pdFAIL  pdFALSE
+#define pdPASS  pdTRUE
+
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t) (((TickType_t) (ms) * (TickType_t) configTICK_RATE_HZ) / (TickType_t) 1000U))
+#define pdTICKS_TO_MS(ticks) ((TickType_t) (ticks))
+
+#define tskIDLE_PRIORITY ((UBaseType_t) 0U)
+#define tskNO_AFFINITY 0x7fffffff
+#define configMAX_PRIORITIES 25
+#define configMAX_TASK_NAME_LEN 16
+
+// buffers of the static create functions, the host keeps its own control blocks
+typedef struct { void *reserved[4]; } StaticTask_t;
+typedef struct { void *reserved[4]; } StaticQueue_t;
+
+// a critical section is a process wide lock, not a disabled scheduler
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(mux)
+#define taskENTER_CRITICAL(mux) portENTER_CRITICAL(mux)
+#define taskEXIT_CRITICAL(mux) portEXIT_CRITICAL(mux)
+
+// as idf_additions.h does on ESP-IDF 5, the application relies on it
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#endif // HOST_FREERTOS_H
@@ -0,0 +1,19 @@
+#ifndef HOST_FREERTOS_RINGBUF_H
+#define HOST_FREERTOS_RINGBUF_H
+
+#include "freertos/FreeRTOS.h"
+
+// declared for rtos_alloc.c, the modules using a ring buffer are not built on the host
+typedef struct host_ringbuf *RingbufHandle_t;
+typedef struct { void *reserved[4]; } StaticRingbuffer_t;
+
+typedef enum {
+    RINGBUF_TYPE_NOSPLIT = 0,
+    RINGBUF_TYPE_ALLOWSPLIT,
+    RINGBUF_TYPE_BYTEBUF,
+} RingbufferType_t;
+
+RingbufHandle_t xRingbufferCreate(size_t size, RingbufferType_t type);
+RingbufHandle_t xRingbufferCreateStatic(size_t size, RingbufferType_t type, uint8_t *storage, StaticRingbuffer_t *ringbuf_buffer);
+
+#endif // HOST_FREERTOS_RINGBUF_H
@@ -0,0 +1,385 @@
+/*
+ * pthread implementation of the FreeRTOS subset declared in port/freertos.
+ * Good enough to run the application core on Linux, not a scheduler: the
+ * tasks run in parallel on the host cores whatever their priority.
+ */
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/ringbuf.h"
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t code;
+    void *parameters;
+    char name[16];
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notify_value;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    size_t item_size;
+    size_t length;
+    size_t count;
+    size_t head;
+    uint8_t *storage;
+    bool static_storage; // given to xQueueCreateStatic, not freed
+};
+
+static __thread struct host_task *s_current = NULL;
+
+/*******************************************************
+ *                Time
+ *******************************************************/
+
+static struct timespec now_monotonic(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now;
+}
+
+// absolute CLOCK_MONOTONIC deadline ticks from now
+static struct timespec deadline_after(TickType_t ticks) {
+    struct timespec deadline = now_monotonic();
+    uint64_t ms = (uint64_t) ticks * portTICK_PERIOD_MS;
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (long) (ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
+static void cond_init(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/*
+  * Function: cond_wait_ticks
+  * ----------------------------
+  *   Waits on cond with its mutex held, like the kernel blocks a task
+  *
+  *   returns: false once ticks elapsed (0 never waits)
+*/
+static bool cond_wait_ticks(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *deadline) {
+    if (ticks == 0) {
+        return false;
+    }
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static struct timespec s_start;
+static pthread_once_t s_start_once = PTHREAD_ONCE_INIT;
+
+static void start_clock(void) {
+    s_start = now_monotonic();
+}
+
+TickType_t xTaskGetTickCount(void) {
+    pthread_once(&s_start_once, start_clock);
+    struct timespec now = now_monotonic();
+    int64_t ms = (int64_t) (now.tv_sec - s_start.tv_sec) * 1000 + (now.tv_nsec - s_start.tv_nsec) / 1000000L;
+    return (TickType_t) (ms / portTICK_PERIOD_MS);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    uint64_t ms = (uint64_t) ticks * portTICK_PERIOD_MS;
+    struct timespec delay = { .tv_sec = ms / 1000, .tv_nsec = (long) (ms % 1000) * 1000000L };
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+    }
+}
+
+/*******************************************************
+ *                Tasks
+ *******************************************************/
+
+static struct host_task * task_new(const char *name) {
+    struct host_task *task = calloc(1, sizeof(struct host_task));
+    if (task == NULL) {
+        return NULL;
+    }
+    strncpy(task->name, name != NULL ? name : "", sizeof(task->name) - 1);
+    pthread_mutex_init(&task->lock, NULL);
+    cond_init(&task->notified);
+    return task;
+}
+
+static void * task_entry(void *arg) {
+    s_current = arg;
+    s_current->code(s_current->parameters);
+    // a FreeRTOS task must not return, vTaskDelete(NULL) ends it
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stack_depth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id) {
+    struct host_task *task = task_new(name);
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->code = code;
+    task->parameters = parameters;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    // the stack depth is in bytes on ESP-IDF, the host libc needs more
+    int err = pthread_create(&task->thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    if (created_task != NULL) {
+        *created_task = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stack_depth, void *parameters,
+                       UBaseType_t priority, TaskHandle_t *created_task) {
+    return xTaskCreatePinnedToCore(code, name, stack_depth, parameters, priority, created_task, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t code, const char *name, uint32_t stack_depth, void *parameters,
+                               UBaseType_t priority, StackType_t *stack_buffer, StaticTask_t *task_buffer) {
+    TaskHandle_t task = NULL;
+    xTaskCreatePinnedToCore(code, name, stack_depth, parameters, priority, &task, tskNO_AFFINITY);
+    return task;
+}
+
+/*
+  * Function: vTaskDelete
+  * ----------------------------
+  *   Only a task can delete itself, the handle is leaked so a late
+  *   xTaskNotifyGive on it stays harmless
+  *
+*/
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL || task == s_current) {
+        pthread_exit(NULL);
+    }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (s_current == NULL) {
+        // a thread not created by xTaskCreate, the main thread
+        s_current = task_new("main");
+        s_current->thread = pthread_self();
+    }
+    return s_current;
+}
+
+const char * pcTaskGetName(TaskHandle_t task) {
+    return (task != NULL ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notify_value++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline = deadline_after(ticks_to_wait);
+    pthread_mutex_lock(&task->lock);
+    while (task->notify_value == 0 && cond_wait_ticks(&task->notified, &task->lock, ticks_to_wait, &deadline)) {
+    }
+    uint32_t value = task->notify_value;
+    if (value != 0) {
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+/*******************************************************
+ *                Queues
+ *******************************************************/
+
+static QueueHandle_t queue_new(UBaseType_t length, UBaseType_t item_size, uint8_t *storage) {
+    if (length == 0) {
+        return NULL;
+    }
+    struct host_queue *queue = calloc(1, sizeof(struct host_queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->static_storage = storage != NULL;
+    queue->storage = storage;
+    if (item_size != 0 && storage == NULL) {
+        queue->storage = malloc(length * item_size);
+        if (queue->storage == NULL) {
+            free(queue);
+            return NULL;
+        }
+    }
+    queue->item_size = item_size;
+    queue->length = length;
+    pthread_mutex_init(&queue->lock, NULL);
+    cond_init(&queue->not_empty);
+    cond_init(&queue->not_full);
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    return queue_new(length, item_size, NULL);
+}
+
+// the control block stays on the heap, queue_buffer is not used
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *queue_buffer) {
+    return queue_new(length, item_size, storage);
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (queue == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    if (!queue->static_storage) {
+        free(queue->storage);
+    }
+    free(queue);
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait, BaseType_t position) {
+    struct timespec deadline = deadline_after(ticks_to_wait);
+    pthread_mutex_lock(&queue->lock);
+    if (position == queueOVERWRITE && queue->count == queue->length) {
+        // only meant for queues of length 1
+        queue->count = 0;
+    }
+    while (queue->count == queue->length) {
+        if (!cond_wait_ticks(&queue->not_full, &queue->lock, ticks_to_wait, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    size_t slot;
+    if (position == queueSEND_TO_FRONT) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        slot = queue->head;
+    } else {
+        slot = (queue->head + queue->count) % queue->length;
+    }
+    if (queue->item_size != 0) {
+        memcpy(queue->storage + slot * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+static BaseType_t queue_receive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait, bool remove) {
+    struct timespec deadline = deadline_after(ticks_to_wait);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (!cond_wait_ticks(&queue->not_empty, &queue->lock, ticks_to_wait, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    if (queue->item_size != 0 && buffer != NULL) {
+        memcpy(buffer, queue->storage + queue->head * queue->item_size, queue->item_size);
+    }
+    if (remove) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait) {
+    return queue_receive(queue, buffer, ticks_to_wait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait) {
+    return queue_receive(queue, buffer, ticks_to_wait, false);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t spaces = queue->length - queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return spaces;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->count = 0;
+    queue->head = 0;
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+/*******************************************************
+ *                Semaphores
+ *******************************************************/
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+    SemaphoreHandle_t semaphore = xQueueCreate(max_count, 0);
+    if (semaphore != NULL) {
+        semaphore->count = initial_count;
+    }
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+/*
+  * Function: xSemaphoreCreateMutex
+  * ----------------------------
+  *   A binary semaphore given once. No priority inheritance nor owner
+  *   check, the application never relies on them
+  *
+*/
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+/*******************************************************
+ *                Ring buffers
+ *******************************************************/
+
+// not ported, no module of the host build logs through dlog
+RingbufHandle_t xRingbufferCreate(size_t size, RingbufferType_t type) {
+    return NULL;
+}
+
+RingbufHandle_t xRingbufferCreateStatic(size_t size, RingbufferType_t type, uint8_t *storage, StaticRingbuffer_t *ringbuf_buffer) {
+    return NULL;
+}
@@ -0,0 +1,465 @@
+/*
+ * Host stand-ins of the ESP-IDF services the application core calls:
+ * logging, esp_timer (clock and one-shot timers), the MAC addresses, NVS (in memory), GPIO and the
+ * shutdown handlers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <errno.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_mac.h"
+#include "esp_wifi.h"
+#include "esp_mesh.h"
+#include "nvs_flash.h"
+#include "driver/gpio.h"
+
+/*******************************************************
+ *                Errors and logging
+ *******************************************************/
+
+const char * esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_NVS_NOT_INITIALIZED: return "ESP_ERR_NVS_NOT_INITIALIZED";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_TYPE_MISMATCH: return "ESP_ERR_NVS_TYPE_MISMATCH";
+        case ESP_ERR_NVS_INVALID_HANDLE: return "ESP_ERR_NVS_INVALID_HANDLE";
+        case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+esp_log_level_t esp_log_host_level = ESP_LOG_INFO;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    esp_log_host_level = level;
+}
+
+uint32_t esp_log_timestamp(void) {
+    return (uint32_t) (esp_timer_get_time() / 1000);
+}
+
+void esp_log_writev(esp_log_level_t level, const char *tag, const char *format, va_list args) {
+    vfprintf(stderr, format, args);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    esp_log_writev(level, tag, format, args);
+    va_end(args);
+}
+
+/*******************************************************
+ *                Time, MAC, mesh
+ *******************************************************/
+
+static struct timespec s_start;
+static pthread_once_t s_start_once = PTHREAD_ONCE_INIT;
+
+static void start_clock(void) {
+    clock_gettime(CLOCK_MONOTONIC, &s_start);
+}
+
+int64_t esp_timer_get_time(void) {
+    pthread_once(&s_start_once, start_clock);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) (now.tv_sec - s_start.tv_sec) * 1000000 + (now.tv_nsec - s_start.tv_nsec) / 1000;
+}
+
+struct esp_timer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    esp_timer_cb_t callback;
+    void *arg;
+    bool armed;
+    struct timespec deadline; // CLOCK_MONOTONIC
+};
+
+static void * timer_thread(void *args) {
+    struct esp_timer *timer = args;
+    pthread_mutex_lock(&timer->lock);
+    while (1) {
+        if (!timer->armed) {
+            pthread_cond_wait(&timer->changed, &timer->lock);
+        } else if (pthread_cond_timedwait(&timer->changed, &timer->lock, &timer->deadline) == ETIMEDOUT && timer->armed) {
+            timer->armed = false;
+            pthread_mutex_unlock(&timer->lock);
+            timer->callback(timer->arg);
+            pthread_mutex_lock(&timer->lock);
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+    struct esp_timer *timer = calloc(1, sizeof(struct esp_timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&timer->lock, NULL);
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    if (pthread_create(&timer->thread, NULL, timer_thread, timer) != 0) {
+        free(timer);
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_detach(timer->thread);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timer->lock);
+    if (timer->armed) {
+        pthread_mutex_unlock(&timer->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &timer->deadline);
+    timer->deadline.tv_sec += timeout_us / 1000000;
+    timer->deadline.tv_nsec += (long) (timeout_us % 1000000) * 1000L;
+    if (timer->deadline.tv_nsec >= 1000000000L) {
+        timer->deadline.tv_sec++;
+        timer->deadline.tv_nsec -= 1000000000L;
+    }
+    timer->armed = true;
+    pthread_cond_signal(&timer->changed);
+    pthread_mutex_unlock(&timer->lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timer->lock);
+    esp_err_t err = timer->armed ? ESP_OK : ESP_ERR_INVALID_STATE;
+    timer->armed = false;
+    pthread_cond_signal(&timer->changed);
+    pthread_mutex_unlock(&timer->lock);
+    return err;
+}
+
+static const uint8_t s_base_mac[6] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01 };
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type) {
+    memcpy(mac, s_base_mac, sizeof(s_base_mac));
+    mac[5] += type;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6]) {
+    return esp_read_mac(mac, ifx == WIFI_IF_AP ? ESP_MAC_WIFI_SOFTAP : ESP_MAC_WIFI_STA);
+}
+
+bool esp_mesh_is_root(void) {
+    return true;
+}
+
+int esp_mesh_get_layer(void) {
+    return 1;
+}
+
+/*******************************************************
+ *                System
+ *******************************************************/
+
+#define SHUTDOWN_HANDLERS 8
+
+static shutdown_handler_t s_shutdown_handlers[SHUTDOWN_HANDLERS];
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+    for (size_t i = 0; i < SHUTDOWN_HANDLERS; i++) {
+        if (s_shutdown_handlers[i] == handler) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (s_shutdown_handlers[i] == NULL) {
+            s_shutdown_handlers[i] = handler;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_unregister_shutdown_handler(shutdown_handler_t handler) {
+    for (size_t i = 0; i < SHUTDOWN_HANDLERS; i++) {
+        if (s_shutdown_handlers[i] == handler) {
+            s_shutdown_handlers[i] = NULL;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_STATE;
+}
+
+void esp_restart(void) {
+    for (size_t i = SHUTDOWN_HANDLERS; i > 0; i--) {
+        if (s_shutdown_handlers[i - 1] != NULL) {
+            s_shutdown_handlers[i - 1]();
+        }
+    }
+    exit(0);
+}
+
+// the host heap has no meaningful size, these only keep the reports non-zero
+uint32_t esp_get_free_heap_size(void) {
+    return 300 * 1024;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return 300 * 1024;
+}
+
+/*******************************************************
+ *                NVS
+ *******************************************************/
+
+typedef enum {
+    NVS_ENTRY_U8,
+    NVS_ENTRY_STR,
+    NVS_ENTRY_BLOB
+} nvs_entry_type_t;
+
+typedef struct nvs_entry {
+    struct nvs_entry *next;
+    char namespace_name[NVS_NS_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_entry_type_t type;
+    size_t length;
+    uint8_t *value;
+} nvs_entry_t;
+
+#define NVS_NAMESPACES 16
+
+static pthread_mutex_t s_nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static nvs_entry_t *s_nvs = NULL;
+// a handle is the index of its namespace plus one, the open mode is not enforced
+static char s_nvs_namespaces[NVS_NAMESPACES][NVS_NS_NAME_MAX_SIZE];
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    pthread_mutex_lock(&s_nvs_lock);
+    while (s_nvs != NULL) {
+        nvs_entry_t *next = s_nvs->next;
+        free(s_nvs->value);
+        free(s_nvs);
+        s_nvs = next;
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    if (namespace_name == NULL || strlen(namespace_name) >= sizeof(s_nvs_namespaces[0])) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    pthread_mutex_lock(&s_nvs_lock);
+    for (size_t i = 0; i < NVS_NAMESPACES; i++) {
+        if (s_nvs_namespaces[i][0] == '\0' || strcmp(s_nvs_namespaces[i], namespace_name) == 0) {
+            strcpy(s_nvs_namespaces[i], namespace_name);
+            *out_handle = i + 1;
+            pthread_mutex_unlock(&s_nvs_lock);
+            return ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+void nvs_close(nvs_handle_t handle) {
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return handle >= 1 && handle <= NVS_NAMESPACES ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+// with s_nvs_lock held
+static nvs_entry_t ** nvs_find(nvs_handle_t handle, const char *key) {
+    nvs_entry_t **entry = &s_nvs;
+    while (*entry != NULL) {
+        if (strcmp((*entry)->namespace_name, s_nvs_namespaces[handle - 1]) == 0 && strcmp((*entry)->key, key) == 0) {
+            break;
+        }
+        entry = &(*entry)->next;
+    }
+    return entry;
+}
+
+static esp_err_t nvs_set(nvs_handle_t handle, const char *key, nvs_entry_type_t type, const void *value, size_t length) {
+    if (handle < 1 || handle > NVS_NAMESPACES) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (key == NULL || strlen(key) >= sizeof(s_nvs->key)) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    uint8_t *copy = malloc(length != 0 ? length : 1);
+    if (copy == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, value, length);
+    pthread_mutex_lock(&s_nvs_lock);
+    nvs_entry_t **found = nvs_find(handle, key);
+    nvs_entry_t *entry = *found;
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(nvs_entry_t));
+        if (entry == NULL) {
+            pthread_mutex_unlock(&s_nvs_lock);
+            free(copy);
+            return ESP_ERR_NO_MEM;
+        }
+        strcpy(entry->namespace_name, s_nvs_namespaces[handle - 1]);
+        strcpy(entry->key, key);
+        *found = entry;
+    }
+    free(entry->value);
+    entry->type = type;
+    entry->length = length;
+    entry->value = copy;
+    pthread_mutex_unlock(&s_nvs_lock);
+    return ESP_OK;
+}
+
+/*
+  * Function: nvs_get
+  * ----------------------------
+  *   Reads an entry like nvs_get_blob: a NULL out_value only returns the
+  *   length, a short buffer is ESP_ERR_NVS_INVALID_LENGTH
+  *
+*/
+static esp_err_t nvs_get(nvs_handle_t handle, const char *key, nvs_entry_type_t type, void *out_value, size_t *length) {
+    if (handle < 1 || handle > NVS_NAMESPACES) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&s_nvs_lock);
+    nvs_entry_t *entry = *nvs_find(handle, key);
+    if (entry == NULL || entry->type != type) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (out_value == NULL) {
+        *length = entry->length;
+    } else if (*length < entry->length) {
+        *length = entry->length;
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(out_value, entry->value, entry->length);
+        *length = entry->length;
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    if (handle < 1 || handle > NVS_NAMESPACES) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    pthread_mutex_lock(&s_nvs_lock);
+    nvs_entry_t **found = nvs_find(handle, key);
+    nvs_entry_t *entry = *found;
+    if (entry != NULL) {
+        *found = entry->next;
+        free(entry->value);
+        free(entry);
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return entry != NULL ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    if (handle < 1 || handle > NVS_NAMESPACES) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    pthread_mutex_lock(&s_nvs_lock);
+    nvs_entry_t **entry = &s_nvs;
+    while (*entry != NULL) {
+        if (strcmp((*entry)->namespace_name, s_nvs_namespaces[handle - 1]) == 0) {
+            nvs_entry_t *erased = *entry;
+            *entry = erased->next;
+            free(erased->value);
+            free(erased);
+        } else {
+            entry = &(*entry)->next;
+        }
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value) {
+    return nvs_set(handle, key, NVS_ENTRY_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value) {
+    size_t length = sizeof(*out_value);
+    return nvs_get(handle, key, NVS_ENTRY_U8, out_value, &length);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    return nvs_set(handle, key, NVS_ENTRY_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+    return nvs_get(handle, key, NVS_ENTRY_STR, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    return nvs_set(handle, key, NVS_ENTRY_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    return nvs_get(handle, key, NVS_ENTRY_BLOB, out_value, length);
+}
+
+/*******************************************************
+ *                GPIO
+ *******************************************************/
+
+static uint8_t s_gpio_levels[GPIO_NUM_MAX];
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode) {
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull) {
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    __atomic_store_n(&s_gpio_levels[gpio_num], level != 0, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return 0;
+    }
+    return __atomic_load_n(&s_gpio_levels[gpio_num], __ATOMIC_RELAXED);
+}
@@ -0,0 +1,6 @@
+#ifndef HOST_LWIP_LWIP_NAPT_H
+#define HOST_LWIP_LWIP_NAPT_H
+
+// included by mesh_netif.h, nothing of it is used by the core
+
+#endif // HOST_LWIP_LWIP_NAPT_H
@@ -0,0 +1,129 @@
+/*
+ * Host tests of main/components/dht_decode.c on DHT waveforms in the shape
+ * the RMT receiver captures them: the end of the start signal, the 80 us
+ * response, 40 bits and the final low, with the jitter of a real sensor.
+ * Run by ctest, a failed check prints its line and fails the test.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "dht_decode.h"
+
+#define PULSES(array) (sizeof(array) / sizeof((array)[0]))
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            s_failures++; \
+        } \
+    } while (0)
+
+static int s_failures = 0;
+
+// DHT11, 40 % and 21.5 C
+static const dht_pulse_t s_dht11_frame[] = {
+    { 1, 27 }, { 0, 80 }, { 1, 86 }, { 0, 47 }, { 1, 23 }, { 0, 55 },
+    { 1, 23 }, { 0, 52 }, { 1, 68 }, { 0, 55 }, { 1, 25 }, { 0, 47 },
+    { 1, 69 }, { 0, 53 }, { 1, 28 }, { 0, 48 }, { 1, 25 }, { 0, 48 },
+    { 1, 28 }, { 0, 47 }, { 1, 23 }, { 0, 50 }, { 1, 22 }, { 0, 56 },
+    { 1, 28 }, { 0, 47 }, { 1, 25 }, { 0, 47 }, { 1, 24 }, { 0, 51 },
+    { 1, 28 }, { 0, 49 }, { 1, 23 }, { 0, 56 }, { 1, 26 }, { 0, 55 },
+    { 1, 24 }, { 0, 48 }, { 1, 25 }, { 0, 52 }, { 1, 23 }, { 0, 55 },
+    { 1, 69 }, { 0, 56 }, { 1, 22 }, { 0, 56 }, { 1, 71 }, { 0, 54 },
+    { 1, 28 }, { 0, 52 }, { 1, 75 }, { 0, 56 }, { 1, 29 }, { 0, 52 },
+    { 1, 26 }, { 0, 50 }, { 1, 24 }, { 0, 50 }, { 1, 23 }, { 0, 56 },
+    { 1, 26 }, { 0, 55 }, { 1, 75 }, { 0, 52 }, { 1, 29 }, { 0, 51 },
+    { 1, 69 }, { 0, 48 }, { 1, 28 }, { 0, 49 }, { 1, 73 }, { 0, 49 },
+    { 1, 29 }, { 0, 53 }, { 1, 22 }, { 0, 48 }, { 1, 27 }, { 0, 52 },
+    { 1, 27 }, { 0, 56 }, { 1, 75 }, { 0, 56 }, { 1, 29 }, { 0, 50 },
+};
+
+// DHT22, 65.2 % and -10.1 C
+static const dht_pulse_t s_dht22_frame[] = {
+    { 1, 23 }, { 0, 82 }, { 1, 87 }, { 0, 48 }, { 1, 22 }, { 0, 51 },
+    { 1, 29 }, { 0, 51 }, { 1, 28 }, { 0, 52 }, { 1, 22 }, { 0, 54 },
+    { 1, 27 }, { 0, 49 }, { 1, 23 }, { 0, 54 }, { 1, 68 }, { 0, 50 },
+    { 1, 26 }, { 0, 49 }, { 1, 71 }, { 0, 53 }, { 1, 28 }, { 0, 54 },
+    { 1, 23 }, { 0, 49 }, { 1, 29 }, { 0, 53 }, { 1, 72 }, { 0, 49 },
+    { 1, 74 }, { 0, 55 }, { 1, 26 }, { 0, 53 }, { 1, 27 }, { 0, 53 },
+    { 1, 71 }, { 0, 49 }, { 1, 23 }, { 0, 49 }, { 1, 24 }, { 0, 50 },
+    { 1, 25 }, { 0, 47 }, { 1, 29 }, { 0, 56 }, { 1, 24 }, { 0, 51 },
+    { 1, 26 }, { 0, 47 }, { 1, 24 }, { 0, 53 }, { 1, 27 }, { 0, 56 },
+    { 1, 73 }, { 0, 49 }, { 1, 68 }, { 0, 54 }, { 1, 28 }, { 0, 53 },
+    { 1, 28 }, { 0, 53 }, { 1, 69 }, { 0, 54 }, { 1, 28 }, { 0, 47 },
+    { 1, 71 }, { 0, 48 }, { 1, 25 }, { 0, 54 }, { 1, 70 }, { 0, 48 },
+    { 1, 73 }, { 0, 56 }, { 1, 68 }, { 0, 48 }, { 1, 22 }, { 0, 56 },
+    { 1, 24 }, { 0, 55 }, { 1, 69 }, { 0, 52 }, { 1, 68 }, { 0, 50 },
+};
+
+/*******************************************************
+ *                Cases
+ *******************************************************/
+
+static void test_good_frames(void) {
+    static const uint8_t dht11[DHT_DECODE_DATA_BYTES] = { 0x28, 0x00, 0x15, 0x05, 0x42 };
+    static const uint8_t dht22[DHT_DECODE_DATA_BYTES] = { 0x02, 0x8C, 0x80, 0x65, 0x73 };
+    uint8_t data[DHT_DECODE_DATA_BYTES];
+
+    CHECK(dht_decode_pulses(s_dht11_frame, PULSES(s_dht11_frame), data) == DHT_DECODE_OK);
+    CHECK(memcmp(data, dht11, sizeof(data)) == 0);
+    CHECK(dht_decode_pulses(s_dht22_frame, PULSES(s_dht22_frame), data) == DHT_DECODE_OK);
+    CHECK(memcmp(data, dht22, sizeof(data)) == 0);
+}
+
+static void test_truncated_frame(void) {
+    uint8_t data[DHT_DECODE_DATA_BYTES];
+    // the capture stops after 25 of the 40 bits
+    CHECK(dht_decode_pulses(s_dht11_frame, 3 + 25 * 2, data) == DHT_DECODE_TRUNCATED);
+    // the low of the last bit without its high
+    CHECK(dht_decode_pulses(s_dht11_frame, 3 + 39 * 2 + 1, data) == DHT_DECODE_TRUNCATED);
+}
+
+static void test_bad_timing(void) {
+    dht_pulse_t pulses[PULSES(s_dht22_frame)];
+    uint8_t data[DHT_DECODE_DATA_BYTES];
+
+    // the high of bit 10 stretched past any '1'
+    memcpy(pulses, s_dht22_frame, sizeof(pulses));
+    pulses[3 + 10 * 2 + 1].duration_us = 140;
+    CHECK(dht_decode_pulses(pulses, PULSES(pulses), data) == DHT_DECODE_BAD_TIMING);
+
+    // the low of bit 30 too short for a bit start
+    memcpy(pulses, s_dht22_frame, sizeof(pulses));
+    pulses[3 + 30 * 2].duration_us = 12;
+    CHECK(dht_decode_pulses(pulses, PULSES(pulses), data) == DHT_DECODE_BAD_TIMING);
+}
+
+static void test_glitch_before_response(void) {
+    // ringing of the line when the host releases it, before the response
+    static const dht_pulse_t glitch[] = { { 0, 12 }, { 1, 9 }, { 0, 15 }, { 1, 40 } };
+    static const uint8_t dht11[DHT_DECODE_DATA_BYTES] = { 0x28, 0x00, 0x15, 0x05, 0x42 };
+    dht_pulse_t pulses[PULSES(glitch) + PULSES(s_dht11_frame)];
+    uint8_t data[DHT_DECODE_DATA_BYTES];
+
+    memcpy(pulses, glitch, sizeof(glitch));
+    memcpy(pulses + PULSES(glitch), s_dht11_frame, sizeof(s_dht11_frame));
+    CHECK(dht_decode_pulses(pulses, PULSES(pulses), data) == DHT_DECODE_OK);
+    CHECK(memcmp(data, dht11, sizeof(data)) == 0);
+}
+
+static void test_no_response(void) {
+    // only the start signal: the sensor never answered
+    static const dht_pulse_t start[] = { { 0, 18000 }, { 1, 31 } };
+    uint8_t data[DHT_DECODE_DATA_BYTES];
+    CHECK(dht_decode_pulses(start, PULSES(start), data) == DHT_DECODE_NO_RESPONSE);
+    CHECK(dht_decode_pulses(start, 0, data) == DHT_DECODE_NO_RESPONSE);
+}
+
+int main(void) {
+    test_good_frames();
+    test_truncated_frame();
+    test_bad_timing();
+    test_glitch_before_response();
+    test_no_response();
+    if (s_failures != 0) {
+        fprintf(stderr, "dht_decode: %d checks failed\n", s_failures);
+        return 1;
+    }
+    printf("dht_decode: all checks passed\n");
+    return 0;
+}
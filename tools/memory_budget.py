@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""RAM reserved for the static tasks and queues, per subsystem.
+
+Reads the linker map of the firmware and adds up the .rtos_static input
+sections emitted by main/rtos_alloc/rtos_alloc.c, named
+.rtos_static.<subsystem>.<array>. Run after every build by the project
+CMakeLists.txt:
+
+    python tools/memory_budget.py build/ip_internal_network.map
+"""
+import argparse
+import re
+import sys
+from collections import defaultdict
+
+# the section name is alone on its line when it is longer than the column
+SECTION = re.compile(
+    r'^ (\.rtos_static\.(?P<subsystem>\w+)\.(?P<array>\w+))\s*\n?\s+0x[0-9a-f]+\s+0x(?P<size>[0-9a-f]+)',
+    re.MULTILINE)
+
+KINDS = (
+    ('stack_', 'stacks'),
+    ('tcb_', 'tasks'),
+    ('queue_storage_', 'queues'),
+    ('queue_', 'queues'),
+    ('ringbuf_storage_', 'queues'),
+    ('ringbuf_', 'queues'),
+)
+
+
+def kind_of(array):
+    for prefix, kind in KINDS:
+        if array.startswith(prefix):
+            return kind
+    return 'other'
+
+
+def parse(map_text):
+    # the discarded sections are listed before the memory map
+    start = map_text.find('Linker script and memory map')
+    if start >= 0:
+        map_text = map_text[start:]
+    budget = defaultdict(lambda: defaultdict(int))
+    for match in SECTION.finditer(map_text):
+        size = int(match.group('size'), 16)
+        budget[match.group('subsystem')][kind_of(match.group('array'))] += size
+    return budget
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('map_file', help='linker map of the firmware')
+    parser.add_argument('--limit', type=int, default=0,
+                        help='fail when the total is above this many bytes')
+    args = parser.parse_args()
+
+    with open(args.map_file, encoding='utf-8', errors='replace') as map_file:
+        budget = parse(map_file.read())
+    if not budget:
+        print('memory budget: no .rtos_static section, CONFIG_MESH_STATIC_ALLOCATION is off')
+        return 0
+
+    columns = ('stacks', 'tasks', 'queues')
+    print('memory budget of the static tasks and queues (bytes)')
+    print('{:<14}{:>10}{:>10}{:>10}{:>10}'.format('subsystem', 'stacks', 'tcbs', 'queues', 'total'))
+    total = 0
+    for subsystem in sorted(budget, key=lambda name: -sum(budget[name].values())):
+        sizes = budget[subsystem]
+        subtotal = sum(sizes.values())
+        total += subtotal
+        print('{:<14}{:>10}{:>10}{:>10}{:>10}'.format(subsystem, *(sizes[column] for column in columns), subtotal))
+    print('{:<14}{:>40}'.format('total', total))
+
+    if args.limit and total > args.limit:
+        print('memory budget: {} bytes reserved, the limit is {}'.format(total, args.limit), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
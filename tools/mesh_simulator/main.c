@@ -0,0 +1,324 @@
+/*
+ * Host-side discrete-event simulator of the MILOS mesh application layer.
+ *
+ * Runs N virtual nodes in one process against a simulated esp_mesh API and
+ * a broker stand-in, and reports per-link load, queue drops and end-to-end
+ * latency. See README.md for the model and its limits.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "sim_core.h"
+#include "sim_mesh.h"
+#include "sim_app.h"
+#include "sim_broker.h"
+#include "topology/topology_proto.h"
+
+typedef struct {
+    int index;
+    int up; // 1: node -> parent, 0: parent -> node
+    const sim_link_t *link;
+} link_ref_t;
+
+static uint32_t s_duration_s = 600;
+static uint64_t s_seed = 1;
+static int s_top_links = 10;
+static double s_fail_root_at_s = -1;
+static const char *s_links_csv = NULL;
+
+static sim_mesh_config_t s_mesh = {
+    .nodes = 100,
+    .layout = SIM_LAYOUT_RANDOM,
+    .area_m = 300,
+    .range_m = 60,
+    .ap_connections = 6,     // CONFIG_MESH_AP_CONNECTIONS default
+    .max_layer = 6,          // CONFIG_MESH_MAX_LAYER default
+    .route_table_size = 50,  // CONFIG_MESH_ROUTE_TABLE_SIZE default
+    .link_kbps = 6000,
+    .link_latency_us = 2000,
+    .router_kbps = 10000,
+    .router_latency_us = 20000,
+    .queue_depth = 32,
+    .reelect_ms = 10000
+};
+
+static sim_app_config_t s_app = {
+    .route_table_period_ms = 2000,
+    .status_period_ms = CONFIG_MESH_TOPOLOGY_STATUS_INTERVAL * 1000,
+    .status_bytes = sizeof(topology_status_t),
+    .topology_delta_period_ms = CONFIG_MESH_TOPOLOGY_DELTA_INTERVAL * 1000,
+    .topology_bytes = 780,
+    .topology_nodes_per_message = TOPOLOGY_NODES_PER_MESSAGE,
+    .sensors = 2,
+    .sensor_period_ms = 10000,
+    .sensor_bytes = 180,
+    .ip_overhead_bytes = 125,
+    .root_broadcast_per_s = 1.0,
+    .node_broadcast_per_s = 0.02,
+    .broadcast_bytes = 60
+};
+
+static void usage(const char *argv0) {
+    printf("usage: %s [options]\n"
+           "  --nodes N              virtual nodes (default %d)\n"
+           "  --duration S           simulated seconds (default %u)\n"
+           "  --seed N               RNG seed (default %llu)\n"
+           "  --layout L             random|grid|line (default random)\n"
+           "  --area M               side of the site in meters (default %.0f)\n"
+           "  --range M              node to node radio range in meters (default %.0f)\n"
+           "  --ap-connections N     CONFIG_MESH_AP_CONNECTIONS (default %d)\n"
+           "  --max-layer N          CONFIG_MESH_MAX_LAYER (default %d)\n"
+           "  --route-table-size N   CONFIG_MESH_ROUTE_TABLE_SIZE (default %d)\n"
+           "  --link-kbps N          mesh hop throughput (default %u)\n"
+           "  --link-latency-us N    mesh hop latency (default %u)\n"
+           "  --router-kbps N        root uplink throughput (default %u)\n"
+           "  --router-latency-us N  root to broker latency (default %u)\n"
+           "  --queue-depth N        frames per link direction (default %d)\n"
+           "  --reelect-ms N         outage after losing the root (default %u)\n"
+           "  --fail-root-at S       power the root off after S seconds\n"
+           "  --status-period-ms N   topology status period (default %u)\n"
+           "  --delta-period-ms N    topology delta period (default %u)\n"
+           "  --route-period-ms N    task_mesh_table_routing period (default %u)\n"
+           "  --sensors N            sensor tasks per node (default %d)\n"
+           "  --sensor-period-ms N   sensor polling time (default %u)\n"
+           "  --root-bcast N         root broadcasts per second (default %.2f)\n"
+           "  --node-bcast N         broadcasts per second per node (default %.2f)\n"
+           "  --top N                busiest links to print (default %d)\n"
+           "  --links-csv FILE       write every link to FILE\n",
+           argv0, s_mesh.nodes, s_duration_s, (unsigned long long)s_seed, s_mesh.area_m, s_mesh.range_m,
+           s_mesh.ap_connections, s_mesh.max_layer, s_mesh.route_table_size, s_mesh.link_kbps,
+           s_mesh.link_latency_us, s_mesh.router_kbps, s_mesh.router_latency_us, s_mesh.queue_depth,
+           s_mesh.reelect_ms, s_app.status_period_ms, s_app.topology_delta_period_ms, s_app.route_table_period_ms, s_app.sensors,
+           s_app.sensor_period_ms, s_app.root_broadcast_per_s, s_app.node_broadcast_per_s, s_top_links);
+}
+
+static bool parse_args(int argc, char **argv) {
+    enum {
+        OPT_NODES = 1, OPT_DURATION, OPT_SEED, OPT_LAYOUT, OPT_AREA, OPT_RANGE, OPT_AP_CONNECTIONS,
+        OPT_MAX_LAYER, OPT_ROUTE_TABLE_SIZE, OPT_LINK_KBPS, OPT_LINK_LATENCY, OPT_ROUTER_KBPS,
+        OPT_ROUTER_LATENCY, OPT_QUEUE_DEPTH, OPT_REELECT, OPT_FAIL_ROOT, OPT_STATUS_PERIOD,
+        OPT_DELTA_PERIOD, OPT_ROUTE_PERIOD, OPT_SENSORS, OPT_SENSOR_PERIOD, OPT_ROOT_BCAST, OPT_NODE_BCAST, OPT_TOP,
+        OPT_LINKS_CSV, OPT_HELP
+    };
+    static const struct option options[] = {
+        { "nodes", required_argument, NULL, OPT_NODES },
+        { "duration", required_argument, NULL, OPT_DURATION },
+        { "seed", required_argument, NULL, OPT_SEED },
+        { "layout", required_argument, NULL, OPT_LAYOUT },
+        { "area", required_argument, NULL, OPT_AREA },
+        { "range", required_argument, NULL, OPT_RANGE },
+        { "ap-connections", required_argument, NULL, OPT_AP_CONNECTIONS },
+        { "max-layer", required_argument, NULL, OPT_MAX_LAYER },
+        { "route-table-size", required_argument, NULL, OPT_ROUTE_TABLE_SIZE },
+        { "link-kbps", required_argument, NULL, OPT_LINK_KBPS },
+        { "link-latency-us", required_argument, NULL, OPT_LINK_LATENCY },
+        { "router-kbps", required_argument, NULL, OPT_ROUTER_KBPS },
+        { "router-latency-us", required_argument, NULL, OPT_ROUTER_LATENCY },
+        { "queue-depth", required_argument, NULL, OPT_QUEUE_DEPTH },
+        { "reelect-ms", required_argument, NULL, OPT_REELECT },
+        { "fail-root-at", required_argument, NULL, OPT_FAIL_ROOT },
+        { "status-period-ms", required_argument, NULL, OPT_STATUS_PERIOD },
+        { "delta-period-ms", required_argument, NULL, OPT_DELTA_PERIOD },
+        { "route-period-ms", required_argument, NULL, OPT_ROUTE_PERIOD },
+        { "sensors", required_argument, NULL, OPT_SENSORS },
+        { "sensor-period-ms", required_argument, NULL, OPT_SENSOR_PERIOD },
+        { "root-bcast", required_argument, NULL, OPT_ROOT_BCAST },
+        { "node-bcast", required_argument, NULL, OPT_NODE_BCAST },
+        { "top", required_argument, NULL, OPT_TOP },
+        { "links-csv", required_argument, NULL, OPT_LINKS_CSV },
+        { "help", no_argument, NULL, OPT_HELP },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+            case OPT_NODES: s_mesh.nodes = atoi(optarg); break;
+            case OPT_DURATION: s_duration_s = (uint32_t)atoi(optarg); break;
+            case OPT_SEED: s_seed = strtoull(optarg, NULL, 0); break;
+            case OPT_LAYOUT:
+                if (strcmp(optarg, "grid") == 0) {
+                    s_mesh.layout = SIM_LAYOUT_GRID;
+                } else if (strcmp(optarg, "line") == 0) {
+                    s_mesh.layout = SIM_LAYOUT_LINE;
+                } else if (strcmp(optarg, "random") == 0) {
+                    s_mesh.layout = SIM_LAYOUT_RANDOM;
+                } else {
+                    fprintf(stderr, "unknown layout: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPT_AREA: s_mesh.area_m = atof(optarg); break;
+            case OPT_RANGE: s_mesh.range_m = atof(optarg); break;
+            case OPT_AP_CONNECTIONS: s_mesh.ap_connections = atoi(optarg); break;
+            case OPT_MAX_LAYER: s_mesh.max_layer = atoi(optarg); break;
+            case OPT_ROUTE_TABLE_SIZE: s_mesh.route_table_size = atoi(optarg); break;
+            case OPT_LINK_KBPS: s_mesh.link_kbps = (uint32_t)atoi(optarg); break;
+            case OPT_LINK_LATENCY: s_mesh.link_latency_us = (uint32_t)atoi(optarg); break;
+            case OPT_ROUTER_KBPS: s_mesh.router_kbps = (uint32_t)atoi(optarg); break;
+            case OPT_ROUTER_LATENCY: s_mesh.router_latency_us = (uint32_t)atoi(optarg); break;
+            case OPT_QUEUE_DEPTH: s_mesh.queue_depth = atoi(optarg); break;
+            case OPT_REELECT: s_mesh.reelect_ms = (uint32_t)atoi(optarg); break;
+            case OPT_FAIL_ROOT: s_fail_root_at_s = atof(optarg); break;
+            case OPT_STATUS_PERIOD: s_app.status_period_ms = (uint32_t)atoi(optarg); break;
+            case OPT_DELTA_PERIOD: s_app.topology_delta_period_ms = (uint32_t)atoi(optarg); break;
+            case OPT_ROUTE_PERIOD: s_app.route_table_period_ms = (uint32_t)atoi(optarg); break;
+            case OPT_SENSORS: s_app.sensors = atoi(optarg); break;
+            case OPT_SENSOR_PERIOD: s_app.sensor_period_ms = (uint32_t)atoi(optarg); break;
+            case OPT_ROOT_BCAST: s_app.root_broadcast_per_s = atof(optarg); break;
+            case OPT_NODE_BCAST: s_app.node_broadcast_per_s = atof(optarg); break;
+            case OPT_TOP: s_top_links = atoi(optarg); break;
+            case OPT_LINKS_CSV: s_links_csv = optarg; break;
+            default:
+                usage(argv[0]);
+                return false;
+        }
+    }
+
+    if (s_mesh.nodes < 1 || s_mesh.nodes > 65535 || s_mesh.ap_connections < 1 || s_mesh.max_layer < 1 ||
+        s_mesh.route_table_size < 1 || s_mesh.link_kbps == 0 || s_mesh.router_kbps == 0 ||
+        s_mesh.queue_depth < 1 || s_app.status_period_ms == 0 ||
+        s_app.topology_delta_period_ms == 0 || s_app.route_table_period_ms == 0 ||
+        s_app.sensor_period_ms == 0 || s_app.sensors < 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return false;
+    }
+    return true;
+}
+
+static void fail_root(void *ctx, uint64_t arg) {
+    int root = sim_mesh_get_root();
+    printf("t=%.1fs: root %d powered off\n", (double)sim_now() / 1e6, root);
+    sim_mesh_fail_node(root);
+}
+
+static int compare_links(const void *a, const void *b) {
+    const link_ref_t *x = a;
+    const link_ref_t *y = b;
+    return (x->link->bytes < y->link->bytes) - (x->link->bytes > y->link->bytes);
+}
+
+static double link_utilization(const sim_link_t *link, double seconds) {
+    uint32_t kbps = link->peer == SIM_PEER_DS ? s_mesh.router_kbps : s_mesh.link_kbps;
+    return (double)link->bytes * 8.0 / seconds / (kbps * 1000.0) * 100.0;
+}
+
+static void print_link(const link_ref_t *ref, double seconds) {
+    const sim_node_t *node = sim_mesh_node(ref->index);
+    const sim_link_t *link = ref->link;
+    char name[32];
+    if (ref->up && link->peer == SIM_PEER_DS) {
+        snprintf(name, sizeof(name), "%d -> router", ref->index);
+    } else if (ref->up) {
+        snprintf(name, sizeof(name), "%d -> %d", ref->index, node->parent);
+    } else {
+        snprintf(name, sizeof(name), "%d -> %d", node->parent, ref->index);
+    }
+    printf("  %-16s %5d %12llu %9llu %8.1f %6.1f %7llu %6d\n", name, node->layer,
+           (unsigned long long)link->bytes, (unsigned long long)link->frames,
+           (double)link->bytes * 8.0 / seconds / 1000.0, link_utilization(link, seconds),
+           (unsigned long long)link->drops, link->queue_max);
+}
+
+static void write_links_csv(const link_ref_t *refs, int count, double seconds) {
+    FILE *f = fopen(s_links_csv, "w");
+    if (f == NULL) {
+        perror(s_links_csv);
+        return;
+    }
+    fprintf(f, "node,direction,parent,layer,bytes,frames,kbps,utilization,drops,queue_max\n");
+    for (int i = 0; i < count; i++) {
+        const sim_node_t *node = sim_mesh_node(refs[i].index);
+        const sim_link_t *link = refs[i].link;
+        fprintf(f, "%d,%s,%d,%d,%llu,%llu,%.2f,%.2f,%llu,%d\n", refs[i].index, refs[i].up ? "up" : "down",
+                link->peer == SIM_PEER_DS ? -1 : node->parent, node->layer,
+                (unsigned long long)link->bytes, (unsigned long long)link->frames,
+                (double)link->bytes * 8.0 / seconds / 1000.0, link_utilization(link, seconds),
+                (unsigned long long)link->drops, link->queue_max);
+    }
+    fclose(f);
+}
+
+static void report(void) {
+    const sim_mesh_counters_t *counters = sim_mesh_counters();
+    double seconds = (double)s_duration_s;
+
+    printf("\ntopology: root %d, depth %d, orphans %d, reelections %d\n",
+           sim_mesh_get_root(), counters->depth, counters->orphans, counters->reelections);
+    printf("frames: sent %llu, delivered %llu, queue drops %llu, send errors %llu, lost in failover %llu\n",
+           (unsigned long long)counters->sent, (unsigned long long)counters->delivered,
+           (unsigned long long)counters->dropped, (unsigned long long)counters->send_errors,
+           (unsigned long long)counters->lost_in_failover);
+    if (counters->oversize > 0) {
+        printf("warning: %llu frames above MESH_MPS (%d bytes) were rejected by esp_mesh_send\n",
+               (unsigned long long)counters->oversize, MESH_MPS);
+    }
+    if (counters->route_table_truncated > 0) {
+        printf("warning: routing table truncated %llu times, raise --route-table-size\n",
+               (unsigned long long)counters->route_table_truncated);
+    }
+
+    printf("\n  %-12s %10s %12s %8s %8s %8s %8s\n", "traffic", "delivered", "bytes", "p50 ms", "p95 ms", "p99 ms", "max ms");
+    for (int t = 0; t < SIM_TRAFFIC_COUNT; t++) {
+        sim_traffic_stats_t *stats = sim_traffic_stats((sim_traffic_t)t);
+        printf("  %-12s %10llu %12llu %8.1f %8.1f %8.1f %8.1f\n", sim_traffic_to_str((sim_traffic_t)t),
+               (unsigned long long)stats->messages, (unsigned long long)stats->bytes,
+               sim_stats_percentile(&stats->latency_ms, 50), sim_stats_percentile(&stats->latency_ms, 95),
+               sim_stats_percentile(&stats->latency_ms, 99), stats->latency_ms.max);
+    }
+
+    int nodes = sim_mesh_node_count();
+    link_ref_t *refs = calloc((size_t)nodes * 2, sizeof(link_ref_t));
+    if (refs == NULL) {
+        abort();
+    }
+    int count = 0;
+    for (int i = 0; i < nodes; i++) {
+        const sim_node_t *node = sim_mesh_node(i);
+        if (node->up.frames > 0 || node->up.drops > 0) {
+            refs[count++] = (link_ref_t){ .index = i, .up = 1, .link = &node->up };
+        }
+        if (node->down.frames > 0 || node->down.drops > 0) {
+            refs[count++] = (link_ref_t){ .index = i, .up = 0, .link = &node->down };
+        }
+    }
+    qsort(refs, count, sizeof(link_ref_t), compare_links);
+
+    printf("\nbusiest links:\n  %-16s %5s %12s %9s %8s %6s %7s %6s\n",
+           "link", "layer", "bytes", "frames", "kbps", "util%", "drops", "maxq");
+    for (int i = 0; i < count && i < s_top_links; i++) {
+        print_link(&refs[i], seconds);
+    }
+    if (s_links_csv != NULL) {
+        write_links_csv(refs, count, seconds);
+        printf("\nall %d links written to %s\n", count, s_links_csv);
+    }
+    free(refs);
+}
+
+int main(int argc, char **argv) {
+    if (!parse_args(argc, argv)) {
+        return EXIT_FAILURE;
+    }
+
+    sim_init(s_seed);
+    sim_mesh_init(&s_mesh, sim_broker_on_publish);
+    sim_app_start(&s_app);
+    if (s_fail_root_at_s >= 0) {
+        sim_schedule((uint64_t)(s_fail_root_at_s * 1e6), fail_root, NULL, 0);
+    }
+
+    printf("mesh_simulator: %d nodes, %u s simulated, seed %llu\n",
+           s_mesh.nodes, s_duration_s, (unsigned long long)s_seed);
+    uint64_t events = sim_run(SIM_S(s_duration_s));
+    printf("%llu events dispatched\n", (unsigned long long)events);
+
+    report();
+
+    sim_app_stop();
+    sim_mesh_deinit();
+    sim_traffic_free();
+    sim_shutdown();
+    return EXIT_SUCCESS;
+}
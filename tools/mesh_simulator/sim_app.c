@@ -0,0 +1,198 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sim_app.h"
+#include "sim_broker.h"
+#include "topology/topology_proto.h"
+
+static sim_app_config_t s_app;
+static mesh_addr_t *s_route_table = NULL;
+static int s_topology_root = -1;        // root that published the last snapshot
+static uint64_t s_topology_root_seen_us = 0;
+static uint64_t s_topology_delta_us = 0;
+
+static uint64_t next_poisson_us(double rate_per_s) {
+    double u = sim_rand_unit();
+    return (uint64_t)(-log(1.0 - u) / rate_per_s * 1e6);
+}
+
+static mesh_data_t make_data(sim_traffic_t traffic, uint16_t size, mesh_proto_t proto) {
+    mesh_data_t data = {
+        .size = size,
+        .proto = proto,
+        .traffic = traffic,
+        .created_us = sim_now()
+    };
+    return data;
+}
+
+/*
+  * Function: recv_cb
+  * ----------------------------
+  *   Raw frames reaching their destination node
+  *
+*/
+static void recv_cb(sim_node_t *node, const mesh_addr_t *from, const mesh_data_t *data) {
+    sim_traffic_record(data);
+}
+
+/*
+  * Function: task_mesh_table_routing
+  * ----------------------------
+  *   mesh_main.c: the root sends its routing table P2P to every entry
+  *
+*/
+static void task_mesh_table_routing(void *ctx, uint64_t arg) {
+    sim_node_t *node = ctx;
+    if (!node->alive) {
+        return;
+    }
+    if (sim_mesh_is_root(node)) {
+        int size = 0;
+        sim_mesh_get_routing_table(node, s_route_table, sim_mesh_config()->route_table_size * 6, &size);
+        mesh_data_t data = make_data(SIM_TRAFFIC_ROUTE_TABLE, size * 6 + 1, MESH_PROTO_BIN);
+        for (int i = 0; i < size; i++) {
+            sim_mesh_send(node, &s_route_table[i], &data, MESH_DATA_P2P);
+        }
+    }
+    sim_schedule(SIM_MS(s_app.route_table_period_ms), task_mesh_table_routing, node, 0);
+}
+
+/*
+  * Function: task_topology_status
+  * ----------------------------
+  *   topology.c: every node but the root sends its status frame to the root
+  *   over the raw mesh channel
+  *
+*/
+static void task_topology_status(void *ctx, uint64_t arg) {
+    sim_node_t *node = ctx;
+    if (!node->alive) {
+        return;
+    }
+    if (!sim_mesh_is_root(node) && sim_mesh_get_layer(node) > 0) {
+        mesh_data_t data = make_data(SIM_TRAFFIC_STATUS, s_app.status_bytes, MESH_PROTO_BIN);
+        sim_mesh_send(node, NULL, &data, 0);
+    }
+    sim_schedule(SIM_MS(s_app.status_period_ms), task_topology_status, node, 0);
+}
+
+static void publish_topology_part(void *ctx, uint64_t arg) {
+    sim_node_t *node = ctx;
+    if (!node->alive || !sim_mesh_is_root(node)) {
+        return;
+    }
+    mesh_data_t data = make_data(SIM_TRAFFIC_TOPOLOGY, s_app.topology_bytes + s_app.ip_overhead_bytes, MESH_PROTO_AP);
+    sim_mesh_send(node, NULL, &data, MESH_DATA_TODS);
+}
+
+/*
+  * Function: task_topology_root
+  * ----------------------------
+  *   topology.c: a new root publishes the snapshot of its routing table once
+  *   the tree settled, then one delta part per delta period. The tree of the
+  *   simulator only changes when the root is lost, so that is the only
+  *   snapshot
+  *
+*/
+static void task_topology_root(void *ctx, uint64_t arg) {
+    int root = sim_mesh_get_root();
+    if (root < 0) {
+        s_topology_root_seen_us = 0;
+    } else if (root != s_topology_root) {
+        if (s_topology_root_seen_us == 0) {
+            s_topology_root_seen_us = sim_now();
+        } else if (sim_now() - s_topology_root_seen_us >= SIM_MS(TOPOLOGY_SETTLE_MS)) {
+            sim_node_t *node = sim_mesh_node(root);
+            int size = 0;
+            sim_mesh_get_routing_table(node, s_route_table, sim_mesh_config()->route_table_size * 6, &size);
+            int parts = size == 0 ? 1 : (size + s_app.topology_nodes_per_message - 1) / s_app.topology_nodes_per_message;
+            for (int part = 0; part < parts; part++) {
+                sim_schedule(SIM_MS(part * TOPOLOGY_PART_GAP_MS), publish_topology_part, node, 0);
+            }
+            s_topology_root = root;
+            s_topology_delta_us = sim_now() + SIM_MS(s_app.topology_delta_period_ms);
+        }
+    } else if (sim_now() >= s_topology_delta_us) {
+        publish_topology_part(sim_mesh_node(root), 0);
+        s_topology_delta_us += SIM_MS(s_app.topology_delta_period_ms);
+    }
+    sim_schedule(SIM_MS(TOPOLOGY_TICK_MS), task_topology_root, NULL, 0);
+}
+
+static void task_sensor(void *ctx, uint64_t arg) {
+    sim_node_t *node = ctx;
+    if (!node->alive) {
+        return;
+    }
+    mesh_data_t data = make_data(SIM_TRAFFIC_SENSOR, s_app.sensor_bytes + s_app.ip_overhead_bytes, MESH_PROTO_AP);
+    sim_mesh_send(node, NULL, &data, MESH_DATA_TODS);
+    sim_schedule(SIM_MS(s_app.sensor_period_ms), task_sensor, node, arg);
+}
+
+/*
+  * Function: netif_broadcast
+  * ----------------------------
+  *   mesh_netif.c: a broadcast from a node goes up to the root, a broadcast
+  *   from the root AP netif is fanned out P2P to every routing table entry
+  *   but itself
+  *
+*/
+static void netif_broadcast(void *ctx, uint64_t arg) {
+    sim_node_t *node = ctx;
+    if (!node->alive) {
+        return;
+    }
+    // the timer runs at the larger of both rates and is thinned to the rate
+    // of the role the node has right now, a node can become root later
+    double max_rate = fmax(s_app.root_broadcast_per_s, s_app.node_broadcast_per_s);
+    double rate = sim_mesh_is_root(node) ? s_app.root_broadcast_per_s : s_app.node_broadcast_per_s;
+    if (sim_rand_unit() * max_rate < rate) {
+        if (sim_mesh_is_root(node)) {
+            int size = 0;
+            sim_mesh_get_routing_table(node, s_route_table, sim_mesh_config()->route_table_size * 6, &size);
+            mesh_data_t data = make_data(SIM_TRAFFIC_BROADCAST, s_app.broadcast_bytes, MESH_PROTO_STA);
+            for (int i = 0; i < size; i++) {
+                if (memcmp(s_route_table[i].addr, node->sta_mac.addr, sizeof(node->sta_mac.addr)) == 0) {
+                    continue;
+                }
+                sim_mesh_send(node, &s_route_table[i], &data, MESH_DATA_P2P);
+            }
+        } else if (sim_mesh_get_layer(node) > 0) {
+            mesh_data_t data = make_data(SIM_TRAFFIC_BROADCAST, s_app.broadcast_bytes, MESH_PROTO_AP);
+            sim_mesh_send(node, NULL, &data, 0);
+        }
+    }
+    sim_schedule(next_poisson_us(max_rate), netif_broadcast, node, 0);
+}
+
+void sim_app_start(const sim_app_config_t *config) {
+    s_app = *config;
+    s_route_table = calloc(sim_mesh_config()->route_table_size, sizeof(mesh_addr_t));
+    if (s_route_table == NULL) {
+        abort();
+    }
+
+    s_topology_root = -1;
+    s_topology_root_seen_us = 0;
+    sim_schedule(SIM_MS(TOPOLOGY_TICK_MS), task_topology_root, NULL, 0);
+    for (int i = 0; i < sim_mesh_node_count(); i++) {
+        sim_node_t *node = sim_mesh_node(i);
+        node->recv_cb = recv_cb;
+
+        sim_schedule(sim_rand_range(0, SIM_MS(s_app.route_table_period_ms)), task_mesh_table_routing, node, 0);
+        sim_schedule(sim_rand_range(0, SIM_MS(s_app.status_period_ms)), task_topology_status, node, 0);
+        for (int sensor = 0; sensor < s_app.sensors; sensor++) {
+            sim_schedule(sim_rand_range(0, SIM_MS(s_app.sensor_period_ms)), task_sensor, node, sensor);
+        }
+        double rate = fmax(s_app.root_broadcast_per_s, s_app.node_broadcast_per_s);
+        if (rate > 0) {
+            sim_schedule(next_poisson_us(rate), netif_broadcast, node, 0);
+        }
+    }
+}
+
+void sim_app_stop(void) {
+    free(s_route_table);
+    s_route_table = NULL;
+}
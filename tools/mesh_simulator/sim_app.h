@@ -0,0 +1,37 @@
+#ifndef SIM_APP_H
+#define SIM_APP_H
+
+#include "sim_mesh.h"
+
+/*****
+ *   Application traffic of main/, one instance per virtual node
+ *****/
+
+typedef struct {
+    uint32_t route_table_period_ms; // task_mesh_table_routing delay
+    uint32_t status_period_ms;      // CONFIG_MESH_TOPOLOGY_STATUS_INTERVAL
+    uint16_t status_bytes;          // topology_status_t
+    uint32_t topology_delta_period_ms; // CONFIG_MESH_TOPOLOGY_DELTA_INTERVAL
+    uint16_t topology_bytes;        // snapshot or delta part after create_mqtt_message
+    int topology_nodes_per_message; // TOPOLOGY_NODES_PER_MESSAGE
+    int sensors;                    // sensor tasks per node
+    uint32_t sensor_period_ms;      // Config_t polling_time
+    uint16_t sensor_bytes;          // sensor message after create_mqtt_message
+    uint16_t ip_overhead_bytes;     // topic + MQTT + TLS + TCP/IP headers on a publish
+    double root_broadcast_per_s;    // ARP/DHCP broadcasts fanned out by the root AP netif
+    double node_broadcast_per_s;    // broadcasts each node sends up to the root
+    uint16_t broadcast_bytes;
+} sim_app_config_t;
+
+/*
+  * Function: sim_app_start
+  * ----------------------------
+  *   Installs recv_cb on every node and schedules its periodic tasks with a
+  *   random boot offset
+  *
+*/
+void sim_app_start(const sim_app_config_t *config);
+
+void sim_app_stop(void);
+
+#endif // SIM_APP_H
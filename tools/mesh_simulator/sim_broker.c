@@ -0,0 +1,35 @@
+#include "sim_broker.h"
+
+static sim_traffic_stats_t s_traffic[SIM_TRAFFIC_COUNT];
+
+void sim_traffic_record(const mesh_data_t *data) {
+    sim_traffic_stats_t *stats = &s_traffic[data->traffic];
+    stats->messages++;
+    stats->bytes += data->size;
+    sim_stats_add(&stats->latency_ms, (double)(sim_now() - data->created_us) / 1000.0);
+}
+
+void sim_broker_on_publish(const sim_node_t *from, const mesh_data_t *data) {
+    sim_traffic_record(data);
+}
+
+sim_traffic_stats_t * sim_traffic_stats(sim_traffic_t traffic) {
+    return &s_traffic[traffic];
+}
+
+const char * sim_traffic_to_str(sim_traffic_t traffic) {
+    switch (traffic) {
+        case SIM_TRAFFIC_ROUTE_TABLE: return "route_table";
+        case SIM_TRAFFIC_STATUS:      return "status";
+        case SIM_TRAFFIC_TOPOLOGY:    return "topology";
+        case SIM_TRAFFIC_SENSOR:      return "sensor";
+        case SIM_TRAFFIC_BROADCAST:   return "broadcast";
+        default:                      return "unknown";
+    }
+}
+
+void sim_traffic_free(void) {
+    for (int i = 0; i < SIM_TRAFFIC_COUNT; i++) {
+        sim_stats_free(&s_traffic[i].latency_ms);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef SIM_BROKER_H
+#define SIM_BROKER_H
+
+#include "sim_mesh.h"
+
+/*****
+ *   Broker stand-in: end of the TODS path and latency bookkeeping
+ *****/
+
+typedef struct {
+    uint64_t messages;
+    uint64_t bytes;
+    sim_stats_t latency_ms;
+} sim_traffic_stats_t;
+
+/*
+  * Function: sim_broker_on_publish
+  * ----------------------------
+  *   Called by the mesh for every frame that leaves the root towards the
+  *   router (publishes arriving at the broker)
+  *
+*/
+void sim_broker_on_publish(const sim_node_t *from, const mesh_data_t *data);
+
+/*
+  * Function: sim_traffic_record
+  * ----------------------------
+  *   Records the end-to-end latency of a frame delivered to its final
+  *   destination, broker or node
+  *
+*/
+void sim_traffic_record(const mesh_data_t *data);
+
+sim_traffic_stats_t * sim_traffic_stats(sim_traffic_t traffic);
+const char * sim_traffic_to_str(sim_traffic_t traffic);
+void sim_traffic_free(void);
+
+#endif // SIM_BROKER_H
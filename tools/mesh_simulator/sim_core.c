@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sim_core.h"
+
+typedef struct {
+    uint64_t time;
+    uint64_t seq;
+    sim_event_fn_t fn;
+    void *ctx;
+    uint64_t arg;
+} sim_event_t;
+
+static sim_event_t *s_heap = NULL;
+static size_t s_heap_size = 0;
+static size_t s_heap_capacity = 0;
+static uint64_t s_now = 0;
+static uint64_t s_seq = 0;
+static uint64_t s_rng = 0x9E3779B97F4A7C15ULL;
+
+static bool event_before(const sim_event_t *a, const sim_event_t *b) {
+    if (a->time != b->time) {
+        return a->time < b->time;
+    }
+    return a->seq < b->seq;
+}
+
+static void heap_push(sim_event_t ev) {
+    if (s_heap_size == s_heap_capacity) {
+        s_heap_capacity = s_heap_capacity ? s_heap_capacity * 2 : 1024;
+        s_heap = realloc(s_heap, s_heap_capacity * sizeof(sim_event_t));
+        if (s_heap == NULL) {
+            abort();
+        }
+    }
+    size_t i = s_heap_size++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!event_before(&ev, &s_heap[parent])) {
+            break;
+        }
+        s_heap[i] = s_heap[parent];
+        i = parent;
+    }
+    s_heap[i] = ev;
+}
+
+static sim_event_t heap_pop(void) {
+    sim_event_t top = s_heap[0];
+    sim_event_t last = s_heap[--s_heap_size];
+    size_t i = 0;
+    while (true) {
+        size_t child = 2 * i + 1;
+        if (child >= s_heap_size) {
+            break;
+        }
+        if (child + 1 < s_heap_size && event_before(&s_heap[child + 1], &s_heap[child])) {
+            child++;
+        }
+        if (!event_before(&s_heap[child], &last)) {
+            break;
+        }
+        s_heap[i] = s_heap[child];
+        i = child;
+    }
+    if (s_heap_size > 0) {
+        s_heap[i] = last;
+    }
+    return top;
+}
+
+void sim_init(uint64_t seed) {
+    s_heap_size = 0;
+    s_now = 0;
+    s_seq = 0;
+    s_rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+uint64_t sim_now(void) {
+    return s_now;
+}
+
+void sim_schedule(uint64_t delay_us, sim_event_fn_t fn, void *ctx, uint64_t arg) {
+    sim_event_t ev = {
+        .time = s_now + delay_us,
+        .seq = s_seq++,
+        .fn = fn,
+        .ctx = ctx,
+        .arg = arg
+    };
+    heap_push(ev);
+}
+
+uint64_t sim_run(uint64_t until_us) {
+    uint64_t dispatched = 0;
+    while (s_heap_size > 0 && s_heap[0].time <= until_us) {
+        sim_event_t ev = heap_pop();
+        s_now = ev.time;
+        ev.fn(ev.ctx, ev.arg);
+        dispatched++;
+    }
+    s_now = until_us;
+    return dispatched;
+}
+
+void sim_shutdown(void) {
+    free(s_heap);
+    s_heap = NULL;
+    s_heap_size = 0;
+    s_heap_capacity = 0;
+}
+
+uint64_t sim_rand(void) {
+    s_rng ^= s_rng >> 12;
+    s_rng ^= s_rng << 25;
+    s_rng ^= s_rng >> 27;
+    return s_rng * 0x2545F4914F6CDD1DULL;
+}
+
+double sim_rand_unit(void) {
+    return (double)(sim_rand() >> 11) / (double)(1ULL << 53);
+}
+
+uint64_t sim_rand_range(uint64_t lo, uint64_t hi) {
+    if (hi <= lo) {
+        return lo;
+    }
+    return lo + sim_rand() % (hi - lo);
+}
+
+void sim_stats_add(sim_stats_t *stats, double value) {
+    if (stats->count == stats->capacity) {
+        stats->capacity = stats->capacity ? stats->capacity * 2 : 256;
+        stats->samples = realloc(stats->samples, stats->capacity * sizeof(double));
+        if (stats->samples == NULL) {
+            abort();
+        }
+    }
+    stats->samples[stats->count++] = value;
+    stats->sum += value;
+    if (value > stats->max) {
+        stats->max = value;
+    }
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+double sim_stats_percentile(sim_stats_t *stats, double p) {
+    if (stats->count == 0) {
+        return 0;
+    }
+    qsort(stats->samples, stats->count, sizeof(double), compare_double);
+    size_t index = (size_t)(p / 100.0 * (double)(stats->count - 1) + 0.5);
+    return stats->samples[index];
+}
+
+double sim_stats_mean(const sim_stats_t *stats) {
+    return stats->count ? stats->sum / (double)stats->count : 0;
+}
+
+void sim_stats_free(sim_stats_t *stats) {
+    free(stats->samples);
+    memset(stats, 0, sizeof(*stats));
+}
@@ -0,0 +1,78 @@
+#ifndef SIM_CORE_H
+#define SIM_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*****
+ *   Simulation clock and event queue
+ *****/
+
+#define SIM_MS(ms) ((uint64_t)(ms) * 1000ULL)
+#define SIM_S(s)   ((uint64_t)(s) * 1000000ULL)
+
+typedef void (*sim_event_fn_t)(void *ctx, uint64_t arg);
+
+/*
+  * Function: sim_init
+  * ----------------------------
+  *   Resets the clock to zero, empties the event queue and seeds the RNG
+  *
+*/
+void sim_init(uint64_t seed);
+
+/*
+  * Function: sim_now
+  * ----------------------------
+  *   returns: current simulated time in microseconds
+  *
+*/
+uint64_t sim_now(void);
+
+/*
+  * Function: sim_schedule
+  * ----------------------------
+  *   Schedules fn(ctx, arg) to run delay_us after the current time.
+  *   Events with the same timestamp run in the order they were scheduled.
+  *
+*/
+void sim_schedule(uint64_t delay_us, sim_event_fn_t fn, void *ctx, uint64_t arg);
+
+/*
+  * Function: sim_run
+  * ----------------------------
+  *   Dispatches events until the queue is empty or the clock passes until_us
+  *
+  *   returns: number of events dispatched
+*/
+uint64_t sim_run(uint64_t until_us);
+
+void sim_shutdown(void);
+
+/*****
+ *   Random numbers (xorshift64*, deterministic per seed)
+ *****/
+
+uint64_t sim_rand(void);
+double sim_rand_unit(void);                    // [0, 1)
+uint64_t sim_rand_range(uint64_t lo, uint64_t hi); // [lo, hi)
+
+/*****
+ *   Sample statistics
+ *****/
+
+typedef struct {
+    double *samples;
+    size_t count;
+    size_t capacity;
+    double sum;
+    double max;
+} sim_stats_t;
+
+void sim_stats_add(sim_stats_t *stats, double value);
+double sim_stats_percentile(sim_stats_t *stats, double p);
+double sim_stats_mean(const sim_stats_t *stats);
+void sim_stats_free(sim_stats_t *stats);
+
+#endif // SIM_CORE_H
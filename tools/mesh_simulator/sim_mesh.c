@@ -0,0 +1,439 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sim_mesh.h"
+
+// mesh header + 802.11 MAC/PHY framing added to every frame on air
+#define SIM_FRAME_OVERHEAD 64
+
+typedef struct sim_frame {
+    struct sim_frame *next;
+    int src;
+    int dst;         // node index or SIM_PEER_DS
+    uint32_t epoch;  // topology generation the frame was sent in
+    mesh_data_t data;
+} sim_frame_t;
+
+static sim_mesh_config_t s_config;
+static sim_node_t *s_nodes = NULL;
+static int s_root = -1;
+static bool s_available = false;
+static uint32_t s_epoch = 0;
+static sim_ds_cb_t s_ds_cb = NULL;
+static sim_mesh_counters_t s_counters;
+
+/*****
+ *   Addressing
+ *****/
+
+static void index_to_mac(int index, mesh_addr_t *mac) {
+    // same OUI as the boards on the bench, index in the last two bytes
+    const uint8_t oui[4] = { 0x24, 0x6f, 0x28, 0x00 };
+    memcpy(mac->addr, oui, sizeof(oui));
+    mac->addr[4] = (uint8_t)(index >> 8);
+    mac->addr[5] = (uint8_t)(index & 0xff);
+}
+
+static int mac_to_index(const mesh_addr_t *mac) {
+    int index = (mac->addr[4] << 8) | mac->addr[5];
+    if (mac->addr[0] != 0x24 || mac->addr[1] != 0x6f || index >= s_config.nodes) {
+        return -1;
+    }
+    return index;
+}
+
+/*****
+ *   Topology
+ *****/
+
+static double distance(const sim_node_t *a, double x, double y) {
+    return hypot(a->x - x, a->y - y);
+}
+
+static void place_nodes(void) {
+    int side = (int)ceil(sqrt((double)s_config.nodes));
+    for (int i = 0; i < s_config.nodes; i++) {
+        sim_node_t *node = &s_nodes[i];
+        switch (s_config.layout) {
+            case SIM_LAYOUT_GRID:
+                node->x = (i % side + 0.5) * s_config.area_m / side;
+                node->y = (i / side + 0.5) * s_config.area_m / side;
+                break;
+            case SIM_LAYOUT_LINE:
+                node->x = (i + 0.5) * s_config.area_m / s_config.nodes;
+                node->y = s_config.area_m / 2;
+                break;
+            default:
+                node->x = sim_rand_unit() * s_config.area_m;
+                node->y = sim_rand_unit() * s_config.area_m;
+                break;
+        }
+    }
+}
+
+static void flush_link(sim_link_t *link) {
+    sim_frame_t *frame = link->head;
+    while (frame != NULL) {
+        sim_frame_t *next = frame->next;
+        s_counters.lost_in_failover++;
+        free(frame);
+        frame = next;
+    }
+    link->head = NULL;
+    link->tail = NULL;
+    link->queue_len = 0;
+    link->busy = false;
+}
+
+/*
+  * Function: build_tree
+  * ----------------------------
+  *   Root election + parent selection. The router sits in the middle of the
+  *   area and the alive node closest to it wins the vote (best RSSI). The
+  *   rest join layer by layer, picking the nearest in-range parent that
+  *   still has a free AP slot, so the tree stays as shallow as ESP-MESH
+  *   keeps it.
+  *
+*/
+static void build_tree(void) {
+    double router_x = s_config.area_m / 2;
+    double router_y = s_config.area_m / 2;
+
+    s_epoch++;
+    s_root = -1;
+    for (int i = 0; i < s_config.nodes; i++) {
+        sim_node_t *node = &s_nodes[i];
+        flush_link(&node->up);
+        flush_link(&node->down);
+        node->parent = -1;
+        node->layer = 0;
+        node->children = 0;
+        if (node->alive && (s_root < 0 ||
+            distance(node, router_x, router_y) < distance(&s_nodes[s_root], router_x, router_y))) {
+            s_root = i;
+        }
+    }
+    if (s_root < 0) {
+        s_available = false;
+        return;
+    }
+    s_nodes[s_root].layer = 1;
+    s_nodes[s_root].up.peer = SIM_PEER_DS;
+
+    int depth = 1;
+    for (int layer = 1; layer < s_config.max_layer; layer++) {
+        bool attached = false;
+        for (int i = 0; i < s_config.nodes; i++) {
+            sim_node_t *node = &s_nodes[i];
+            if (!node->alive || node->layer != 0) {
+                continue;
+            }
+            int best = -1;
+            double best_distance = s_config.range_m;
+            for (int p = 0; p < s_config.nodes; p++) {
+                sim_node_t *parent = &s_nodes[p];
+                if (!parent->alive || parent->layer != layer || parent->children >= s_config.ap_connections) {
+                    continue;
+                }
+                double d = distance(node, parent->x, parent->y);
+                if (d <= best_distance) {
+                    best = p;
+                    best_distance = d;
+                }
+            }
+            if (best >= 0) {
+                node->parent = best;
+                node->layer = layer + 1;
+                node->up.peer = best;
+                node->down.peer = i;
+                s_nodes[best].children++;
+                depth = layer + 1;
+                attached = true;
+            }
+        }
+        if (!attached) {
+            break;
+        }
+    }
+
+    s_counters.orphans = 0;
+    for (int i = 0; i < s_config.nodes; i++) {
+        if (s_nodes[i].alive && s_nodes[i].layer == 0) {
+            s_counters.orphans++;
+        }
+    }
+    s_counters.depth = depth;
+    s_available = true;
+}
+
+static void reelect_root(void *ctx, uint64_t arg) {
+    build_tree();
+    s_counters.reelections++;
+}
+
+/*****
+ *   Links
+ *****/
+
+static void forward(sim_frame_t *frame, int at);
+
+static uint64_t link_tx_time(const sim_link_t *link, uint16_t size) {
+    uint32_t kbps = link->peer == SIM_PEER_DS ? s_config.router_kbps : s_config.link_kbps;
+    return (uint64_t)(size + SIM_FRAME_OVERHEAD) * 8ULL * 1000ULL / kbps;
+}
+
+static uint64_t link_latency(const sim_link_t *link) {
+    return link->peer == SIM_PEER_DS ? s_config.router_latency_us : s_config.link_latency_us;
+}
+
+static void frame_arrived(void *ctx, uint64_t arg) {
+    sim_frame_t *frame = ctx;
+    int at = (int)arg;
+    if (frame->epoch != s_epoch || (at != SIM_PEER_DS && !s_nodes[at].alive)) {
+        s_counters.lost_in_failover++;
+        free(frame);
+        return;
+    }
+    forward(frame, at);
+}
+
+static void link_start(sim_link_t *link);
+
+static void link_tx_done(void *ctx, uint64_t arg) {
+    sim_link_t *link = ctx;
+    sim_frame_t *frame = link->head;
+    if (frame == NULL || (uint32_t)arg != s_epoch) {
+        // queue was flushed by a topology change while on air
+        return;
+    }
+    link->head = frame->next;
+    if (link->head == NULL) {
+        link->tail = NULL;
+    }
+    link->queue_len--;
+    link->busy = false;
+    link->bytes += frame->data.size + SIM_FRAME_OVERHEAD;
+    link->frames++;
+    frame->next = NULL;
+    sim_schedule(link_latency(link), frame_arrived, frame, (uint64_t)(int64_t)link->peer);
+    link_start(link);
+}
+
+static void link_start(sim_link_t *link) {
+    if (link->busy || link->head == NULL) {
+        return;
+    }
+    link->busy = true;
+    sim_schedule(link_tx_time(link, link->head->data.size), link_tx_done, link, s_epoch);
+}
+
+static bool link_enqueue(sim_link_t *link, sim_frame_t *frame) {
+    if (link->queue_len >= s_config.queue_depth) {
+        link->drops++;
+        s_counters.dropped++;
+        free(frame);
+        return false;
+    }
+    frame->next = NULL;
+    if (link->tail != NULL) {
+        link->tail->next = frame;
+    } else {
+        link->head = frame;
+    }
+    link->tail = frame;
+    link->queue_len++;
+    if (link->queue_len > link->queue_max) {
+        link->queue_max = link->queue_len;
+    }
+    link_start(link);
+    return true;
+}
+
+static void deliver(sim_frame_t *frame, int at) {
+    s_counters.delivered++;
+    if (at == SIM_PEER_DS) {
+        if (s_ds_cb != NULL) {
+            s_ds_cb(&s_nodes[frame->src], &frame->data);
+        }
+    } else if (s_nodes[at].recv_cb != NULL) {
+        s_nodes[at].recv_cb(&s_nodes[at], &s_nodes[frame->src].sta_mac, &frame->data);
+    }
+    free(frame);
+}
+
+/*
+  * Function: forward
+  * ----------------------------
+  *   One routing step at node at: deliver, go down towards the child whose
+  *   subtree holds dst, or go up to the parent (the router from the root)
+  *
+*/
+static void forward(sim_frame_t *frame, int at) {
+    if (at == frame->dst) {
+        deliver(frame, at);
+        return;
+    }
+    sim_node_t *node = &s_nodes[at];
+    if (frame->dst == SIM_PEER_DS) {
+        link_enqueue(&node->up, frame);
+        return;
+    }
+    int hop = frame->dst;
+    while (hop >= 0 && s_nodes[hop].parent != at) {
+        hop = s_nodes[hop].parent;
+    }
+    if (hop >= 0) {
+        link_enqueue(&s_nodes[hop].down, frame);
+    } else if (at != s_root) {
+        link_enqueue(&node->up, frame);
+    } else {
+        // destination left the tree while the frame was in flight
+        s_counters.lost_in_failover++;
+        free(frame);
+    }
+}
+
+/*****
+ *   Public API
+ *****/
+
+void sim_mesh_init(const sim_mesh_config_t *config, sim_ds_cb_t ds_cb) {
+    s_config = *config;
+    s_ds_cb = ds_cb;
+    memset(&s_counters, 0, sizeof(s_counters));
+    s_nodes = calloc(s_config.nodes, sizeof(sim_node_t));
+    if (s_nodes == NULL) {
+        abort();
+    }
+    for (int i = 0; i < s_config.nodes; i++) {
+        s_nodes[i].index = i;
+        s_nodes[i].alive = true;
+        index_to_mac(i, &s_nodes[i].sta_mac);
+    }
+    place_nodes();
+    build_tree();
+}
+
+void sim_mesh_deinit(void) {
+    for (int i = 0; i < s_config.nodes; i++) {
+        flush_link(&s_nodes[i].up);
+        flush_link(&s_nodes[i].down);
+    }
+    free(s_nodes);
+    s_nodes = NULL;
+}
+
+int sim_mesh_node_count(void) {
+    return s_config.nodes;
+}
+
+sim_node_t * sim_mesh_node(int index) {
+    return &s_nodes[index];
+}
+
+const sim_mesh_config_t * sim_mesh_config(void) {
+    return &s_config;
+}
+
+void sim_mesh_fail_node(int index) {
+    if (index < 0 || index >= s_config.nodes || !s_nodes[index].alive) {
+        return;
+    }
+    s_nodes[index].alive = false;
+    if (index == s_root) {
+        s_available = false;
+        for (int i = 0; i < s_config.nodes; i++) {
+            flush_link(&s_nodes[i].up);
+            flush_link(&s_nodes[i].down);
+        }
+        s_epoch++;
+        sim_schedule(SIM_MS(s_config.reelect_ms), reelect_root, NULL, 0);
+    } else {
+        build_tree();
+    }
+}
+
+esp_err_t sim_mesh_send(sim_node_t *self, const mesh_addr_t *to, const mesh_data_t *data, int flag) {
+    if (data->size > MESH_MPS) {
+        s_counters.send_errors++;
+        s_counters.oversize++;
+        return ESP_ERR_MESH_ARGUMENT;
+    }
+    if (!s_available || !self->alive || self->layer == 0) {
+        s_counters.send_errors++;
+        return ESP_ERR_MESH_NO_PARENT;
+    }
+    int dst;
+    if (to == NULL) {
+        dst = (flag & MESH_DATA_TODS) ? SIM_PEER_DS : s_root;
+    } else {
+        dst = mac_to_index(to);
+        if (dst < 0 || !s_nodes[dst].alive || s_nodes[dst].layer == 0) {
+            s_counters.send_errors++;
+            return ESP_ERR_MESH_NO_ROUTE;
+        }
+    }
+
+    sim_frame_t *frame = calloc(1, sizeof(sim_frame_t));
+    if (frame == NULL) {
+        abort();
+    }
+    frame->src = self->index;
+    frame->dst = dst;
+    frame->epoch = s_epoch;
+    frame->data = *data;
+    s_counters.sent++;
+
+    if (dst == self->index) {
+        deliver(frame, dst);
+        return ESP_OK;
+    }
+    uint64_t dropped = s_counters.dropped;
+    forward(frame, self->index);
+    return s_counters.dropped == dropped ? ESP_OK : ESP_ERR_MESH_QUEUE_FULL;
+}
+
+bool sim_mesh_is_root(const sim_node_t *self) {
+    return s_available && self->index == s_root;
+}
+
+int sim_mesh_get_layer(const sim_node_t *self) {
+    return self->layer;
+}
+
+int sim_mesh_get_root(void) {
+    return s_available ? s_root : -1;
+}
+
+esp_err_t sim_mesh_get_routing_table(const sim_node_t *self, mesh_addr_t *table, int len, int *size) {
+    int max_entries = len / 6;
+    int count = 0;
+    bool truncated = false;
+    for (int i = 0; i < s_config.nodes; i++) {
+        if (!s_nodes[i].alive || s_nodes[i].layer == 0) {
+            continue;
+        }
+        int hop = i;
+        while (hop >= 0 && hop != self->index) {
+            hop = s_nodes[hop].parent;
+        }
+        if (hop != self->index) {
+            continue;
+        }
+        if (count < max_entries) {
+            table[count++] = s_nodes[i].sta_mac;
+        } else {
+            truncated = true;
+        }
+    }
+    if (truncated) {
+        s_counters.route_table_truncated++;
+    }
+    *size = count;
+    return ESP_OK;
+}
+
+const sim_mesh_counters_t * sim_mesh_counters(void) {
+    return &s_counters;
+}
@@ -0,0 +1,173 @@
+#ifndef SIM_MESH_H
+#define SIM_MESH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sim_core.h"
+
+/*****
+ *   Subset of the esp_mesh API used by main/, mirrored for the host build
+ *****/
+
+typedef int esp_err_t;
+#define ESP_OK                   0
+#define ESP_ERR_MESH_ARGUMENT    0x4007
+#define ESP_ERR_MESH_NO_PARENT   0x400d
+#define ESP_ERR_MESH_QUEUE_FULL  0x4010
+#define ESP_ERR_MESH_NO_ROUTE    0x4013
+
+#define MESH_MPS        1472 // max payload of a single esp_mesh_send
+#define MESH_DATA_P2P   0x02
+#define MESH_DATA_TODS  0x08
+
+typedef struct {
+    uint8_t addr[6];
+} mesh_addr_t;
+
+typedef enum {
+    MESH_PROTO_BIN = 0,
+    MESH_PROTO_AP = 4,
+    MESH_PROTO_STA = 5
+} mesh_proto_t;
+
+// Traffic classes used for per-class latency accounting
+typedef enum {
+    SIM_TRAFFIC_ROUTE_TABLE = 0, // task_mesh_table_routing
+    SIM_TRAFFIC_STATUS,          // topology status frames, node -> root
+    SIM_TRAFFIC_TOPOLOGY,        // topology snapshots and deltas of the root
+    SIM_TRAFFIC_SENSOR,          // sensor publishes
+    SIM_TRAFFIC_BROADCAST,       // mesh_netif broadcast fan-out
+    SIM_TRAFFIC_COUNT
+} sim_traffic_t;
+
+typedef struct {
+    uint16_t size;
+    mesh_proto_t proto;
+    sim_traffic_t traffic;
+    uint64_t created_us; // stamped by the sender, used for end-to-end latency
+} mesh_data_t;
+
+/*****
+ *   Topology and radio parameters
+ *****/
+
+typedef enum {
+    SIM_LAYOUT_RANDOM = 0,
+    SIM_LAYOUT_GRID,
+    SIM_LAYOUT_LINE
+} sim_layout_t;
+
+typedef struct {
+    int nodes;
+    sim_layout_t layout;
+    double area_m;           // side of the square the nodes are placed in
+    double range_m;          // max distance of a node <-> node link
+    int ap_connections;      // CONFIG_MESH_AP_CONNECTIONS
+    int max_layer;           // CONFIG_MESH_MAX_LAYER
+    int route_table_size;    // CONFIG_MESH_ROUTE_TABLE_SIZE
+    uint32_t link_kbps;      // PHY throughput of a mesh hop
+    uint32_t link_latency_us; // per hop latency (contention + processing)
+    uint32_t router_kbps;    // root <-> router/broker uplink
+    uint32_t router_latency_us;
+    int queue_depth;         // frames buffered per link direction before dropping
+    uint32_t reelect_ms;     // outage between losing the root and the new tree
+} sim_mesh_config_t;
+
+typedef struct {
+    int peer;                // next node, SIM_PEER_DS for the router uplink
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t drops;
+    int queue_len;
+    int queue_max;
+    bool busy;
+    struct sim_frame *head;
+    struct sim_frame *tail;
+} sim_link_t;
+
+#define SIM_PEER_DS (-2)
+
+typedef struct sim_node sim_node_t;
+
+typedef void (*sim_recv_cb_t)(sim_node_t *node, const mesh_addr_t *from, const mesh_data_t *data);
+typedef void (*sim_ds_cb_t)(const sim_node_t *from, const mesh_data_t *data);
+
+struct sim_node {
+    int index;
+    mesh_addr_t sta_mac;
+    double x;
+    double y;
+    bool alive;
+    int parent;              // -1 for the root or a detached node
+    int layer;               // 1 for the root, 0 when detached
+    int children;
+    sim_link_t up;           // node -> parent (router for the root)
+    sim_link_t down;         // parent -> node
+    sim_recv_cb_t recv_cb;
+    void *app;
+};
+
+/*
+  * Function: sim_mesh_init
+  * ----------------------------
+  *   Places the nodes, elects a root and builds the tree
+  *
+*/
+void sim_mesh_init(const sim_mesh_config_t *config, sim_ds_cb_t ds_cb);
+
+void sim_mesh_deinit(void);
+
+int sim_mesh_node_count(void);
+sim_node_t * sim_mesh_node(int index);
+const sim_mesh_config_t * sim_mesh_config(void);
+
+/*
+  * Function: sim_mesh_fail_node
+  * ----------------------------
+  *   Powers a node off. If it was the root the mesh is unavailable for
+  *   reelect_ms and then a new root is elected; otherwise its subtree
+  *   reattaches immediately.
+  *
+*/
+void sim_mesh_fail_node(int index);
+
+/*
+  * Function: sim_mesh_send
+  * ----------------------------
+  *   esp_mesh_send as seen from node self. to == NULL with flag 0 or
+  *   MESH_DATA_TODS sends upstream (TODS leaves the mesh at the root).
+  *
+  *   returns: ESP_OK if the frame was queued on the first hop
+*/
+esp_err_t sim_mesh_send(sim_node_t *self, const mesh_addr_t *to, const mesh_data_t *data, int flag);
+
+bool sim_mesh_is_root(const sim_node_t *self);
+int sim_mesh_get_layer(const sim_node_t *self);
+int sim_mesh_get_root(void);
+
+/*
+  * Function: sim_mesh_get_routing_table
+  * ----------------------------
+  *   esp_mesh_get_routing_table: the STA MACs of self and its whole subtree.
+  *   Entries that do not fit in len bytes are left out and counted in
+  *   route_table_truncated.
+  *
+*/
+esp_err_t sim_mesh_get_routing_table(const sim_node_t *self, mesh_addr_t *table, int len, int *size);
+
+typedef struct {
+    uint64_t sent;
+    uint64_t delivered;
+    uint64_t dropped;
+    uint64_t send_errors;
+    uint64_t oversize;        // frames above MESH_MPS, part of send_errors
+    uint64_t lost_in_failover;
+    uint64_t route_table_truncated;
+    int orphans;
+    int depth;
+    int reelections;
+} sim_mesh_counters_t;
+
+const sim_mesh_counters_t * sim_mesh_counters(void);
+
+#endif // SIM_MESH_H